@@ -0,0 +1,119 @@
+/**
+ * @file bench_acl.c
+ * @brief 监听Socket访问控制：SYN检查的耗时与规则数的关系，被拒绝与被接受的连接的代价
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 第一部分直接调用socket_acl_check（前缀树查找加每源计数查找），规则数从10到10万。
+ * 查找最多走32层，规则多时走得更深、节点数组也放不进缓存，耗时的增长来自缓存缺失，
+ * 远小于规则数的增长（不是逐条比较）。
+ * 第二部分从被拒绝和被允许的源地址发起完整的connect：
+ * 被拒绝的SYN在创建子Socket之前就被丢弃，只剩下客户端一侧的开销。
+ * connect里模拟的1ms网络时延会掩盖差别，这一部分统计进程CPU时间而不是墙钟时间。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <assert.h>
+
+#define LOOKUPS             2000000
+#define CONNECTS            2000
+#define TCP_PORT            9700
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double cpu_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * 装入rules条随机的/16-/32拒绝规则，测量每次检查的耗时
+ * @return 纳秒/次
+ */
+static double bench_check(int rules) {
+    assert(mysocket_init() == 0);
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", TCP_PORT);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 16) == 0);
+    assert(mysocket_acl_limit(listen_fd, 64) == 0);
+
+    srand(1);
+    char cidr[32];
+    for (int i = 0; i < rules; i++) {
+        snprintf(cidr, sizeof(cidr), "%d.%d.%d.%d/%d", rand() % 224, rand() % 256,
+                 rand() % 256, rand() % 256, 16 + rand() % 17);
+        assert(mysocket_acl_add(listen_fd, cidr, MYSOCKET_ACL_DENY) == 0);
+    }
+
+    struct mysocket *listen_sock = socket_find_by_fd(listen_fd);
+    struct mysocket_addr_in peer = mysocket_make_addr(NULL, 40000);
+    uint32_t x = 12345, accepted = 0;
+
+    double start = now_sec();
+    for (int i = 0; i < LOOKUPS; i++) {
+        x = x * 1103515245 + 12345;
+        peer.sin_addr = x;
+        accepted += (uint32_t)socket_acl_check(listen_sock, &peer);
+    }
+    double elapsed = now_sec() - start;
+
+    assert(accepted > 0);
+    mysocket_cleanup();
+    return elapsed / LOOKUPS * 1e9;
+}
+
+/**
+ * 从一个源地址连续发起connect，服务端接受后双方关闭
+ * @return CPU微秒/次
+ */
+static double bench_connect(const char *src, int expect_ok) {
+    assert(mysocket_init() == 0);
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", TCP_PORT);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 16) == 0);
+    assert(mysocket_acl_add(listen_fd, "10.0.0.0/8", MYSOCKET_ACL_DENY) == 0);
+
+    double start = cpu_sec();
+    for (int i = 0; i < CONNECTS; i++) {
+        int fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        struct mysocket_addr_in local = mysocket_make_addr(src, (uint16_t)(20000 + i));
+        assert(mysocket_bind(fd, (struct mysocket_addr*)&local, sizeof(local)) == 0);
+        int ok = mysocket_connect(fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0;
+        assert(ok == expect_ok);
+        if (ok) {
+            mysocket_close(mysocket_accept(listen_fd, NULL, NULL));
+        }
+        mysocket_close(fd);
+    }
+    double elapsed = cpu_sec() - start;
+
+    mysocket_cleanup();
+    return elapsed / CONNECTS * 1e6;
+}
+
+int main() {
+    printf("=== 监听Socket访问控制 ===\n\n");
+
+    printf("%10s | %14s\n", "规则数", "ns/检查");
+    int rule_counts[] = { 10, 1000, 100000 };
+    for (size_t i = 0; i < sizeof(rule_counts) / sizeof(rule_counts[0]); i++) {
+        printf("%10d | %14.1f\n", rule_counts[i], bench_check(rule_counts[i]));
+    }
+
+    printf("\n%16s | %12s\n", "connect", "CPU us/次");
+    printf("%16s | %12.2f\n", "被拒绝", bench_connect("10.9.9.9", 0));
+    printf("%16s | %12.2f\n", "被接受", bench_connect("192.168.1.1", 1));
+
+    return 0;
+}
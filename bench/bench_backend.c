@@ -0,0 +1,190 @@
+/**
+ * @file bench_backend.c
+ * @brief 同一段mysocket_*代码在本项目协议栈和内核直通后端上的对比
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 子进程作为服务端，父进程作为客户端，收发代码完全相同，只有后端不同：
+ *   用户态：本项目的TCP，两个进程经共享内存设备交换包（不经过内核）；
+ *   内核：g_socket_backend = SOCKET_BACKEND_KERNEL，mysocket_*直接映射到127.0.0.1上的内核TCP。
+ * 测量批量传输的吞吐和小消息一问一答的往返时延。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <assert.h>
+#include <sys/wait.h>
+
+#define TRANSFER_BYTES      (32UL * 1024 * 1024)
+#define CHUNK_SIZE          (64 * 1024)
+#define PINGPONG_ROUNDS     20000
+#define PINGPONG_SIZE       64
+#define TCP_PORT            9402
+#define LINGER_MS           200     /* 服务端结束后继续处理ACK的时间 */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* 没有数据可处理时等待对端（内核后端的套接字是阻塞的，不会走到这里） */
+static void idle(void) {
+    netdev_wait(NULL, 10);
+}
+
+static void send_all(int fd, const char *buf, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = mysocket_send(fd, buf + sent, len - sent, 0);
+        if (n > 0) {
+            sent += (size_t)n;
+        } else {
+            idle();
+        }
+    }
+}
+
+static void recv_all(int fd, char *buf, size_t len) {
+    size_t received = 0;
+    while (received < len) {
+        ssize_t n = mysocket_recv(fd, buf + received, len - received, 0);
+        if (n > 0) {
+            received += (size_t)n;
+        } else {
+            idle();
+        }
+    }
+}
+
+/**
+ * 服务端：先接收批量数据，再回应一问一答
+ */
+static void run_server(int ready_fd) {
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", TCP_PORT);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 1) == 0);
+    assert(write(ready_fd, "r", 1) == 1);
+
+    int fd;
+    while ((fd = mysocket_accept(listen_fd, NULL, NULL)) < 0) {
+        idle();
+    }
+
+    static char buf[CHUNK_SIZE];
+    size_t received = 0;
+    while (received < TRANSFER_BYTES) {
+        size_t len = TRANSFER_BYTES - received < sizeof(buf) ? TRANSFER_BYTES - received : sizeof(buf);
+        recv_all(fd, buf, len);
+        received += len;
+    }
+
+    for (int i = 0; i < PINGPONG_ROUNDS; i++) {
+        recv_all(fd, buf, PINGPONG_SIZE);
+        send_all(fd, buf, PINGPONG_SIZE);
+    }
+
+    /* 用户态协议栈：客户端可能还在等最后几个ACK */
+    struct mysocket *sock = socket_find_by_fd(fd);
+    if (sock->host_fd < 0) {
+        double end = now_sec() + LINGER_MS / 1000.0;
+        while (now_sec() < end) {
+            socket_rx_process(sock);
+            netdev_wait(NULL, 5);
+        }
+    }
+}
+
+/**
+ * 运行一轮对比
+ * @param backend SOCKET_BACKEND_*
+ * @param rate 返回吞吐（MB/s）
+ * @param rtt_us 返回平均往返时延（微秒）
+ */
+static void run_backend(int backend, double *rate, double *rtt_us) {
+    struct netdev *dev = NULL;
+    g_socket_backend = backend;
+    if (backend == SOCKET_BACKEND_USER) {
+        dev = netdev_open("shm", "create");
+        assert(dev != NULL);
+    }
+
+    int ready[2];
+    assert(pipe(ready) == 0);
+
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(ready[0]);
+        assert(mysocket_init() == 0);
+        if (dev) {
+            char arg[64];
+            snprintf(arg, sizeof(arg), "attach=/proc/self/fd/%d", netdev_shm_fd(dev));
+            struct netdev *peer = netdev_open("shm", arg);
+            assert(peer != NULL);
+            netdev_set_default(peer);
+        }
+        run_server(ready[1]);
+        mysocket_cleanup();
+        _exit(0);
+    }
+
+    close(ready[1]);
+    char c;
+    assert(read(ready[0], &c, 1) == 1);
+    close(ready[0]);
+
+    assert(mysocket_init() == 0);
+    if (dev) {
+        netdev_set_default(dev);
+    }
+
+    int fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", TCP_PORT);
+
+    double start = now_sec();
+    assert(mysocket_connect(fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+
+    static char chunk[CHUNK_SIZE];
+    size_t sent = 0;
+    while (sent < TRANSFER_BYTES) {
+        size_t len = TRANSFER_BYTES - sent < sizeof(chunk) ? TRANSFER_BYTES - sent : sizeof(chunk);
+        send_all(fd, chunk, len);
+        sent += len;
+    }
+
+    /* 第一次往返的应答说明批量数据已全部到达 */
+    char msg[PINGPONG_SIZE] = {0};
+    send_all(fd, msg, sizeof(msg));
+    recv_all(fd, msg, sizeof(msg));
+    *rate = (double)TRANSFER_BYTES / (now_sec() - start) / 1e6;
+
+    start = now_sec();
+    for (int i = 1; i < PINGPONG_ROUNDS; i++) {
+        send_all(fd, msg, sizeof(msg));
+        recv_all(fd, msg, sizeof(msg));
+    }
+    *rtt_us = (now_sec() - start) / (PINGPONG_ROUNDS - 1) * 1e6;
+
+    waitpid(pid, NULL, 0);
+    mysocket_cleanup();
+    netdev_close(dev);
+}
+
+int main() {
+    printf("=== 同一段代码在两种后端上的TCP性能（%lu MB，%d次往返） ===\n\n",
+           TRANSFER_BYTES >> 20, PINGPONG_ROUNDS);
+    printf("%20s | %10s | %12s\n", "后端", "MB/s", "往返(us)");
+
+    int backends[] = { SOCKET_BACKEND_USER, SOCKET_BACKEND_KERNEL };
+    const char *names[] = { "用户态（共享内存）", "内核（回环）" };
+    for (int i = 0; i < 2; i++) {
+        double rate, rtt;
+        run_backend(backends[i], &rate, &rtt);
+        printf("%20s | %10.1f | %12.1f\n", names[i], rate, rtt);
+    }
+
+    return 0;
+}
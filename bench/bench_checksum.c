@@ -0,0 +1,108 @@
+/**
+ * @file bench_checksum.c
+ * @brief 校验和各实现在不同数据长度下的吞吐
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 每个长度重复计算同一缓冲区（数据在缓存中），报告GB/s；
+ * 另外比较memcpy后再计算与checksum_copy一遍完成复制和计算。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <stdio.h>
+
+#define TARGET_BYTES    (256ULL * 1024 * 1024)  /* 每项累计处理的字节数 */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main() {
+    static const char *impls[] = { "scalar", "sse2", "avx2" };
+    static const size_t sizes[] = { 20, 64, 256, 576, TCP_DEFAULT_MSS, 4096, 9000, 65536, 1024 * 1024 };
+    int num_impls = sizeof(impls) / sizeof(impls[0]);
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    size_t max_size = sizes[num_sizes - 1];
+    uint8_t *buf = malloc(max_size);
+    if (!buf) return 1;
+    for (size_t i = 0; i < max_size; i++) {
+        buf[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    printf("=== Internet校验和吞吐 (GB/s) ===\n");
+    printf("自动选择: %s\n\n", checksum_impl_name());
+    printf("%10s", "长度");
+    for (int k = 0; k < num_impls; k++) {
+        printf(" | %10s", impls[k]);
+    }
+    printf("\n");
+
+    volatile uint16_t sink = 0;
+
+    for (int i = 0; i < num_sizes; i++) {
+        size_t len = sizes[i];
+        uint64_t iters = TARGET_BYTES / len;
+
+        printf("%10zu", len);
+        for (int k = 0; k < num_impls; k++) {
+            if (checksum_select_impl(impls[k]) < 0) {
+                printf(" | %10s", "-");
+                continue;
+            }
+
+            double start = now_sec();
+            for (uint64_t n = 0; n < iters; n++) {
+                sink ^= checksum(buf, len);
+            }
+            double elapsed = now_sec() - start;
+
+            printf(" | %10.2f", (double)(iters * len) / elapsed / 1e9);
+        }
+        printf("\n");
+    }
+
+    checksum_select_impl(NULL);
+
+    /* 复制加校验：分两遍（memcpy后再计算）与一遍融合 */
+    uint8_t *dst = malloc(max_size);
+    if (!dst) {
+        free(buf);
+        return 1;
+    }
+
+    printf("\n=== 复制加校验和吞吐 (GB/s, %s) ===\n", checksum_impl_name());
+    printf("%10s | %10s | %10s\n", "长度", "分两遍", "融合");
+
+    for (int i = 0; i < num_sizes; i++) {
+        size_t len = sizes[i];
+        uint64_t iters = TARGET_BYTES / len;
+
+        double start = now_sec();
+        for (uint64_t n = 0; n < iters; n++) {
+            memcpy(dst, buf, len);
+            sink ^= checksum(dst, len);
+        }
+        double separate = now_sec() - start;
+
+        start = now_sec();
+        for (uint64_t n = 0; n < iters; n++) {
+            sink ^= checksum_fold(checksum_copy(dst, buf, len, 0));
+        }
+        double fused = now_sec() - start;
+
+        printf("%10zu | %10.2f | %10.2f\n", len,
+               (double)(iters * len) / separate / 1e9,
+               (double)(iters * len) / fused / 1e9);
+    }
+
+    free(dst);
+    free(buf);
+    (void)sink;
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file bench_kernel_tcp.c
+ * @brief 内核TCP在127.0.0.1回环上的吞吐，作为bench_udp_tunnel的对照
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 与bench_udp_tunnel相同的传输量和写入大小，子进程接收、父进程发送。
+ * 只使用系统套接字接口，不包含本项目的头文件（其中的AF_INET等定义与系统头文件冲突）。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define TRANSFER_BYTES      (32UL * 1024 * 1024)
+#define CHUNK_SIZE          (64 * 1024)
+#define TCP_PORT            39503
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main() {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TCP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    assert(listen_fd >= 0);
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    assert(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(listen_fd, 1) == 0);
+
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        int fd = accept(listen_fd, NULL, NULL);
+        static char buf[CHUNK_SIZE];
+        size_t received = 0;
+        while (received < TRANSFER_BYTES) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0) break;
+            received += (size_t)n;
+        }
+        close(fd);
+        _exit(received == TRANSFER_BYTES ? 0 : 1);
+    }
+    close(listen_fd);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+
+    double start = now_sec();
+    assert(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+    static char chunk[CHUNK_SIZE];
+    size_t sent = 0;
+    while (sent < TRANSFER_BYTES) {
+        size_t len = TRANSFER_BYTES - sent < sizeof(chunk) ? TRANSFER_BYTES - sent : sizeof(chunk);
+        ssize_t n = write(fd, chunk, len);
+        assert(n > 0);
+        sent += (size_t)n;
+    }
+    close(fd);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    double elapsed = now_sec() - start;
+
+    printf("=== 内核TCP回环吞吐（%lu MB） ===\n\n", TRANSFER_BYTES >> 20);
+    printf("%10.1f MB/s\n", (double)TRANSFER_BYTES / elapsed / 1e6);
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
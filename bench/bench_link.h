@@ -0,0 +1,131 @@
+/**
+ * @file bench_link.h
+ * @brief 基准测试共用的链路仿真（虚拟时间、时延、带宽、随机丢包）
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 通过packet_set_output_hook截获发出的包，按瓶颈带宽串行化后
+ * 加上单向时延排队，link_deliver_due按虚拟时间投递到期的包。
+ * 每个方向的到达时间单调递增，因此各用一个FIFO即可。
+ */
+
+#ifndef BENCH_LINK_H
+#define BENCH_LINK_H
+
+#include "socket_internal.h"
+#include <assert.h>
+
+/* 链路上的包 */
+struct link_item {
+    struct packet *pkt;
+    uint64_t deliver_at;
+    struct link_item *next;
+};
+
+/* 链路参数和状态 */
+struct bench_link {
+    uint64_t delay_us;          /* 单向时延 */
+    uint64_t rate_bps;          /* 瓶颈带宽 */
+    double loss_rate;           /* 正向（数据方向）丢包率 */
+    uint16_t client_port;       /* 区分方向：源端口为client_port的是正向 */
+    uint64_t now_us;            /* 虚拟时间 */
+    uint64_t busy_until[2];     /* 两个方向的链路占用截止时间 */
+    uint64_t wire_bytes;        /* 正向发出的数据字节数（含重传） */
+    uint32_t rng_state;         /* 线性同余随机数，保证各轮看到相同的丢包序列 */
+    struct link_item *head[2];  /* 两个方向的在途包 */
+    struct link_item *tail[2];
+};
+
+static struct bench_link g_link;
+
+static inline uint64_t link_clock(void) {
+    return g_link.now_us / 1000;
+}
+
+static inline double link_rng_next(void) {
+    g_link.rng_state = g_link.rng_state * 1103515245u + 12345u;
+    return (double)((g_link.rng_state >> 8) & 0xFFFFFF) / (double)0x1000000;
+}
+
+static inline int link_hook(struct packet *pkt) {
+    int dir = (pkt->tcp_hdr.src_port == g_link.client_port) ? 0 : 1;
+    size_t bytes = sizeof(struct ip_header) + sizeof(struct tcp_header) + pkt->data_len;
+
+    /* 串行化到瓶颈链路 */
+    uint64_t start = (g_link.busy_until[dir] > g_link.now_us) ? g_link.busy_until[dir] : g_link.now_us;
+    g_link.busy_until[dir] = start + bytes * 8ULL * 1000000ULL / g_link.rate_bps;
+
+    if (dir == 0) {
+        g_link.wire_bytes += pkt->data_len;
+        if (g_link.loss_rate > 0 && link_rng_next() < g_link.loss_rate) {
+            return 0;  /* 丢包 */
+        }
+    }
+
+    struct link_item *item = malloc(sizeof(struct link_item));
+    assert(item != NULL);
+    item->pkt = packet_clone(pkt);
+    item->deliver_at = g_link.busy_until[dir] + g_link.delay_us;
+
+    item->next = NULL;
+    if (g_link.tail[dir]) {
+        g_link.tail[dir]->next = item;
+    } else {
+        g_link.head[dir] = item;
+    }
+    g_link.tail[dir] = item;
+
+    return 0;
+}
+
+static inline void link_deliver_due(void) {
+    for (;;) {
+        /* 取两个方向中最早到达的包 */
+        int dir = -1;
+        for (int d = 0; d < 2; d++) {
+            struct link_item *h = g_link.head[d];
+            if (h && h->deliver_at <= g_link.now_us &&
+                (dir < 0 || h->deliver_at < g_link.head[dir]->deliver_at)) {
+                dir = d;
+            }
+        }
+        if (dir < 0) {
+            break;
+        }
+
+        struct link_item *item = g_link.head[dir];
+        g_link.head[dir] = item->next;
+        if (!g_link.head[dir]) {
+            g_link.tail[dir] = NULL;
+        }
+        packet_deliver(item->pkt);
+        packet_destroy(item->pkt);
+        free(item);
+    }
+}
+
+/**
+ * 清空在途包并设置新的链路参数，虚拟时间从1秒开始
+ */
+static inline void link_reset(uint64_t delay_us, uint64_t rate_bps, double loss_rate) {
+    for (int d = 0; d < 2; d++) {
+        while (g_link.head[d]) {
+            struct link_item *item = g_link.head[d];
+            g_link.head[d] = item->next;
+            packet_destroy(item->pkt);
+            free(item);
+        }
+        g_link.tail[d] = NULL;
+    }
+
+    g_link.delay_us = delay_us;
+    g_link.rate_bps = rate_bps;
+    g_link.loss_rate = loss_rate;
+    g_link.client_port = 0;
+    g_link.now_us = 1000000;
+    g_link.busy_until[0] = g_link.busy_until[1] = 0;
+    g_link.wire_bytes = 0;
+    g_link.rng_state = 12345;
+}
+
+#endif /* BENCH_LINK_H */
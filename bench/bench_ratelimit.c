@@ -0,0 +1,133 @@
+/**
+ * @file bench_ratelimit.c
+ * @brief 按源地址限速：一个吵闹的UDP来源挤占接收缓冲区时，安静来源的送达率；限速检查的耗时
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 用虚拟时钟按毫秒推进：每毫秒吵闹的来源发100个数据报，安静的来源发1个，
+ * 接收方每毫秒只读出固定字节数。不限速时接收缓冲区几乎总是满的，安静来源的数据报大多被丢弃；
+ * 每源每秒2000个的限速让吵闹来源只占用它应得的份额。
+ * 第二部分测量socket_rate_limit_allow的耗时：来源数小于和远大于表的容量（需要淘汰）。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <assert.h>
+
+#define TICKS               2000        /* 虚拟毫秒数 */
+#define NOISY_PER_TICK      100
+#define DGRAM_SIZE          512
+#define DRAIN_PER_TICK      (8 * DGRAM_SIZE)
+#define UDP_PORT            9710
+#define CHECKS              5000000
+
+static uint64_t virtual_ms = 0;
+
+static uint64_t virtual_clock(void) {
+    return virtual_ms;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * 运行一次
+ * @param rate 每源每秒的限速，0表示不限
+ * @return 安静来源的送达率（%）
+ */
+static double run_flood(unsigned int rate, uint64_t *throttled) {
+    assert(mysocket_init() == 0);
+    tcp_set_clock(virtual_clock);
+    virtual_ms = 1;
+
+    int rx = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    int noisy = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    int quiet = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    struct mysocket_addr_in rx_addr = mysocket_make_addr("127.0.0.1", UDP_PORT);
+    struct mysocket_addr_in noisy_addr = mysocket_make_addr("10.0.0.1", UDP_PORT + 1);
+    struct mysocket_addr_in quiet_addr = mysocket_make_addr("10.0.0.2", UDP_PORT + 2);
+    assert(mysocket_bind(rx, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr)) == 0);
+    assert(mysocket_bind(noisy, (struct mysocket_addr*)&noisy_addr, sizeof(noisy_addr)) == 0);
+    assert(mysocket_bind(quiet, (struct mysocket_addr*)&quiet_addr, sizeof(quiet_addr)) == 0);
+    if (rate > 0) {
+        assert(mysocket_rate_limit(rx, rate, rate / 10) == 0);
+    }
+
+    static char noisy_msg[DGRAM_SIZE], quiet_msg[DGRAM_SIZE], buf[DRAIN_PER_TICK];
+    memset(noisy_msg, 'n', sizeof(noisy_msg));
+    memset(quiet_msg, 'q', sizeof(quiet_msg));
+
+    uint64_t quiet_bytes = 0;
+    for (int tick = 0; tick < TICKS; tick++, virtual_ms++) {
+        for (int i = 0; i < NOISY_PER_TICK; i++) {
+            mysocket_sendto(noisy, noisy_msg, sizeof(noisy_msg), 0, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr));
+            if (i == NOISY_PER_TICK / 2) {
+                mysocket_sendto(quiet, quiet_msg, sizeof(quiet_msg), 0, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr));
+            }
+        }
+
+        ssize_t n = mysocket_recvfrom(rx, buf, sizeof(buf), 0, NULL, NULL);
+        for (ssize_t i = 0; i < n; i++) {
+            quiet_bytes += (buf[i] == 'q');
+        }
+    }
+
+    struct rate_limit *rl = socket_find_by_fd(rx)->rate_limit;
+    *throttled = rl ? rl->throttled : 0;
+
+    tcp_set_clock(NULL);
+    mysocket_cleanup();
+    return (double)quiet_bytes * 100.0 / ((double)TICKS * DGRAM_SIZE);
+}
+
+/**
+ * 限速检查的耗时
+ * @param sources 轮流出现的来源数
+ * @return 纳秒/次
+ */
+static double bench_check(uint32_t sources, uint64_t *evictions) {
+    struct rate_limit *rl = calloc(1, sizeof(struct rate_limit));
+    assert(rl != NULL);
+    pthread_mutex_init(&rl->lock, NULL);
+    rl->rate = 1000;
+    rl->burst = 10;
+
+    double start = now_sec();
+    for (uint32_t i = 0; i < CHECKS; i++) {
+        socket_rate_limit_allow(rl, mysocket_htonl(0x0A000000 + i % sources));
+    }
+    double elapsed = now_sec() - start;
+
+    *evictions = rl->evictions;
+    socket_rate_limit_destroy(rl);
+    return elapsed / CHECKS * 1e9;
+}
+
+int main() {
+    printf("=== 按源地址限速（表%d桶，%zu KB） ===\n\n", RATE_LIMIT_SETS * RATE_LIMIT_WAYS,
+           sizeof(struct rate_limit) / 1024);
+
+    printf("%16s | %14s | %12s\n", "限速", "安静来源送达%", "被限速");
+    unsigned int rates[] = { 0, 2000 };
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        uint64_t throttled;
+        double pct = run_flood(rates[i], &throttled);
+        char label[32];
+        snprintf(label, sizeof(label), rates[i] ? "%u/s" : "不限", rates[i]);
+        printf("%16s | %14.1f | %12llu\n", label, pct, (unsigned long long)throttled);
+    }
+
+    printf("\n%10s | %12s | %12s\n", "来源数", "ns/检查", "淘汰");
+    uint32_t sources[] = { 16, 1000, 100000 };
+    for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        uint64_t evictions;
+        double ns = bench_check(sources[i], &evictions);
+        printf("%10u | %12.1f | %12llu\n", sources[i], ns, (unsigned long long)evictions);
+    }
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file bench_raw.c
+ * @brief 原始套接字旁听对TCP回环吞吐的影响
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 同一线程交替发送和接收，分别测量：
+ *   没有原始套接字（packet_send只多一次计数检查）；
+ *   一个原始套接字旁听，监视线程用raw_dequeue取走包（每包一次克隆，不复制负载）；
+ *   一个原始套接字旁听，用mysocket_recv读出完整的帧（读取时复制）。
+ * 旁听在数据路径上的开销只有克隆和入队，复制发生在读取旁听队列的一方。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <assert.h>
+
+#define TRANSFER_BYTES      (256UL * 1024 * 1024)
+#define CHUNK_SIZE          (16 * 1024)
+#define TCP_PORT            9409
+
+enum { MODE_NONE, MODE_DEQUEUE, MODE_RECV };
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * 运行一种方式
+ * @param packets 返回旁听到的包数
+ * @return MB/s
+ */
+static double run_mode(int mode, uint64_t *packets) {
+    assert(mysocket_init() == 0);
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", TCP_PORT);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 1) == 0);
+    int client = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(mysocket_connect(client, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    int server = mysocket_accept(listen_fd, NULL, NULL);
+    assert(server >= 0);
+
+    struct mysocket *raw = NULL;
+    if (mode != MODE_NONE) {
+        raw = socket_find_by_fd(mysocket_socket(AF_INET, SOCK_RAW, IPPROTO_TCP));
+        assert(raw != NULL);
+    }
+
+    static char out[CHUNK_SIZE], in[CHUNK_SIZE], frame[64 * 1024];
+    size_t sent = 0, received = 0;
+    *packets = 0;
+
+    double start = now_sec();
+    while (received < TRANSFER_BYTES) {
+        if (sent < TRANSFER_BYTES) {
+            ssize_t n = mysocket_send(client, out, sizeof(out), 0);
+            if (n > 0) sent += (size_t)n;
+        }
+        ssize_t n = mysocket_recv(server, in, sizeof(in), 0);
+        if (n > 0) received += (size_t)n;
+
+        /* 监视方把旁听队列取空 */
+        if (mode == MODE_DEQUEUE) {
+            struct packet *pkt;
+            while ((pkt = raw_dequeue(raw)) != NULL) {
+                packet_destroy(pkt);
+                (*packets)++;
+            }
+        } else if (mode == MODE_RECV) {
+            while (mysocket_recv(raw->fd, frame, sizeof(frame), 0) > 0) {
+                (*packets)++;
+            }
+        }
+    }
+    double elapsed = now_sec() - start;
+
+    if (raw) {
+        assert(raw->raw_sk->drops == 0);
+    }
+    mysocket_cleanup();
+    return (double)TRANSFER_BYTES / elapsed / 1e6;
+}
+
+int main() {
+    printf("=== TCP回环%lu MB：原始套接字旁听的开销 ===\n\n", TRANSFER_BYTES >> 20);
+    printf("%24s | %10s | %10s\n", "方式", "MB/s", "旁听包数");
+
+    const char *names[] = { "无原始套接字", "旁听 + raw_dequeue", "旁听 + recv读帧" };
+    for (int mode = MODE_NONE; mode <= MODE_RECV; mode++) {
+        uint64_t packets;
+        double rate = run_mode(mode, &packets);
+        printf("%24s | %10.1f | %10llu\n", names[mode], rate, (unsigned long long)packets);
+    }
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file bench_route.c
+ * @brief 路由表：最长前缀查找的耗时与路由数的关系，以及连接缓存路由后的代价
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * route_output每次都查前缀树（加锁、最多32层）；tcp_route只比较路由表代数，
+ * 代数没变时直接返回缓存的设备，TCP数据路径上每个报文段走的是后者。
+ * 路由为随机的/8-/32前缀（类似一张较大的内部路由表），目标地址随机。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <assert.h>
+
+#define LOOKUPS             2000000
+#define TCP_PORT            9720
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * 装入routes条路由，测量route_output的耗时
+ * @return 纳秒/次
+ */
+static double bench_lookup(struct netdev *dev, int routes) {
+    srand(1);
+    char cidr[32];
+    for (int added = 0; added < routes; ) {
+        snprintf(cidr, sizeof(cidr), "%d.%d.%d.%d/%d", 1 + rand() % 223, rand() % 256,
+                 rand() % 256, rand() % 256, 8 + rand() % 25);
+        if (route_add(cidr, NULL, dev, 0) == 0) {
+            added++;
+        }
+    }
+
+    uint32_t x = 12345, hits = 0;
+    struct netdev *def = netdev_get_default();
+    double start = now_sec();
+    for (int i = 0; i < LOOKUPS; i++) {
+        x = x * 1103515245 + 12345;
+        hits += route_output(x) != def;
+    }
+    double elapsed = now_sec() - start;
+
+    assert(hits > 0 || routes < 100);
+    route_flush_dev(dev);
+    return elapsed / LOOKUPS * 1e9;
+}
+
+/**
+ * 已连接的TCP Socket取出口设备（路由表不变，走缓存）
+ * @return 纳秒/次
+ */
+static double bench_cached(struct netdev *dev) {
+    assert(mysocket_init() == 0);
+    assert(route_add("127.0.0.0/8", NULL, dev, 0) == 0);
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int client = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", TCP_PORT);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 1) == 0);
+    assert(mysocket_connect(client, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    struct mysocket *sock = socket_find_by_fd(client);
+
+    uintptr_t sum = 0;
+    double start = now_sec();
+    for (int i = 0; i < LOOKUPS; i++) {
+        sum += (uintptr_t)tcp_route(sock);
+    }
+    double elapsed = now_sec() - start;
+
+    assert(sum != 0 && sock->conn->route_dev == dev);
+    route_flush_dev(dev);
+    mysocket_cleanup();
+    return elapsed / LOOKUPS * 1e9;
+}
+
+int main() {
+    printf("=== 路由表：最长前缀查找与连接的路由缓存 ===\n\n");
+
+    struct netdev *dev = netdev_open("loopback", NULL);
+    assert(dev != NULL);
+
+    printf("%10s | %14s\n", "路由数", "ns/查找");
+    int route_counts[] = { 10, 1000, 100000 };
+    for (size_t i = 0; i < sizeof(route_counts) / sizeof(route_counts[0]); i++) {
+        printf("%10d | %14.1f\n", route_counts[i], bench_lookup(dev, route_counts[i]));
+    }
+
+    printf("\n连接缓存的路由（tcp_route）: %.1f ns/次\n", bench_cached(dev));
+
+    netdev_close(dev);
+    return 0;
+}
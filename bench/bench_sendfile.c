@@ -0,0 +1,128 @@
+/**
+ * @file bench_sendfile.c
+ * @brief 发送静态文件：pread+mysocket_send与mysocket_sendfile（pread回退/映射文件页）的对比
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 同一线程里交替推进发送端和接收端，经回环设备传输同一个文件：
+ *   pread + send：文件 -> 用户缓冲区 -> 发送缓冲区 -> 包，三次复制；
+ *   sendfile(pread)：文件 -> 包，一次复制；
+ *   sendfile(mmap)：包的负载直接引用映射的文件页，只计算校验和。
+ * 接收端的复制（包 -> 接收缓冲区 -> 用户缓冲区）三种方式相同。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <assert.h>
+#include <fcntl.h>
+
+#define FILE_BYTES          (64UL * 1024 * 1024)
+#define ROUNDS              4
+#define CHUNK_SIZE          (64 * 1024)
+#define TCP_PORT            9408
+#define FILE_PATH           "/tmp/mysocket-bench-sendfile.dat"
+
+enum { MODE_PREAD_SEND, MODE_SENDFILE_PREAD, MODE_SENDFILE_MMAP };
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void tcp_pair(uint16_t port, int *client, int *server) {
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", port);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 1) == 0);
+    *client = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(mysocket_connect(*client, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    *server = mysocket_accept(listen_fd, NULL, NULL);
+    assert(*server >= 0);
+}
+
+/**
+ * 发送端的一步
+ * @return 本步从文件发出的字节数
+ */
+static size_t sender_step(int mode, int fd, int file_fd, off_t *off) {
+    static char buf[CHUNK_SIZE];
+    static size_t pending_off, pending_len;
+
+    if (mode != MODE_PREAD_SEND) {
+        ssize_t n = mysocket_sendfile(fd, file_fd, off, FILE_BYTES);
+        return n > 0 ? (size_t)n : 0;
+    }
+
+    if (pending_len == 0) {
+        ssize_t n = pread(file_fd, buf, sizeof(buf), *off);
+        if (n <= 0) return 0;
+        pending_off = 0;
+        pending_len = (size_t)n;
+    }
+    ssize_t n = mysocket_send(fd, buf + pending_off, pending_len, 0);
+    if (n <= 0) return 0;
+    pending_off += (size_t)n;
+    pending_len -= (size_t)n;
+    *off += n;
+    return (size_t)n;
+}
+
+/**
+ * 运行一种方式
+ * @return MB/s
+ */
+static double run_mode(int mode, int file_fd) {
+    assert(mysocket_init() == 0);
+    g_sendfile_mmap = (mode == MODE_SENDFILE_MMAP);
+
+    int client, server;
+    tcp_pair(TCP_PORT, &client, &server);
+
+    static char in[CHUNK_SIZE];
+    size_t total = 0;
+
+    double start = now_sec();
+    for (int round = 0; round < ROUNDS; round++) {
+        off_t off = 0;
+        size_t received = 0;
+        while (received < FILE_BYTES) {
+            if ((size_t)off < FILE_BYTES) {
+                sender_step(mode, client, file_fd, &off);
+            }
+            ssize_t n = mysocket_recv(server, in, sizeof(in), 0);
+            if (n > 0) received += (size_t)n;
+        }
+        total += received;
+    }
+    double elapsed = now_sec() - start;
+
+    g_sendfile_mmap = 1;
+    mysocket_cleanup();
+    return (double)total / elapsed / 1e6;
+}
+
+int main() {
+    int file_fd = open(FILE_PATH, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    assert(file_fd >= 0);
+    static char block[CHUNK_SIZE];
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = (char)i;
+    }
+    for (size_t written = 0; written < FILE_BYTES; written += sizeof(block)) {
+        assert(write(file_fd, block, sizeof(block)) == (ssize_t)sizeof(block));
+    }
+
+    printf("=== 发送%lu MB文件%d次（页缓存已热） ===\n\n", FILE_BYTES >> 20, ROUNDS);
+    printf("%20s | %10s\n", "方式", "MB/s");
+
+    const char *names[] = { "pread + send", "sendfile（pread）", "sendfile（映射）" };
+    for (int mode = MODE_PREAD_SEND; mode <= MODE_SENDFILE_MMAP; mode++) {
+        printf("%20s | %10.1f\n", names[mode], run_mode(mode, file_fd));
+    }
+
+    close(file_fd);
+    unlink(FILE_PATH);
+    return 0;
+}
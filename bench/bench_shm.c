@@ -0,0 +1,141 @@
+/**
+ * @file bench_shm.c
+ * @brief 两个进程经共享内存设备用本项目的TCP传输数据的吞吐
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 父进程创建共享内存设备后fork，子进程映射同一区域作为服务端，父进程作为客户端。
+ * 收发两端没有数据可处理时在netdev_wait中睡眠，由对端的门铃唤醒；
+ * 传输量和写入大小与bench_udp_tunnel、bench_kernel_tcp相同，便于对比。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <assert.h>
+#include <sys/wait.h>
+
+#define TRANSFER_BYTES      (32UL * 1024 * 1024)
+#define CHUNK_SIZE          (64 * 1024)
+#define TCP_PORT            9401
+#define LINGER_MS           200     /* 服务端收完后继续处理ACK的时间 */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * 服务端进程：映射父进程创建的区域，接收TRANSFER_BYTES后退出
+ * @param shm_fd 共享内存设备的memfd（fork继承）
+ * @param ready_fd 开始监听后写入一个字节通知父进程
+ */
+static void run_server(int shm_fd, int ready_fd) {
+    char arg[64];
+    snprintf(arg, sizeof(arg), "attach=/proc/self/fd/%d", shm_fd);
+
+    assert(mysocket_init() == 0);
+    struct netdev *dev = netdev_open("shm", arg);
+    assert(dev != NULL);
+    netdev_set_default(dev);
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", TCP_PORT);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 1) == 0);
+    assert(write(ready_fd, "r", 1) == 1);
+
+    int fd;
+    while ((fd = mysocket_accept(listen_fd, NULL, NULL)) < 0) {
+        netdev_wait(NULL, 10);
+    }
+
+    static char buf[CHUNK_SIZE];
+    size_t received = 0;
+    while (received < TRANSFER_BYTES) {
+        ssize_t n = mysocket_recv(fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            received += (size_t)n;
+        } else {
+            netdev_wait(NULL, 10);
+        }
+    }
+
+    /* 客户端可能还在等最后几个ACK或重传 */
+    struct mysocket *sock = socket_find_by_fd(fd);
+    double end = now_sec() + LINGER_MS / 1000.0;
+    while (now_sec() < end) {
+        socket_rx_process(sock);
+        netdev_wait(NULL, 5);
+    }
+
+    netdev_close(dev);
+    mysocket_cleanup();
+}
+
+int main() {
+    struct netdev *dev = netdev_open("shm", "create");
+    assert(dev != NULL);
+
+    int ready[2];
+    assert(pipe(ready) == 0);
+
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(ready[0]);
+        run_server(netdev_shm_fd(dev), ready[1]);
+        _exit(0);
+    }
+
+    close(ready[1]);
+    char c;
+    assert(read(ready[0], &c, 1) == 1);
+    close(ready[0]);
+
+    assert(mysocket_init() == 0);
+    netdev_set_default(dev);
+
+    int fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", TCP_PORT);
+
+    double start = now_sec();
+    assert(mysocket_connect(fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+
+    static char chunk[CHUNK_SIZE];
+    size_t sent = 0;
+    while (sent < TRANSFER_BYTES) {
+        size_t len = TRANSFER_BYTES - sent < sizeof(chunk) ? TRANSFER_BYTES - sent : sizeof(chunk);
+        ssize_t n = mysocket_send(fd, chunk, len, 0);
+        if (n > 0) {
+            sent += (size_t)n;
+        } else {
+            netdev_wait(NULL, 1);
+        }
+    }
+
+    /* 等全部数据被确认 */
+    struct mysocket *sock = socket_find_by_fd(fd);
+    while (sock->send_buf_used > 0 || sock->conn->snd_una != sock->conn->snd_nxt) {
+        socket_rx_process(sock);
+        tcp_retransmit_timer(sock);
+        socket_flush_send_buffer(sock);
+        netdev_wait(NULL, 1);
+    }
+    double elapsed = now_sec() - start;
+
+    struct netdev_stats stats;
+    netdev_get_stats(dev, &stats);
+    netdev_close(dev);
+    mysocket_cleanup();
+    waitpid(pid, NULL, 0);
+
+    printf("=== 两个进程经共享内存设备的TCP吞吐（%lu MB） ===\n\n", TRANSFER_BYTES >> 20);
+    printf("%10s | %10s | %10s | %10s\n", "MB/s", "发出包数", "门铃", "丢包");
+    printf("%10.1f | %10llu | %10llu | %10llu\n", (double)TRANSFER_BYTES / elapsed / 1e6,
+           (unsigned long long)stats.tx_packets, (unsigned long long)stats.doorbells,
+           (unsigned long long)stats.tx_dropped);
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file bench_splice.c
+ * @brief 代理转发：recv/send循环与mysocket_splice的吞吐对比
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 同一线程里依次推进客户端、代理和服务端：client -> front | 代理 | back -> server。
+ * recv/send循环把数据从front的接收缓冲区复制到用户缓冲区，再复制到back的发送缓冲区，
+ * 然后才复制进包；splice直接从front的接收缓冲区构造back的包（窗口之外的部分才进发送缓冲区）。
+ * 分别测量两条TCP连接和两对Unix域Socket的情况。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <assert.h>
+
+#define TRANSFER_BYTES      (128UL * 1024 * 1024)
+#define CHUNK_SIZE          (64 * 1024)
+#define FRONT_PORT          9406
+#define BACK_PORT           9407
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void tcp_pair(uint16_t port, int *client, int *server) {
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", port);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 1) == 0);
+    *client = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(mysocket_connect(*client, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    *server = mysocket_accept(listen_fd, NULL, NULL);
+    assert(*server >= 0);
+}
+
+/**
+ * 代理的一步：use_splice为0时用recv/send经用户缓冲区转发，发不完的部分留到下一步
+ */
+static void proxy_step(int front, int back, int use_splice) {
+    static char buf[CHUNK_SIZE];
+    static size_t pending_off, pending_len;
+
+    if (use_splice) {
+        mysocket_splice(front, back, CHUNK_SIZE, 0);
+        return;
+    }
+
+    if (pending_len == 0) {
+        ssize_t n = mysocket_recv(front, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        pending_off = 0;
+        pending_len = (size_t)n;
+    }
+    ssize_t n = mysocket_send(back, buf + pending_off, pending_len, 0);
+    if (n > 0) {
+        pending_off += (size_t)n;
+        pending_len -= (size_t)n;
+    }
+}
+
+/**
+ * 运行一轮转发
+ * @param family AF_INET或AF_UNIX
+ * @return MB/s
+ */
+static double run_proxy(int family, int use_splice) {
+    assert(mysocket_init() == 0);
+
+    int client, front, back, server;
+    if (family == AF_INET) {
+        tcp_pair(FRONT_PORT, &client, &front);
+        tcp_pair(BACK_PORT, &back, &server);
+    } else {
+        int sv[2];
+        assert(mysocket_socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        client = sv[0];
+        front = sv[1];
+        assert(mysocket_socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        back = sv[0];
+        server = sv[1];
+    }
+
+    static char out[CHUNK_SIZE], in[CHUNK_SIZE];
+    size_t sent = 0, received = 0;
+
+    double start = now_sec();
+    while (received < TRANSFER_BYTES) {
+        if (sent < TRANSFER_BYTES) {
+            ssize_t n = mysocket_send(client, out, sizeof(out), 0);
+            if (n > 0) sent += (size_t)n;
+        }
+        proxy_step(front, back, use_splice);
+        ssize_t n = mysocket_recv(server, in, sizeof(in), 0);
+        if (n > 0) received += (size_t)n;
+    }
+    double elapsed = now_sec() - start;
+
+    mysocket_cleanup();
+    return (double)TRANSFER_BYTES / elapsed / 1e6;
+}
+
+int main() {
+    printf("=== 代理转发%lu MB：recv/send循环与splice ===\n\n", TRANSFER_BYTES >> 20);
+    printf("%10s | %14s | %14s\n", "连接", "recv/send MB/s", "splice MB/s");
+
+    int families[] = { AF_INET, AF_UNIX };
+    const char *names[] = { "TCP", "Unix域" };
+    for (int i = 0; i < 2; i++) {
+        double copy_rate = run_proxy(families[i], 0);
+        double splice_rate = run_proxy(families[i], 1);
+        printf("%10s | %14.1f | %14.1f\n", names[i], copy_rate, splice_rate);
+    }
+
+    return 0;
+}
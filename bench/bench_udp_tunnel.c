@@ -0,0 +1,145 @@
+/**
+ * @file bench_udp_tunnel.c
+ * @brief 两个进程经UDP封装设备用本项目的TCP传输数据的吞吐
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 子进程作为服务端，父进程作为客户端，各自打开一个互为对端的UDP封装设备，
+ * 包经主机127.0.0.1的UDP往返。分别测量开启和关闭GSO时的吞吐；
+ * 与内核TCP在回环上的对比见bench_kernel_tcp。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <assert.h>
+#include <sys/wait.h>
+
+#define TRANSFER_BYTES      (32UL * 1024 * 1024)
+#define CHUNK_SIZE          (64 * 1024)
+#define CLIENT_UDP_PORT     39501
+#define SERVER_UDP_PORT     39502
+#define TCP_PORT            9400
+#define LINGER_MS           200     /* 服务端收完后继续处理ACK的时间 */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static struct netdev* open_tunnel(uint16_t local, uint16_t remote, int gso) {
+    char arg[96];
+    snprintf(arg, sizeof(arg), "local=127.0.0.1:%u,remote=127.0.0.1:%u%s",
+             local, remote, gso ? "" : ",gso=0");
+    struct netdev *dev = netdev_open("udp", arg);
+    assert(dev != NULL);
+    netdev_set_default(dev);
+    return dev;
+}
+
+/**
+ * 服务端进程：接收TRANSFER_BYTES后退出
+ * @param ready_fd 开始监听后写入一个字节通知父进程
+ */
+static void run_server(int gso, int ready_fd) {
+    assert(mysocket_init() == 0);
+    struct netdev *dev = open_tunnel(SERVER_UDP_PORT, CLIENT_UDP_PORT, gso);
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", TCP_PORT);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 1) == 0);
+    assert(write(ready_fd, "r", 1) == 1);
+
+    int fd;
+    while ((fd = mysocket_accept(listen_fd, NULL, NULL)) < 0) {
+    }
+
+    static char buf[CHUNK_SIZE];
+    size_t received = 0;
+    while (received < TRANSFER_BYTES) {
+        ssize_t n = mysocket_recv(fd, buf, sizeof(buf), 0);
+        if (n > 0) received += (size_t)n;
+    }
+
+    /* 客户端可能还在等最后几个ACK或重传 */
+    struct mysocket *sock = socket_find_by_fd(fd);
+    double end = now_sec() + LINGER_MS / 1000.0;
+    while (now_sec() < end) {
+        socket_rx_process(sock);
+    }
+
+    netdev_close(dev);
+    mysocket_cleanup();
+}
+
+/**
+ * 运行一轮传输
+ * @return 吞吐（MB/s）
+ */
+static double run_transfer(int gso, struct netdev_stats *stats) {
+    int ready[2];
+    assert(pipe(ready) == 0);
+
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(ready[0]);
+        run_server(gso, ready[1]);
+        _exit(0);
+    }
+
+    close(ready[1]);
+    char c;
+    assert(read(ready[0], &c, 1) == 1);
+    close(ready[0]);
+
+    assert(mysocket_init() == 0);
+    struct netdev *dev = open_tunnel(CLIENT_UDP_PORT, SERVER_UDP_PORT, gso);
+
+    int fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", TCP_PORT);
+
+    double start = now_sec();
+    assert(mysocket_connect(fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+
+    static char chunk[CHUNK_SIZE];
+    size_t sent = 0;
+    while (sent < TRANSFER_BYTES) {
+        size_t len = TRANSFER_BYTES - sent < sizeof(chunk) ? TRANSFER_BYTES - sent : sizeof(chunk);
+        ssize_t n = mysocket_send(fd, chunk, len, 0);
+        if (n > 0) sent += (size_t)n;
+    }
+
+    /* 等全部数据被确认 */
+    struct mysocket *sock = socket_find_by_fd(fd);
+    while (sock->send_buf_used > 0 || sock->conn->snd_una != sock->conn->snd_nxt) {
+        socket_rx_process(sock);
+        tcp_retransmit_timer(sock);
+        socket_flush_send_buffer(sock);
+    }
+    double elapsed = now_sec() - start;
+
+    netdev_get_stats(dev, stats);
+    netdev_close(dev);
+    mysocket_cleanup();
+    waitpid(pid, NULL, 0);
+
+    return (double)TRANSFER_BYTES / elapsed / 1e6;
+}
+
+int main() {
+    printf("=== 两个进程经UDP封装设备的TCP吞吐（%lu MB） ===\n\n", TRANSFER_BYTES >> 20);
+    printf("%6s | %10s | %10s | %10s | %10s\n", "GSO", "MB/s", "发出包数", "批数", "丢包");
+
+    for (int gso = 1; gso >= 0; gso--) {
+        struct netdev_stats stats;
+        double rate = run_transfer(gso, &stats);
+        printf("%6s | %10.1f | %10llu | %10llu | %10llu\n", gso ? "开" : "关", rate,
+               (unsigned long long)stats.tx_packets, (unsigned long long)stats.tx_bursts,
+               (unsigned long long)stats.tx_dropped);
+    }
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file bench_unix.c
+ * @brief 进程内Unix域Socket与经回环设备的TCP/UDP的对比
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 同一线程交替发送和接收：流式测量吞吐，数据报测量每秒消息数。
+ * Unix域的数据直接写入对端的接收缓冲区，TCP/UDP要构造包、计算校验和、经回环设备投递。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <assert.h>
+#include <stddef.h>
+
+#define STREAM_BYTES        (256UL * 1024 * 1024)
+#define CHUNK_SIZE          (16 * 1024)
+#define DGRAM_COUNT         200000
+#define DGRAM_SIZE          128
+#define TCP_PORT            9403
+#define UDP_PORT_A          9404
+#define UDP_PORT_B          9405
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static socklen_t unix_addr(struct mysocket_addr_un *un, const char *name) {
+    memset(un, 0, sizeof(*un));
+    un->sun_family = AF_UNIX;
+    strcpy(un->sun_path + 1, name);     /* 抽象命名空间 */
+    return (socklen_t)(offsetof(struct mysocket_addr_un, sun_path) + 1 + strlen(name));
+}
+
+/**
+ * 建立一对已连接的流式Socket
+ */
+static void stream_pair(int family, int *client, int *server) {
+    int listen_fd = mysocket_socket(family, SOCK_STREAM, 0);
+    struct mysocket_addr_in in = mysocket_make_addr("127.0.0.1", TCP_PORT);
+    struct mysocket_addr_un un;
+    struct mysocket_addr *addr = (struct mysocket_addr *)&in;
+    socklen_t len = sizeof(in);
+    if (family == AF_UNIX) {
+        len = unix_addr(&un, "bench-stream");
+        addr = (struct mysocket_addr *)&un;
+    }
+
+    assert(mysocket_bind(listen_fd, addr, len) == 0);
+    assert(mysocket_listen(listen_fd, 1) == 0);
+    *client = mysocket_socket(family, SOCK_STREAM, 0);
+    assert(mysocket_connect(*client, addr, len) == 0);
+    *server = mysocket_accept(listen_fd, NULL, NULL);
+    assert(*server >= 0);
+}
+
+/**
+ * 流式吞吐
+ * @return MB/s
+ */
+static double bench_stream(int family) {
+    int client, server;
+    assert(mysocket_init() == 0);
+    stream_pair(family, &client, &server);
+
+    static char out[CHUNK_SIZE], in[CHUNK_SIZE];
+    size_t sent = 0, received = 0;
+
+    double start = now_sec();
+    while (received < STREAM_BYTES) {
+        if (sent < STREAM_BYTES) {
+            ssize_t n = mysocket_send(client, out, sizeof(out), 0);
+            if (n > 0) sent += (size_t)n;
+        }
+        ssize_t n = mysocket_recv(server, in, sizeof(in), 0);
+        if (n > 0) received += (size_t)n;
+    }
+    double elapsed = now_sec() - start;
+
+    mysocket_cleanup();
+    return (double)STREAM_BYTES / elapsed / 1e6;
+}
+
+/**
+ * 数据报消息率
+ * @return 每秒消息数（百万）
+ */
+static double bench_dgram(int family) {
+    assert(mysocket_init() == 0);
+    int a = mysocket_socket(family, SOCK_DGRAM, 0);
+    int b = mysocket_socket(family, SOCK_DGRAM, 0);
+
+    struct mysocket_addr_in in_a = mysocket_make_addr("127.0.0.1", UDP_PORT_A);
+    struct mysocket_addr_in in_b = mysocket_make_addr("127.0.0.1", UDP_PORT_B);
+    struct mysocket_addr_un un_a, un_b;
+    struct mysocket_addr *addr_a = (struct mysocket_addr *)&in_a;
+    struct mysocket_addr *addr_b = (struct mysocket_addr *)&in_b;
+    socklen_t len_a = sizeof(in_a), len_b = sizeof(in_b);
+    if (family == AF_UNIX) {
+        len_a = unix_addr(&un_a, "bench-dgram-a");
+        len_b = unix_addr(&un_b, "bench-dgram-b");
+        addr_a = (struct mysocket_addr *)&un_a;
+        addr_b = (struct mysocket_addr *)&un_b;
+    }
+    assert(mysocket_bind(a, addr_a, len_a) == 0);
+    assert(mysocket_bind(b, addr_b, len_b) == 0);
+
+    char msg[DGRAM_SIZE] = {0};
+    char buf[DGRAM_SIZE];
+    int received = 0;
+
+    double start = now_sec();
+    for (int i = 0; i < DGRAM_COUNT; i++) {
+        mysocket_sendto(a, msg, sizeof(msg), 0, addr_b, len_b);
+        if (mysocket_recvfrom(b, buf, sizeof(buf), 0, NULL, NULL) == (ssize_t)sizeof(buf)) {
+            received++;
+        }
+    }
+    double elapsed = now_sec() - start;
+    assert(received == DGRAM_COUNT);
+
+    mysocket_cleanup();
+    return (double)DGRAM_COUNT / elapsed / 1e6;
+}
+
+int main() {
+    printf("=== 进程内Unix域Socket与回环TCP/UDP（流式%lu MB，数据报%d条×%d字节） ===\n\n",
+           STREAM_BYTES >> 20, DGRAM_COUNT, DGRAM_SIZE);
+    printf("%10s | %12s | %16s\n", "协议族", "流式MB/s", "数据报(百万条/s)");
+    printf("%10s | %12.1f | %16.2f\n", "AF_UNIX", bench_stream(AF_UNIX), bench_dgram(AF_UNIX));
+    printf("%10s | %12.1f | %16.2f\n", "AF_INET", bench_stream(AF_INET), bench_dgram(AF_INET));
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file proxy_example.c
+ * @brief 四层代理示例：用mysocket_splice在两条TCP连接之间转发数据
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 客户端、代理和后端服务器在同一个进程中：
+ *   客户端 -> 代理(9010) ==splice==> 后端(9011)
+ * 后端把收到的内容转成大写后回送，回程同样经代理splice转发。
+ * 代理不分配转发缓冲区，数据从一个Socket的接收缓冲区直接交给另一个Socket发送。
+ */
+
+#include "mysocket.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#define PROXY_PORT 9010
+#define BACKEND_PORT 9011
+#define BUFFER_SIZE 1024
+
+static struct mysocket_addr_in make_addr(uint16_t port) {
+    struct mysocket_addr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr = mysocket_inet_addr("127.0.0.1");
+    addr.sin_port = mysocket_htons(port);
+    return addr;
+}
+
+static int listen_on(uint16_t port) {
+    int fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = make_addr(port);
+    if (fd < 0 || mysocket_bind(fd, (struct mysocket_addr*)&addr, sizeof(addr)) != 0 ||
+        mysocket_listen(fd, 4) != 0) {
+        return -1;
+    }
+    return fd;
+}
+
+static int connect_to(uint16_t port) {
+    int fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = make_addr(port);
+    if (fd < 0 || mysocket_connect(fd, (struct mysocket_addr*)&addr, sizeof(addr)) != 0) {
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * 代理转发一轮：两个方向各搬运一次
+ * @return 本轮搬运的字节数
+ */
+static ssize_t proxy_pump(int front, int back) {
+    ssize_t total = 0;
+    ssize_t n = mysocket_splice(front, back, BUFFER_SIZE * 64, 0);
+    if (n > 0) total += n;
+    n = mysocket_splice(back, front, BUFFER_SIZE * 64, 0);
+    if (n > 0) total += n;
+    return total;
+}
+
+int main() {
+    printf("=== MySocket 四层代理示例（splice） ===\n\n");
+
+    if (mysocket_init() != 0) {
+        printf("Socket系统初始化失败\n");
+        return 1;
+    }
+
+    int backend_listen = listen_on(BACKEND_PORT);
+    int proxy_listen = listen_on(PROXY_PORT);
+    if (backend_listen < 0 || proxy_listen < 0) {
+        printf("创建监听Socket失败\n");
+        mysocket_cleanup();
+        return 1;
+    }
+
+    /* 客户端连接代理，代理再连接后端 */
+    int client = connect_to(PROXY_PORT);
+    int front = mysocket_accept(proxy_listen, NULL, NULL);
+    int back = connect_to(BACKEND_PORT);
+    int backend = mysocket_accept(backend_listen, NULL, NULL);
+    if (client < 0 || front < 0 || back < 0 || backend < 0) {
+        printf("建立连接失败\n");
+        mysocket_cleanup();
+        return 1;
+    }
+    printf("连接建立: 客户端 -> 代理:%d -> 后端:%d\n\n", PROXY_PORT, BACKEND_PORT);
+
+    const char *messages[] = {
+        "hello through the proxy",
+        "splice moves data without a user buffer",
+        "bye"
+    };
+    int count = sizeof(messages) / sizeof(messages[0]);
+
+    char buffer[BUFFER_SIZE];
+    ssize_t proxied = 0;
+    for (int i = 0; i < count; i++) {
+        printf("客户端发送: %s\n", messages[i]);
+        mysocket_send(client, messages[i], strlen(messages[i]), 0);
+
+        /* 代理转发到后端，后端转成大写回送 */
+        proxied += proxy_pump(front, back);
+        ssize_t n = mysocket_recv(backend, buffer, sizeof(buffer) - 1, 0);
+        if (n <= 0) {
+            printf("后端未收到数据\n");
+            continue;
+        }
+        for (ssize_t j = 0; j < n; j++) {
+            buffer[j] = (char)toupper((unsigned char)buffer[j]);
+        }
+        mysocket_send(backend, buffer, (size_t)n, 0);
+
+        /* 代理把回应转发给客户端 */
+        proxied += proxy_pump(front, back);
+        n = mysocket_recv(client, buffer, sizeof(buffer) - 1, 0);
+        if (n > 0) {
+            buffer[n] = '\0';
+            printf("客户端收到: %s\n\n", buffer);
+        } else {
+            printf("客户端未收到回应\n\n");
+        }
+    }
+
+    printf("代理共转发 %zd 字节\n", proxied);
+
+    mysocket_close(client);
+    mysocket_close(front);
+    mysocket_close(back);
+    mysocket_close(backend);
+    mysocket_close(proxy_listen);
+    mysocket_close(backend_listen);
+    mysocket_cleanup();
+
+    printf("\n=== 示例结束 ===\n");
+    return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file sniffer_example.c
+ * @brief 抓包示例：用SOCK_RAW旁听一条TCP连接上的报文段
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 先打开原始套接字，再建立连接并收发几条消息，最后逐个读出旁听到的IP帧，
+ * 按线格式解析IP头和TCP头后打印，类似tcpdump的一行摘要。
+ */
+
+#include "mysocket.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SERVER_PORT 9012
+#define FRAME_SIZE 2048
+
+static uint16_t get16(const unsigned char *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * 打印一帧的摘要：端口、标志、序列号、确认号、负载长度
+ */
+static void print_frame(int index, const unsigned char *frame, ssize_t len) {
+    size_t ip_hlen = (size_t)(frame[0] & 0x0F) * 4;
+    size_t total_len = get16(frame + 2);
+    const unsigned char *tcp = frame + ip_hlen;
+    size_t tcp_hlen = (size_t)(tcp[12] >> 4) * 4;
+    uint8_t flags = tcp[13];
+
+    char flag_str[8];
+    int n = 0;
+    if (flags & 0x02) flag_str[n++] = 'S';
+    if (flags & 0x01) flag_str[n++] = 'F';
+    if (flags & 0x04) flag_str[n++] = 'R';
+    if (flags & 0x08) flag_str[n++] = 'P';
+    if (flags & 0x10) flag_str[n++] = '.';
+    flag_str[n] = '\0';
+
+    printf("%2d  %5u > %-5u [%-3s] seq=%-10u ack=%-10u win=%-5u len=%zu (帧%zd字节)\n",
+           index, get16(tcp), get16(tcp + 2), flag_str, get32(tcp + 4), get32(tcp + 8),
+           get16(tcp + 14), total_len - ip_hlen - tcp_hlen, len);
+}
+
+int main() {
+    printf("=== MySocket 抓包示例（SOCK_RAW） ===\n\n");
+
+    if (mysocket_init() != 0) {
+        printf("Socket系统初始化失败\n");
+        return 1;
+    }
+
+    /* 旁听所有TCP报文段 */
+    int sniffer = mysocket_socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+    if (sniffer < 0) {
+        printf("创建原始套接字失败\n");
+        mysocket_cleanup();
+        return 1;
+    }
+
+    struct mysocket_addr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr = mysocket_inet_addr("127.0.0.1");
+    addr.sin_port = mysocket_htons(SERVER_PORT);
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int client = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) != 0 ||
+        mysocket_listen(listen_fd, 1) != 0 ||
+        mysocket_connect(client, (struct mysocket_addr*)&addr, sizeof(addr)) != 0) {
+        printf("建立连接失败\n");
+        mysocket_cleanup();
+        return 1;
+    }
+    int server = mysocket_accept(listen_fd, NULL, NULL);
+
+    const char *messages[] = { "GET / HTTP/1.0\r\n\r\n", "HTTP/1.0 200 OK\r\n\r\nhello" };
+    char buffer[256];
+    mysocket_send(client, messages[0], strlen(messages[0]), 0);
+    mysocket_recv(server, buffer, sizeof(buffer), 0);
+    mysocket_send(server, messages[1], strlen(messages[1]), 0);
+    mysocket_recv(client, buffer, sizeof(buffer), 0);
+
+    /* 读出旁听到的帧 */
+    unsigned char frame[FRAME_SIZE];
+    ssize_t len;
+    int count = 0;
+    while ((len = mysocket_recv(sniffer, frame, sizeof(frame), 0)) > 0) {
+        print_frame(++count, frame, len);
+    }
+    printf("\n共旁听到 %d 个报文段\n", count);
+
+    mysocket_close(client);
+    mysocket_close(server);
+    mysocket_close(listen_fd);
+    mysocket_close(sniffer);
+    mysocket_cleanup();
+
+    printf("\n=== 示例结束 ===\n");
+    return 0;
+}
@@ -71,12 +71,114 @@ struct mysocket_addr_in {
     char sin_zero[8];           /* 填充字节 */
 };
 
+/* Unix域地址结构（与Linux相同：sun_path首字节为0表示抽象命名空间，名字长度由addrlen决定） */
+#define MYSOCKET_UNIX_PATH_MAX  108
+struct mysocket_addr_un {
+    uint16_t sun_family;        /* 地址族 AF_UNIX */
+    char sun_path[MYSOCKET_UNIX_PATH_MAX]; /* 路径 */
+};
+
 /* 通用地址结构 */
 struct mysocket_addr {
     uint16_t sa_family;         /* 地址族 */
     char sa_data[14];           /* 地址数据 */
 };
 
+/* TCP连接控制块（内部结构，定义见socket_internal.h） */
+struct connection_cb;
+
+/* Unix域Socket的私有数据（内部结构，定义见socket_internal.h） */
+struct unix_sock;
+
+/* 原始套接字的旁听队列（内部结构，定义见socket_internal.h） */
+struct raw_sock;
+
+/* 预解码的BPF过滤器（内部结构，定义见socket_internal.h） */
+struct sk_filter;
+
+/* 监听Socket的访问控制（内部结构，定义见socket_internal.h） */
+struct listen_acl;
+
+/* 按源地址的令牌桶表（内部结构，定义见socket_internal.h） */
+struct rate_limit;
+
+/* 经典BPF指令和程序，布局与Linux的struct sock_filter/struct sock_fprog相同 */
+struct mysocket_sock_filter {
+    uint16_t code;              /* 操作码 */
+    uint8_t jt;                 /* 条件成立时向前跳过的指令数 */
+    uint8_t jf;                 /* 条件不成立时向前跳过的指令数 */
+    uint32_t k;                 /* 常数 */
+};
+
+struct mysocket_sock_fprog {
+    unsigned short len;         /* 指令数 */
+    struct mysocket_sock_filter *filter;
+};
+
+/* BPF操作码（与linux/bpf_common.h相同） */
+#define BPF_CLASS(code) ((code) & 0x07)
+#define BPF_LD          0x00
+#define BPF_LDX         0x01
+#define BPF_ST          0x02
+#define BPF_STX         0x03
+#define BPF_ALU         0x04
+#define BPF_JMP         0x05
+#define BPF_RET         0x06
+#define BPF_MISC        0x07
+
+#define BPF_SIZE(code)  ((code) & 0x18)
+#define BPF_W           0x00
+#define BPF_H           0x08
+#define BPF_B           0x10
+
+#define BPF_MODE(code)  ((code) & 0xe0)
+#define BPF_IMM         0x00
+#define BPF_ABS         0x20
+#define BPF_IND         0x40
+#define BPF_MEM         0x60
+#define BPF_LEN         0x80
+#define BPF_MSH         0xa0
+
+#define BPF_OP(code)    ((code) & 0xf0)
+#define BPF_ADD         0x00
+#define BPF_SUB         0x10
+#define BPF_MUL         0x20
+#define BPF_DIV         0x30
+#define BPF_OR          0x40
+#define BPF_AND         0x50
+#define BPF_LSH         0x60
+#define BPF_RSH         0x70
+#define BPF_NEG         0x80
+#define BPF_MOD         0x90
+#define BPF_XOR         0xa0
+
+#define BPF_JA          0x00
+#define BPF_JEQ         0x10
+#define BPF_JGT         0x20
+#define BPF_JGE         0x30
+#define BPF_JSET        0x40
+
+#define BPF_SRC(code)   ((code) & 0x08)
+#define BPF_K           0x00
+#define BPF_X           0x08
+
+#define BPF_RVAL(code)  ((code) & 0x18)
+#define BPF_A           0x10
+
+#define BPF_MISCOP(code) ((code) & 0xf8)
+#define BPF_TAX         0x00
+#define BPF_TXA         0x80
+
+#define BPF_MAXINSNS    4096
+#define BPF_MEMWORDS    16
+
+#ifndef BPF_STMT
+#define BPF_STMT(code, k) { (uint16_t)(code), 0, 0, k }
+#endif
+#ifndef BPF_JUMP
+#define BPF_JUMP(code, k, jt, jf) { (uint16_t)(code), jt, jf, k }
+#endif
+
 /* Socket结构体 - 模仿Linux内核的socket结构 */
 struct mysocket {
     int fd;                     /* 文件描述符 */
@@ -103,6 +205,31 @@ struct mysocket {
     int listen_backlog;         /* 最大监听数量 */
     int listen_count;           /* 当前连接数量 */
     
+    /* TCP连接控制块（仅TCP Socket） */
+    struct connection_cb *conn;
+    
+    /* Unix域地址和对端（仅AF_UNIX Socket） */
+    struct unix_sock *unix_sk;
+    
+    /* 旁听队列和协议号（仅SOCK_RAW Socket） */
+    struct raw_sock *raw_sk;
+    
+    /* mysocket_attach_filter挂上的BPF过滤器，NULL表示不过滤 */
+    struct sk_filter *filter;
+    
+    /* 访问控制：监听Socket自己的规则；子Socket为计入其连接数的监听Socket的规则 */
+    struct listen_acl *acl;
+    
+    /* 按源地址限速（监听Socket限制SYN，UDP Socket限制数据报），NULL表示不限 */
+    struct rate_limit *rate_limit;
+    
+    /* 接收环（异步投递时首次投递创建） */
+    struct packet_ring *rx_ring;
+    int rx_producers;           /* 正在向接收环投递的线程数 */
+    
+    /* 内核直通后端的真实套接字，-1表示使用本项目的协议栈 */
+    int host_fd;
+    
     /* 链表指针（用于管理所有socket） */
     struct mysocket *next;
 };
@@ -112,6 +239,7 @@ struct socket_manager {
     struct mysocket *socket_list;    /* Socket链表头 */
     int next_fd;                     /* 下一个可用文件描述符 */
     int total_sockets;               /* 总Socket数量 */
+    uint32_t generation;             /* 链表变化时递增，使缓存的查找结果失效 */
 };
 
 /* 错误码定义 */
@@ -122,6 +250,7 @@ struct socket_manager {
 #define MYSOCKET_EADDRINUSE     -4
 #define MYSOCKET_ECONNREFUSED   -5
 #define MYSOCKET_ETIMEDOUT      -6
+#define MYSOCKET_ENOMEM         -7
 
 /* 函数声明 */
 
@@ -131,6 +260,7 @@ void mysocket_cleanup(void);
 
 /* 基本Socket操作 */
 int mysocket_socket(int domain, int type, int protocol);
+int mysocket_socketpair(int domain, int type, int protocol, int sv[2]);
 int mysocket_bind(int sockfd, const struct mysocket_addr *addr, socklen_t addrlen);
 int mysocket_listen(int sockfd, int backlog);
 int mysocket_accept(int sockfd, struct mysocket_addr *addr, socklen_t *addrlen);
@@ -144,10 +274,28 @@ ssize_t mysocket_sendto(int sockfd, const void *buf, size_t len, int flags,
                        const struct mysocket_addr *dest_addr, socklen_t addrlen);
 ssize_t mysocket_recvfrom(int sockfd, void *buf, size_t len, int flags,
                          struct mysocket_addr *src_addr, socklen_t *addrlen);
+ssize_t mysocket_splice(int fd_in, int fd_out, size_t len, int flags);
+ssize_t mysocket_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+
+/* 套接字过滤器（类似SO_ATTACH_FILTER/SO_DETACH_FILTER） */
+int mysocket_attach_filter(int sockfd, const struct mysocket_sock_fprog *fprog);
+int mysocket_detach_filter(int sockfd);
+
+/* 监听Socket的访问控制：CIDR前缀允许/拒绝（最长前缀优先），每个源地址的连接数上限 */
+#define MYSOCKET_ACL_DENY       0
+#define MYSOCKET_ACL_ALLOW      1
+int mysocket_acl_add(int sockfd, const char *cidr, int action);
+int mysocket_acl_default(int sockfd, int action);
+int mysocket_acl_limit(int sockfd, unsigned int max_per_source);
+int mysocket_acl_clear(int sockfd);
+
+/* 按源地址的令牌桶限速：每秒rate个SYN/数据报，突发burst个 */
+int mysocket_rate_limit(int sockfd, unsigned int rate, unsigned int burst);
 
 /* 辅助函数 */
 const char* mysocket_strerror(int error_code);
 void mysocket_print_socket_info(int sockfd);
+void mysocket_print_mem_stats(void);
 int mysocket_set_nonblocking(int sockfd);
 int mysocket_get_socket_state(int sockfd);
 
@@ -32,6 +32,25 @@
 #define DEFAULT_RECV_BUFFER_SIZE    8192
 #define DEFAULT_LISTEN_BACKLOG      128
 
+/* TCP参数 */
+#define TCP_DEFAULT_MSS             1460    /* 默认最大报文段长度 */
+#define TCP_RTO_INIT_MS             1000    /* 初始重传超时 */
+#define TCP_RTO_MIN_MS              200     /* 最小重传超时 */
+#define TCP_RTO_MAX_MS              60000   /* 最大重传超时 */
+#define TCP_DUPACK_THRESHOLD        3       /* 快速重传的重复ACK阈值 */
+#define TCP_MAX_SACK_BLOCKS         4       /* 单个ACK携带的SACK块上限 */
+#define TCP_SCOREBOARD_SIZE         32      /* 发送端记分板最多记录的区间数 */
+#define TCP_MAX_WSCALE              14      /* 窗口扩大因子上限（RFC 7323） */
+#define TCP_MAX_RECV_BUFFER_SIZE    (6 * 1024 * 1024)  /* 接收缓冲区自动增长上限 */
+#define TCP_MAX_SEND_BUFFER_SIZE    (4 * 1024 * 1024)  /* 发送缓冲区自动增长上限 */
+#define TCP_BUFFER_IDLE_MS          1000    /* 空闲超过该时间的连接可被收缩缓冲区 */
+#define TCP_PRESSURE_WINDOW         (4 * TCP_DEFAULT_MSS)  /* 内存压力下通告窗口的上限 */
+#define TCP_CONNECT_TIMEOUT_MS      3000    /* 异步投递时connect等待握手完成的时间 */
+
+/* 序列号比较（处理32位回绕） */
+#define tcp_seq_before(a, b)    ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+#define tcp_seq_after(a, b)     tcp_seq_before(b, a)
+
 /* TCP包头结构（简化版） */
 struct tcp_header {
     uint16_t src_port;          /* 源端口 */
@@ -52,6 +71,28 @@ struct tcp_header {
 #define TCP_FLAG_ACK    0x10
 #define TCP_FLAG_URG    0x20
 
+/* SACK块（主机字节序，区间为[start_seq, end_seq)） */
+struct tcp_sack_block {
+    uint32_t start_seq;
+    uint32_t end_seq;
+};
+
+/* TCP选项（解析后的形式） */
+struct tcp_options {
+    uint8_t sack_permitted;     /* SYN中携带SACK-Permitted */
+    uint8_t wscale_ok;          /* SYN中携带窗口扩大选项 */
+    uint8_t wscale;             /* 窗口扩大因子 */
+    uint8_t num_sacks;          /* SACK块数量 */
+    struct tcp_sack_block sacks[TCP_MAX_SACK_BLOCKS];
+};
+
+/* 发送端SACK记分板：按序列号排序、互不重叠的已SACK区间 */
+struct tcp_scoreboard {
+    struct tcp_sack_block ranges[TCP_SCOREBOARD_SIZE];
+    int count;                  /* 有效区间数 */
+    uint32_t high_sacked;       /* 已SACK的最高序列号（count>0时有效） */
+};
+
 /* IP包头结构（简化版） */
 struct ip_header {
     uint8_t version_ihl;        /* 版本和头长度 */
@@ -66,41 +107,449 @@ struct ip_header {
     uint32_t dst_addr;          /* 目标地址 */
 };
 
+/* 线格式（packet_wire.c） */
+#define IP_WIRE_HDR_LEN         20      /* 不带选项的IPv4头 */
+#define TCP_WIRE_HDR_LEN        20      /* 不带选项的TCP头 */
+#define TCP_WIRE_MAX_OPT_LEN    40      /* TCP选项空间上限 */
+#define UDP_WIRE_HDR_LEN        8
+#define PACKET_WIRE_MAX_HDR     (IP_WIRE_HDR_LEN + TCP_WIRE_HDR_LEN + TCP_WIRE_MAX_OPT_LEN)
+
+/* TCP选项类型和长度 */
+#define TCPOPT_EOL              0
+#define TCPOPT_NOP              1
+#define TCPOPT_MSS              2
+#define TCPOPT_WINDOW           3
+#define TCPOPT_SACK_PERM        4
+#define TCPOPT_SACK             5
+#define TCPOLEN_MSS             4
+#define TCPOLEN_WINDOW          3
+#define TCPOLEN_SACK_PERM       2
+
+/* 帧的解析结果：指针指向原始帧，地址和端口为网络字节序 */
+struct packet_wire_info {
+    const uint8_t *ip;          /* IP头 */
+    const uint8_t *l4;          /* TCP/UDP头 */
+    const uint8_t *options;     /* TCP选项 */
+    const uint8_t *payload;     /* 负载 */
+    size_t ip_len;              /* IP总长度 */
+    size_t l4_hlen;             /* 传输层头长度（含选项） */
+    size_t opt_len;             /* TCP选项长度 */
+    size_t payload_len;         /* 负载长度 */
+    uint8_t protocol;           /* IPPROTO_TCP或IPPROTO_UDP */
+    uint8_t tcp_flags;          /* TCP标志 */
+    uint32_t src_addr;
+    uint32_t dst_addr;
+    uint16_t src_port;
+    uint16_t dst_port;
+    struct tcp_options tcp_opt; /* 解析后的TCP选项 */
+};
+
+/* 报文段标志（用于重传队列） */
+#define TCP_SEG_RETRANS     0x01    /* 本轮恢复中已重传过 */
+
+/* 数据包缓冲区布局（类似sk_buff）：包结构后紧跟缓冲区，缓冲区开头预留包头空间 */
+#define PACKET_HEADROOM         128                 /* 为序列化IP/TCP头（含选项）预留 */
+#define PACKET_INLINE_SIZE      TCP_DEFAULT_MSS     /* 对象池中包的数据区大小 */
+#define PACKET_POOL_MAX_CACHED  512                 /* 每线程每类最多缓存的空闲包数 */
+
+/* 对象池类别 */
+#define PACKET_POOL_FULL        0       /* 带PACKET_HEADROOM + PACKET_INLINE_SIZE缓冲区的包 */
+#define PACKET_POOL_CLONE       1       /* 不带缓冲区的克隆头 */
+#define PACKET_POOL_CLASSES     2
+#define PACKET_POOL_NONE        0xFF    /* 超大缓冲区，直接释放不缓存 */
+
+/* 数据包校验和状态（类似sk_buff的ip_summed） */
+#define PACKET_CSUM_NONE        0   /* 校验和由软件填好，接收端需要校验 */
+#define PACKET_CSUM_PARTIAL     1   /* 校验和卸载未计算，受信任的本地回环上视为正确 */
+#define PACKET_CSUM_UNNECESSARY 2   /* 接收端已校验 */
+
+/* 外部缓冲区：负载位于包以外的内存（如sendfile映射的文件页），最后一个引用释放时调用release */
+struct packet_extbuf {
+    int refcnt;
+    void (*release)(struct packet_extbuf *ext);
+};
+
 /* 数据包结构 */
 struct packet {
     struct ip_header ip_hdr;
     struct tcp_header tcp_hdr;
-    char *data;
-    size_t data_len;
+    struct tcp_options tcp_opt; /* TCP选项 */
+    char *data;                 /* 有效数据起始 */
+    size_t data_len;            /* 有效数据长度 */
     struct packet *next;        /* 链表指针 */
+    
+    /* TCP控制信息（类似Linux的TCP_SKB_CB，主机字节序） */
+    uint32_t seq;               /* 起始序列号 */
+    uint32_t end_seq;           /* 结束序列号（不含） */
+    uint64_t sent_time;         /* 最后一次发送时间（毫秒） */
+    uint8_t seg_flags;          /* 报文段标志 */
+    uint8_t ip_summed;          /* 校验和状态（PACKET_CSUM_*） */
+    struct netdev *dev;         /* 出口设备（TCP取自连接的路由缓存），NULL时发送前查路由表 */
+
+    /* 缓冲区管理：[head, end)为缓冲区，克隆与原始包共享同一缓冲区 */
+    char *head;                 /* 缓冲区起始 */
+    char *end;                  /* 缓冲区结束 */
+    struct packet *owner;       /* 缓冲区所在的包（自身或被克隆的包） */
+    int dataref;                /* 缓冲区引用计数，只在owner上有效 */
+    struct packet_extbuf *extbuf; /* 缓冲区是外部内存时指向它（只读），只在owner上有效 */
+    size_t truesize;            /* 内存记账大小，创建后不变 */
+    uint8_t pool_class;         /* 对象池类别 */
+    char buf[];                 /* 缓冲区（克隆头没有） */
+};
+
+/* 每Socket接收环（packet_queue.c） */
+#define PACKET_RX_RING_SIZE     512     /* 槽数，必须是2的幂 */
+#define PACKET_CACHELINE_SIZE   64
+
+struct packet_ring_slot {
+    size_t seq;                 /* 槽序号：等于位置时可写，等于位置+1时可读 */
+    struct packet *pkt;
+};
+
+struct packet_ring {
+    size_t tail __attribute__((aligned(PACKET_CACHELINE_SIZE)));   /* 生产者争夺的写位置 */
+    uint64_t drops;             /* 环满丢弃的包数 */
+    size_t head __attribute__((aligned(PACKET_CACHELINE_SIZE)));   /* 消费者独占的读位置 */
+    struct packet_ring_slot slots[PACKET_RX_RING_SIZE] __attribute__((aligned(PACKET_CACHELINE_SIZE)));
+};
+
+/* 每线程发送队列（packet_queue.c） */
+#define PACKET_TX_BATCH         32      /* 发送队列满一批时刷新 */
+
+/* 目标Socket查找缓存：批量投递时连续发往同一四元组的包只查找一次 */
+struct packet_dst_cache {
+    int valid;
+    uint32_t generation;        /* 查找时的Socket链表版本 */
+    uint8_t protocol;
+    uint32_t src_addr;
+    uint32_t dst_addr;
+    uint16_t src_port;
+    uint16_t dst_port;
+    struct mysocket *target;
+    uint64_t hits;              /* 复用查找结果的次数 */
+};
+
+/* 发送队列统计（每线程） */
+struct packet_tx_stats {
+    uint64_t batches;           /* 刷新的批次数 */
+    uint64_t packets;           /* 经发送队列发出的包数 */
+    uint64_t errors;            /* 投递失败的包数 */
+};
+
+/* 虚拟网卡（netdev.c） */
+#define NETDEV_MIN_MTU          576     /* 不小于IPv4最小重组长度，保证放得下最长的线格式头 */
+#define NETDEV_MAX_MTU          65535
+#define NETDEV_POLL_BUDGET      64      /* socket_rx_process每次从设备收取的包数上限 */
+
+/* 设备能力（类似netdev features） */
+#define NETDEV_F_HW_CSUM        0x01    /* 发送时由设备填写校验和，可以交给它PACKET_CSUM_PARTIAL的包 */
+#define NETDEV_F_RXCSUM         0x02    /* 接收时设备已校验，上交的包不必再算 */
+
+struct netdev;
+
+/* 驱动接口：收发都按批进行，包的所有权不转移（发送时驱动需要保留就自己克隆） */
+struct netdev_ops {
+    const char *name;
+    int (*open)(struct netdev *dev, const char *arg);
+    void (*close)(struct netdev *dev);
+    int (*tx_burst)(struct netdev *dev, struct packet **pkts, int n);   /* 返回发出的包数 */
+    int (*rx_burst)(struct netdev *dev, struct packet **pkts, int n);   /* 返回收到的包数，可为NULL */
+    int (*wait)(struct netdev *dev, int timeout_ms);    /* 睡眠到有包可收或超时，可为NULL */
+};
+
+/* 设备统计 */
+struct netdev_stats {
+    uint64_t tx_packets;
+    uint64_t tx_bytes;          /* 交给驱动的线格式字节数 */
+    uint64_t tx_bursts;
+    uint64_t tx_dropped;        /* 超过MTU或驱动未能发出的包 */
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t rx_bursts;
+    uint64_t rx_dropped;        /* 驱动丢弃的畸形帧 */
+    uint64_t lookup_hits;       /* 回环：同一批中复用目标查找结果的次数 */
+    uint64_t doorbells;         /* 共享内存：对端睡眠时唤醒它的次数 */
+};
+
+struct netdev {
+    const struct netdev_ops *ops;
+    uint32_t mtu;               /* 线格式IP包的最大长度 */
+    uint32_t features;          /* NETDEV_F_* */
+    void *priv;                 /* 驱动私有数据 */
+    struct netdev_stats stats;
+};
+
+/* 数据包对象池统计（每线程） */
+struct packet_pool_stats {
+    uint64_t allocs;            /* 分配的包数（含克隆头） */
+    uint64_t clones;            /* 共享缓冲区的克隆数 */
+    uint64_t pool_hits;         /* 从空闲链表取得的次数 */
+    uint64_t heap_allocs;       /* 堆分配次数 */
+    size_t cached;              /* 当前缓存的空闲包数 */
+};
+
+/* 连接的包头模板：四元组确定后不变的IP/TCP头字段 */
+struct tcp_hdr_template {
+    struct ip_header ip_hdr;    /* 版本、TTL、协议、源/目标地址 */
+    struct tcp_header tcp_hdr;  /* 源/目标端口 */
+    uint32_t pseudo_sum;        /* 伪首部部分和（地址和协议，不含长度，未折叠） */
 };
 
 /* 连接控制块（类似Linux内核的sock结构） */
 struct connection_cb {
     struct mysocket *sock;      /* 关联的socket */
+    uint32_t iss;              /* 初始发送序列号 */
+    uint32_t irs;              /* 初始接收序列号 */
     uint32_t snd_una;          /* 发送未确认序列号 */
     uint32_t snd_nxt;          /* 发送下一个序列号 */
     uint32_t snd_wnd;          /* 发送窗口 */
     uint32_t rcv_nxt;          /* 接收下一个序列号 */
-    uint32_t rcv_wnd;          /* 接收窗口 */
+    uint32_t rcv_wnd;          /* 最近一次通告的接收窗口（字节） */
+    uint32_t rcv_wup;          /* 最近一次通告窗口时的rcv_nxt，rcv_wup+rcv_wnd是通告过的右边沿 */
+    uint32_t rcv_clamp;        /* 非0时新空间最多通告到这么大（等待收缩空闲的接收缓冲区） */
+    
+    /* 包头模板（首次发包时根据四元组生成） */
+    struct tcp_hdr_template hdr_tmpl;
+    int hdr_tmpl_valid;
+    
+    /* 路由缓存（首次发包时查找，路由表或当前设备变化后重新查找） */
+    struct netdev *route_dev;
+    uint32_t route_gen;
+    
+    /* 窗口扩大 */
+    int wscale_ok;              /* 双方均支持窗口扩大 */
+    uint8_t snd_wscale;         /* 对端通告窗口的扩大因子 */
+    uint8_t rcv_wscale;         /* 本端通告窗口的扩大因子 */
+    
+    /* 接收缓冲区自动调整（类似Linux的tcp_rcv_space_adjust） */
+    uint32_t copied_seq;        /* 应用层已读取的字节计数 */
+    uint32_t rcvq_space;        /* 上一个RTT内应用读取的字节数 */
+    uint32_t rcvq_seq;          /* 本轮测量开始时的copied_seq */
+    uint64_t rcvq_time;         /* 本轮测量开始时间 */
+    uint32_t rcv_rtt_ms;        /* 接收端估计的RTT */
+    uint32_t rcv_rtt_seq;       /* RTT测量的目标序列号 */
+    uint64_t rcv_rtt_time;      /* RTT测量开始时间 */
+    int in_output;              /* 正在刷新发送缓冲区（防止重入） */
+    
+    /* 发送缓冲区自动调整 */
+    uint32_t sndq_seq;          /* 本轮测量开始时的snd_una */
+    uint64_t sndq_time;         /* 本轮测量开始时间 */
+    int snd_buf_limited;        /* 本轮内发送受发送缓冲区限制（而非对端窗口） */
+    uint64_t last_active;       /* 最近一次收发的时间，用于判断空闲 */
+    int shrink_pending;         /* 有回收请求，由本Socket的线程在socket_rx_process中收缩 */
+    
+    /* SACK */
+    int sack_ok;                /* 双方均支持SACK */
+    struct tcp_sack_block sack_blocks[TCP_MAX_SACK_BLOCKS]; /* 待通告的SACK块 */
+    int num_sacks;              /* 待通告的SACK块数量 */
+    struct packet *ooo_queue;   /* 乱序接收队列（按序列号排序） */
+    size_t ooo_bytes;           /* 乱序队列中的数据字节数 */
+    struct tcp_scoreboard scoreboard; /* 发送端记分板 */
     
     /* 重传机制 */
-    struct packet *retrans_queue; /* 重传队列 */
-    time_t last_ack_time;       /* 最后ACK时间 */
-    int retrans_count;          /* 重传次数 */
+    struct packet *retrans_queue; /* 重传队列（已发送未确认，按序列号排序） */
+    struct packet *retrans_tail;  /* 重传队列尾部，大窗口下追加为O(1) */
+    uint64_t last_ack_time;     /* 最后ACK时间（毫秒） */
+    int retrans_count;          /* 连续超时重传次数 */
+    int dupacks;                /* 重复ACK计数 */
+    int in_recovery;            /* 是否处于快速恢复 */
+    uint32_t recovery_point;    /* 进入恢复时的snd_nxt */
+    uint32_t srtt_ms;           /* 平滑RTT */
+    uint32_t rttvar_ms;         /* RTT偏差 */
+    uint32_t rto_ms;            /* 当前重传超时 */
+    
+    /* 统计 */
+    uint64_t retrans_segs;      /* 重传报文段数 */
+    uint64_t retrans_bytes;     /* 重传字节数 */
+    uint64_t csum_errors;       /* 校验和错误丢弃的段数 */
+    
+    /* 融合复制校验时已暂存到接收缓冲区空闲处的数据 */
+    const char *csum_staged_src; /* 来源（包中的数据） */
+    const char *csum_staged_dst; /* 暂存位置，接收缓冲区变化后失效 */
+    size_t csum_staged_len;
+};
+
+/* Unix域Socket：按路径查找，数据直接写入对端的接收缓冲区，不经过IP/TCP */
+struct unix_sock {
+    struct mysocket *sock;      /* 所属Socket */
+    char path[MYSOCKET_UNIX_PATH_MAX]; /* 绑定的名字（抽象命名空间以0字节开头） */
+    size_t path_len;            /* 名字长度，0表示未绑定 */
+    struct unix_sock *hash_next; /* 路径表链 */
+    
+    /* 已连接的对端Socket（流式，或socketpair创建的数据报），对端关闭后为NULL */
+    struct mysocket *peer;
+    int peer_closed;            /* 对端已关闭，读完接收缓冲区后返回0 */
+    
+    /* 数据报：connect设置的默认目标 */
+    char peer_path[MYSOCKET_UNIX_PATH_MAX];
+    size_t peer_path_len;
+    
+    pthread_mutex_t lock;       /* 保护接收缓冲区（发送方直接写入） */
+};
+
+/* 原始套接字：接收经packet_send发出的包的克隆（共享缓冲区），可以注入IP帧 */
+struct raw_sock {
+    struct mysocket *sock;      /* 所属Socket */
+    int protocol;               /* 匹配的IP协议号，0表示所有协议 */
+    struct packet *queue;       /* 接收队列（按发出顺序） */
+    struct packet *queue_tail;
+    size_t queued;              /* 队列中包的truesize之和 */
+    size_t rcvbuf;              /* 队列上限 */
+    uint64_t packets;           /* 入队的包数 */
+    uint64_t drops;             /* 队列满丢弃的包数 */
+    struct raw_sock *next;      /* 原始套接字链表 */
+    pthread_mutex_t lock;       /* 保护接收队列 */
+};
+
+/* 预解码的BPF指令（socket_filter.c）：code展开为连续的操作编号，运行时一个switch分派 */
+struct sk_filter_insn {
+    uint8_t op;                 /* 操作编号 */
+    uint8_t jt;                 /* 条件成立时向前跳过的指令数 */
+    uint8_t jf;                 /* 条件不成立时向前跳过的指令数 */
+    uint32_t k;                 /* 常数 */
+};
+
+/* 挂在Socket上的过滤器：已校验，运行时不再检查跳转和下标 */
+struct sk_filter {
+    uint32_t len;               /* 指令数 */
+    uint64_t runs;              /* 运行次数 */
+    uint64_t drops;             /* 返回0（丢弃）的次数 */
+    struct sk_filter_insn insns[];
+};
+
+/* 最长前缀匹配的二叉前缀树（lpm_trie.c）：节点放在一个数组里，子节点用下标引用 */
+#define LPM_NONE    (-1)        /* 节点不是前缀终点 / 没有匹配 */
+
+struct lpm_node {
+    uint32_t child[2];          /* 子节点下标，0表示没有（0号是根） */
+    int32_t value;              /* 终止于该节点的前缀的值，LPM_NONE表示不是前缀终点 */
+};
+
+struct lpm_trie {
+    struct lpm_node *nodes;
+    uint32_t count;             /* 已用节点数 */
+    uint32_t capacity;          /* 数组容量 */
+    uint32_t prefixes;          /* 前缀数 */
+};
+
+/* 每个源地址的连接数（开放寻址哈希表的槽，count为0表示空槽） */
+struct listen_acl_source {
+    uint32_t addr;              /* 源地址（网络字节序） */
+    uint32_t count;             /* 计数中的连接数 */
+};
+
+/* 监听Socket的访问控制（socket_acl.c）：SYN到达时、分配子Socket之前检查 */
+struct listen_acl {
+    struct lpm_trie rules;      /* 前缀 -> MYSOCKET_ACL_ALLOW/MYSOCKET_ACL_DENY */
+    int default_action;         /* 没有前缀匹配时的动作 */
+    uint32_t max_per_source;    /* 每个源地址的连接数上限，0表示不限 */
+    struct listen_acl_source *sources; /* 线性探测的哈希表，大小为2的幂 */
+    uint32_t source_mask;       /* 表大小-1 */
+    uint32_t source_used;       /* 非空槽数 */
+    uint64_t denied;            /* 被前缀规则拒绝的SYN */
+    uint64_t limited;           /* 超过每源上限被拒绝的SYN */
+    struct mysocket *listener;  /* 所属监听Socket，关闭后为NULL */
+    int refcnt;                 /* 监听Socket和计数中的子Socket各持有一个引用 */
+    pthread_mutex_t lock;
+};
+
+/* 路由（route.c）：同一前缀可以有多条路由，按metric从小到大链接，前缀树指向链首 */
+struct route_entry {
+    uint32_t prefix;            /* 前缀（主机字节序，长度以外的位为0） */
+    int prefix_len;
+    uint32_t gateway;           /* 下一跳（网络字节序），0表示直连 */
+    struct netdev *dev;         /* 出口设备 */
+    int metric;                 /* 越小越优先 */
+    int32_t next;               /* 同一前缀的下一条路由，LPM_NONE表示没有 */
+};
+
+/* 按源地址的令牌桶（socket_ratelimit.c）：固定大小的组相联表，组满时淘汰令牌最多的桶 */
+#define RATE_LIMIT_SETS     256         /* 组数（2的幂） */
+#define RATE_LIMIT_WAYS     4           /* 每组的桶数 */
+
+struct rate_bucket {
+    uint32_t addr;              /* 源地址（网络字节序） */
+    uint32_t tokens;            /* 令牌（千分之一为单位） */
+    uint32_t last_ms;           /* 上次补充的时间 */
+    uint32_t in_use;
+};
+
+struct rate_limit {
+    uint32_t rate;              /* 每秒补充的令牌数 */
+    uint32_t burst;             /* 桶容量 */
+    uint64_t passed;            /* 通过的SYN/数据报 */
+    uint64_t throttled;         /* 被限速丢弃的SYN/数据报 */
+    uint64_t evictions;         /* 组满时丢掉的未满的桶 */
+    pthread_mutex_t lock;
+    struct rate_bucket buckets[RATE_LIMIT_SETS * RATE_LIMIT_WAYS];
 };
 
 /* 全局变量声明 */
 extern struct socket_manager g_socket_manager;
+extern int g_tcp_sack_enabled;  /* 是否在SYN中协商SACK（类似sysctl_tcp_sack） */
+extern int g_tcp_window_scaling; /* 是否协商窗口扩大（类似sysctl_tcp_window_scaling） */
+extern int g_tcp_checksum_offload; /* 发送时把校验和留给声明NETDEV_F_HW_CSUM的设备 */
+extern int g_tcp_checksum_verify;  /* 接收时校验软件计算的校验和 */
+extern int g_tcp_moderate_rcvbuf; /* 是否自动调整接收缓冲区（类似sysctl_tcp_moderate_rcvbuf） */
+extern int g_tcp_moderate_sndbuf; /* 是否自动调整发送缓冲区 */
+extern int g_packet_rx_queue;     /* 经每Socket接收环异步投递，由接收方线程处理；所有者线程须持续轮询（见packet_queue.c） */
+extern size_t g_tcp_mem[3];     /* TCP内存水位：低水位、压力阈值、上限（类似sysctl_tcp_mem） */
+extern size_t g_udp_mem[3];     /* UDP内存水位（类似sysctl_udp_mem） */
+extern int g_socket_backend;      /* 新建Socket使用的后端（SOCKET_BACKEND_*） */
+extern int g_sendfile_mmap;       /* sendfile映射文件页并按引用挂到报文段上，0时总是pread */
+extern int g_raw_sock_count;      /* 打开的原始套接字数，为0时packet_send跳过旁听 */
+extern uint32_t g_route_gen;      /* 路由表或当前设备变化时递增，使连接的路由缓存失效 */
+extern uint64_t g_route_lookups;  /* 路由表查找次数（路由表为空时不计） */
+
+/* Socket后端：本项目的协议栈，或直通内核的真实套接字（环境变量MYSOCKET_BACKEND=kernel选择后者） */
+#define SOCKET_BACKEND_USER     0
+#define SOCKET_BACKEND_KERNEL   1
+
+/* 内存记账类别 */
+#define SOCKET_MEM_TCP          0
+#define SOCKET_MEM_UDP          1
+#define SOCKET_MEM_CLASSES      2
+
+/* 记账方式 */
+#define SOCKET_MEM_FORCE        0   /* 总是成功 */
+#define SOCKET_MEM_NEW          1   /* 超过上限时失败 */
+#define SOCKET_MEM_GROW         2   /* 压力状态下失败 */
+
+/* 内存状态 */
+typedef enum {
+    SOCKET_MEM_NORMAL = 0,
+    SOCKET_MEM_PRESSURE,
+    SOCKET_MEM_HIGH
+} socket_mem_state_t;
+
+/* 内存统计 */
+struct socket_mem_stats {
+    size_t allocated;           /* 当前占用 */
+    size_t peak;                /* 峰值占用 */
+    uint64_t pressure_events;   /* 进入压力状态的次数 */
+    uint64_t grow_denied;       /* 被拒绝的缓冲区增长 */
+    uint64_t alloc_failures;    /* 超过上限被拒绝的分配 */
+    uint64_t packets_dropped;   /* 因内存不足丢弃的包 */
+    uint64_t conns_refused;     /* 因内存不足拒绝的连接 */
+};
+
+/* 包在队列中占用的内存 */
+#define packet_truesize(pkt)    ((pkt)->truesize)
+
+/* 数据包输出钩子：设置后packet_send把包交给钩子而不是网卡（用于链路仿真） */
+typedef int (*packet_output_hook_t)(struct packet *pkt);
 
 /* 内部函数声明 */
 
 /* Socket管理 */
 struct mysocket* socket_find_by_fd(int fd);
 struct mysocket* socket_create(int domain, int type, int protocol);
+int socket_alloc_fd(void);
 void socket_destroy(struct mysocket *sock);
 int socket_add_to_manager(struct mysocket *sock);
 void socket_remove_from_manager(struct mysocket *sock);
+void socket_manager_lock(void);
+void socket_manager_unlock(void);
 
 /* 地址处理 */
 int socket_addr_copy(struct mysocket_addr_in *dst, const struct mysocket_addr *src, socklen_t addrlen);
@@ -113,6 +562,7 @@ void socket_buffer_cleanup(struct mysocket *sock);
 int socket_buffer_write(char *buffer, size_t *used, size_t total, 
                        const void *data, size_t len);
 int socket_buffer_read(char *buffer, size_t *used, void *data, size_t len);
+int socket_buffer_consume(char *buffer, size_t *used, size_t len);
 
 /* TCP状态机 */
 int tcp_state_transition(struct mysocket *sock, int event);
@@ -124,15 +574,249 @@ int tcp_send_syn(struct mysocket *sock);
 int tcp_send_ack(struct mysocket *sock);
 int tcp_send_fin(struct mysocket *sock);
 int tcp_send_data(struct mysocket *sock, const void *data, size_t len);
+int tcp_send_segment(struct mysocket *sock, struct packet *pkt);
+size_t tcp_current_mss(struct mysocket *sock);
+struct netdev* tcp_route(struct mysocket *sock);
+struct connection_cb* tcp_conn_create(struct mysocket *sock);
+void tcp_conn_destroy(struct connection_cb *cb);
+size_t tcp_data_to_recv_buffer(struct mysocket *sock, const char *data, size_t len);
 
-/* 数据包处理 */
+/* SACK（tcp_sack.c） */
+void tcp_scoreboard_clear(struct tcp_scoreboard *sb);
+void tcp_scoreboard_add(struct tcp_scoreboard *sb, uint32_t start_seq, uint32_t end_seq);
+void tcp_scoreboard_trim(struct tcp_scoreboard *sb, uint32_t snd_una);
+int tcp_scoreboard_is_sacked(const struct tcp_scoreboard *sb, uint32_t start_seq, uint32_t end_seq);
+void tcp_sack_process(struct connection_cb *cb, const struct packet *pkt);
+int tcp_ooo_queue_insert(struct connection_cb *cb, const struct packet *pkt);
+size_t tcp_ooo_queue_drain(struct mysocket *sock);
+void tcp_ooo_queue_purge(struct connection_cb *cb);
+void tcp_sack_build_blocks(struct connection_cb *cb, uint32_t recent_start, uint32_t recent_end);
+
+/* 窗口管理（tcp_window.c） */
+uint8_t tcp_compute_wscale(size_t max_space);
+uint16_t tcp_select_window(struct mysocket *sock, int is_syn);
+uint32_t tcp_send_window_avail(struct mysocket *sock);
+void tcp_rcv_rtt_measure(struct connection_cb *cb);
+void tcp_rcv_space_adjust(struct mysocket *sock);
+void tcp_cleanup_rbuf(struct mysocket *sock, size_t copied);
+size_t tcp_send_buffer_space(struct mysocket *sock);
+void tcp_snd_space_adjust(struct mysocket *sock);
+size_t tcp_shrink_idle_buffers(struct mysocket *sock);
+
+/* 重传（tcp_retrans.c） */
+uint64_t tcp_clock_ms(void);
+void tcp_set_clock(uint64_t (*clock_fn)(void));
+void tcp_retrans_queue_add(struct connection_cb *cb, struct packet *seg);
+void tcp_retrans_queue_clean(struct connection_cb *cb);
+void tcp_retrans_queue_purge(struct connection_cb *cb);
+int tcp_retransmit_segment(struct mysocket *sock, struct packet *seg);
+int tcp_fast_retransmit(struct mysocket *sock);
+int tcp_retransmit_timer(struct mysocket *sock);
+
+/* 数据包缓冲区与对象池（packet_pool.c） */
+struct packet* packet_alloc(size_t size);
 struct packet* packet_create(void);
+struct packet* packet_alloc_ext(struct packet_extbuf *ext, const char *data, size_t len);
+void packet_extbuf_get(struct packet_extbuf *ext);
+void packet_extbuf_put(struct packet_extbuf *ext);
 void packet_destroy(struct packet *pkt);
+struct packet* packet_clone(const struct packet *pkt);
+struct packet* packet_copy(const struct packet *pkt);
+int packet_shared(const struct packet *pkt);
+char* packet_put(struct packet *pkt, size_t len);
+char* packet_push(struct packet *pkt, size_t len);
+char* packet_pull(struct packet *pkt, size_t len);
+void packet_trim(struct packet *pkt, size_t len);
+size_t packet_headroom(const struct packet *pkt);
+size_t packet_tailroom(const struct packet *pkt);
+void packet_pool_get_stats(struct packet_pool_stats *stats);
+void packet_pool_drain(void);
+
+/* 线格式序列化与解析（packet_wire.c） */
+size_t packet_wire_len(const struct packet *pkt);
+ssize_t packet_serialize(const struct packet *pkt, void *frame, size_t size);
+ssize_t packet_serialize_udp(void *frame, size_t size,
+                             const struct mysocket_addr_in *src,
+                             const struct mysocket_addr_in *dst,
+                             const void *data, size_t len);
+void packet_udp_wire_headers(void *hdr, const struct mysocket_addr_in *src,
+                             const struct mysocket_addr_in *dst, size_t len);
+int packet_parse(const void *frame, size_t len, struct packet_wire_info *info);
+struct packet* packet_from_wire(const struct packet_wire_info *info);
+
+/* 数据包处理 */
 int packet_send(struct packet *pkt);
+int packet_xmit(struct packet *pkt);
+int packet_xmit_burst(struct packet **pkts, int n);
+int packet_deliver(struct packet *pkt);
+int packet_deliver_cached(struct packet *pkt, struct packet_dst_cache *cache);
+void packet_set_output_hook(packet_output_hook_t hook);
+
+/* 发送队列（packet_queue.c） */
+void packet_tx_begin(void);
+int packet_tx_end(void);
+int packet_tx_enqueue(struct packet *pkt);
+int packet_tx_flush(void);
+void packet_tx_get_stats(struct packet_tx_stats *stats);
+
+/* 虚拟网卡（netdev.c和各驱动） */
+extern const struct netdev_ops netdev_loopback_ops;
+extern const struct netdev_ops netdev_pcap_ops;
+extern const struct netdev_ops netdev_udp_ops;
+extern const struct netdev_ops netdev_shm_ops;
+struct netdev* netdev_open(const char *driver, const char *arg);
+void netdev_close(struct netdev *dev);
+void netdev_set_default(struct netdev *dev);
+struct netdev* netdev_get_default(void);
+int netdev_set_mtu(struct netdev *dev, uint32_t mtu);
+int netdev_tx_burst(struct netdev *dev, struct packet **pkts, int n);
+int netdev_rx_burst(struct netdev *dev, struct packet **pkts, int n);
+int netdev_poll(struct netdev *dev, int budget);
+int netdev_wait(struct netdev *dev, int timeout_ms);
+void netdev_get_stats(const struct netdev *dev, struct netdev_stats *stats);
+int netdev_shm_fd(const struct netdev *dev);
+
+/* 主机UDP通道（host_udp.c，只依赖系统头文件） */
+struct host_udp;
+struct host_udp* host_udp_open(const char *local_ip, uint16_t local_port,
+                               const char *remote_ip, uint16_t remote_port, size_t frame_size);
+void host_udp_close(struct host_udp *h);
+int host_udp_gso(const struct host_udp *h);
+void host_udp_disable_gso(struct host_udp *h);
+int host_udp_send(struct host_udp *h, const uint8_t *const *frames, const size_t *lens, int n);
+int host_udp_recv(struct host_udp *h, const uint8_t **frames, size_t *lens, int n);
+int host_udp_wait(struct host_udp *h, int timeout_ms);
+
+/* Unix域Socket（socket_unix.c） */
+int unix_sock_init(struct mysocket *sock);
+void unix_sock_release(struct mysocket *sock);
+void unix_close(struct mysocket *sock);
+int unix_socketpair(struct mysocket *a, struct mysocket *b);
+int unix_bind(struct mysocket *sock, const struct mysocket_addr *addr, socklen_t addrlen);
+int unix_listen(struct mysocket *sock, int backlog);
+int unix_accept(struct mysocket *sock, struct mysocket_addr *addr, socklen_t *addrlen);
+int unix_connect(struct mysocket *sock, const struct mysocket_addr *addr, socklen_t addrlen);
+ssize_t unix_send(struct mysocket *sock, const void *buf, size_t len);
+ssize_t unix_recv(struct mysocket *sock, void *buf, size_t len);
+ssize_t unix_sendto(struct mysocket *sock, const void *buf, size_t len,
+                    const struct mysocket_addr *dest_addr, socklen_t addrlen);
+ssize_t unix_recvfrom(struct mysocket *sock, void *buf, size_t len,
+                      struct mysocket_addr *src_addr, socklen_t *addrlen);
+
+/* 原始套接字（socket_raw.c） */
+int raw_sock_init(struct mysocket *sock);
+void raw_sock_release(struct mysocket *sock);
+void raw_tap(const struct packet *pkt);
+struct packet* raw_dequeue(struct mysocket *sock);
+ssize_t raw_send(struct mysocket *sock, const void *buf, size_t len);
+ssize_t raw_recvfrom(struct mysocket *sock, void *buf, size_t len,
+                     struct mysocket_addr *src_addr, socklen_t *addrlen);
+
+/* BPF套接字过滤器（socket_filter.c） */
+struct sk_filter* sk_filter_create(const struct mysocket_sock_filter *prog, unsigned int len);
+void sk_filter_destroy(struct sk_filter *f);
+uint32_t sk_filter_run(struct sk_filter *f, const void *hdr, size_t hdr_len,
+                       const void *payload, size_t payload_len);
+size_t sk_filter_udp(struct mysocket *target, const struct mysocket_addr_in *src,
+                     const struct mysocket_addr_in *dst, const void *data, size_t len);
+
+/* 最长前缀匹配（lpm_trie.c） */
+int lpm_trie_init(struct lpm_trie *t);
+void lpm_trie_free(struct lpm_trie *t);
+int lpm_trie_insert(struct lpm_trie *t, uint32_t prefix, int len, int32_t value);
+int32_t lpm_trie_lookup(const struct lpm_trie *t, uint32_t addr);
+int32_t lpm_trie_get(const struct lpm_trie *t, uint32_t prefix, int len);
+int lpm_trie_remove(struct lpm_trie *t, uint32_t prefix, int len);
+
+/* 监听Socket的访问控制（socket_acl.c） */
+int socket_acl_check(struct mysocket *listen_sock, const struct mysocket_addr_in *peer_addr);
+int socket_acl_charge(struct mysocket *listen_sock, struct mysocket *child);
+void socket_acl_release(struct mysocket *sock);
+
+/* 路由表（route.c） */
+int route_add(const char *cidr, const char *gateway, struct netdev *dev, int metric);
+int route_del(const char *cidr, struct netdev *dev);
+void route_flush_dev(struct netdev *dev);
+int route_lookup(uint32_t dst, struct route_entry *out);
+struct netdev* route_output(uint32_t dst);
+void route_invalidate(void);
+
+/* 按源地址限速（socket_ratelimit.c） */
+int socket_rate_limit_allow(struct rate_limit *rl, uint32_t addr);
+void socket_rate_limit_destroy(struct rate_limit *rl);
+
+/* 内核直通后端（socket_kernel.c） */
+void socket_kernel_init(void);
+struct mysocket* socket_kernel_create(int domain, int type, int protocol);
+int socket_kernel_socketpair(int type, int protocol, struct mysocket *pair[2]);
+int socket_kernel_bind(struct mysocket *sock, const struct mysocket_addr *addr, socklen_t addrlen);
+int socket_kernel_listen(struct mysocket *sock, int backlog);
+int socket_kernel_accept(struct mysocket *sock, struct mysocket_addr *addr, socklen_t *addrlen);
+int socket_kernel_connect(struct mysocket *sock, const struct mysocket_addr *addr, socklen_t addrlen);
+ssize_t socket_kernel_send(struct mysocket *sock, const void *buf, size_t len);
+ssize_t socket_kernel_recv(struct mysocket *sock, void *buf, size_t len);
+ssize_t socket_kernel_sendto(struct mysocket *sock, const void *buf, size_t len,
+                             const struct mysocket_addr *dest_addr, socklen_t addrlen);
+ssize_t socket_kernel_recvfrom(struct mysocket *sock, void *buf, size_t len,
+                               struct mysocket_addr *src_addr, socklen_t *addrlen);
+ssize_t socket_kernel_sendfile(struct mysocket *sock, int in_fd, off_t *offset, size_t count);
+int socket_kernel_set_nonblocking(struct mysocket *sock);
+
+/* 主机套接字（host_sock.c，只依赖系统头文件；常量和结构与该文件中的定义一致） */
+#define HOST_AF_INET            1
+#define HOST_AF_UNIX            2
+#define HOST_SOCK_STREAM        1
+#define HOST_SOCK_DGRAM         2
+#define HOST_UNIX_PATH_MAX      108
+
+struct host_sockaddr {
+    int family;                 /* HOST_AF_* */
+    uint32_t addr;              /* IPv4地址（网络字节序） */
+    uint16_t port;              /* 端口（网络字节序） */
+    char path[HOST_UNIX_PATH_MAX]; /* Unix域地址，首字节为0表示抽象命名空间 */
+    size_t path_len;            /* 路径的有效长度 */
+};
+
+int host_sock_socket(int family, int type);
+int host_sock_socketpair(int type, int fds[2]);
+int host_sock_bind(int fd, const struct host_sockaddr *sa);
+int host_sock_connect(int fd, const struct host_sockaddr *sa);
+int host_sock_listen(int fd, int backlog);
+int host_sock_accept(int fd, struct host_sockaddr *sa);
+ssize_t host_sock_send(int fd, const void *buf, size_t len);
+ssize_t host_sock_recv(int fd, void *buf, size_t len);
+ssize_t host_sock_sendto(int fd, const void *buf, size_t len, const struct host_sockaddr *sa);
+ssize_t host_sock_recvfrom(int fd, void *buf, size_t len, struct host_sockaddr *sa);
+ssize_t host_sock_sendfile(int fd, int in_fd, off_t *offset, size_t count);
+int host_sock_attach_filter(int fd, const void *insns, unsigned short len);
+int host_sock_detach_filter(int fd);
+int host_sock_set_nonblocking(int fd);
+int host_sock_close(int fd);
+
+/* 接收环（packet_queue.c） */
+int packet_rx_deferred(void);
+struct packet_ring* packet_ring_create(void);
+int packet_ring_enqueue(struct packet_ring *ring, struct packet *pkt);
+struct packet* packet_ring_dequeue(struct packet_ring *ring);
+void packet_ring_destroy(struct packet_ring *ring);
+int socket_rx_enqueue(struct mysocket *sock, struct packet *pkt);
 struct packet* packet_receive(struct mysocket *sock);
+int socket_rx_process(struct mysocket *sock);
 
-/* 校验和计算 */
+/* 校验和计算（checksum.c） */
 uint16_t checksum(void *data, size_t len);
+uint32_t checksum_partial(const void *data, size_t len, uint32_t sum);
+uint32_t checksum_copy(void *dst, const void *src, size_t len, uint32_t sum);
+uint16_t checksum_fold(uint32_t sum);
+uint16_t checksum_update16(uint16_t check, uint16_t old_val, uint16_t new_val);
+uint16_t checksum_update32(uint16_t check, uint32_t old_val, uint32_t new_val);
+int checksum_select_impl(const char *name);
+const char* checksum_impl_name(void);
+uint32_t tcp_pseudo_sum(uint32_t src_addr, uint32_t dst_addr, uint8_t protocol);
+uint16_t tcp_checksum_pseudo(uint32_t pseudo_sum, const struct tcp_header *tcp_hdr,
+                             const void *data, size_t data_len);
+uint16_t tcp_checksum_data_sum(uint32_t pseudo_sum, const struct tcp_header *tcp_hdr,
+                               uint32_t data_sum, size_t data_len);
 uint16_t tcp_checksum(struct ip_header *ip_hdr, struct tcp_header *tcp_hdr, 
                      void *data, size_t data_len);
 
@@ -161,6 +845,19 @@ int socket_can_accept_connection(struct mysocket *listen_sock, const struct myso
 
 /* 缓冲区扩展功能 */
 int socket_buffer_resize(struct mysocket *sock, size_t send_size, size_t recv_size);
+int socket_buffer_grow(struct mysocket *sock, size_t send_size, size_t recv_size);
+void socket_buffer_request_reclaim(struct mysocket *except);
+
+/* 全局内存记账（socket_mem.c） */
+int socket_mem_class(const struct mysocket *sock);
+int socket_mem_charge(int mem_class, size_t bytes, int kind);
+void socket_mem_uncharge(int mem_class, size_t bytes);
+void socket_mem_reclaim(void);
+socket_mem_state_t socket_mem_state(int mem_class);
+void socket_mem_count_drop(int mem_class);
+void socket_mem_count_refused(int mem_class);
+void socket_mem_get_stats(int mem_class, struct socket_mem_stats *stats);
+void socket_mem_reset_stats(void);
 void socket_buffer_clear(struct mysocket *sock, int clear_send, int clear_recv);
 int socket_buffer_status(struct mysocket *sock, size_t *send_used, size_t *send_free,
                         size_t *recv_used, size_t *recv_free);
@@ -173,10 +870,11 @@ ssize_t socket_send_udp_packet(struct mysocket *sock, const void *data, size_t l
 ssize_t socket_recv_udp_packet(struct mysocket *sock, void *buf, size_t len,
                               struct mysocket_addr_in *src_addr);
 struct mysocket* socket_find_udp_receiver(const struct mysocket_addr_in *addr);
-size_t socket_simulate_tcp_receive(struct mysocket *sock, void *buf, size_t len);
 
 /* 地址查找和管理 */
 struct mysocket* socket_find_by_address(const struct mysocket_addr_in *addr);
+struct mysocket* socket_lookup_tcp(const struct mysocket_addr_in *local,
+                                   const struct mysocket_addr_in *remote);
 
 /* 辅助工具函数 */
 struct mysocket_addr_in mysocket_make_addr(const char *ip, uint16_t port);
@@ -185,6 +883,7 @@ int mysocket_addr_equal(const struct mysocket_addr_in *addr1, const struct mysoc
 uint16_t mysocket_random_port(void);
 int mysocket_port_in_use(uint16_t port);
 void mysocket_addr_to_string(const struct mysocket_addr_in *addr, char *buf, size_t len);
+int socket_parse_cidr(const char *cidr, uint32_t *prefix, int *len);
 
 /* 辅助工具 */
 void socket_print_debug_info(struct mysocket *sock, const char *msg);
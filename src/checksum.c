@@ -0,0 +1,516 @@
+/**
+ * @file checksum.c
+ * @brief Internet校验和（RFC 1071）与增量更新（RFC 1624）
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 反码求和与字节序无关：按内存顺序把数据当作本机字节序的字相加，
+ * 折叠后的结果按原样存回包头即为网络字节序的校验和。
+ * 因此可以按32位字累加到64位累加器中（进位推迟到最后折叠），
+ * x86上再用SSE2/AVX2把32位字零扩展到64位通道并行累加，运行时按CPU选择实现。
+ * 每种实现都有一个复制并累加的版本，数据搬运和校验和只需读一遍内存。
+ */
+
+#include "socket_internal.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHECKSUM_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* 发送时卸载校验和（本地回环受信任，不计算），默认关闭 */
+int g_tcp_checksum_offload = 0;
+
+/* 接收时校验软件计算的校验和，默认关闭 */
+int g_tcp_checksum_verify = 0;
+
+/* 短于此长度（如单独的包头）直接用标量实现，向量实现的启动开销不划算 */
+#define CHECKSUM_VECTOR_MIN     64
+
+/* 累加函数：把data按16位字累加到64位部分和上 */
+typedef uint64_t (*checksum_add_fn)(const uint8_t *data, size_t len, uint64_t sum);
+
+/* 复制并累加：把src复制到dst，同时累加src */
+typedef uint64_t (*checksum_copy_fn)(uint8_t *dst, const uint8_t *src, size_t len, uint64_t sum);
+
+/**
+ * 64位加法，溢出时回卷进位（反码加法）
+ */
+static inline uint64_t checksum_add64(uint64_t sum, uint64_t value) {
+    sum += value;
+    return sum + (sum < value);
+}
+
+/**
+ * 把64位部分和折叠为32位
+ */
+static inline uint32_t checksum_fold64(uint64_t sum) {
+    sum = (sum & 0xFFFFFFFFu) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFFu) + (sum >> 32);
+    return (uint32_t)sum;
+}
+
+/**
+ * 标量实现：32位字累加到64位累加器
+ */
+static uint64_t checksum_add_scalar(const uint8_t *data, size_t len, uint64_t sum) {
+    while (len >= 16) {
+        uint32_t words[4];
+        memcpy(words, data, sizeof(words));
+        sum = checksum_add64(sum, (uint64_t)words[0] + words[1] + words[2] + words[3]);
+        data += 16;
+        len -= 16;
+    }
+
+    while (len >= 4) {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        sum = checksum_add64(sum, word);
+        data += 4;
+        len -= 4;
+    }
+
+    if (len >= 2) {
+        uint16_t word;
+        memcpy(&word, data, sizeof(word));
+        sum = checksum_add64(sum, word);
+        data += 2;
+        len -= 2;
+    }
+
+    /* 处理奇数字节：补零成一个16位字 */
+    if (len == 1) {
+        uint16_t word = 0;
+        memcpy(&word, data, 1);
+        sum = checksum_add64(sum, word);
+    }
+
+    return sum;
+}
+
+/**
+ * 标量实现：复制的同时累加
+ */
+static uint64_t checksum_copy_scalar(uint8_t *dst, const uint8_t *src, size_t len, uint64_t sum) {
+    while (len >= 16) {
+        uint32_t words[4];
+        memcpy(words, src, sizeof(words));
+        memcpy(dst, words, sizeof(words));
+        sum = checksum_add64(sum, (uint64_t)words[0] + words[1] + words[2] + words[3]);
+        src += 16;
+        dst += 16;
+        len -= 16;
+    }
+
+    while (len >= 4) {
+        uint32_t word;
+        memcpy(&word, src, sizeof(word));
+        memcpy(dst, &word, sizeof(word));
+        sum = checksum_add64(sum, word);
+        src += 4;
+        dst += 4;
+        len -= 4;
+    }
+
+    if (len >= 2) {
+        uint16_t word;
+        memcpy(&word, src, sizeof(word));
+        memcpy(dst, &word, sizeof(word));
+        sum = checksum_add64(sum, word);
+        src += 2;
+        dst += 2;
+        len -= 2;
+    }
+
+    if (len == 1) {
+        uint16_t word = 0;
+        memcpy(&word, src, 1);
+        dst[0] = src[0];
+        sum = checksum_add64(sum, word);
+    }
+
+    return sum;
+}
+
+#ifdef CHECKSUM_HAVE_X86
+
+/**
+ * SSE2实现：每16字节拆成两对32位字，零扩展到64位通道累加
+ */
+__attribute__((target("sse2")))
+static uint64_t checksum_add_sse2(const uint8_t *data, size_t len, uint64_t sum) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero;
+    __m128i acc1 = zero;
+
+    while (len >= 64) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(data + 0));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(data + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(data + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i *)(data + 48));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v2, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v2, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v3, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v3, zero));
+        data += 64;
+        len -= 64;
+    }
+
+    while (len >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)data);
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+        data += 16;
+        len -= 16;
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+    sum = checksum_add64(sum, lanes[0]);
+    sum = checksum_add64(sum, lanes[1]);
+
+    return checksum_add_scalar(data, len, sum);
+}
+
+/**
+ * SSE2实现：复制的同时累加
+ */
+__attribute__((target("sse2")))
+static uint64_t checksum_copy_sse2(uint8_t *dst, const uint8_t *src, size_t len, uint64_t sum) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero;
+    __m128i acc1 = zero;
+
+    while (len >= 32) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(src + 0));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(src + 16));
+        _mm_storeu_si128((__m128i *)(dst + 0), v0);
+        _mm_storeu_si128((__m128i *)(dst + 16), v1);
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+        src += 32;
+        dst += 32;
+        len -= 32;
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+    sum = checksum_add64(sum, lanes[0]);
+    sum = checksum_add64(sum, lanes[1]);
+
+    return checksum_copy_scalar(dst, src, len, sum);
+}
+
+/**
+ * AVX2实现：每32字节拆成两组32位字，零扩展到64位通道累加
+ */
+__attribute__((target("avx2")))
+static uint64_t checksum_add_avx2(const uint8_t *data, size_t len, uint64_t sum) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero;
+    __m256i acc1 = zero;
+
+    while (len >= 128) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)(data + 0));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(data + 32));
+        __m256i v2 = _mm256_loadu_si256((const __m256i *)(data + 64));
+        __m256i v3 = _mm256_loadu_si256((const __m256i *)(data + 96));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v2, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v2, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v3, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v3, zero));
+        data += 128;
+        len -= 128;
+    }
+
+    while (len >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)data);
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+        data += 32;
+        len -= 32;
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+    for (int i = 0; i < 4; i++) {
+        sum = checksum_add64(sum, lanes[i]);
+    }
+
+    return checksum_add_scalar(data, len, sum);
+}
+
+/**
+ * AVX2实现：复制的同时累加
+ */
+__attribute__((target("avx2")))
+static uint64_t checksum_copy_avx2(uint8_t *dst, const uint8_t *src, size_t len, uint64_t sum) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero;
+    __m256i acc1 = zero;
+
+    while (len >= 64) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)(src + 0));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+        _mm256_storeu_si256((__m256i *)(dst + 0), v0);
+        _mm256_storeu_si256((__m256i *)(dst + 32), v1);
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+        src += 64;
+        dst += 64;
+        len -= 64;
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+    for (int i = 0; i < 4; i++) {
+        sum = checksum_add64(sum, lanes[i]);
+    }
+
+    return checksum_copy_scalar(dst, src, len, sum);
+}
+
+static int checksum_cpu_sse2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+static int checksum_cpu_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif /* CHECKSUM_HAVE_X86 */
+
+static int checksum_cpu_any(void) {
+    return 1;
+}
+
+/* 可用实现，按优先级从低到高排列 */
+static const struct {
+    const char *name;
+    checksum_add_fn add;
+    checksum_copy_fn copy;
+    int (*supported)(void);
+} checksum_impls[] = {
+    { "scalar", checksum_add_scalar, checksum_copy_scalar, checksum_cpu_any },
+#ifdef CHECKSUM_HAVE_X86
+    { "sse2",   checksum_add_sse2,   checksum_copy_sse2,   checksum_cpu_sse2 },
+    { "avx2",   checksum_add_avx2,   checksum_copy_avx2,   checksum_cpu_avx2 },
+#endif
+};
+
+#define CHECKSUM_NUM_IMPLS  ((int)(sizeof(checksum_impls) / sizeof(checksum_impls[0])))
+
+/* 当前使用的实现 */
+static int checksum_impl = -1;
+static pthread_once_t checksum_impl_once = PTHREAD_ONCE_INIT;
+
+/**
+ * 选择CPU支持的最快实现
+ */
+static void checksum_impl_detect(void) {
+    for (int i = CHECKSUM_NUM_IMPLS - 1; i >= 0; i--) {
+        if (checksum_impls[i].supported()) {
+            checksum_impl = i;
+            DEBUG_PRINT("校验和实现: %s", checksum_impls[i].name);
+            return;
+        }
+    }
+}
+
+static inline checksum_add_fn checksum_get_add(void) {
+    pthread_once(&checksum_impl_once, checksum_impl_detect);
+    return checksum_impls[checksum_impl].add;
+}
+
+static inline checksum_copy_fn checksum_get_copy(void) {
+    pthread_once(&checksum_impl_once, checksum_impl_detect);
+    return checksum_impls[checksum_impl].copy;
+}
+
+/**
+ * 指定校验和实现（用于测试和性能对比）
+ * @param name "scalar"、"sse2"、"avx2"，NULL表示自动选择
+ * @return 0成功，-1未知或CPU不支持
+ */
+int checksum_select_impl(const char *name) {
+    pthread_once(&checksum_impl_once, checksum_impl_detect);
+
+    if (!name) {
+        checksum_impl_detect();
+        return 0;
+    }
+
+    for (int i = 0; i < CHECKSUM_NUM_IMPLS; i++) {
+        if (strcmp(checksum_impls[i].name, name) == 0) {
+            if (!checksum_impls[i].supported()) {
+                return -1;
+            }
+            checksum_impl = i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * 获取当前使用的校验和实现名称
+ */
+const char* checksum_impl_name(void) {
+    pthread_once(&checksum_impl_once, checksum_impl_detect);
+    return checksum_impls[checksum_impl].name;
+}
+
+/**
+ * 16位反码累加（RFC 1071）
+ * @param data 数据
+ * @param len 数据长度（只有最后一段可以是奇数长度）
+ * @param sum 初始部分和
+ * @return 未折叠的32位部分和
+ */
+uint32_t checksum_partial(const void *data, size_t len, uint32_t sum) {
+    if (!data || len == 0) return sum;
+
+    checksum_add_fn add = (len < CHECKSUM_VECTOR_MIN) ? checksum_add_scalar : checksum_get_add();
+    return checksum_fold64(add((const uint8_t *)data, len, sum));
+}
+
+/**
+ * 复制数据并同时计算部分和（融合复制与校验和，数据只读一遍）
+ * @param dst 目标地址（不能与src重叠）
+ * @param src 源数据
+ * @param len 数据长度（只有最后一段可以是奇数长度）
+ * @param sum 初始部分和
+ * @return 未折叠的32位部分和
+ */
+uint32_t checksum_copy(void *dst, const void *src, size_t len, uint32_t sum) {
+    if (!dst || !src || len == 0) return sum;
+
+    checksum_copy_fn copy = (len < CHECKSUM_VECTOR_MIN) ? checksum_copy_scalar : checksum_get_copy();
+    return checksum_fold64(copy((uint8_t *)dst, (const uint8_t *)src, len, sum));
+}
+
+/**
+ * 折叠部分和并取反
+ * @param sum 部分和
+ * @return 校验和
+ */
+uint16_t checksum_fold(uint32_t sum) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+/**
+ * 计算校验和
+ * @param data 数据
+ * @param len 数据长度
+ * @return 校验和
+ */
+uint16_t checksum(void *data, size_t len) {
+    return checksum_fold(checksum_partial(data, len, 0));
+}
+
+/**
+ * 包头中一个16位字段改变后增量更新校验和（RFC 1624 式3：HC' = ~(~HC + ~m + m')）
+ * @param check 原校验和
+ * @param old_val 字段原值（与包头中相同的字节序）
+ * @param new_val 字段新值
+ * @return 新校验和
+ */
+uint16_t checksum_update16(uint16_t check, uint16_t old_val, uint16_t new_val) {
+    uint32_t sum = (uint16_t)~check;
+    sum += (uint16_t)~old_val;
+    sum += new_val;
+    return checksum_fold(sum);
+}
+
+/**
+ * 包头中一个32位字段改变后增量更新校验和（如序列号、确认号、地址）
+ * @param check 原校验和
+ * @param old_val 字段原值（与包头中相同的字节序）
+ * @param new_val 字段新值
+ * @return 新校验和
+ */
+uint16_t checksum_update32(uint16_t check, uint32_t old_val, uint32_t new_val) {
+    uint32_t sum = (uint16_t)~check;
+    sum += (uint16_t)~old_val;
+    sum += (uint16_t)~(old_val >> 16);
+    sum += new_val & 0xFFFF;
+    sum += new_val >> 16;
+    return checksum_fold(sum);
+}
+
+/**
+ * 计算伪首部中与报文长度无关的部分和（源/目标地址和协议，TCP和UDP相同）
+ * @param src_addr 源地址（网络字节序）
+ * @param dst_addr 目标地址（网络字节序）
+ * @param protocol 协议号
+ * @return 未折叠的部分和
+ */
+uint32_t tcp_pseudo_sum(uint32_t src_addr, uint32_t dst_addr, uint8_t protocol) {
+    uint64_t sum = (uint64_t)src_addr + dst_addr + mysocket_htons(protocol);
+    return checksum_fold64(sum);
+}
+
+/**
+ * 在伪首部部分和的基础上计算TCP校验和
+ * @param pseudo_sum tcp_pseudo_sum的结果
+ * @param tcp_hdr TCP头（checksum字段应为0）
+ * @param data 数据
+ * @param data_len 数据长度
+ * @return TCP校验和
+ */
+uint16_t tcp_checksum_pseudo(uint32_t pseudo_sum, const struct tcp_header *tcp_hdr,
+                             const void *data, size_t data_len) {
+    return tcp_checksum_data_sum(pseudo_sum, tcp_hdr, checksum_partial(data, data_len, 0), data_len);
+}
+
+/**
+ * 用已算好的数据部分和（如checksum_copy的结果）计算TCP校验和
+ * @param pseudo_sum tcp_pseudo_sum的结果
+ * @param tcp_hdr TCP头（计算时checksum字段应为0；校验时保留原值，结果为0表示正确）
+ * @param data_sum 数据的部分和
+ * @param data_len 数据长度
+ * @return TCP校验和
+ */
+uint16_t tcp_checksum_data_sum(uint32_t pseudo_sum, const struct tcp_header *tcp_hdr,
+                               uint32_t data_sum, size_t data_len) {
+    uint64_t sum = (uint64_t)pseudo_sum +
+                   mysocket_htons((uint16_t)(sizeof(struct tcp_header) + data_len));
+
+    sum += checksum_partial(tcp_hdr, sizeof(struct tcp_header), 0);
+    sum += data_sum;
+
+    return checksum_fold(checksum_fold64(sum));
+}
+
+/**
+ * 计算TCP校验和（含伪首部）
+ * @param ip_hdr IP头
+ * @param tcp_hdr TCP头（checksum字段应为0）
+ * @param data 数据
+ * @param data_len 数据长度
+ * @return TCP校验和
+ */
+uint16_t tcp_checksum(struct ip_header *ip_hdr, struct tcp_header *tcp_hdr,
+                     void *data, size_t data_len) {
+    if (!ip_hdr || !tcp_hdr) return 0;
+
+    uint32_t pseudo = tcp_pseudo_sum(ip_hdr->src_addr, ip_hdr->dst_addr, ip_hdr->protocol);
+    return tcp_checksum_pseudo(pseudo, tcp_hdr, data, data_len);
+}
@@ -0,0 +1,262 @@
+/**
+ * @file host_udp.c
+ * @brief 主机UDP通道：经真实的内核UDP套接字批量收发帧
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 本文件只包含系统头文件（mysocket.h中的AF_INET、SOCK_*、IPPROTO_*等定义与系统头文件冲突），
+ * 对外只暴露不透明的struct host_udp和基本类型，由netdev_udp.c在其上实现网卡驱动。
+ *
+ * 发送用sendmmsg一次提交一批帧；内核支持UDP_SEGMENT（GSO）时，
+ * 连续等长的帧（最后一个可以更短）合并成一条消息，由内核按帧长切分，
+ * 一次系统调用和一次协议栈遍历发出多个数据报。接收用recvmmsg非阻塞地一次取一批。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP                 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT             103
+#endif
+
+#define HOST_UDP_BATCH          32          /* 每次系统调用最多的消息数 */
+#define HOST_UDP_MAX_SEGS       64          /* 一条GSO消息最多的数据报数（UDP_MAX_SEGMENTS） */
+#define HOST_UDP_MAX_PAYLOAD    65507       /* 一条消息的最大负载 */
+#define HOST_UDP_SOCK_BUF       (4 * 1024 * 1024)
+
+struct host_udp {
+    int fd;
+    struct sockaddr_in remote;
+    int gso;                    /* 内核支持UDP_SEGMENT */
+    size_t frame_size;          /* 每个接收缓冲区的大小 */
+    uint8_t *rx_buf;            /* HOST_UDP_BATCH个接收缓冲区 */
+};
+
+/**
+ * 填写IPv4地址
+ * @return 0成功，-1地址无效
+ */
+static int host_udp_addr(struct sockaddr_in *sa, const char *ip, uint16_t port) {
+    memset(sa, 0, sizeof(*sa));
+    sa->sin_family = AF_INET;
+    sa->sin_port = htons(port);
+    return inet_pton(AF_INET, ip, &sa->sin_addr) == 1 ? 0 : -1;
+}
+
+/**
+ * 打开通道：绑定本地地址，帧发往固定的对端
+ * @param local_ip 本地地址
+ * @param local_port 本地端口（主机字节序）
+ * @param remote_ip 对端地址
+ * @param remote_port 对端端口（主机字节序）
+ * @param frame_size 最大帧长
+ * @return 通道，失败返回NULL
+ */
+struct host_udp* host_udp_open(const char *local_ip, uint16_t local_port,
+                               const char *remote_ip, uint16_t remote_port, size_t frame_size) {
+    struct sockaddr_in local;
+    struct host_udp *h = calloc(1, sizeof(struct host_udp));
+    if (!h) return NULL;
+
+    h->fd = -1;
+    h->frame_size = frame_size;
+    h->rx_buf = malloc(HOST_UDP_BATCH * frame_size);
+    if (!h->rx_buf) goto fail;
+
+    if (host_udp_addr(&local, local_ip, local_port) < 0 ||
+        host_udp_addr(&h->remote, remote_ip, remote_port) < 0) {
+        goto fail;
+    }
+
+    h->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (h->fd < 0) goto fail;
+
+    /* 一批突发可能有几百个帧，放大内核缓冲区（受rmem_max/wmem_max限制） */
+    int size = HOST_UDP_SOCK_BUF;
+    setsockopt(h->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(h->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    if (bind(h->fd, (struct sockaddr *)&local, sizeof(local)) < 0) goto fail;
+
+    int gso = 0;
+    socklen_t len = sizeof(gso);
+    h->gso = getsockopt(h->fd, SOL_UDP, UDP_SEGMENT, &gso, &len) == 0;
+
+    return h;
+
+fail:
+    if (h->fd >= 0) close(h->fd);
+    free(h->rx_buf);
+    free(h);
+    return NULL;
+}
+
+/**
+ * 关闭通道
+ */
+void host_udp_close(struct host_udp *h) {
+    if (!h) return;
+    close(h->fd);
+    free(h->rx_buf);
+    free(h);
+}
+
+/**
+ * 是否使用GSO发送
+ */
+int host_udp_gso(const struct host_udp *h) {
+    return h ? h->gso : 0;
+}
+
+/**
+ * 关闭GSO（用于对比测试）
+ */
+void host_udp_disable_gso(struct host_udp *h) {
+    if (h) h->gso = 0;
+}
+
+/**
+ * 发送一批帧，每个帧是一个数据报
+ * @param h 通道
+ * @param frames 帧数组
+ * @param lens 帧长数组
+ * @param n 帧数
+ * @return 内核接受的帧数（发送缓冲区满时其余的帧未发出）
+ */
+int host_udp_send(struct host_udp *h, const uint8_t *const *frames, const size_t *lens, int n) {
+    struct mmsghdr msgs[HOST_UDP_BATCH];
+    struct iovec iov[HOST_UDP_BATCH];
+    union {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } ctrl[HOST_UDP_BATCH];
+    int frames_in_msg[HOST_UDP_BATCH];
+    int total = 0;
+    int i = 0;
+
+    while (i < n) {
+        int first = i;
+        int nmsg = 0;
+        int k = 0;
+
+        memset(msgs, 0, sizeof(msgs));
+
+        while (i < n && k < HOST_UDP_BATCH) {
+            /* 一条消息：开启GSO时合并连续等长的帧，只有最后一个可以更短 */
+            int start = k;
+            size_t seg = lens[i];
+            size_t bytes = 0;
+
+            do {
+                iov[k].iov_base = (void *)frames[i];
+                iov[k].iov_len = lens[i];
+                bytes += lens[i];
+                k++;
+                i++;
+            } while (h->gso && i < n && k < HOST_UDP_BATCH && k - start < HOST_UDP_MAX_SEGS &&
+                     lens[i - 1] == seg && lens[i] <= seg && bytes + lens[i] <= HOST_UDP_MAX_PAYLOAD);
+
+            struct msghdr *mh = &msgs[nmsg].msg_hdr;
+            mh->msg_name = &h->remote;
+            mh->msg_namelen = sizeof(h->remote);
+            mh->msg_iov = &iov[start];
+            mh->msg_iovlen = (size_t)(k - start);
+
+            if (k - start > 1) {
+                mh->msg_control = ctrl[nmsg].buf;
+                mh->msg_controllen = sizeof(ctrl[nmsg].buf);
+                struct cmsghdr *cm = CMSG_FIRSTHDR(mh);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type = UDP_SEGMENT;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t gso_size = (uint16_t)seg;
+                memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+            }
+
+            frames_in_msg[nmsg++] = k - start;
+        }
+
+        int sent = sendmmsg(h->fd, msgs, (unsigned int)nmsg, 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                i = first;
+                continue;
+            }
+            /* 探测通过但实际不支持GSO（如出口设备不支持）：退回逐个数据报发送 */
+            if (h->gso && errno != EAGAIN && errno != EWOULDBLOCK) {
+                h->gso = 0;
+                i = first;
+                continue;
+            }
+            return total;
+        }
+
+        for (int m = 0; m < sent; m++) {
+            total += frames_in_msg[m];
+        }
+        if (sent < nmsg) {
+            return total;
+        }
+    }
+
+    return total;
+}
+
+/**
+ * 非阻塞地接收一批帧
+ * @param h 通道
+ * @param frames 返回帧地址（指向通道内部的缓冲区，下次接收前有效）
+ * @param lens 返回帧长（被截断的帧长度不完整，由解析丢弃）
+ * @param n 最多接收的帧数
+ * @return 收到的帧数
+ */
+int host_udp_recv(struct host_udp *h, const uint8_t **frames, size_t *lens, int n) {
+    struct mmsghdr msgs[HOST_UDP_BATCH];
+    struct iovec iov[HOST_UDP_BATCH];
+
+    if (n > HOST_UDP_BATCH) n = HOST_UDP_BATCH;
+    if (n <= 0) return 0;
+
+    memset(msgs, 0, (size_t)n * sizeof(msgs[0]));
+    for (int i = 0; i < n; i++) {
+        iov[i].iov_base = h->rx_buf + (size_t)i * h->frame_size;
+        iov[i].iov_len = h->frame_size;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int count = recvmmsg(h->fd, msgs, (unsigned int)n, MSG_DONTWAIT, NULL);
+    if (count <= 0) return 0;
+
+    for (int i = 0; i < count; i++) {
+        frames[i] = iov[i].iov_base;
+        lens[i] = msgs[i].msg_len;
+    }
+
+    return count;
+}
+
+/**
+ * 等待数据报到达
+ * @param h 通道
+ * @param timeout_ms 超时毫秒数，负数表示一直等待
+ * @return 0
+ */
+int host_udp_wait(struct host_udp *h, int timeout_ms) {
+    struct pollfd pfd = { h->fd, POLLIN, 0 };
+    poll(&pfd, 1, timeout_ms);
+    return 0;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file lpm_trie.c
+ * @brief 最长前缀匹配：IPv4前缀的二叉前缀树，节点存放在一个连续数组里
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 每层按地址的一位选择子节点，前缀长度为n的前缀终止于第n层的节点。
+ * 查找沿目标地址的位向下走，记住途中最后一个前缀终点，最多走32步，与表中的前缀数无关。
+ * 节点用数组下标互相引用（0号是根，不会是子节点，所以下标0表示没有子节点），
+ * 每个节点12字节，插入时按倍数扩容，缓存友好且释放只需一次free。
+ *
+ * 不带锁，由使用者（监听Socket的访问控制、路由表）负责同步。
+ */
+
+#include "socket_internal.h"
+
+#define LPM_TRIE_INIT_NODES     64
+
+/**
+ * 初始化为只有根节点的空树
+ * @return 0成功，-1失败
+ */
+int lpm_trie_init(struct lpm_trie *t) {
+    t->nodes = malloc(LPM_TRIE_INIT_NODES * sizeof(struct lpm_node));
+    if (!t->nodes) return -1;
+
+    t->capacity = LPM_TRIE_INIT_NODES;
+    t->count = 1;
+    t->prefixes = 0;
+    t->nodes[0].child[0] = 0;
+    t->nodes[0].child[1] = 0;
+    t->nodes[0].value = LPM_NONE;
+    return 0;
+}
+
+/**
+ * 释放所有节点
+ */
+void lpm_trie_free(struct lpm_trie *t) {
+    free(t->nodes);
+    t->nodes = NULL;
+    t->count = t->capacity = t->prefixes = 0;
+}
+
+/**
+ * 分配一个空节点
+ * @return 节点下标，失败返回0
+ */
+static uint32_t lpm_node_alloc(struct lpm_trie *t) {
+    if (t->count == t->capacity) {
+        struct lpm_node *nodes = realloc(t->nodes, (size_t)t->capacity * 2 * sizeof(struct lpm_node));
+        if (!nodes) return 0;
+        t->nodes = nodes;
+        t->capacity *= 2;
+    }
+
+    uint32_t index = t->count++;
+    t->nodes[index].child[0] = 0;
+    t->nodes[index].child[1] = 0;
+    t->nodes[index].value = LPM_NONE;
+    return index;
+}
+
+/**
+ * 插入前缀，已存在时替换其值
+ * @param prefix 前缀（主机字节序），前缀长度以外的位被忽略
+ * @param len 前缀长度（0-32）
+ * @param value 值（非负）
+ * @return 0成功，-1失败
+ */
+int lpm_trie_insert(struct lpm_trie *t, uint32_t prefix, int len, int32_t value) {
+    if (len < 0 || len > 32 || value < 0) return -1;
+
+    uint32_t node = 0;
+    for (int depth = 0; depth < len; depth++) {
+        int bit = (prefix >> (31 - depth)) & 1;
+        if (t->nodes[node].child[bit] == 0) {
+            uint32_t child = lpm_node_alloc(t);
+            if (child == 0) return -1;
+            t->nodes[node].child[bit] = child;
+        }
+        node = t->nodes[node].child[bit];
+    }
+
+    if (t->nodes[node].value == LPM_NONE) {
+        t->prefixes++;
+    }
+    t->nodes[node].value = value;
+    return 0;
+}
+
+/**
+ * 查找地址的最长匹配前缀
+ * @param addr 地址（主机字节序）
+ * @return 匹配前缀的值，没有匹配返回LPM_NONE
+ */
+int32_t lpm_trie_lookup(const struct lpm_trie *t, uint32_t addr) {
+    const struct lpm_node *nodes = t->nodes;
+    uint32_t node = 0;
+    int32_t best = nodes[0].value;
+
+    for (int depth = 0; depth < 32; depth++) {
+        node = nodes[node].child[(addr >> (31 - depth)) & 1];
+        if (node == 0) break;
+        if (nodes[node].value != LPM_NONE) {
+            best = nodes[node].value;
+        }
+    }
+    return best;
+}
+
+/**
+ * 精确查找前缀
+ * @param prefix 前缀（主机字节序）
+ * @param len 前缀长度（0-32）
+ * @return 该前缀的值，前缀不存在返回LPM_NONE
+ */
+int32_t lpm_trie_get(const struct lpm_trie *t, uint32_t prefix, int len) {
+    if (len < 0 || len > 32) return LPM_NONE;
+
+    uint32_t node = 0;
+    for (int depth = 0; depth < len; depth++) {
+        node = t->nodes[node].child[(prefix >> (31 - depth)) & 1];
+        if (node == 0) return LPM_NONE;
+    }
+    return t->nodes[node].value;
+}
+
+/**
+ * 删除前缀（节点保留，只清除前缀终点标记；被删除前缀覆盖的地址改为匹配更短的前缀）
+ * @param prefix 前缀（主机字节序）
+ * @param len 前缀长度（0-32）
+ * @return 0成功，-1前缀不存在
+ */
+int lpm_trie_remove(struct lpm_trie *t, uint32_t prefix, int len) {
+    if (len < 0 || len > 32) return -1;
+
+    uint32_t node = 0;
+    for (int depth = 0; depth < len; depth++) {
+        node = t->nodes[node].child[(prefix >> (31 - depth)) & 1];
+        if (node == 0) return -1;
+    }
+
+    if (t->nodes[node].value == LPM_NONE) return -1;
+    t->nodes[node].value = LPM_NONE;
+    t->prefixes--;
+    return 0;
+}
@@ -0,0 +1,293 @@
+/**
+ * @file netdev.c
+ * @brief 虚拟网卡：协议栈与收发通道之间的设备层，以及进程内回环驱动
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * packet_send经发送队列调用netdev_tx_burst，需要轮询的设备由socket_rx_process
+ * 调用netdev_poll收包并交给packet_deliver，协议代码不关心包走的是哪条通道。
+ * 设备声明MTU和能力（NETDEV_F_*）：超过MTU的包在设备层丢弃，
+ * 只有声明NETDEV_F_HW_CSUM的设备才会收到未计算校验和的包。
+ *
+ * 回环驱动就是原来的直接投递：在发送方调用栈中查找目标Socket并处理，
+ * 同一批中发往同一四元组的包只查找一次。没有打开其他设备时使用内置的回环设备。
+ */
+
+#include "socket_internal.h"
+
+/* 已知的驱动 */
+static const struct netdev_ops *netdev_drivers[] = {
+    &netdev_loopback_ops,
+    &netdev_pcap_ops,
+    &netdev_udp_ops,
+    &netdev_shm_ops,
+    NULL
+};
+
+/* 内置回环设备 */
+static struct netdev loopback_dev = {
+    .ops = &netdev_loopback_ops,
+    .mtu = NETDEV_MAX_MTU,
+    .features = NETDEV_F_HW_CSUM | NETDEV_F_RXCSUM,
+};
+
+/* 当前设备，NULL表示内置回环设备 */
+static struct netdev *default_dev = NULL;
+
+/**
+ * 打开设备
+ * @param driver 驱动名（"loopback"、"pcap"、"udp"、"shm"）
+ * @param arg 驱动参数，含义由驱动决定，可为NULL
+ * @return 设备指针，失败返回NULL
+ */
+struct netdev* netdev_open(const char *driver, const char *arg) {
+    if (!driver) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return NULL;
+    }
+
+    const struct netdev_ops *ops = NULL;
+    for (int i = 0; netdev_drivers[i]; i++) {
+        if (strcmp(netdev_drivers[i]->name, driver) == 0) {
+            ops = netdev_drivers[i];
+            break;
+        }
+    }
+
+    if (!ops) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return NULL;
+    }
+
+    struct netdev *dev = calloc(1, sizeof(struct netdev));
+    if (!dev) {
+        socket_set_error(MYSOCKET_ENOMEM);
+        return NULL;
+    }
+
+    dev->ops = ops;
+    dev->mtu = NETDEV_MAX_MTU;
+
+    if (ops->open && ops->open(dev, arg) < 0) {
+        free(dev);
+        return NULL;
+    }
+
+    DEBUG_PRINT("打开设备: driver=%s, mtu=%u, features=%#x", driver, dev->mtu, dev->features);
+    return dev;
+}
+
+/**
+ * 关闭设备，正在使用的设备关闭后恢复为内置回环设备，经过它的路由被删除
+ * @param dev 设备指针
+ */
+void netdev_close(struct netdev *dev) {
+    if (!dev || dev == &loopback_dev) return;
+
+    struct netdev *expected = dev;
+    __atomic_compare_exchange_n(&default_dev, &expected, NULL, 0,
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+
+    /* 经过该设备的路由失效，连接重新查找出口设备 */
+    route_flush_dev(dev);
+
+    if (dev->ops->close) {
+        dev->ops->close(dev);
+    }
+    free(dev);
+}
+
+/**
+ * 设置协议栈使用的设备
+ * @param dev 设备指针，NULL恢复内置回环设备
+ */
+void netdev_set_default(struct netdev *dev) {
+    __atomic_store_n(&default_dev, dev, __ATOMIC_RELEASE);
+    route_invalidate();
+}
+
+/**
+ * 获取协议栈使用的设备
+ * @return 设备指针（不会为NULL）
+ */
+struct netdev* netdev_get_default(void) {
+    struct netdev *dev = __atomic_load_n(&default_dev, __ATOMIC_ACQUIRE);
+    return dev ? dev : &loopback_dev;
+}
+
+/**
+ * 设置设备MTU
+ * @param dev 设备指针
+ * @param mtu 线格式IP包的最大长度
+ * @return 0成功，-1失败
+ */
+int netdev_set_mtu(struct netdev *dev, uint32_t mtu) {
+    if (!dev || mtu < NETDEV_MIN_MTU || mtu > NETDEV_MAX_MTU) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    dev->mtu = mtu;
+    return 0;
+}
+
+/**
+ * 发送一批包，超过MTU的包不交给驱动
+ * @param dev 设备指针
+ * @param pkts 数据包数组（调用者保留所有权）
+ * @param n 包数
+ * @return 发出的包数
+ */
+int netdev_tx_burst(struct netdev *dev, struct packet **pkts, int n) {
+    struct packet *burst[PACKET_TX_BATCH];
+    int sent = 0;
+    int i = 0;
+
+    while (i < n) {
+        int count = 0;
+        uint64_t bytes = 0;
+
+        while (i < n && count < PACKET_TX_BATCH) {
+            struct packet *pkt = pkts[i++];
+            size_t len = packet_wire_len(pkt);
+
+            if (len > dev->mtu) {
+                DEBUG_PRINT("超过MTU，丢弃: len=%zu, mtu=%u", len, dev->mtu);
+                __atomic_add_fetch(&dev->stats.tx_dropped, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            bytes += len;
+            burst[count++] = pkt;
+        }
+
+        if (count == 0) continue;
+
+        int done = dev->ops->tx_burst(dev, burst, count);
+        sent += done;
+
+        __atomic_add_fetch(&dev->stats.tx_packets, (uint64_t)done, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&dev->stats.tx_bytes, bytes, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&dev->stats.tx_bursts, 1, __ATOMIC_RELAXED);
+        if (done < count) {
+            __atomic_add_fetch(&dev->stats.tx_dropped, (uint64_t)(count - done), __ATOMIC_RELAXED);
+        }
+    }
+
+    return sent;
+}
+
+/**
+ * 从设备收取一批包
+ * @param dev 设备指针
+ * @param pkts 返回的数据包（调用者负责释放）
+ * @param n 最多收取的包数
+ * @return 收到的包数
+ */
+int netdev_rx_burst(struct netdev *dev, struct packet **pkts, int n) {
+    if (!dev->ops->rx_burst || n <= 0) return 0;
+
+    int count = dev->ops->rx_burst(dev, pkts, n);
+    if (count <= 0) return 0;
+
+    uint64_t bytes = 0;
+    for (int i = 0; i < count; i++) {
+        bytes += packet_wire_len(pkts[i]);
+    }
+
+    __atomic_add_fetch(&dev->stats.rx_packets, (uint64_t)count, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dev->stats.rx_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dev->stats.rx_bursts, 1, __ATOMIC_RELAXED);
+
+    return count;
+}
+
+/**
+ * 从设备收包并投递给协议栈
+ * @param dev 设备指针
+ * @param budget 最多处理的包数
+ * @return 处理的包数
+ */
+int netdev_poll(struct netdev *dev, int budget) {
+    if (!dev) return 0;
+
+    struct packet *pkts[PACKET_TX_BATCH];
+    int total = 0;
+
+    /* 处理过程中产生的回复攒成一批发送 */
+    packet_tx_begin();
+    while (total < budget) {
+        int want = budget - total < PACKET_TX_BATCH ? budget - total : PACKET_TX_BATCH;
+        int n = netdev_rx_burst(dev, pkts, want);
+        if (n == 0) break;
+
+        for (int i = 0; i < n; i++) {
+            if ((dev->features & NETDEV_F_RXCSUM) && pkts[i]->ip_summed == PACKET_CSUM_NONE) {
+                pkts[i]->ip_summed = PACKET_CSUM_UNNECESSARY;
+            }
+            packet_deliver(pkts[i]);
+            packet_destroy(pkts[i]);
+        }
+        total += n;
+    }
+    packet_tx_end();
+
+    return total;
+}
+
+/**
+ * 没有包可收时睡眠，直到有包到达或超时（设备不支持时立即返回）
+ * @param dev 设备指针，NULL表示当前设备
+ * @param timeout_ms 超时毫秒数，负数表示一直等待
+ * @return 0
+ */
+int netdev_wait(struct netdev *dev, int timeout_ms) {
+    if (!dev) dev = netdev_get_default();
+    if (!dev->ops->wait) return 0;
+    return dev->ops->wait(dev, timeout_ms);
+}
+
+/**
+ * 获取设备统计
+ * @param dev 设备指针，NULL表示当前设备
+ * @param stats 返回统计信息
+ */
+void netdev_get_stats(const struct netdev *dev, struct netdev_stats *stats) {
+    if (!stats) return;
+    if (!dev) dev = netdev_get_default();
+    *stats = dev->stats;
+}
+
+/* ==================== 回环驱动 ==================== */
+
+static int loopback_open(struct netdev *dev, const char *arg) {
+    (void)arg;
+    dev->features = NETDEV_F_HW_CSUM | NETDEV_F_RXCSUM;
+    return 0;
+}
+
+/**
+ * 回环发送：直接投递到目标Socket，同一批复用目标查找结果
+ */
+static int loopback_tx_burst(struct netdev *dev, struct packet **pkts, int n) {
+    struct packet_dst_cache cache;
+    int sent = 0;
+
+    memset(&cache, 0, sizeof(cache));
+    for (int i = 0; i < n; i++) {
+        if (packet_deliver_cached(pkts[i], &cache) == 0) {
+            sent++;
+        }
+    }
+
+    __atomic_add_fetch(&dev->stats.lookup_hits, cache.hits, __ATOMIC_RELAXED);
+    return sent;
+}
+
+const struct netdev_ops netdev_loopback_ops = {
+    .name = "loopback",
+    .open = loopback_open,
+    .close = NULL,
+    .tx_burst = loopback_tx_burst,
+    .rx_burst = NULL,
+    .wait = NULL,
+};
@@ -0,0 +1,248 @@
+/**
+ * @file netdev_pcap.c
+ * @brief pcap文件驱动：把发出的包写入抓包文件，或把抓包文件中的包重放给协议栈
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 参数形如"tx=out.pcap,rx=in.pcap"，两项都可以省略。
+ * 发送的包按线格式序列化后写入（LINKTYPE_RAW，每条记录是一个IPv4包），
+ * 可以直接用Wireshark/tcpdump查看；接收时按记录读取，
+ * 支持两种字节序、微秒/纳秒时间戳，以及RAW、IPV4和以太网链路类型，畸形帧计入rx_dropped。
+ * 序列化时才计算卸载的校验和，所以声明NETDEV_F_HW_CSUM；读入的包不做额外校验。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+
+#define PCAP_MAGIC              0xa1b2c3d4  /* 微秒时间戳 */
+#define PCAP_MAGIC_NSEC         0xa1b23c4d  /* 纳秒时间戳 */
+#define PCAP_VERSION_MAJOR      2
+#define PCAP_VERSION_MINOR      4
+#define PCAP_SNAPLEN            NETDEV_MAX_MTU
+#define PCAP_FILE_HDR_LEN       24
+#define PCAP_REC_HDR_LEN        16
+
+#define PCAP_LINKTYPE_ETHERNET  1
+#define PCAP_LINKTYPE_RAW       101
+#define PCAP_LINKTYPE_IPV4      228
+
+#define PCAP_ETH_HDR_LEN        14
+#define PCAP_ETHERTYPE_IPV4     0x0800
+
+#define PCAP_PATH_MAX           256
+
+/* 驱动私有数据 */
+struct pcap_priv {
+    FILE *tx;                   /* 写入发出的包，NULL表示丢弃 */
+    FILE *rx;                   /* 重放的抓包文件，NULL表示不收包 */
+    int rx_swapped;             /* 文件字节序与本机相反 */
+    uint32_t rx_linktype;
+    pthread_mutex_t lock;       /* 帧缓冲区收发共用 */
+    uint8_t frame[PCAP_SNAPLEN];
+};
+
+static uint32_t pcap_swap32(uint32_t v) {
+    return ((v & 0xff) << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) | (v >> 24);
+}
+
+/* 文件头和记录头都是写入方的本机字节序 */
+static void pcap_put16(uint8_t *p, uint16_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+static void pcap_put32(uint8_t *p, uint32_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+/**
+ * 写文件头
+ */
+static int pcap_write_file_header(FILE *fp) {
+    uint8_t hdr[PCAP_FILE_HDR_LEN];
+
+    pcap_put32(hdr, PCAP_MAGIC);
+    pcap_put16(hdr + 4, PCAP_VERSION_MAJOR);
+    pcap_put16(hdr + 6, PCAP_VERSION_MINOR);
+    pcap_put32(hdr + 8, 0);     /* 时区 */
+    pcap_put32(hdr + 12, 0);    /* 时间戳精度 */
+    pcap_put32(hdr + 16, PCAP_SNAPLEN);
+    pcap_put32(hdr + 20, PCAP_LINKTYPE_RAW);
+
+    return fwrite(hdr, sizeof(hdr), 1, fp) == 1 ? 0 : -1;
+}
+
+/**
+ * 读文件头，确定字节序和链路类型
+ */
+static int pcap_read_file_header(struct pcap_priv *priv) {
+    uint32_t hdr[6];
+
+    if (fread(hdr, PCAP_FILE_HDR_LEN, 1, priv->rx) != 1) return -1;
+
+    if (hdr[0] == PCAP_MAGIC || hdr[0] == PCAP_MAGIC_NSEC) {
+        priv->rx_swapped = 0;
+    } else if (pcap_swap32(hdr[0]) == PCAP_MAGIC || pcap_swap32(hdr[0]) == PCAP_MAGIC_NSEC) {
+        priv->rx_swapped = 1;
+    } else {
+        return -1;
+    }
+
+    priv->rx_linktype = priv->rx_swapped ? pcap_swap32(hdr[5]) : hdr[5];
+    if (priv->rx_linktype != PCAP_LINKTYPE_RAW && priv->rx_linktype != PCAP_LINKTYPE_IPV4 &&
+        priv->rx_linktype != PCAP_LINKTYPE_ETHERNET) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void pcap_close(struct netdev *dev) {
+    struct pcap_priv *priv = dev->priv;
+    if (!priv) return;
+
+    if (priv->tx) fclose(priv->tx);
+    if (priv->rx) fclose(priv->rx);
+    pthread_mutex_destroy(&priv->lock);
+    free(priv);
+    dev->priv = NULL;
+}
+
+/**
+ * 打开抓包文件
+ * @param dev 设备
+ * @param arg "tx=<文件>,rx=<文件>"
+ * @return 0成功，-1失败
+ */
+static int pcap_open(struct netdev *dev, const char *arg) {
+    struct pcap_priv *priv = calloc(1, sizeof(struct pcap_priv));
+    if (!priv) {
+        socket_set_error(MYSOCKET_ENOMEM);
+        return -1;
+    }
+    dev->priv = priv;
+    dev->mtu = 1500;
+    dev->features = NETDEV_F_HW_CSUM;
+    pthread_mutex_init(&priv->lock, NULL);
+
+    char buf[2 * PCAP_PATH_MAX];
+    char *saveptr = NULL;
+
+    if (arg && strlen(arg) >= sizeof(buf)) goto invalid;
+    strcpy(buf, arg ? arg : "");
+
+    for (char *item = strtok_r(buf, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        if (strncmp(item, "tx=", 3) == 0 && !priv->tx) {
+            priv->tx = fopen(item + 3, "wb");
+            if (!priv->tx || pcap_write_file_header(priv->tx) < 0) goto invalid;
+        } else if (strncmp(item, "rx=", 3) == 0 && !priv->rx) {
+            priv->rx = fopen(item + 3, "rb");
+            if (!priv->rx || pcap_read_file_header(priv) < 0) goto invalid;
+        } else {
+            goto invalid;
+        }
+    }
+
+    return 0;
+
+invalid:
+    DEBUG_PRINT("打开pcap设备失败: %s", arg ? arg : "");
+    pcap_close(dev);
+    socket_set_error(MYSOCKET_EINVAL);
+    return -1;
+}
+
+/**
+ * 把包序列化后追加到抓包文件，没有tx文件时丢弃（仍算发出）
+ */
+static int pcap_tx_burst(struct netdev *dev, struct packet **pkts, int n) {
+    struct pcap_priv *priv = dev->priv;
+    if (!priv->tx) return n;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    pthread_mutex_lock(&priv->lock);
+
+    int sent = 0;
+    for (int i = 0; i < n; i++) {
+        ssize_t len = packet_serialize(pkts[i], priv->frame, sizeof(priv->frame));
+        if (len < 0) continue;
+
+        uint8_t rec[PCAP_REC_HDR_LEN];
+        pcap_put32(rec, (uint32_t)ts.tv_sec);
+        pcap_put32(rec + 4, (uint32_t)(ts.tv_nsec / 1000));
+        pcap_put32(rec + 8, (uint32_t)len);     /* 记录长度 */
+        pcap_put32(rec + 12, (uint32_t)len);    /* 原始长度 */
+
+        if (fwrite(rec, sizeof(rec), 1, priv->tx) != 1 ||
+            fwrite(priv->frame, (size_t)len, 1, priv->tx) != 1) {
+            break;
+        }
+        sent++;
+    }
+
+    pthread_mutex_unlock(&priv->lock);
+    return sent;
+}
+
+/**
+ * 从抓包文件读取下一批TCP包，到文件末尾后不再返回包
+ */
+static int pcap_rx_burst(struct netdev *dev, struct packet **pkts, int n) {
+    struct pcap_priv *priv = dev->priv;
+    if (!priv->rx) return 0;
+
+    pthread_mutex_lock(&priv->lock);
+
+    int count = 0;
+    while (count < n) {
+        uint32_t rec[4];
+        if (fread(rec, PCAP_REC_HDR_LEN, 1, priv->rx) != 1) break;
+
+        uint32_t caplen = priv->rx_swapped ? pcap_swap32(rec[2]) : rec[2];
+        if (caplen > sizeof(priv->frame)) {
+            dev->stats.rx_dropped++;
+            if (fseek(priv->rx, (long)caplen, SEEK_CUR) != 0) break;
+            continue;
+        }
+        if (fread(priv->frame, caplen, 1, priv->rx) != 1 && caplen > 0) break;
+
+        const uint8_t *frame = priv->frame;
+        size_t len = caplen;
+
+        if (priv->rx_linktype == PCAP_LINKTYPE_ETHERNET) {
+            if (len < PCAP_ETH_HDR_LEN ||
+                ((frame[12] << 8) | frame[13]) != PCAP_ETHERTYPE_IPV4) {
+                dev->stats.rx_dropped++;
+                continue;
+            }
+            frame += PCAP_ETH_HDR_LEN;
+            len -= PCAP_ETH_HDR_LEN;
+        }
+
+        struct packet_wire_info info;
+        struct packet *pkt = NULL;
+        if (packet_parse(frame, len, &info) == 0 && info.protocol == IPPROTO_TCP) {
+            pkt = packet_from_wire(&info);
+        }
+        if (!pkt) {
+            dev->stats.rx_dropped++;
+            continue;
+        }
+
+        pkts[count++] = pkt;
+    }
+
+    pthread_mutex_unlock(&priv->lock);
+    return count;
+}
+
+const struct netdev_ops netdev_pcap_ops = {
+    .name = "pcap",
+    .open = pcap_open,
+    .close = pcap_close,
+    .tx_burst = pcap_tx_burst,
+    .rx_burst = pcap_rx_burst,
+    .wait = NULL,
+};
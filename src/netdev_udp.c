@@ -0,0 +1,205 @@
+/**
+ * @file netdev_udp.c
+ * @brief UDP封装驱动：把线格式的包装进主机UDP数据报，让不同进程中的协议栈互通
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 参数形如"local=127.0.0.1:9001,remote=127.0.0.1:9002"，可选"gso=0"关闭GSO。
+ * 每个进程打开一个设备，本地端口收、对端端口发；两端设备互为对端，
+ * 客户端和服务端进程就能用本项目的TCP实现端到端通信（也可以本地和对端相同，自发自收）。
+ *
+ * 发送时每个包序列化为一个帧（序列化时才计算卸载的校验和，所以声明NETDEV_F_HW_CSUM），
+ * 整批交给host_udp_send；主机发送缓冲区满时多出的帧算作链路上丢包，由TCP重传恢复。
+ * 接收时由socket_rx_process轮询，一次取一批数据报解析成包。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+
+#define UDP_DEV_ADDR_LEN        64
+
+/* 驱动私有数据 */
+struct udp_priv {
+    struct host_udp *host;
+    uint8_t *tx_frames;         /* PACKET_TX_BATCH个帧缓冲区 */
+    pthread_mutex_t tx_lock;    /* 帧缓冲区和主机套接字的收发各自只允许一个线程 */
+    pthread_mutex_t rx_lock;
+};
+
+/**
+ * 解析"地址:端口"
+ * @return 0成功，-1格式错误
+ */
+static int udp_parse_endpoint(const char *str, char *ip, size_t ip_size, uint16_t *port) {
+    const char *colon = strrchr(str, ':');
+    if (!colon || colon == str || (size_t)(colon - str) >= ip_size) return -1;
+
+    char *end = NULL;
+    long value = strtol(colon + 1, &end, 10);
+    if (*end != '\0' || value <= 0 || value > 65535) return -1;
+
+    memcpy(ip, str, (size_t)(colon - str));
+    ip[colon - str] = '\0';
+    *port = (uint16_t)value;
+    return 0;
+}
+
+static void udp_close(struct netdev *dev) {
+    struct udp_priv *priv = dev->priv;
+    if (!priv) return;
+
+    host_udp_close(priv->host);
+    pthread_mutex_destroy(&priv->tx_lock);
+    pthread_mutex_destroy(&priv->rx_lock);
+    free(priv->tx_frames);
+    free(priv);
+    dev->priv = NULL;
+}
+
+/**
+ * 打开设备
+ * @param dev 设备
+ * @param arg "local=<地址:端口>,remote=<地址:端口>[,gso=0]"
+ * @return 0成功，-1失败
+ */
+static int udp_open(struct netdev *dev, const char *arg) {
+    char local_ip[UDP_DEV_ADDR_LEN] = "", remote_ip[UDP_DEV_ADDR_LEN] = "";
+    uint16_t local_port = 0, remote_port = 0;
+    int gso = 1;
+
+    char buf[4 * UDP_DEV_ADDR_LEN];
+    char *saveptr = NULL;
+
+    if (!arg || strlen(arg) >= sizeof(buf)) goto invalid;
+    strcpy(buf, arg);
+
+    for (char *item = strtok_r(buf, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        if (strncmp(item, "local=", 6) == 0) {
+            if (udp_parse_endpoint(item + 6, local_ip, sizeof(local_ip), &local_port) < 0) goto invalid;
+        } else if (strncmp(item, "remote=", 7) == 0) {
+            if (udp_parse_endpoint(item + 7, remote_ip, sizeof(remote_ip), &remote_port) < 0) goto invalid;
+        } else if (strcmp(item, "gso=0") == 0) {
+            gso = 0;
+        } else {
+            goto invalid;
+        }
+    }
+
+    if (local_port == 0 || remote_port == 0) goto invalid;
+
+    struct udp_priv *priv = calloc(1, sizeof(struct udp_priv));
+    if (!priv) {
+        socket_set_error(MYSOCKET_ENOMEM);
+        return -1;
+    }
+    dev->priv = priv;
+    pthread_mutex_init(&priv->tx_lock, NULL);
+    pthread_mutex_init(&priv->rx_lock, NULL);
+
+    priv->tx_frames = malloc((size_t)PACKET_TX_BATCH * NETDEV_MAX_MTU);
+    priv->host = host_udp_open(local_ip, local_port, remote_ip, remote_port, NETDEV_MAX_MTU);
+    if (!priv->tx_frames || !priv->host) {
+        DEBUG_PRINT("打开主机UDP套接字失败: %s", arg);
+        udp_close(dev);
+        socket_set_error(MYSOCKET_EADDRINUSE);
+        return -1;
+    }
+
+    if (!gso) {
+        host_udp_disable_gso(priv->host);
+    }
+
+    dev->mtu = 1500;
+    dev->features = NETDEV_F_HW_CSUM;
+    DEBUG_PRINT("UDP封装设备: %s:%u -> %s:%u, gso=%d",
+                local_ip, local_port, remote_ip, remote_port, host_udp_gso(priv->host));
+    return 0;
+
+invalid:
+    socket_set_error(MYSOCKET_EINVAL);
+    return -1;
+}
+
+/**
+ * 序列化后整批发送，主机缓冲区满时多出的帧按丢包处理
+ */
+static int udp_tx_burst(struct netdev *dev, struct packet **pkts, int n) {
+    struct udp_priv *priv = dev->priv;
+    const uint8_t *frames[PACKET_TX_BATCH];
+    size_t lens[PACKET_TX_BATCH];
+    int count = 0;
+
+    pthread_mutex_lock(&priv->tx_lock);
+
+    for (int i = 0; i < n; i++) {
+        uint8_t *frame = priv->tx_frames + (size_t)count * NETDEV_MAX_MTU;
+        ssize_t len = packet_serialize(pkts[i], frame, NETDEV_MAX_MTU);
+        if (len < 0) continue;
+
+        frames[count] = frame;
+        lens[count] = (size_t)len;
+        count++;
+    }
+
+    int sent = host_udp_send(priv->host, frames, lens, count);
+
+    pthread_mutex_unlock(&priv->tx_lock);
+
+    if (sent < count) {
+        __atomic_add_fetch(&dev->stats.tx_dropped, (uint64_t)(count - sent), __ATOMIC_RELAXED);
+    }
+
+    return count;
+}
+
+/**
+ * 取一批数据报解析成包；其他线程正在收取时直接返回
+ */
+static int udp_rx_burst(struct netdev *dev, struct packet **pkts, int n) {
+    struct udp_priv *priv = dev->priv;
+    const uint8_t *frames[PACKET_TX_BATCH];
+    size_t lens[PACKET_TX_BATCH];
+
+    if (pthread_mutex_trylock(&priv->rx_lock) != 0) {
+        return 0;
+    }
+
+    if (n > PACKET_TX_BATCH) n = PACKET_TX_BATCH;
+    int received = host_udp_recv(priv->host, frames, lens, n);
+    int count = 0;
+
+    for (int i = 0; i < received; i++) {
+        struct packet_wire_info info;
+        struct packet *pkt = NULL;
+
+        if (packet_parse(frames[i], lens[i], &info) == 0 && info.protocol == IPPROTO_TCP) {
+            pkt = packet_from_wire(&info);
+        }
+        if (!pkt) {
+            __atomic_add_fetch(&dev->stats.rx_dropped, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        pkts[count++] = pkt;
+    }
+
+    pthread_mutex_unlock(&priv->rx_lock);
+    return count;
+}
+
+/**
+ * 主机套接字上没有数据报时睡眠
+ */
+static int udp_wait(struct netdev *dev, int timeout_ms) {
+    struct udp_priv *priv = dev->priv;
+    return host_udp_wait(priv->host, timeout_ms);
+}
+
+const struct netdev_ops netdev_udp_ops = {
+    .name = "udp",
+    .open = udp_open,
+    .close = udp_close,
+    .tx_burst = udp_tx_burst,
+    .rx_burst = udp_rx_burst,
+    .wait = udp_wait,
+};
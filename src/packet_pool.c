@@ -0,0 +1,368 @@
+/**
+ * @file packet_pool.c
+ * @brief 数据包缓冲区与对象池
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 数据包仿照Linux的sk_buff：包结构和缓冲区是一次连续分配，
+ * 缓冲区开头预留包头空间，head/data/data_len/end描述有效数据的位置，
+ * 通过put/push/pull/trim在两端增删数据而不移动负载。
+ * 克隆只分配一个不带缓冲区的包头，与原始包共享缓冲区并增加引用计数，
+ * 重传和多路投递都不再复制负载；共享的缓冲区只读，需要写入时先packet_copy。
+ *
+ * 包也可以引用外部缓冲区（packet_alloc_ext）：包头不带缓冲区，负载直接指向外部内存，
+ * 外部缓冲区按引用计数在最后一个包释放后归还，这样的负载始终视为共享（只读）。
+ *
+ * 每个线程按类别维护空闲包链表，packet_destroy把包放回当前线程的链表，
+ * 稳态下收发路径不再调用分配器。包可以在一个线程创建、在另一个线程释放。
+ */
+
+#include "socket_internal.h"
+#include <stddef.h>
+
+/* 包结构中分配时需要清零的部分（缓冲区管理字段之前） */
+#define PACKET_HDR_BYTES    offsetof(struct packet, head)
+
+/* 每线程对象池 */
+struct packet_pool {
+    struct packet *free_list[PACKET_POOL_CLASSES];
+    size_t cached[PACKET_POOL_CLASSES];
+    struct packet_pool_stats stats;
+    int registered;             /* 是否已登记线程退出时的清理函数 */
+};
+
+static __thread struct packet_pool thread_pool;
+
+static pthread_key_t pool_key;
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * 释放对象池中缓存的所有包
+ * @param pool 对象池
+ */
+static void packet_pool_release(struct packet_pool *pool) {
+    for (int i = 0; i < PACKET_POOL_CLASSES; i++) {
+        while (pool->free_list[i]) {
+            struct packet *pkt = pool->free_list[i];
+            pool->free_list[i] = pkt->next;
+            free(pkt);
+        }
+        pool->cached[i] = 0;
+    }
+    pool->stats.cached = 0;
+}
+
+/**
+ * 线程退出时释放该线程缓存的包
+ */
+static void packet_pool_thread_exit(void *arg) {
+    packet_pool_release((struct packet_pool *)arg);
+}
+
+static void packet_pool_key_init(void) {
+    pthread_key_create(&pool_key, packet_pool_thread_exit);
+}
+
+/**
+ * 获取当前线程的对象池，首次使用时登记线程退出清理
+ */
+static struct packet_pool* packet_pool_get(void) {
+    struct packet_pool *pool = &thread_pool;
+
+    if (!pool->registered) {
+        pthread_once(&pool_key_once, packet_pool_key_init);
+        pthread_setspecific(pool_key, pool);
+        pool->registered = 1;
+    }
+
+    return pool;
+}
+
+/**
+ * 从对象池取一个包结构（包头字段已清零）
+ * @param pool_class 对象池类别
+ * @param buf_size 缓冲区大小（PACKET_POOL_NONE时使用）
+ * @return 包指针，失败返回NULL
+ */
+static struct packet* packet_pool_take(uint8_t pool_class, size_t buf_size) {
+    struct packet_pool *pool = packet_pool_get();
+    struct packet *pkt = NULL;
+
+    pool->stats.allocs++;
+
+    if (pool_class != PACKET_POOL_NONE && pool->free_list[pool_class]) {
+        pkt = pool->free_list[pool_class];
+        pool->free_list[pool_class] = pkt->next;
+        pool->cached[pool_class]--;
+        pool->stats.cached--;
+        pool->stats.pool_hits++;
+    } else {
+        pkt = malloc(sizeof(struct packet) + buf_size);
+        if (!pkt) return NULL;
+        pool->stats.heap_allocs++;
+    }
+
+    memset(pkt, 0, PACKET_HDR_BYTES);
+    pkt->pool_class = pool_class;
+
+    return pkt;
+}
+
+/**
+ * 归还包结构到当前线程的对象池
+ * @param pkt 包指针
+ */
+static void packet_pool_put(struct packet *pkt) {
+    struct packet_pool *pool = packet_pool_get();
+    uint8_t pool_class = pkt->pool_class;
+
+    if (pool_class == PACKET_POOL_NONE || pool->cached[pool_class] >= PACKET_POOL_MAX_CACHED) {
+        free(pkt);
+        return;
+    }
+
+    pkt->next = pool->free_list[pool_class];
+    pool->free_list[pool_class] = pkt;
+    pool->cached[pool_class]++;
+    pool->stats.cached++;
+}
+
+/**
+ * 分配数据包，缓冲区可容纳size字节数据，并已预留PACKET_HEADROOM的包头空间
+ * @param size 数据区大小，不超过PACKET_INLINE_SIZE时使用对象池
+ * @return 数据包指针（data_len为0），失败返回NULL
+ */
+struct packet* packet_alloc(size_t size) {
+    uint8_t pool_class = PACKET_POOL_FULL;
+    size_t buf_size = PACKET_HEADROOM + PACKET_INLINE_SIZE;
+
+    if (size > PACKET_INLINE_SIZE) {
+        pool_class = PACKET_POOL_NONE;
+        buf_size = PACKET_HEADROOM + size;
+    }
+
+    struct packet *pkt = packet_pool_take(pool_class, buf_size);
+    if (!pkt) return NULL;
+
+    pkt->head = pkt->buf;
+    pkt->end = pkt->buf + buf_size;
+    pkt->data = pkt->head + PACKET_HEADROOM;
+    pkt->owner = pkt;
+    pkt->dataref = 1;
+    pkt->extbuf = NULL;
+    pkt->truesize = sizeof(struct packet) + buf_size;
+
+    return pkt;
+}
+
+/**
+ * 分配负载引用外部缓冲区的数据包，不复制数据
+ * @param ext 外部缓冲区（增加一个引用）
+ * @param data 负载起始地址（位于ext中）
+ * @param len 负载长度
+ * @return 数据包指针，失败返回NULL
+ */
+struct packet* packet_alloc_ext(struct packet_extbuf *ext, const char *data, size_t len) {
+    if (!ext || !data) return NULL;
+
+    struct packet *pkt = packet_pool_take(PACKET_POOL_CLONE, 0);
+    if (!pkt) return NULL;
+
+    packet_extbuf_get(ext);
+    pkt->head = (char *)data;
+    pkt->end = (char *)data + len;
+    pkt->data = pkt->head;
+    pkt->data_len = len;
+    pkt->owner = pkt;
+    pkt->dataref = 1;
+    pkt->extbuf = ext;
+    pkt->truesize = sizeof(struct packet) + len;
+
+    return pkt;
+}
+
+void packet_extbuf_get(struct packet_extbuf *ext) {
+    __atomic_add_fetch(&ext->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * 释放外部缓冲区的一个引用，最后一个引用释放时调用release
+ */
+void packet_extbuf_put(struct packet_extbuf *ext) {
+    if (ext && __atomic_sub_fetch(&ext->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        ext->release(ext);
+    }
+}
+
+/**
+ * 创建不带数据的数据包
+ * @return 数据包指针，失败返回NULL
+ */
+struct packet* packet_create(void) {
+    return packet_alloc(0);
+}
+
+/**
+ * 销毁数据包：克隆头直接归还，缓冲区在最后一个引用释放时归还
+ * @param pkt 数据包指针
+ */
+void packet_destroy(struct packet *pkt) {
+    if (!pkt) return;
+
+    struct packet *owner = pkt->owner;
+
+    if (owner != pkt) {
+        packet_pool_put(pkt);
+    }
+
+    if (__atomic_sub_fetch(&owner->dataref, 1, __ATOMIC_ACQ_REL) == 0) {
+        packet_extbuf_put(owner->extbuf);
+        packet_pool_put(owner);
+    }
+}
+
+/**
+ * 克隆数据包：复制包头和控制信息，共享缓冲区
+ * @param pkt 源数据包
+ * @return 新数据包，失败返回NULL
+ */
+struct packet* packet_clone(const struct packet *pkt) {
+    if (!pkt) return NULL;
+
+    struct packet *clone = packet_pool_take(PACKET_POOL_CLONE, 0);
+    if (!clone) return NULL;
+
+    struct packet *owner = pkt->owner;
+    __atomic_add_fetch(&owner->dataref, 1, __ATOMIC_RELAXED);
+
+    memcpy(clone, pkt, PACKET_HDR_BYTES);
+    clone->next = NULL;
+    clone->head = pkt->head;
+    clone->end = pkt->end;
+    clone->owner = owner;
+    clone->extbuf = NULL;
+    clone->truesize = pkt->truesize;
+
+    packet_pool_get()->stats.clones++;
+
+    return clone;
+}
+
+/**
+ * 复制数据包：包头和数据都复制到新的私有缓冲区
+ * @param pkt 源数据包
+ * @return 新数据包，失败返回NULL
+ */
+struct packet* packet_copy(const struct packet *pkt) {
+    if (!pkt) return NULL;
+
+    struct packet *copy = packet_alloc(pkt->data_len);
+    if (!copy) return NULL;
+
+    char *data = copy->data;
+    memcpy(copy, pkt, PACKET_HDR_BYTES);
+    copy->next = NULL;
+    copy->data = data;
+    copy->data_len = 0;
+
+    if (pkt->data_len > 0) {
+        memcpy(packet_put(copy, pkt->data_len), pkt->data, pkt->data_len);
+    }
+
+    return copy;
+}
+
+/**
+ * 缓冲区是否与其他包共享（外部缓冲区总是视为共享）
+ * @param pkt 数据包
+ * @return 1共享，0私有
+ */
+int packet_shared(const struct packet *pkt) {
+    if (!pkt) return 0;
+    return pkt->owner != pkt || pkt->extbuf ||
+           __atomic_load_n(&pkt->dataref, __ATOMIC_ACQUIRE) > 1;
+}
+
+/**
+ * 在数据尾部追加空间
+ * @param pkt 数据包
+ * @param len 追加的字节数
+ * @return 追加区域的起始地址，尾部空间不足或缓冲区共享时返回NULL
+ */
+char* packet_put(struct packet *pkt, size_t len) {
+    if (!pkt || len > packet_tailroom(pkt) || packet_shared(pkt)) return NULL;
+
+    char *tail = pkt->data + pkt->data_len;
+    pkt->data_len += len;
+    return tail;
+}
+
+/**
+ * 在数据头部预留的空间中前插数据（如封装包头）
+ * @param pkt 数据包
+ * @param len 前插的字节数
+ * @return 新的数据起始地址，头部空间不足或缓冲区共享时返回NULL
+ */
+char* packet_push(struct packet *pkt, size_t len) {
+    if (!pkt || len > packet_headroom(pkt) || packet_shared(pkt)) return NULL;
+
+    pkt->data -= len;
+    pkt->data_len += len;
+    return pkt->data;
+}
+
+/**
+ * 从数据头部移除数据（如剥离包头、丢弃已确认或重复的部分）
+ * 只移动本包的数据指针，不修改缓冲区，克隆包也可以使用
+ * @param pkt 数据包
+ * @param len 移除的字节数
+ * @return 新的数据起始地址，数据不足时返回NULL
+ */
+char* packet_pull(struct packet *pkt, size_t len) {
+    if (!pkt || len > pkt->data_len) return NULL;
+
+    pkt->data += len;
+    pkt->data_len -= len;
+    return pkt->data;
+}
+
+/**
+ * 把数据截断到len字节（不会变长）
+ * @param pkt 数据包
+ * @param len 保留的字节数
+ */
+void packet_trim(struct packet *pkt, size_t len) {
+    if (pkt && len < pkt->data_len) {
+        pkt->data_len = len;
+    }
+}
+
+/**
+ * 数据前可用的头部空间
+ */
+size_t packet_headroom(const struct packet *pkt) {
+    return pkt ? (size_t)(pkt->data - pkt->head) : 0;
+}
+
+/**
+ * 数据后可用的尾部空间
+ */
+size_t packet_tailroom(const struct packet *pkt) {
+    return pkt ? (size_t)(pkt->end - (pkt->data + pkt->data_len)) : 0;
+}
+
+/**
+ * 获取当前线程的对象池统计
+ * @param stats 返回统计信息
+ */
+void packet_pool_get_stats(struct packet_pool_stats *stats) {
+    if (!stats) return;
+    *stats = packet_pool_get()->stats;
+}
+
+/**
+ * 释放当前线程缓存的空闲包
+ */
+void packet_pool_drain(void) {
+    packet_pool_release(packet_pool_get());
+}
@@ -0,0 +1,318 @@
+/**
+ * @file packet_queue.c
+ * @brief 每Socket的接收环（多生产者单消费者、无锁）与每线程的批量发送队列
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 默认情况下packet_deliver在发送方的调用栈里直接执行接收方的协议处理，
+ * 发送线程会改写接收方的控制块和缓冲区。开启g_packet_rx_queue后，
+ * packet_deliver只把包的克隆放进目标Socket的接收环，由接收方线程在
+ * connect/accept/send/recv中调用socket_rx_process取出并处理，
+ * 两端的协议状态各自只被自己的线程访问。
+ *
+ * 这也意味着异步模式下没有任何后台处理：ACK、窗口更新和重传定时器都只在所有者线程
+ * 进入API（或调用socket_rx_process/tcp_retransmit_timer）时处理，发送缓冲区中等待
+ * 窗口的数据要等所有者处理到打开窗口的ACK时才会发出。send返回只表示数据进了发送缓冲区，
+ * 所有者线程必须持续轮询它的Socket（像事件循环那样），直到关心的数据都被确认。
+ *
+ * 接收环是有界的MPSC环：每个槽带一个序号，生产者用CAS争夺tail后写入包指针再发布序号，
+ * 消费者按序号判断槽是否就绪；tail和head分别独占一个缓存行，生产者之间只竞争tail，
+ * 与消费者不共享写入的缓存行。环满时丢包（计入drops），由TCP重传恢复。
+ * 同一Socket只能有一个线程接收。
+ *
+ * 发送方向，协议层在packet_tx_begin/packet_tx_end之间（如一次发送的全部分段、
+ * 一轮重传、处理一批接收包产生的ACK）把包放进当前线程的发送队列，
+ * 队列攒满PACKET_TX_BATCH个包或最外层区间结束时整批交给网卡的tx_burst（类似网卡的门铃）。
+ * 区间之外的packet_send立即发送。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+
+/* 是否经接收环异步投递，默认关闭（在发送方调用栈中同步处理） */
+int g_packet_rx_queue = 0;
+
+/* 每线程发送队列 */
+struct packet_tx_queue {
+    struct packet *pkts[PACKET_TX_BATCH];
+    int count;
+    int depth;                  /* 嵌套的批量发送区间数 */
+    struct packet_tx_stats stats;
+};
+
+static __thread struct packet_tx_queue tx_queue;
+
+/**
+ * 包是否在接收方轮询时才处理（接收环或需要轮询的网卡），而不是在发送方调用栈中同步处理
+ * 此时握手不会在connect/accept调用内同步完成
+ * @return 1是，0否
+ */
+int packet_rx_deferred(void) {
+    return g_packet_rx_queue || netdev_get_default()->ops->rx_burst != NULL;
+}
+
+/**
+ * 创建接收环
+ * @return 接收环，失败返回NULL
+ */
+struct packet_ring* packet_ring_create(void) {
+    void *mem = NULL;
+
+    if (posix_memalign(&mem, PACKET_CACHELINE_SIZE, sizeof(struct packet_ring)) != 0) {
+        return NULL;
+    }
+
+    struct packet_ring *ring = mem;
+    memset(ring, 0, sizeof(*ring));
+    for (size_t i = 0; i < PACKET_RX_RING_SIZE; i++) {
+        ring->slots[i].seq = i;
+    }
+
+    return ring;
+}
+
+/**
+ * 销毁接收环，释放尚未处理的包
+ * @param ring 接收环
+ */
+void packet_ring_destroy(struct packet_ring *ring) {
+    if (!ring) return;
+
+    struct packet *pkt;
+    while ((pkt = packet_ring_dequeue(ring)) != NULL) {
+        packet_destroy(pkt);
+    }
+
+    free(ring);
+}
+
+/**
+ * 放入一个包（可由多个线程并发调用）
+ * @param ring 接收环
+ * @param pkt 数据包（成功后所有权归接收环）
+ * @return 0成功，-1环已满
+ */
+int packet_ring_enqueue(struct packet_ring *ring, struct packet *pkt) {
+    size_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    struct packet_ring_slot *slot;
+
+    for (;;) {
+        slot = &ring->slots[pos & (PACKET_RX_RING_SIZE - 1)];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            /* 槽空闲，争夺这个位置 */
+            if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;      /* 消费者还没取走一圈前的包 */
+        } else {
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->pkt = pkt;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * 取出一个包（只能由接收方线程调用）
+ * @param ring 接收环
+ * @return 数据包，环为空返回NULL
+ */
+struct packet* packet_ring_dequeue(struct packet_ring *ring) {
+    size_t pos = ring->head;
+    struct packet_ring_slot *slot = &ring->slots[pos & (PACKET_RX_RING_SIZE - 1)];
+    size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) {
+        return NULL;        /* 空，或生产者占了位置还没写完 */
+    }
+
+    struct packet *pkt = slot->pkt;
+    __atomic_store_n(&slot->seq, pos + PACKET_RX_RING_SIZE, __ATOMIC_RELEASE);
+    ring->head = pos + 1;
+    return pkt;
+}
+
+/**
+ * 获取Socket的接收环，首次使用时创建（多个生产者可能同时创建，只保留一个）
+ * @param sock Socket指针
+ * @return 接收环，失败返回NULL
+ */
+static struct packet_ring* socket_rx_ring(struct mysocket *sock) {
+    struct packet_ring *ring = __atomic_load_n(&sock->rx_ring, __ATOMIC_ACQUIRE);
+    if (ring) return ring;
+
+    struct packet_ring *created = packet_ring_create();
+    if (!created) return NULL;
+
+    if (!__atomic_compare_exchange_n(&sock->rx_ring, &ring, created, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(created);
+        return ring;
+    }
+
+    return created;
+}
+
+/**
+ * 把包的克隆放入目标Socket的接收环
+ * @param sock 目标Socket
+ * @param pkt 数据包（调用者保留所有权）
+ * @return 0成功，-1环已满或内存不足（包被丢弃）
+ */
+int socket_rx_enqueue(struct mysocket *sock, struct packet *pkt) {
+    if (!sock || !pkt) return -1;
+
+    struct packet_ring *ring = socket_rx_ring(sock);
+    struct packet *clone = ring ? packet_clone(pkt) : NULL;
+
+    if (!clone || packet_ring_enqueue(ring, clone) < 0) {
+        packet_destroy(clone);
+        if (ring) {
+            __atomic_add_fetch(&ring->drops, 1, __ATOMIC_RELAXED);
+        }
+        DEBUG_PRINT("接收环已满，丢包: fd=%d", sock->fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * 从Socket的接收环取一个包
+ * @param sock Socket指针
+ * @return 数据包（调用者负责释放），无数据返回NULL
+ */
+struct packet* packet_receive(struct mysocket *sock) {
+    if (!sock) return NULL;
+
+    struct packet_ring *ring = __atomic_load_n(&sock->rx_ring, __ATOMIC_ACQUIRE);
+    return ring ? packet_ring_dequeue(ring) : NULL;
+}
+
+/**
+ * 处理接收环中的所有包（在接收方线程中调用），需要轮询的网卡先收取一批
+ * @param sock Socket指针
+ * @return 处理的包数
+ */
+int socket_rx_process(struct mysocket *sock) {
+    if (!sock) return 0;
+
+    int count = 0;
+    struct packet *pkt;
+
+    /* 在API入口、处理包之前执行内存记账时推迟的回收请求；
+     * 被请求的连接在自己的线程里收缩自己的缓冲区 */
+    socket_mem_reclaim();
+    if (sock->conn && __atomic_load_n(&sock->conn->shrink_pending, __ATOMIC_ACQUIRE) &&
+        __atomic_exchange_n(&sock->conn->shrink_pending, 0, __ATOMIC_ACQ_REL)) {
+        tcp_shrink_idle_buffers(sock);
+    }
+
+    /* 处理过程中产生的ACK攒成一批发送 */
+    packet_tx_begin();
+
+    /* 需要轮询的网卡先收一批并投递（同步投递时直接处理，否则进入各Socket的接收环） */
+    struct netdev *dev = netdev_get_default();
+    if (dev->ops->rx_burst) {
+        netdev_poll(dev, NETDEV_POLL_BUDGET);
+    }
+
+    while ((pkt = packet_receive(sock)) != NULL) {
+        if (pkt->ip_hdr.protocol == IPPROTO_TCP) {
+            tcp_process_packet(sock, pkt);
+        }
+        packet_destroy(pkt);
+        count++;
+    }
+    packet_tx_end();
+
+    return count;
+}
+
+/**
+ * 开始批量发送区间（可嵌套）
+ */
+void packet_tx_begin(void) {
+    tx_queue.depth++;
+}
+
+/**
+ * 结束批量发送区间，最外层结束时刷新发送队列
+ * @return 0成功，-1本次刷新中有包投递失败
+ */
+int packet_tx_end(void) {
+    if (tx_queue.depth > 0 && --tx_queue.depth == 0) {
+        return packet_tx_flush();
+    }
+    return 0;
+}
+
+/**
+ * 在批量发送区间内把包放入发送队列，队列满时立即刷新
+ * @param pkt 数据包（放入后所有权归发送队列）
+ * @return 1已排队，0不在区间内（调用者应立即发送）
+ */
+int packet_tx_enqueue(struct packet *pkt) {
+    struct packet_tx_queue *q = &tx_queue;
+
+    if (q->depth == 0) {
+        return 0;
+    }
+
+    q->pkts[q->count++] = pkt;
+    if (q->count == PACKET_TX_BATCH) {
+        packet_tx_flush();
+    }
+    return 1;
+}
+
+/**
+ * 把发送队列中的包整批交给链路
+ * 本地同步投递时对端在投递过程中回复的包进入下一批，直到队列为空
+ * @return 0成功，-1有包投递失败
+ */
+int packet_tx_flush(void) {
+    struct packet_tx_queue *q = &tx_queue;
+    int result = 0;
+
+    q->depth++;
+    while (q->count > 0) {
+        struct packet *batch[PACKET_TX_BATCH];
+        int n = q->count;
+
+        memcpy(batch, q->pkts, (size_t)n * sizeof(batch[0]));
+        q->count = 0;
+
+        int sent = packet_xmit_burst(batch, n);
+        if (sent < n) {
+            q->stats.errors += (uint64_t)(n - sent);
+            result = -1;
+        }
+        for (int i = 0; i < n; i++) {
+            packet_destroy(batch[i]);
+        }
+
+        q->stats.batches++;
+        q->stats.packets += (uint64_t)n;
+    }
+    q->depth--;
+
+    return result;
+}
+
+/**
+ * 获取当前线程的发送队列统计
+ * @param stats 返回统计信息
+ */
+void packet_tx_get_stats(struct packet_tx_stats *stats) {
+    if (!stats) return;
+    *stats = tx_queue.stats;
+}
@@ -0,0 +1,498 @@
+/**
+ * @file packet_wire.c
+ * @brief IP/TCP/UDP线格式的序列化与解析
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 协议栈内部使用struct packet中的ip_hdr/tcp_hdr/tcp_opt，这里负责与标准线格式互相转换：
+ * IPv4头（20字节，无选项）、TCP头（数据偏移、标志、选项按4字节对齐）、UDP头，全部网络字节序，
+ * 可直接写入pcap文件或交给其他传输层/真实设备。
+ *
+ * 内存中的TCP头没有数据偏移和选项，flags是主机字节序的16位字段，
+ * 因此两种形式的校验和不同：序列化和解析时按RFC 1624只对差异部分增量改写校验和，
+ * 不重新计算整个报文段，线上报文的校验和仍然覆盖原始数据，损坏能被接收端发现。
+ * 开启校验和卸载（PACKET_CSUM_PARTIAL）的包在序列化时才完整计算，相当于网卡填写校验和。
+ *
+ * 解析不复制数据：一遍检查IP头、TCP/UDP头和选项的长度与标志，
+ * 结果中的指针直接指向原始帧。
+ */
+
+#include "socket_internal.h"
+
+/* 读写网络字节序字段（帧中的地址不一定对齐） */
+static uint16_t wire_get16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t wire_get32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void wire_put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void wire_put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/* 已是网络字节序的字段按内存原样写入/读出 */
+static void wire_put_raw16(uint8_t *p, uint16_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+static uint16_t wire_get_raw16(const uint8_t *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * 从校验和中去掉一组16位字的和、加上另一组（RFC 1624 式3的推广）
+ * @param check 原校验和
+ * @param removed 去掉的字的部分和
+ * @param added 加上的字的部分和
+ * @return 新校验和
+ */
+static uint16_t wire_csum_rewrite(uint16_t check, uint32_t removed, uint32_t added) {
+    uint32_t sum = (uint16_t)~check;
+    sum += checksum_fold(removed);              /* 减去removed即加上其反码 */
+    sum += (uint16_t)~checksum_fold(added);
+    return checksum_fold(sum);
+}
+
+/**
+ * TCP选项在线上占用的字节数（已按4字节对齐）
+ * SACK块数受40字节选项空间限制
+ * @param opt TCP选项
+ * @param num_sacks 返回实际编码的SACK块数
+ * @return 选项长度
+ */
+static size_t tcp_wire_options_len(const struct tcp_options *opt, int *num_sacks) {
+    size_t len = 0;
+
+    if (opt->sack_permitted) len += 4;     /* NOP NOP SACK-Permitted */
+    if (opt->wscale_ok) len += 4;          /* NOP Window-Scale */
+
+    int sacks = opt->num_sacks;
+    if (sacks > TCP_MAX_SACK_BLOCKS) sacks = TCP_MAX_SACK_BLOCKS;
+    while (sacks > 0 && len + 4 + 8 * (size_t)sacks > TCP_WIRE_MAX_OPT_LEN) {
+        sacks--;
+    }
+    if (sacks > 0) len += 4 + 8 * (size_t)sacks;   /* NOP NOP SACK */
+
+    if (num_sacks) *num_sacks = sacks;
+    return len;
+}
+
+/**
+ * 按线格式写出TCP选项
+ * @param p 输出位置
+ * @param opt TCP选项
+ * @param num_sacks 编码的SACK块数
+ * @return 写入的字节数
+ */
+static size_t tcp_wire_write_options(uint8_t *p, const struct tcp_options *opt, int num_sacks) {
+    uint8_t *start = p;
+
+    if (opt->sack_permitted) {
+        *p++ = TCPOPT_NOP;
+        *p++ = TCPOPT_NOP;
+        *p++ = TCPOPT_SACK_PERM;
+        *p++ = TCPOLEN_SACK_PERM;
+    }
+
+    if (opt->wscale_ok) {
+        *p++ = TCPOPT_NOP;
+        *p++ = TCPOPT_WINDOW;
+        *p++ = TCPOLEN_WINDOW;
+        *p++ = opt->wscale;
+    }
+
+    if (num_sacks > 0) {
+        *p++ = TCPOPT_NOP;
+        *p++ = TCPOPT_NOP;
+        *p++ = TCPOPT_SACK;
+        *p++ = (uint8_t)(2 + 8 * num_sacks);
+        for (int i = 0; i < num_sacks; i++) {
+            wire_put32(p, opt->sacks[i].start_seq);
+            wire_put32(p + 4, opt->sacks[i].end_seq);
+            p += 8;
+        }
+    }
+
+    return (size_t)(p - start);
+}
+
+/**
+ * 写出20字节的IPv4头（含头校验和）
+ * @param p 输出位置
+ * @param ip_hdr 内存中的IP头（地址等字段为网络字节序）
+ * @param protocol 协议号
+ * @param total_len IP总长度
+ */
+static void ip_wire_write_header(uint8_t *p, const struct ip_header *ip_hdr,
+                                 uint8_t protocol, size_t total_len) {
+    p[0] = 0x45;
+    p[1] = ip_hdr->tos;
+    wire_put16(p + 2, (uint16_t)total_len);
+    wire_put_raw16(p + 4, ip_hdr->id);
+    wire_put_raw16(p + 6, ip_hdr->flags_frag);
+    p[8] = ip_hdr->ttl ? ip_hdr->ttl : 64;
+    p[9] = protocol;
+    wire_put16(p + 10, 0);
+    memcpy(p + 12, &ip_hdr->src_addr, 4);
+    memcpy(p + 16, &ip_hdr->dst_addr, 4);
+    wire_put_raw16(p + 10, checksum(p, IP_WIRE_HDR_LEN));
+}
+
+/**
+ * TCP包序列化后的长度
+ * @param pkt 数据包
+ * @return 字节数
+ */
+size_t packet_wire_len(const struct packet *pkt) {
+    if (!pkt) return 0;
+    return IP_WIRE_HDR_LEN + TCP_WIRE_HDR_LEN + tcp_wire_options_len(&pkt->tcp_opt, NULL) + pkt->data_len;
+}
+
+/**
+ * 把TCP包序列化为线格式的IP帧
+ * @param pkt 数据包
+ * @param frame 输出缓冲区
+ * @param size 缓冲区大小
+ * @return 帧长度，缓冲区不足或报文过长返回-1
+ */
+ssize_t packet_serialize(const struct packet *pkt, void *frame, size_t size) {
+    if (!pkt || !frame || pkt->ip_hdr.protocol != IPPROTO_TCP) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    int num_sacks;
+    size_t opt_len = tcp_wire_options_len(&pkt->tcp_opt, &num_sacks);
+    size_t tcp_len = TCP_WIRE_HDR_LEN + opt_len + pkt->data_len;
+    size_t total_len = IP_WIRE_HDR_LEN + tcp_len;
+
+    if (total_len > size || total_len > 0xFFFF) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    uint8_t *ip = frame;
+    uint8_t *th = ip + IP_WIRE_HDR_LEN;
+    const struct tcp_header *hdr = &pkt->tcp_hdr;
+
+    ip_wire_write_header(ip, &pkt->ip_hdr, IPPROTO_TCP, total_len);
+
+    memcpy(th, &hdr->src_port, 2);
+    memcpy(th + 2, &hdr->dst_port, 2);
+    memcpy(th + 4, &hdr->seq_num, 4);
+    memcpy(th + 8, &hdr->ack_num, 4);
+    th[12] = (uint8_t)(((TCP_WIRE_HDR_LEN + opt_len) / 4) << 4);
+    th[13] = (uint8_t)hdr->flags;
+    memcpy(th + 14, &hdr->window, 2);
+    wire_put16(th + 16, 0);
+    memcpy(th + 18, &hdr->urgent, 2);
+    tcp_wire_write_options(th + TCP_WIRE_HDR_LEN, &pkt->tcp_opt, num_sacks);
+
+    if (pkt->data_len > 0) {
+        memcpy(th + TCP_WIRE_HDR_LEN + opt_len, pkt->data, pkt->data_len);
+    }
+
+    uint16_t mem_len = mysocket_htons((uint16_t)(sizeof(struct tcp_header) + pkt->data_len));
+    uint16_t wire_len = mysocket_htons((uint16_t)tcp_len);
+    uint16_t check;
+
+    if (pkt->ip_summed == PACKET_CSUM_PARTIAL) {
+        /* 卸载的包在这里完整计算，相当于网卡填写校验和 */
+        uint32_t pseudo = tcp_pseudo_sum(pkt->ip_hdr.src_addr, pkt->ip_hdr.dst_addr, IPPROTO_TCP);
+        check = checksum_fold(checksum_partial(th, tcp_len, pseudo + wire_len));
+    } else {
+        /* 内存形式与线格式只差flags字、伪首部长度和选项 */
+        uint32_t removed = (uint32_t)hdr->flags + mem_len;
+        uint32_t added = (uint32_t)wire_get_raw16(th + 12) + wire_len;
+        added = checksum_partial(th + TCP_WIRE_HDR_LEN, opt_len, added);
+        check = wire_csum_rewrite(hdr->checksum, removed, added);
+    }
+    wire_put_raw16(th + 16, check);
+
+    return (ssize_t)total_len;
+}
+
+/**
+ * 写出UDP数据报的IPv4头和UDP头（UDP校验和为0，即未计算），负载由调用者处理
+ * @param hdr 输出位置（IP_WIRE_HDR_LEN + UDP_WIRE_HDR_LEN字节）
+ * @param src 源地址
+ * @param dst 目标地址
+ * @param len 负载长度
+ */
+void packet_udp_wire_headers(void *hdr, const struct mysocket_addr_in *src,
+                             const struct mysocket_addr_in *dst, size_t len) {
+    uint8_t *ip = hdr;
+    uint8_t *uh = ip + IP_WIRE_HDR_LEN;
+    size_t udp_len = UDP_WIRE_HDR_LEN + len;
+    struct ip_header ip_hdr;
+
+    memset(&ip_hdr, 0, sizeof(ip_hdr));
+    ip_hdr.src_addr = src->sin_addr;
+    ip_hdr.dst_addr = dst->sin_addr;
+    ip_wire_write_header(ip, &ip_hdr, IPPROTO_UDP, IP_WIRE_HDR_LEN + udp_len);
+
+    memcpy(uh, &src->sin_port, 2);
+    memcpy(uh + 2, &dst->sin_port, 2);
+    wire_put16(uh + 4, (uint16_t)udp_len);
+    wire_put16(uh + 6, 0);
+}
+
+/**
+ * 把UDP数据报序列化为线格式的IP帧
+ * @param frame 输出缓冲区
+ * @param size 缓冲区大小
+ * @param src 源地址
+ * @param dst 目标地址
+ * @param data 负载
+ * @param len 负载长度
+ * @return 帧长度，缓冲区不足或数据报过长返回-1
+ */
+ssize_t packet_serialize_udp(void *frame, size_t size,
+                             const struct mysocket_addr_in *src,
+                             const struct mysocket_addr_in *dst,
+                             const void *data, size_t len) {
+    size_t udp_len = UDP_WIRE_HDR_LEN + len;
+    size_t total_len = IP_WIRE_HDR_LEN + udp_len;
+
+    if (!frame || !src || !dst || (len > 0 && !data) || total_len > size || total_len > 0xFFFF) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    uint8_t *uh = (uint8_t *)frame + IP_WIRE_HDR_LEN;
+    packet_udp_wire_headers(frame, src, dst, len);
+
+    uint32_t pseudo = tcp_pseudo_sum(src->sin_addr, dst->sin_addr, IPPROTO_UDP);
+    uint32_t sum = checksum_partial(uh, UDP_WIRE_HDR_LEN, pseudo + mysocket_htons((uint16_t)udp_len));
+    if (len > 0) {
+        sum = checksum_copy(uh + UDP_WIRE_HDR_LEN, data, len, sum);
+    }
+
+    /* 计算结果为0时发送全1，0表示未计算校验和（RFC 768） */
+    uint16_t check = checksum_fold(sum);
+    wire_put_raw16(uh + 6, check ? check : 0xFFFF);
+
+    return (ssize_t)total_len;
+}
+
+/**
+ * 解析TCP选项
+ * @param p 选项起始
+ * @param len 选项长度
+ * @param opt 返回解析结果
+ * @return 0成功，-1选项长度不合法
+ */
+static int tcp_wire_parse_options(const uint8_t *p, size_t len, struct tcp_options *opt) {
+    const uint8_t *end = p + len;
+
+    while (p < end) {
+        uint8_t kind = *p;
+
+        if (kind == TCPOPT_EOL) break;
+        if (kind == TCPOPT_NOP) {
+            p++;
+            continue;
+        }
+
+        if (end - p < 2) return -1;
+        uint8_t optlen = p[1];
+        if (optlen < 2 || optlen > end - p) return -1;
+
+        switch (kind) {
+        case TCPOPT_MSS:
+            if (optlen != TCPOLEN_MSS) return -1;
+            break;
+        case TCPOPT_WINDOW:
+            if (optlen != TCPOLEN_WINDOW) return -1;
+            opt->wscale_ok = 1;
+            opt->wscale = (p[2] > TCP_MAX_WSCALE) ? TCP_MAX_WSCALE : p[2];
+            break;
+        case TCPOPT_SACK_PERM:
+            if (optlen != TCPOLEN_SACK_PERM) return -1;
+            opt->sack_permitted = 1;
+            break;
+        case TCPOPT_SACK: {
+            int blocks = (optlen - 2) / 8;
+            if ((optlen - 2) % 8 != 0 || blocks == 0) return -1;
+            if (blocks > TCP_MAX_SACK_BLOCKS) blocks = TCP_MAX_SACK_BLOCKS;
+            for (int i = 0; i < blocks; i++) {
+                opt->sacks[i].start_seq = wire_get32(p + 2 + 8 * i);
+                opt->sacks[i].end_seq = wire_get32(p + 6 + 8 * i);
+            }
+            opt->num_sacks = (uint8_t)blocks;
+            break;
+        }
+        default:
+            break;      /* 未知选项按长度跳过 */
+        }
+
+        p += optlen;
+    }
+
+    return 0;
+}
+
+/**
+ * TCP标志组合是否合法：SYN不能与FIN/RST同时出现，
+ * 除SYN和RST外的报文段都必须带ACK
+ */
+static int tcp_wire_flags_valid(uint8_t flags) {
+    if (flags == 0) return 0;
+    if ((flags & TCP_FLAG_SYN) && (flags & (TCP_FLAG_FIN | TCP_FLAG_RST))) return 0;
+    if (!(flags & (TCP_FLAG_SYN | TCP_FLAG_RST | TCP_FLAG_ACK))) return 0;
+    if ((flags & (TCP_FLAG_FIN | TCP_FLAG_PSH | TCP_FLAG_URG)) && !(flags & TCP_FLAG_ACK)) return 0;
+    return 1;
+}
+
+/**
+ * 解析线格式的IP帧（不复制数据，结果中的指针指向frame）
+ * 一遍检查：IPv4版本、头长度、总长度、头校验和、不支持分片，
+ * TCP数据偏移、标志组合和选项长度，UDP长度字段。
+ * 帧尾超出IP总长度的部分（如以太网填充）被忽略；传输层校验和留给协议层校验。
+ * @param frame 帧
+ * @param len 帧长度
+ * @param info 返回解析结果
+ * @return 0成功，-1格式不合法
+ */
+int packet_parse(const void *frame, size_t len, struct packet_wire_info *info) {
+    const uint8_t *ip = frame;
+
+    if (!frame || !info) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    memset(info, 0, sizeof(*info));
+
+    if (len < IP_WIRE_HDR_LEN || (ip[0] >> 4) != 4) goto invalid;
+
+    size_t ip_hlen = (size_t)(ip[0] & 0x0F) * 4;
+    size_t total_len = wire_get16(ip + 2);
+    if (ip_hlen < IP_WIRE_HDR_LEN || total_len < ip_hlen || total_len > len) goto invalid;
+    if (checksum((void *)ip, ip_hlen) != 0) goto invalid;
+
+    /* 不做分片重组：MF或偏移非0的分片直接拒绝 */
+    if (wire_get16(ip + 6) & 0x3FFF) goto invalid;
+
+    const uint8_t *l4 = ip + ip_hlen;
+    size_t l4_len = total_len - ip_hlen;
+
+    info->ip = ip;
+    info->l4 = l4;
+    info->ip_len = total_len;
+    info->protocol = ip[9];
+    memcpy(&info->src_addr, ip + 12, 4);
+    memcpy(&info->dst_addr, ip + 16, 4);
+
+    if (info->protocol == IPPROTO_TCP) {
+        if (l4_len < TCP_WIRE_HDR_LEN) goto invalid;
+
+        size_t doff = (size_t)(l4[12] >> 4) * 4;
+        if (doff < TCP_WIRE_HDR_LEN || doff > l4_len) goto invalid;
+
+        info->tcp_flags = l4[13];
+        if (!tcp_wire_flags_valid(info->tcp_flags)) goto invalid;
+
+        info->options = l4 + TCP_WIRE_HDR_LEN;
+        info->opt_len = doff - TCP_WIRE_HDR_LEN;
+        if (tcp_wire_parse_options(info->options, info->opt_len, &info->tcp_opt) < 0) goto invalid;
+
+        info->l4_hlen = doff;
+    } else if (info->protocol == IPPROTO_UDP) {
+        if (l4_len < UDP_WIRE_HDR_LEN) goto invalid;
+
+        size_t udp_len = wire_get16(l4 + 4);
+        if (udp_len < UDP_WIRE_HDR_LEN || udp_len > l4_len) goto invalid;
+
+        l4_len = udp_len;
+        info->l4_hlen = UDP_WIRE_HDR_LEN;
+    } else {
+        goto invalid;
+    }
+
+    memcpy(&info->src_port, l4, 2);
+    memcpy(&info->dst_port, l4 + 2, 2);
+    info->payload = l4 + info->l4_hlen;
+    info->payload_len = l4_len - info->l4_hlen;
+
+    return 0;
+
+invalid:
+    DEBUG_PRINT("丢弃格式不合法的帧: len=%zu", len);
+    socket_set_error(MYSOCKET_EINVAL);
+    return -1;
+}
+
+/**
+ * 由解析结果构造TCP数据包（负载复制到新包的缓冲区）
+ * 校验和按差异增量改写为内存形式，接收端照常校验
+ * @param info packet_parse的结果（协议须为TCP）
+ * @return 数据包，失败返回NULL
+ */
+struct packet* packet_from_wire(const struct packet_wire_info *info) {
+    if (!info || info->protocol != IPPROTO_TCP) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return NULL;
+    }
+
+    struct packet *pkt = packet_alloc(info->payload_len);
+    if (!pkt) {
+        socket_set_error(MYSOCKET_ENOMEM);
+        return NULL;
+    }
+
+    if (info->payload_len > 0) {
+        memcpy(packet_put(pkt, info->payload_len), info->payload, info->payload_len);
+    }
+
+    const uint8_t *ip = info->ip;
+    const uint8_t *th = info->l4;
+    struct tcp_header *hdr = &pkt->tcp_hdr;
+
+    pkt->ip_hdr.version_ihl = 0x45;
+    pkt->ip_hdr.tos = ip[1];
+    pkt->ip_hdr.total_len = mysocket_htons((uint16_t)(sizeof(struct ip_header) +
+                                                      sizeof(struct tcp_header) + pkt->data_len));
+    pkt->ip_hdr.id = wire_get_raw16(ip + 4);
+    pkt->ip_hdr.flags_frag = wire_get_raw16(ip + 6);
+    pkt->ip_hdr.ttl = ip[8];
+    pkt->ip_hdr.protocol = IPPROTO_TCP;
+    pkt->ip_hdr.src_addr = info->src_addr;
+    pkt->ip_hdr.dst_addr = info->dst_addr;
+
+    memcpy(&hdr->src_port, th, 2);
+    memcpy(&hdr->dst_port, th + 2, 2);
+    memcpy(&hdr->seq_num, th + 4, 4);
+    memcpy(&hdr->ack_num, th + 8, 4);
+    hdr->flags = info->tcp_flags;
+    memcpy(&hdr->window, th + 14, 2);
+    memcpy(&hdr->urgent, th + 18, 2);
+    pkt->tcp_opt = info->tcp_opt;
+
+    uint16_t mem_len = mysocket_htons((uint16_t)(sizeof(struct tcp_header) + pkt->data_len));
+    uint16_t wire_len = mysocket_htons((uint16_t)(info->l4_hlen + info->payload_len));
+    uint32_t removed = checksum_partial(info->options, info->opt_len,
+                                        (uint32_t)wire_get_raw16(th + 12) + wire_len);
+    uint32_t added = (uint32_t)hdr->flags + mem_len;
+    hdr->checksum = wire_csum_rewrite(wire_get_raw16(th + 16), removed, added);
+    pkt->ip_summed = PACKET_CSUM_NONE;
+
+    /* 控制信息 */
+    pkt->seq = mysocket_ntohl(hdr->seq_num);
+    pkt->end_seq = pkt->seq + (uint32_t)pkt->data_len +
+                   ((hdr->flags & TCP_FLAG_SYN) ? 1 : 0) + ((hdr->flags & TCP_FLAG_FIN) ? 1 : 0);
+
+    return pkt;
+}
@@ -0,0 +1,243 @@
+/**
+ * @file route.c
+ * @brief 路由表：按目标地址的最长前缀选择出口设备，连接缓存查找结果
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 路由（前缀、下一跳、出口设备、metric）放在一个数组里，lpm_trie把前缀映射到该前缀
+ * metric最小的路由的下标，同一前缀的其他路由按metric链在后面，删除链首时下一条顶上。
+ *
+ * 数据路径不查表：TCP连接第一次发包时查找并缓存出口设备（tcp_route），
+ * 路由增删、设备关闭或当前设备变化时递增g_route_gen，连接发现代数不同才重新查找。
+ * 没有缓存的包（原始套接字注入的帧）在packet_xmit_burst里逐个查找。
+ *
+ * 没有匹配的路由时使用当前设备（netdev_get_default），相当于隐含的默认路由，
+ * 所以路由表为空时行为与以前完全相同。
+ * 本项目没有链路层地址解析，下一跳只记录在路由中供查询，包仍按IP目标地址交给出口设备。
+ */
+
+#include "socket_internal.h"
+
+#define ROUTE_INIT_ENTRIES      16
+
+uint32_t g_route_gen = 1;
+uint64_t g_route_lookups = 0;
+
+static struct lpm_trie route_trie;          /* 前缀 -> 链首路由的下标 */
+static struct route_entry *routes = NULL;   /* 路由数组，dev为NULL的槽是空闲的 */
+static int32_t route_capacity = 0;
+static int route_count = 0;
+static pthread_mutex_t route_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * 路由表变化：使所有连接的路由缓存失效
+ */
+void route_invalidate(void) {
+    __atomic_add_fetch(&g_route_gen, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * 分配一个空闲槽（持有route_lock）
+ * @return 下标，失败返回LPM_NONE
+ */
+static int32_t route_slot_alloc(void) {
+    if (!route_trie.nodes && lpm_trie_init(&route_trie) < 0) {
+        return LPM_NONE;
+    }
+
+    for (int32_t i = 0; i < route_capacity; i++) {
+        if (!routes[i].dev) return i;
+    }
+
+    int32_t capacity = route_capacity ? route_capacity * 2 : ROUTE_INIT_ENTRIES;
+    struct route_entry *grown = realloc(routes, (size_t)capacity * sizeof(struct route_entry));
+    if (!grown) return LPM_NONE;
+
+    memset(grown + route_capacity, 0, (size_t)(capacity - route_capacity) * sizeof(struct route_entry));
+    routes = grown;
+    int32_t index = route_capacity;
+    route_capacity = capacity;
+    return index;
+}
+
+/**
+ * 把一条路由从同一前缀的链上摘下并释放槽，链空时删除前缀（持有route_lock）
+ */
+static void route_unlink(int32_t index) {
+    struct route_entry *rt = &routes[index];
+    int32_t head = lpm_trie_get(&route_trie, rt->prefix, rt->prefix_len);
+
+    if (head == index) {
+        if (rt->next == LPM_NONE) {
+            lpm_trie_remove(&route_trie, rt->prefix, rt->prefix_len);
+        } else {
+            lpm_trie_insert(&route_trie, rt->prefix, rt->prefix_len, rt->next);
+        }
+    } else {
+        int32_t prev = head;
+        while (routes[prev].next != index) {
+            prev = routes[prev].next;
+        }
+        routes[prev].next = rt->next;
+    }
+
+    memset(rt, 0, sizeof(*rt));
+    __atomic_sub_fetch(&route_count, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * 添加路由
+ * @param cidr 目标前缀"a.b.c.d/len"（"0.0.0.0/0"为默认路由）
+ * @param gateway 下一跳，NULL表示直连
+ * @param dev 出口设备
+ * @param metric 同一前缀有多条路由时选metric最小的
+ * @return 0成功，-1失败（同一前缀、设备和metric的路由已存在为MYSOCKET_EADDRINUSE）
+ */
+int route_add(const char *cidr, const char *gateway, struct netdev *dev, int metric) {
+    uint32_t prefix;
+    int len;
+
+    if (!dev || metric < 0 || socket_parse_cidr(cidr, &prefix, &len) < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    pthread_mutex_lock(&route_lock);
+
+    int32_t head = route_trie.nodes ? lpm_trie_get(&route_trie, prefix, len) : LPM_NONE;
+    for (int32_t i = head; i != LPM_NONE; i = routes[i].next) {
+        if (routes[i].dev == dev && routes[i].metric == metric) {
+            pthread_mutex_unlock(&route_lock);
+            socket_set_error(MYSOCKET_EADDRINUSE);
+            return -1;
+        }
+    }
+
+    int32_t index = route_slot_alloc();
+    if (index == LPM_NONE) {
+        pthread_mutex_unlock(&route_lock);
+        socket_set_error(MYSOCKET_ENOMEM);
+        return -1;
+    }
+
+    struct route_entry *rt = &routes[index];
+    rt->prefix = prefix;
+    rt->prefix_len = len;
+    rt->gateway = gateway ? mysocket_inet_addr(gateway) : 0;
+    rt->dev = dev;
+    rt->metric = metric;
+
+    /* 按metric插入同一前缀的链，metric相同的排在已有路由之后 */
+    if (head == LPM_NONE || metric < routes[head].metric) {
+        if (lpm_trie_insert(&route_trie, prefix, len, index) < 0) {
+            memset(rt, 0, sizeof(*rt));
+            pthread_mutex_unlock(&route_lock);
+            socket_set_error(MYSOCKET_ENOMEM);
+            return -1;
+        }
+        rt->next = head;
+    } else {
+        int32_t prev = head;
+        while (routes[prev].next != LPM_NONE && routes[routes[prev].next].metric <= metric) {
+            prev = routes[prev].next;
+        }
+        rt->next = routes[prev].next;
+        routes[prev].next = index;
+    }
+    __atomic_add_fetch(&route_count, 1, __ATOMIC_RELAXED);
+    route_invalidate();
+
+    pthread_mutex_unlock(&route_lock);
+
+    DEBUG_PRINT("添加路由: %s via %s metric %d", cidr, gateway ? gateway : "直连", metric);
+    return 0;
+}
+
+/**
+ * 删除路由
+ * @param cidr 目标前缀
+ * @param dev 只删除经过该设备的路由，NULL表示该前缀的所有路由
+ * @return 0成功，-1失败（没有匹配的路由为MYSOCKET_EINVAL）
+ */
+int route_del(const char *cidr, struct netdev *dev) {
+    uint32_t prefix;
+    int len;
+
+    if (socket_parse_cidr(cidr, &prefix, &len) < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    pthread_mutex_lock(&route_lock);
+
+    int removed = 0;
+    int32_t i = route_trie.nodes ? lpm_trie_get(&route_trie, prefix, len) : LPM_NONE;
+    while (i != LPM_NONE) {
+        int32_t next = routes[i].next;
+        if (!dev || routes[i].dev == dev) {
+            route_unlink(i);
+            removed++;
+        }
+        i = next;
+    }
+    if (removed > 0) {
+        route_invalidate();
+    }
+
+    pthread_mutex_unlock(&route_lock);
+
+    if (removed == 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 删除经过某个设备的所有路由（netdev_close调用）
+ */
+void route_flush_dev(struct netdev *dev) {
+    pthread_mutex_lock(&route_lock);
+    for (int32_t i = 0; i < route_capacity; i++) {
+        if (routes[i].dev == dev) {
+            route_unlink(i);
+        }
+    }
+    pthread_mutex_unlock(&route_lock);
+    route_invalidate();
+}
+
+/**
+ * 查找目标地址的路由
+ * @param dst 目标地址（网络字节序）
+ * @param out 返回匹配的路由（复制）
+ * @return 0找到，-1没有匹配的路由
+ */
+int route_lookup(uint32_t dst, struct route_entry *out) {
+    if (__atomic_load_n(&route_count, __ATOMIC_RELAXED) == 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&route_lock);
+    g_route_lookups++;
+    int32_t index = route_trie.nodes ? lpm_trie_lookup(&route_trie, mysocket_ntohl(dst)) : LPM_NONE;
+    if (index != LPM_NONE) {
+        *out = routes[index];
+    }
+    pthread_mutex_unlock(&route_lock);
+
+    return index != LPM_NONE ? 0 : -1;
+}
+
+/**
+ * 目标地址的出口设备
+ * @param dst 目标地址（网络字节序）
+ * @return 设备指针（没有匹配的路由时为当前设备，不会为NULL）
+ */
+struct netdev* route_output(uint32_t dst) {
+    struct route_entry rt;
+    if (route_lookup(dst, &rt) == 0) {
+        return rt.dev;
+    }
+    return netdev_get_default();
+}
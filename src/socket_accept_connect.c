@@ -10,6 +10,8 @@
 #include "socket_internal.h"
 #include <time.h>
 
+static int socket_wait_established(struct mysocket *sock);
+
 /**
  * 接受一个传入的连接
  * @param sockfd 监听Socket文件描述符
@@ -27,12 +29,33 @@ int mysocket_accept(int sockfd, struct mysocket_addr *addr, socklen_t *addrlen)
         return -1;
     }
     
+    if (listen_sock->host_fd >= 0) {
+        return socket_kernel_accept(listen_sock, addr, addrlen);
+    }
+    if (listen_sock->unix_sk) {
+        return unix_accept(listen_sock, addr, addrlen);
+    }
+    
     /* 检查是否为监听Socket */
     if (listen_sock->state != SS_LISTENING) {
         socket_set_error(MYSOCKET_EINVAL);
         return -1;
     }
     
+    /* 异步投递或轮询的网卡：处理监听Socket和半连接子Socket收到的握手包，队首完成握手才能取出 */
+    if (packet_rx_deferred()) {
+        socket_rx_process(listen_sock);
+        for (int i = 0; i < listen_sock->listen_count; i++) {
+            socket_rx_process(listen_sock->listen_queue[i]);
+        }
+        
+        if (listen_sock->listen_count == 0 ||
+            listen_sock->listen_queue[0]->tcp_state != TCP_ESTABLISHED) {
+            socket_set_error(MYSOCKET_EAGAIN);
+            return -1;
+        }
+    }
+    
     /* 从监听队列中获取连接 */
     struct mysocket *new_sock = socket_listen_queue_remove(listen_sock);
     if (!new_sock) {
@@ -80,6 +103,13 @@ int mysocket_connect(int sockfd, const struct mysocket_addr *addr, socklen_t add
         return -1;
     }
     
+    if (sock->host_fd >= 0) {
+        return socket_kernel_connect(sock, addr, addrlen);
+    }
+    if (sock->unix_sk) {
+        return unix_connect(sock, addr, addrlen);
+    }
+    
     /* 参数验证 */
     if (!addr || addrlen < sizeof(struct mysocket_addr_in)) {
         socket_set_error(MYSOCKET_EINVAL);
@@ -111,17 +141,22 @@ int mysocket_connect(int sockfd, const struct mysocket_addr *addr, socklen_t add
     
     /* TCP连接处理 */
     if (sock->protocol == IPPROTO_TCP) {
+        /* 先进入SYN_SENT：本地投递时SYN-ACK会在发送过程中同步到达 */
+        tcp_state_transition(sock, TCP_EVENT_CONNECT);
+        
         /* 发送SYN包 */
         if (tcp_send_syn(sock) < 0) {
             sock->state = SS_UNCONNECTED;
+            sock->tcp_state = TCP_CLOSED;
             socket_set_error(MYSOCKET_ECONNREFUSED);
             return -1;
         }
         
-        sock->tcp_state = TCP_SYN_SENT;
-        
-        /* 模拟连接建立过程 */
-        if (socket_simulate_tcp_handshake(sock) < 0) {
+        /* 模拟连接建立过程，SYN被监听端丢弃（如队列已满）时连接失败；
+         * 异步投递或轮询的网卡上等待SYN-ACK到达（可能来自另一个线程或进程） */
+        int handshake = packet_rx_deferred() ? socket_wait_established(sock)
+                                          : socket_simulate_tcp_handshake(sock);
+        if (handshake < 0 || sock->tcp_state != TCP_ESTABLISHED) {
             sock->state = SS_UNCONNECTED;
             sock->tcp_state = TCP_CLOSED;
             socket_set_error(MYSOCKET_ECONNREFUSED);
@@ -142,6 +177,26 @@ int mysocket_connect(int sockfd, const struct mysocket_addr *addr, socklen_t add
     return MYSOCKET_OK;
 }
 
+/**
+ * 异步投递时等待握手完成：轮询网卡和本Socket的接收环，处理SYN-ACK
+ * @param sock Socket指针（已发出SYN）
+ * @return 0连接建立，-1超时
+ */
+static int socket_wait_established(struct mysocket *sock) {
+    struct timespec delay = {0, 100000};  /* 100us */
+    
+    for (int waited = 0; waited < TCP_CONNECT_TIMEOUT_MS * 10; waited++) {
+        socket_rx_process(sock);
+        if (sock->tcp_state == TCP_ESTABLISHED) {
+            return 0;
+        }
+        nanosleep(&delay, NULL);
+    }
+    
+    DEBUG_PRINT("等待握手超时: fd=%d", sock->fd);
+    return -1;
+}
+
 /**
  * 自动绑定本地地址
  * @param sock Socket指针
@@ -303,7 +358,17 @@ int socket_can_accept_connection(struct mysocket *listen_sock,
         return 0;
     }
     
-    /* 可以添加其他检查逻辑，如访问控制等 */
+    /* 访问控制：前缀规则和每个源地址的连接数上限 */
+    if (!socket_acl_check(listen_sock, peer_addr)) {
+        return 0;
+    }
+    
+    /* 按源地址限速：规则拒绝的SYN不消耗令牌 */
+    struct rate_limit *rl = __atomic_load_n(&listen_sock->rate_limit, __ATOMIC_ACQUIRE);
+    if (rl && !socket_rate_limit_allow(rl, peer_addr->sin_addr)) {
+        DEBUG_PRINT("SYN被限速: listen_fd=%d", listen_sock->fd);
+        return 0;
+    }
     
     return 1;
 }
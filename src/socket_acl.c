@@ -0,0 +1,318 @@
+/**
+ * @file socket_acl.c
+ * @brief 监听Socket的访问控制：CIDR前缀允许/拒绝和每个源地址的连接数上限
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * SYN到达时socket_can_accept_connection调用socket_acl_check，在创建子Socket、
+ * 分配缓冲区之前就拒绝不受欢迎的客户端（与积压队列满时相同，静默丢弃SYN）：
+ *   前缀规则放在lpm_trie里，取最长匹配前缀的动作，没有匹配时用默认动作（初始为允许），
+ *     查找代价与规则数无关，最多32步；
+ *   每个源地址的连接数放在线性探测的哈希表里，O(1)查找。子Socket从创建（半连接）起计数，
+ *     直到销毁，所以SYN洪泛和占着连接不放的客户端都受上限约束。
+ *
+ * 访问控制在第一次调用mysocket_acl_*时创建，此后接受的连接才计数。
+ * 计数中的子Socket持有访问控制的引用，监听Socket先关闭时，子Socket销毁时仍能正确减计数。
+ * 没有配置访问控制的监听Socket只多一次指针检查。
+ */
+
+#include "socket_internal.h"
+
+#define ACL_SOURCES_INIT    64      /* 源地址表的初始槽数（2的幂） */
+
+/**
+ * 源地址在哈希表中的起始槽
+ */
+static uint32_t acl_source_hash(uint32_t addr, uint32_t mask) {
+    /* 同一网段的地址只有低位不同，先把每一位都混合到低位 */
+    addr ^= addr >> 16;
+    addr *= 0x45d9f3bu;
+    addr ^= addr >> 16;
+    return addr & mask;
+}
+
+/**
+ * 查找源地址的槽
+ * @return 槽指针，不存在时返回应插入的空槽
+ */
+static struct listen_acl_source* acl_source_slot(struct listen_acl *acl, uint32_t addr) {
+    uint32_t i = acl_source_hash(addr, acl->source_mask);
+    while (acl->sources[i].count != 0 && acl->sources[i].addr != addr) {
+        i = (i + 1) & acl->source_mask;
+    }
+    return &acl->sources[i];
+}
+
+/**
+ * 源地址表扩容一倍并重新散列
+ * @return 0成功，-1失败
+ */
+static int acl_source_grow(struct listen_acl *acl) {
+    uint32_t old_size = acl->source_mask + 1;
+    struct listen_acl_source *old = acl->sources;
+
+    acl->sources = calloc((size_t)old_size * 2, sizeof(struct listen_acl_source));
+    if (!acl->sources) {
+        acl->sources = old;
+        return -1;
+    }
+    acl->source_mask = old_size * 2 - 1;
+
+    for (uint32_t i = 0; i < old_size; i++) {
+        if (old[i].count != 0) {
+            *acl_source_slot(acl, old[i].addr) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+/**
+ * 源地址的连接数减1，减到0时删除（后移删除，保持探测链连续）
+ */
+static void acl_source_put(struct listen_acl *acl, uint32_t addr) {
+    struct listen_acl_source *slot = acl_source_slot(acl, addr);
+    if (slot->count == 0) return;
+    if (--slot->count > 0) return;
+
+    acl->source_used--;
+    uint32_t hole = (uint32_t)(slot - acl->sources);
+    uint32_t i = hole;
+    for (;;) {
+        i = (i + 1) & acl->source_mask;
+        if (acl->sources[i].count == 0) break;
+
+        /* 起始槽不在(hole, i]之间的条目可以前移到空洞 */
+        uint32_t home = acl_source_hash(acl->sources[i].addr, acl->source_mask);
+        if (((i - home) & acl->source_mask) >= ((i - hole) & acl->source_mask)) {
+            acl->sources[hole] = acl->sources[i];
+            acl->sources[i].count = 0;
+            hole = i;
+        }
+    }
+}
+
+/**
+ * 释放一个引用，最后一个引用释放时销毁（调用时持有acl->lock，返回时已解锁）
+ */
+static void acl_put_unlock(struct listen_acl *acl) {
+    int last = (--acl->refcnt == 0);
+    pthread_mutex_unlock(&acl->lock);
+
+    if (last) {
+        lpm_trie_free(&acl->rules);
+        free(acl->sources);
+        pthread_mutex_destroy(&acl->lock);
+        free(acl);
+    }
+}
+
+/**
+ * 取得监听Socket的访问控制，第一次调用时创建
+ * 已连接的子Socket引用的是监听Socket的访问控制，不能通过它修改，返回MYSOCKET_EINVAL
+ * @return 访问控制，失败返回NULL（已设置错误码）
+ */
+static struct listen_acl* socket_acl_get(int sockfd) {
+    struct mysocket *sock = socket_find_by_fd(sockfd);
+    if (!sock || sock->host_fd >= 0 || sock->family != AF_INET || sock->type != SOCK_STREAM ||
+        (sock->state != SS_UNCONNECTED && sock->state != SS_LISTENING) ||
+        (sock->acl && sock->acl->listener != sock)) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return NULL;
+    }
+    if (sock->acl) {
+        return sock->acl;
+    }
+
+    struct listen_acl *acl = calloc(1, sizeof(struct listen_acl));
+    if (!acl) {
+        socket_set_error(MYSOCKET_ENOMEM);
+        return NULL;
+    }
+    acl->sources = calloc(ACL_SOURCES_INIT, sizeof(struct listen_acl_source));
+    if (!acl->sources || lpm_trie_init(&acl->rules) < 0) {
+        free(acl->sources);
+        free(acl);
+        socket_set_error(MYSOCKET_ENOMEM);
+        return NULL;
+    }
+    acl->source_mask = ACL_SOURCES_INIT - 1;
+    acl->default_action = MYSOCKET_ACL_ALLOW;
+    acl->listener = sock;
+    acl->refcnt = 1;
+    pthread_mutex_init(&acl->lock, NULL);
+
+    sock->acl = acl;
+    return acl;
+}
+
+/**
+ * 检查SYN是否可以接受（socket_can_accept_connection调用，不分配内存）
+ * @return 1允许，0拒绝
+ */
+int socket_acl_check(struct mysocket *listen_sock, const struct mysocket_addr_in *peer_addr) {
+    struct listen_acl *acl = listen_sock->acl;
+    if (!acl) return 1;
+
+    int ok = 1;
+    pthread_mutex_lock(&acl->lock);
+
+    int32_t action = lpm_trie_lookup(&acl->rules, mysocket_ntohl(peer_addr->sin_addr));
+    if (action == LPM_NONE) {
+        action = acl->default_action;
+    }
+
+    if (action == MYSOCKET_ACL_DENY) {
+        acl->denied++;
+        ok = 0;
+    } else if (acl->max_per_source > 0 &&
+               acl_source_slot(acl, peer_addr->sin_addr)->count >= acl->max_per_source) {
+        acl->limited++;
+        ok = 0;
+    }
+
+    pthread_mutex_unlock(&acl->lock);
+
+    if (!ok) {
+        DEBUG_PRINT("访问控制拒绝SYN: listen_fd=%d, 源地址=%s", listen_sock->fd,
+                    mysocket_inet_ntoa(peer_addr->sin_addr));
+    }
+    return ok;
+}
+
+/**
+ * 子Socket计入源地址的连接数（创建子Socket后调用，销毁时由socket_acl_release减去）
+ * @param child 已设置peer_addr的子Socket
+ * @return 0成功，-1失败
+ */
+int socket_acl_charge(struct mysocket *listen_sock, struct mysocket *child) {
+    struct listen_acl *acl = listen_sock->acl;
+    if (!acl) return 0;
+
+    pthread_mutex_lock(&acl->lock);
+
+    if ((acl->source_used + 1) * 2 > acl->source_mask + 1 && acl_source_grow(acl) < 0) {
+        pthread_mutex_unlock(&acl->lock);
+        return -1;
+    }
+
+    struct listen_acl_source *slot = acl_source_slot(acl, child->peer_addr.sin_addr);
+    if (slot->count == 0) {
+        slot->addr = child->peer_addr.sin_addr;
+        acl->source_used++;
+    }
+    slot->count++;
+    acl->refcnt++;
+    child->acl = acl;
+
+    pthread_mutex_unlock(&acl->lock);
+    return 0;
+}
+
+/**
+ * 释放Socket对访问控制的引用（socket_destroy调用）：子Socket减去源地址的计数
+ */
+void socket_acl_release(struct mysocket *sock) {
+    struct listen_acl *acl = sock->acl;
+    if (!acl) return;
+
+    pthread_mutex_lock(&acl->lock);
+    if (acl->listener == sock) {
+        acl->listener = NULL;
+    } else {
+        acl_source_put(acl, sock->peer_addr.sin_addr);
+    }
+    sock->acl = NULL;
+    acl_put_unlock(acl);
+}
+
+/**
+ * 添加前缀规则，相同前缀已存在时替换其动作
+ * @param sockfd 监听（或将要监听）的TCP Socket
+ * @param cidr "a.b.c.d/len"，省略"/len"表示/32；前缀长度以外的位被忽略
+ * @param action MYSOCKET_ACL_ALLOW或MYSOCKET_ACL_DENY
+ * @return 0成功，-1失败
+ */
+int mysocket_acl_add(int sockfd, const char *cidr, int action) {
+    uint32_t prefix;
+    int len;
+
+    if ((action != MYSOCKET_ACL_ALLOW && action != MYSOCKET_ACL_DENY) ||
+        socket_parse_cidr(cidr, &prefix, &len) < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    struct listen_acl *acl = socket_acl_get(sockfd);
+    if (!acl) return -1;
+
+    pthread_mutex_lock(&acl->lock);
+    int ret = lpm_trie_insert(&acl->rules, prefix, len, action);
+    pthread_mutex_unlock(&acl->lock);
+
+    if (ret < 0) {
+        socket_set_error(MYSOCKET_ENOMEM);
+        return -1;
+    }
+
+    DEBUG_PRINT("访问控制规则: fd=%d, %s -> %s", sockfd, cidr,
+                action == MYSOCKET_ACL_ALLOW ? "允许" : "拒绝");
+    return 0;
+}
+
+/**
+ * 设置没有前缀匹配时的动作（默认允许；设为拒绝即白名单）
+ * @return 0成功，-1失败
+ */
+int mysocket_acl_default(int sockfd, int action) {
+    if (action != MYSOCKET_ACL_ALLOW && action != MYSOCKET_ACL_DENY) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    struct listen_acl *acl = socket_acl_get(sockfd);
+    if (!acl) return -1;
+
+    pthread_mutex_lock(&acl->lock);
+    acl->default_action = action;
+    pthread_mutex_unlock(&acl->lock);
+    return 0;
+}
+
+/**
+ * 设置每个源地址同时存在的连接数上限（含半连接和等待accept的连接）
+ * @param max_per_source 上限，0表示不限
+ * @return 0成功，-1失败
+ */
+int mysocket_acl_limit(int sockfd, unsigned int max_per_source) {
+    struct listen_acl *acl = socket_acl_get(sockfd);
+    if (!acl) return -1;
+
+    pthread_mutex_lock(&acl->lock);
+    acl->max_per_source = max_per_source;
+    pthread_mutex_unlock(&acl->lock);
+    return 0;
+}
+
+/**
+ * 清除所有前缀规则，默认动作恢复为允许、取消上限（连接计数保留）
+ * @return 0成功，-1失败
+ */
+int mysocket_acl_clear(int sockfd) {
+    struct listen_acl *acl = socket_acl_get(sockfd);
+    if (!acl) return -1;
+
+    struct lpm_trie empty;
+    if (lpm_trie_init(&empty) < 0) {
+        socket_set_error(MYSOCKET_ENOMEM);
+        return -1;
+    }
+
+    pthread_mutex_lock(&acl->lock);
+    lpm_trie_free(&acl->rules);
+    acl->rules = empty;
+    acl->default_action = MYSOCKET_ACL_ALLOW;
+    acl->max_per_source = 0;
+    pthread_mutex_unlock(&acl->lock);
+    return 0;
+}
@@ -29,6 +29,13 @@ int mysocket_bind(int sockfd, const struct mysocket_addr *addr, socklen_t addrle
     }
     DEBUG_PRINT("Socket查找成功: fd=%d", sockfd);
     
+    if (sock->host_fd >= 0) {
+        return socket_kernel_bind(sock, addr, addrlen);
+    }
+    if (sock->unix_sk) {
+        return unix_bind(sock, addr, addrlen);
+    }
+    
     /* 参数验证 */
     if (!addr || addrlen < sizeof(struct mysocket_addr_in)) {
         DEBUG_PRINT("错误: 参数验证失败, addr=%p, addrlen=%u, 需要>=%zu", addr, addrlen, sizeof(struct mysocket_addr_in));
@@ -96,6 +103,13 @@ int mysocket_listen(int sockfd, int backlog) {
         return -1;
     }
     
+    if (sock->host_fd >= 0) {
+        return socket_kernel_listen(sock, backlog);
+    }
+    if (sock->unix_sk) {
+        return unix_listen(sock, backlog);
+    }
+    
     /* 只有流式Socket可以监听 */
     if (sock->type != SOCK_STREAM) {
         socket_set_error(MYSOCKET_EINVAL);
@@ -9,6 +9,24 @@
 
 #include "socket_internal.h"
 
+/**
+ * 记账缓冲区大小变化：增长在内存压力下会失败，收缩总是成功
+ * @param sock Socket指针
+ * @param old_size 原大小
+ * @param new_size 新大小
+ * @return 0成功，-1失败
+ */
+static int buffer_mem_resize(struct mysocket *sock, size_t old_size, size_t new_size) {
+    int mem_class = socket_mem_class(sock);
+    
+    if (new_size > old_size) {
+        return socket_mem_charge(mem_class, new_size - old_size, SOCKET_MEM_GROW);
+    }
+    
+    socket_mem_uncharge(mem_class, old_size - new_size);
+    return 0;
+}
+
 /**
  * 初始化Socket缓冲区
  * @param sock Socket指针
@@ -17,9 +35,18 @@
 int socket_buffer_init(struct mysocket *sock) {
     if (!sock) return -1;
     
+    /* 全局内存达到上限时拒绝创建新的Socket */
+    int mem_class = socket_mem_class(sock);
+    if (socket_mem_charge(mem_class, DEFAULT_SEND_BUFFER_SIZE + DEFAULT_RECV_BUFFER_SIZE,
+                          SOCKET_MEM_NEW) < 0) {
+        DEBUG_PRINT("内存达到上限，无法分配缓冲区: fd=%d", sock->fd);
+        return -1;
+    }
+    
     /* 分配发送缓冲区 */
     sock->send_buffer = malloc(DEFAULT_SEND_BUFFER_SIZE);
     if (!sock->send_buffer) {
+        socket_mem_uncharge(mem_class, DEFAULT_SEND_BUFFER_SIZE + DEFAULT_RECV_BUFFER_SIZE);
         return -1;
     }
     
@@ -28,6 +55,7 @@ int socket_buffer_init(struct mysocket *sock) {
     if (!sock->recv_buffer) {
         free(sock->send_buffer);
         sock->send_buffer = NULL;
+        socket_mem_uncharge(mem_class, DEFAULT_SEND_BUFFER_SIZE + DEFAULT_RECV_BUFFER_SIZE);
         return -1;
     }
     
@@ -50,6 +78,8 @@ int socket_buffer_init(struct mysocket *sock) {
 void socket_buffer_cleanup(struct mysocket *sock) {
     if (!sock) return;
     
+    socket_mem_uncharge(socket_mem_class(sock), sock->send_buf_size + sock->recv_buf_size);
+    
     if (sock->send_buffer) {
         free(sock->send_buffer);
         sock->send_buffer = NULL;
@@ -133,6 +163,25 @@ int socket_buffer_read(char *buffer, size_t *used, void *data, size_t len) {
     return read_len;
 }
 
+/**
+ * 丢弃缓冲区开头的数据（数据已被直接引用使用，不需要再复制出来）
+ * @param buffer 缓冲区指针
+ * @param used 已使用大小指针
+ * @param len 要丢弃的数据长度
+ * @return 实际丢弃的字节数，-1表示失败
+ */
+int socket_buffer_consume(char *buffer, size_t *used, size_t len) {
+    if (!buffer || !used) return -1;
+    
+    size_t drop_len = (len > *used) ? *used : len;
+    if (drop_len < *used) {
+        memmove(buffer, buffer + drop_len, *used - drop_len);
+    }
+    *used -= drop_len;
+    
+    return drop_len;
+}
+
 /**
  * 扩展缓冲区大小
  * @param sock Socket指针
@@ -145,8 +194,14 @@ int socket_buffer_resize(struct mysocket *sock, size_t send_size, size_t recv_si
     
     /* 扩展发送缓冲区 */
     if (send_size > 0 && send_size != sock->send_buf_size) {
+        if (buffer_mem_resize(sock, sock->send_buf_size, send_size) < 0) {
+            DEBUG_PRINT("发送缓冲区超出内存限制: fd=%d, size=%zu", sock->fd, send_size);
+            return -1;
+        }
+        
         char *new_send_buffer = realloc(sock->send_buffer, send_size);
         if (!new_send_buffer) {
+            buffer_mem_resize(sock, send_size, sock->send_buf_size);
             return -1;
         }
         
@@ -163,8 +218,14 @@ int socket_buffer_resize(struct mysocket *sock, size_t send_size, size_t recv_si
     
     /* 扩展接收缓冲区 */
     if (recv_size > 0 && recv_size != sock->recv_buf_size) {
+        if (buffer_mem_resize(sock, sock->recv_buf_size, recv_size) < 0) {
+            DEBUG_PRINT("接收缓冲区超出内存限制: fd=%d, size=%zu", sock->fd, recv_size);
+            return -1;
+        }
+        
         char *new_recv_buffer = realloc(sock->recv_buffer, recv_size);
         if (!new_recv_buffer) {
+            buffer_mem_resize(sock, recv_size, sock->recv_buf_size);
             return -1;
         }
         
@@ -182,6 +243,45 @@ int socket_buffer_resize(struct mysocket *sock, size_t send_size, size_t recv_si
     return 0;
 }
 
+/**
+ * 自动调整时增长缓冲区：受内存限制失败时请求其他空闲连接回收缓冲区，
+ * 它们各自收缩后，下一轮调整再增长
+ * @param sock Socket指针
+ * @param send_size 新的发送缓冲区大小，0表示不改变
+ * @param recv_size 新的接收缓冲区大小，0表示不改变
+ * @return 0成功，-1失败
+ */
+int socket_buffer_grow(struct mysocket *sock, size_t send_size, size_t recv_size) {
+    if (!sock) return -1;
+    
+    if (socket_buffer_resize(sock, send_size, recv_size) == 0) {
+        return 0;
+    }
+    
+    socket_buffer_request_reclaim(sock);
+    return -1;
+}
+
+/**
+ * 请求其他TCP连接回收空闲缓冲区：只在锁内设置标记，不碰它们的缓冲区。
+ * 其他连接的缓冲区和协议状态只能由它自己的线程改动（异步投递模式下各在各的线程），
+ * 每个连接在自己的socket_rx_process中检查标记并收缩
+ * @param except 跳过的Socket（发出请求的连接），可为NULL
+ */
+void socket_buffer_request_reclaim(struct mysocket *except) {
+    socket_manager_lock();
+    
+    for (struct mysocket *current = g_socket_manager.socket_list; current; current = current->next) {
+        if (current != except && current->conn) {
+            __atomic_store_n(&current->conn->shrink_pending, 1, __ATOMIC_RELEASE);
+        }
+    }
+    
+    socket_manager_unlock();
+    
+    DEBUG_PRINT("请求回收空闲缓冲区");
+}
+
 /**
  * 清空缓冲区内容
  * @param sock Socket指针
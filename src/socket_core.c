@@ -9,6 +9,7 @@
 
 #include "socket_internal.h"
 #include <pthread.h>
+#include <sched.h>
 
 /* 全局Socket管理器 */
 struct socket_manager g_socket_manager = {0};
@@ -35,6 +36,9 @@ int mysocket_init(void) {
     
     pthread_mutex_unlock(&socket_mutex);
     
+    /* 环境变量可以把新建的Socket切到内核直通后端 */
+    socket_kernel_init();
+    
     DEBUG_PRINT("Socket系统初始化完成");
     return MYSOCKET_OK;
 }
@@ -59,6 +63,9 @@ void mysocket_cleanup(void) {
     
     pthread_mutex_unlock(&socket_mutex);
     
+    /* 归还本线程缓存的空闲包 */
+    packet_pool_drain();
+    
     DEBUG_PRINT("Socket系统清理完成");
 }
 
@@ -83,8 +90,14 @@ int mysocket_socket(int domain, int type, int protocol) {
         return -1;
     }
     
-    /* 协议自动推导 */
-    if (protocol == 0) {
+    /* 原始套接字的protocol是要旁听的IP协议号，0表示所有协议 */
+    if (type == SOCK_RAW && (domain == AF_UNIX || protocol < 0 || protocol > 255)) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+    
+    /* 协议自动推导（Unix域不使用IP协议号） */
+    if (protocol == 0 && domain == AF_INET) {
         if (type == SOCK_STREAM) {
             protocol = IPPROTO_TCP;
         } else if (type == SOCK_DGRAM) {
@@ -92,10 +105,22 @@ int mysocket_socket(int domain, int type, int protocol) {
         }
     }
     
+    /* 内核直通后端：创建真实的内核套接字 */
+    if (g_socket_backend == SOCKET_BACKEND_KERNEL) {
+        struct mysocket *sock = socket_kernel_create(domain, type, protocol);
+        if (!sock) {
+            return -1;
+        }
+        socket_add_to_manager(sock);
+        return sock->fd;
+    }
+    
     /* 创建Socket结构 */
     struct mysocket *sock = socket_create(domain, type, protocol);
     if (!sock) {
-        socket_set_error(MYSOCKET_ERROR);
+        int mem_class = (type == SOCK_STREAM) ? SOCKET_MEM_TCP : SOCKET_MEM_UDP;
+        socket_set_error(socket_mem_state(mem_class) == SOCKET_MEM_HIGH ?
+                         MYSOCKET_ENOMEM : MYSOCKET_ERROR);
         return -1;
     }
     
@@ -110,6 +135,61 @@ int mysocket_socket(int domain, int type, int protocol) {
     return sock->fd;
 }
 
+/**
+ * 创建一对已连接的Socket，省去bind/listen/connect/accept
+ * @param domain 只支持AF_UNIX（与Linux一致）
+ * @param type SOCK_STREAM或SOCK_DGRAM
+ * @param protocol 必须为0
+ * @param sv 返回两个文件描述符
+ * @return 0成功，-1失败
+ */
+int mysocket_socketpair(int domain, int type, int protocol, int sv[2]) {
+    DEBUG_PRINT("创建Socket对: domain=%d, type=%d", domain, type);
+
+    if (domain != AF_UNIX || (type != SOCK_STREAM && type != SOCK_DGRAM) || protocol != 0 || !sv) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    struct mysocket *pair[2] = { NULL, NULL };
+
+    /* 内核直通后端：真实的socketpair */
+    if (g_socket_backend == SOCKET_BACKEND_KERNEL) {
+        if (socket_kernel_socketpair(type, protocol, pair) < 0) {
+            return -1;
+        }
+    } else {
+        pair[0] = socket_create(domain, type, protocol);
+        pair[1] = socket_create(domain, type, protocol);
+        if (!pair[0] || !pair[1]) {
+            socket_destroy(pair[0]);
+            socket_destroy(pair[1]);
+            socket_set_error(MYSOCKET_ENOMEM);
+            return -1;
+        }
+        unix_socketpair(pair[0], pair[1]);
+    }
+
+    if (socket_add_to_manager(pair[0]) < 0) {
+        socket_destroy(pair[0]);
+        socket_destroy(pair[1]);
+        socket_set_error(MYSOCKET_ERROR);
+        return -1;
+    }
+    if (socket_add_to_manager(pair[1]) < 0) {
+        socket_remove_from_manager(pair[0]);
+        socket_destroy(pair[0]);
+        socket_destroy(pair[1]);
+        socket_set_error(MYSOCKET_ERROR);
+        return -1;
+    }
+
+    sv[0] = pair[0]->fd;
+    sv[1] = pair[1]->fd;
+    DEBUG_PRINT("Socket对创建成功: fd=%d, fd=%d", sv[0], sv[1]);
+    return MYSOCKET_OK;
+}
+
 /**
  * 关闭Socket
  * @param sockfd Socket文件描述符
@@ -124,10 +204,15 @@ int mysocket_close(int sockfd) {
         return -1;
     }
     
-    /* 如果是TCP连接，需要优雅关闭 */
-    if (sock->type == SOCK_STREAM && sock->state == SS_CONNECTED) {
+    /* 如果是TCP连接，需要优雅关闭（先迁移状态，对端的ACK可能同步到达） */
+    if (sock->conn && sock->state == SS_CONNECTED) {
+        tcp_state_transition(sock, TCP_EVENT_CLOSE);
         tcp_send_fin(sock);
-        sock->tcp_state = TCP_FIN_WAIT1;
+    }
+    
+    /* Unix域监听Socket：关闭还没有被accept的连接 */
+    if (sock->unix_sk) {
+        unix_close(sock);
     }
     
     /* 从管理器中移除 */
@@ -175,9 +260,8 @@ struct mysocket* socket_create(int domain, int type, int protocol) {
     }
     
     /* 分配文件描述符 */
-    pthread_mutex_lock(&socket_mutex);
-    sock->fd = g_socket_manager.next_fd++;
-    pthread_mutex_unlock(&socket_mutex);
+    sock->fd = socket_alloc_fd();
+    sock->host_fd = -1;
     
     /* 初始化基本属性 */
     sock->family = domain;
@@ -203,6 +287,29 @@ struct mysocket* socket_create(int domain, int type, int protocol) {
     sock->listen_backlog = 0;
     sock->listen_count = 0;
     
+    /* TCP Socket分配连接控制块，Unix域Socket分配地址和对端信息，原始套接字加入旁听链表 */
+    sock->conn = NULL;
+    if (domain == AF_UNIX) {
+        if (unix_sock_init(sock) < 0) {
+            socket_buffer_cleanup(sock);
+            free(sock);
+            return NULL;
+        }
+    } else if (type == SOCK_RAW) {
+        if (raw_sock_init(sock) < 0) {
+            socket_buffer_cleanup(sock);
+            free(sock);
+            return NULL;
+        }
+    } else if (type == SOCK_STREAM) {
+        sock->conn = tcp_conn_create(sock);
+        if (!sock->conn) {
+            socket_buffer_cleanup(sock);
+            free(sock);
+            return NULL;
+        }
+    }
+    
     sock->next = NULL;
     
     DEBUG_PRINT("Socket结构创建成功: fd=%d, family=%d, type=%d, protocol=%d",
@@ -211,6 +318,17 @@ struct mysocket* socket_create(int domain, int type, int protocol) {
     return sock;
 }
 
+/**
+ * 分配文件描述符
+ * @return 新的文件描述符
+ */
+int socket_alloc_fd(void) {
+    pthread_mutex_lock(&socket_mutex);
+    int fd = g_socket_manager.next_fd++;
+    pthread_mutex_unlock(&socket_mutex);
+    return fd;
+}
+
 /**
  * 销毁Socket结构体
  * @param sock Socket指针
@@ -228,6 +346,40 @@ void socket_destroy(struct mysocket *sock) {
         free(sock->listen_queue);
     }
     
+    /* 释放接收环中未处理的包：投递方在链表锁内取得引用，Socket摘链后不会有新的投递方，
+     * 等正在投递的线程退出后才能释放 */
+    while (__atomic_load_n(&sock->rx_producers, __ATOMIC_ACQUIRE) > 0) {
+        sched_yield();
+    }
+    packet_ring_destroy(sock->rx_ring);
+    sock->rx_ring = NULL;
+    
+    /* 释放连接控制块（含重传队列和乱序队列） */
+    if (sock->conn) {
+        tcp_conn_destroy(sock->conn);
+        sock->conn = NULL;
+    }
+    
+    /* 从Unix域路径表摘除，通知对端 */
+    unix_sock_release(sock);
+    
+    /* 退出旁听链表，释放队列中的包 */
+    raw_sock_release(sock);
+    
+    /* 释放BPF过滤器 */
+    sk_filter_destroy(sock->filter);
+    
+    /* 释放访问控制的引用，子Socket减去源地址的连接数 */
+    socket_acl_release(sock);
+    
+    /* 释放限速表 */
+    socket_rate_limit_destroy(sock->rate_limit);
+    
+    /* 关闭内核直通的套接字 */
+    if (sock->host_fd >= 0) {
+        host_sock_close(sock->host_fd);
+    }
+    
     /* 释放结构体 */
     free(sock);
 }
@@ -246,6 +398,7 @@ int socket_add_to_manager(struct mysocket *sock) {
     sock->next = g_socket_manager.socket_list;
     g_socket_manager.socket_list = sock;
     g_socket_manager.total_sockets++;
+    __atomic_add_fetch(&g_socket_manager.generation, 1, __ATOMIC_RELEASE);
     
     pthread_mutex_unlock(&socket_mutex);
     
@@ -274,6 +427,7 @@ void socket_remove_from_manager(struct mysocket *sock) {
                 g_socket_manager.socket_list = current->next;
             }
             g_socket_manager.total_sockets--;
+            __atomic_add_fetch(&g_socket_manager.generation, 1, __ATOMIC_RELEASE);
             break;
         }
         prev = current;
@@ -286,6 +440,21 @@ void socket_remove_from_manager(struct mysocket *sock) {
                 sock->fd, g_socket_manager.total_sockets);
 }
 
+/**
+ * 锁住Socket链表，遍历g_socket_manager.socket_list的模块在锁内进行
+ * 持锁期间不能再调用socket_find_by_fd等需要同一把锁的函数
+ */
+void socket_manager_lock(void) {
+    pthread_mutex_lock(&socket_mutex);
+}
+
+/**
+ * 解锁Socket链表
+ */
+void socket_manager_unlock(void) {
+    pthread_mutex_unlock(&socket_mutex);
+}
+
 /**
  * 设置错误码
  * @param error_code 错误码
@@ -323,6 +492,8 @@ const char* mysocket_strerror(int error_code) {
             return "连接被拒绝";
         case MYSOCKET_ETIMEDOUT:
             return "连接超时";
+        case MYSOCKET_ENOMEM:
+            return "内存不足";
         default:
             return "未知错误";
     }
@@ -0,0 +1,392 @@
+/**
+ * @file socket_filter.c
+ * @brief 经典BPF套接字过滤器：挂载时校验并预解码，投递数据报前运行，丢弃的数据报不复制
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 模仿Linux的net/core/filter.c（SO_ATTACH_FILTER）。指令格式与Linux相同，
+ * tcpdump -dd生成的程序可以直接使用。
+ *
+ * 挂载时一次完成sk_chk_filter做的检查：指令数、操作码、跳转不越界且只向前、
+ * 暂存单元下标、除以常数0、最后一条是RET。通过后每条指令的code被展开成连续的枚举值，
+ * 运行时一个switch分派，不再逐字段拆解code，也不再做这些检查。
+ *
+ * 过滤器看到的数据（偏移0开始）：
+ *   UDP：IP头、UDP头和负载，与原始套接字读到的帧相同；头部在栈上构造，负载直接引用发送方的数据；
+ *   Unix域数据报：只有负载。
+ * 返回值是要保留的字节数，0表示丢弃，小于长度时截断；越界读取按丢弃处理。
+ * 内核直通的套接字把程序原样交给内核（SO_ATTACH_FILTER），偏移按内核的约定（UDP从UDP头开始）。
+ *
+ * 和关闭一样，挂载/卸载时不能有其他线程正在向该Socket投递。
+ */
+
+#include "socket_internal.h"
+
+/* 预解码后的操作 */
+enum {
+    SKF_LD_W_ABS, SKF_LD_H_ABS, SKF_LD_B_ABS,
+    SKF_LD_W_IND, SKF_LD_H_IND, SKF_LD_B_IND,
+    SKF_LD_W_LEN, SKF_LD_IMM, SKF_LD_MEM,
+    SKF_LDX_IMM, SKF_LDX_MEM, SKF_LDX_W_LEN, SKF_LDX_B_MSH,
+    SKF_ST, SKF_STX,
+    SKF_ALU_ADD_K, SKF_ALU_SUB_K, SKF_ALU_MUL_K, SKF_ALU_DIV_K, SKF_ALU_MOD_K,
+    SKF_ALU_AND_K, SKF_ALU_OR_K, SKF_ALU_XOR_K, SKF_ALU_LSH_K, SKF_ALU_RSH_K,
+    SKF_ALU_ADD_X, SKF_ALU_SUB_X, SKF_ALU_MUL_X, SKF_ALU_DIV_X, SKF_ALU_MOD_X,
+    SKF_ALU_AND_X, SKF_ALU_OR_X, SKF_ALU_XOR_X, SKF_ALU_LSH_X, SKF_ALU_RSH_X,
+    SKF_ALU_NEG,
+    SKF_JMP_JA,
+    SKF_JMP_JEQ_K, SKF_JMP_JGT_K, SKF_JMP_JGE_K, SKF_JMP_JSET_K,
+    SKF_JMP_JEQ_X, SKF_JMP_JGT_X, SKF_JMP_JGE_X, SKF_JMP_JSET_X,
+    SKF_RET_K, SKF_RET_A,
+    SKF_MISC_TAX, SKF_MISC_TXA
+};
+
+/* 过滤器看到的数据：头部（栈上构造）后接负载（引用原数据），两段在逻辑上连续 */
+struct sk_filter_data {
+    const uint8_t *hdr;
+    uint32_t hdr_len;
+    const uint8_t *payload;
+    uint32_t len;               /* 总长度 */
+};
+
+/**
+ * 把一条指令的code展开为预解码的操作
+ * @return 操作，非法的code返回-1
+ */
+static int sk_filter_decode(uint16_t code) {
+    switch (code) {
+    case BPF_LD | BPF_W | BPF_ABS:  return SKF_LD_W_ABS;
+    case BPF_LD | BPF_H | BPF_ABS:  return SKF_LD_H_ABS;
+    case BPF_LD | BPF_B | BPF_ABS:  return SKF_LD_B_ABS;
+    case BPF_LD | BPF_W | BPF_IND:  return SKF_LD_W_IND;
+    case BPF_LD | BPF_H | BPF_IND:  return SKF_LD_H_IND;
+    case BPF_LD | BPF_B | BPF_IND:  return SKF_LD_B_IND;
+    case BPF_LD | BPF_W | BPF_LEN:  return SKF_LD_W_LEN;
+    case BPF_LD | BPF_IMM:          return SKF_LD_IMM;
+    case BPF_LD | BPF_MEM:          return SKF_LD_MEM;
+    case BPF_LDX | BPF_IMM:         return SKF_LDX_IMM;
+    case BPF_LDX | BPF_MEM:         return SKF_LDX_MEM;
+    case BPF_LDX | BPF_W | BPF_LEN: return SKF_LDX_W_LEN;
+    case BPF_LDX | BPF_B | BPF_MSH: return SKF_LDX_B_MSH;
+    case BPF_ST:                    return SKF_ST;
+    case BPF_STX:                   return SKF_STX;
+    case BPF_ALU | BPF_ADD | BPF_K: return SKF_ALU_ADD_K;
+    case BPF_ALU | BPF_SUB | BPF_K: return SKF_ALU_SUB_K;
+    case BPF_ALU | BPF_MUL | BPF_K: return SKF_ALU_MUL_K;
+    case BPF_ALU | BPF_DIV | BPF_K: return SKF_ALU_DIV_K;
+    case BPF_ALU | BPF_MOD | BPF_K: return SKF_ALU_MOD_K;
+    case BPF_ALU | BPF_AND | BPF_K: return SKF_ALU_AND_K;
+    case BPF_ALU | BPF_OR | BPF_K:  return SKF_ALU_OR_K;
+    case BPF_ALU | BPF_XOR | BPF_K: return SKF_ALU_XOR_K;
+    case BPF_ALU | BPF_LSH | BPF_K: return SKF_ALU_LSH_K;
+    case BPF_ALU | BPF_RSH | BPF_K: return SKF_ALU_RSH_K;
+    case BPF_ALU | BPF_ADD | BPF_X: return SKF_ALU_ADD_X;
+    case BPF_ALU | BPF_SUB | BPF_X: return SKF_ALU_SUB_X;
+    case BPF_ALU | BPF_MUL | BPF_X: return SKF_ALU_MUL_X;
+    case BPF_ALU | BPF_DIV | BPF_X: return SKF_ALU_DIV_X;
+    case BPF_ALU | BPF_MOD | BPF_X: return SKF_ALU_MOD_X;
+    case BPF_ALU | BPF_AND | BPF_X: return SKF_ALU_AND_X;
+    case BPF_ALU | BPF_OR | BPF_X:  return SKF_ALU_OR_X;
+    case BPF_ALU | BPF_XOR | BPF_X: return SKF_ALU_XOR_X;
+    case BPF_ALU | BPF_LSH | BPF_X: return SKF_ALU_LSH_X;
+    case BPF_ALU | BPF_RSH | BPF_X: return SKF_ALU_RSH_X;
+    case BPF_ALU | BPF_NEG:         return SKF_ALU_NEG;
+    case BPF_JMP | BPF_JA:          return SKF_JMP_JA;
+    case BPF_JMP | BPF_JEQ | BPF_K: return SKF_JMP_JEQ_K;
+    case BPF_JMP | BPF_JGT | BPF_K: return SKF_JMP_JGT_K;
+    case BPF_JMP | BPF_JGE | BPF_K: return SKF_JMP_JGE_K;
+    case BPF_JMP | BPF_JSET | BPF_K: return SKF_JMP_JSET_K;
+    case BPF_JMP | BPF_JEQ | BPF_X: return SKF_JMP_JEQ_X;
+    case BPF_JMP | BPF_JGT | BPF_X: return SKF_JMP_JGT_X;
+    case BPF_JMP | BPF_JGE | BPF_X: return SKF_JMP_JGE_X;
+    case BPF_JMP | BPF_JSET | BPF_X: return SKF_JMP_JSET_X;
+    case BPF_RET | BPF_K:           return SKF_RET_K;
+    case BPF_RET | BPF_A:           return SKF_RET_A;
+    case BPF_MISC | BPF_TAX:        return SKF_MISC_TAX;
+    case BPF_MISC | BPF_TXA:        return SKF_MISC_TXA;
+    default:                        return -1;
+    }
+}
+
+/**
+ * 校验并预解码一个程序
+ * @param prog 指令
+ * @param len 指令数
+ * @return 过滤器，程序不合法或内存不足返回NULL（错误码已设置）
+ */
+struct sk_filter* sk_filter_create(const struct mysocket_sock_filter *prog, unsigned int len) {
+    if (!prog || len == 0 || len > BPF_MAXINSNS) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return NULL;
+    }
+
+    struct sk_filter *f = malloc(sizeof(struct sk_filter) + len * sizeof(struct sk_filter_insn));
+    if (!f) {
+        socket_set_error(MYSOCKET_ENOMEM);
+        return NULL;
+    }
+    f->len = len;
+    f->runs = 0;
+    f->drops = 0;
+
+    for (unsigned int pc = 0; pc < len; pc++) {
+        const struct mysocket_sock_filter *insn = &prog[pc];
+        int op = sk_filter_decode(insn->code);
+        int valid = op >= 0;
+
+        switch (op) {
+        case SKF_LD_MEM: case SKF_LDX_MEM: case SKF_ST: case SKF_STX:
+            valid = insn->k < BPF_MEMWORDS;
+            break;
+        case SKF_ALU_DIV_K: case SKF_ALU_MOD_K:
+            valid = insn->k != 0;
+            break;
+        case SKF_ALU_LSH_K: case SKF_ALU_RSH_K:
+            valid = insn->k < 32;
+            break;
+        case SKF_JMP_JA:
+            valid = insn->k < len - pc - 1;
+            break;
+        case SKF_JMP_JEQ_K: case SKF_JMP_JGT_K: case SKF_JMP_JGE_K: case SKF_JMP_JSET_K:
+        case SKF_JMP_JEQ_X: case SKF_JMP_JGT_X: case SKF_JMP_JGE_X: case SKF_JMP_JSET_X:
+            valid = pc + 1 + insn->jt < len && pc + 1 + insn->jf < len;
+            break;
+        default:
+            break;
+        }
+
+        if (!valid) {
+            DEBUG_PRINT("BPF程序不合法: pc=%u, code=0x%04x, k=%u", pc, insn->code, insn->k);
+            free(f);
+            socket_set_error(MYSOCKET_EINVAL);
+            return NULL;
+        }
+
+        f->insns[pc].op = (uint8_t)op;
+        f->insns[pc].jt = insn->jt;
+        f->insns[pc].jf = insn->jf;
+        f->insns[pc].k = insn->k;
+    }
+
+    /* 程序必须以RET结束，否则可能执行到末尾之外 */
+    int last = f->insns[len - 1].op;
+    if (last != SKF_RET_K && last != SKF_RET_A) {
+        free(f);
+        socket_set_error(MYSOCKET_EINVAL);
+        return NULL;
+    }
+
+    return f;
+}
+
+/**
+ * 释放过滤器
+ */
+void sk_filter_destroy(struct sk_filter *f) {
+    free(f);
+}
+
+/**
+ * 读取size字节（网络字节序转为主机字节序），大多数读取落在头部或负载之内，跨越两段时逐字节读
+ * @return 0成功，-1越界
+ */
+static inline int sk_filter_load(const struct sk_filter_data *d, uint32_t k, uint32_t size,
+                                 uint32_t *out) {
+    if (k > d->len || size > d->len - k) {
+        return -1;
+    }
+
+    const uint8_t *p;
+    uint8_t tmp[4];
+    if (k + size <= d->hdr_len) {
+        p = d->hdr + k;
+    } else if (k >= d->hdr_len) {
+        p = d->payload + (k - d->hdr_len);
+    } else {
+        for (uint32_t i = 0; i < size; i++) {
+            tmp[i] = (k + i < d->hdr_len) ? d->hdr[k + i] : d->payload[k + i - d->hdr_len];
+        }
+        p = tmp;
+    }
+
+    switch (size) {
+    case 4: *out = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; break;
+    case 2: *out = ((uint32_t)p[0] << 8) | p[1]; break;
+    default: *out = p[0]; break;
+    }
+    return 0;
+}
+
+/**
+ * 运行过滤器
+ * @param f 过滤器
+ * @param hdr 头部（可为NULL）
+ * @param hdr_len 头部长度
+ * @param payload 负载
+ * @param payload_len 负载长度
+ * @return 保留的字节数（从头部开始计），0表示丢弃
+ */
+uint32_t sk_filter_run(struct sk_filter *f, const void *hdr, size_t hdr_len,
+                       const void *payload, size_t payload_len) {
+    struct sk_filter_data d = {
+        hdr, (uint32_t)hdr_len, payload, (uint32_t)(hdr_len + payload_len)
+    };
+    const struct sk_filter_insn *insn = f->insns;
+    uint32_t A = 0, X = 0, tmp;
+    uint32_t mem[BPF_MEMWORDS] = {0};
+    uint32_t result;
+
+    f->runs++;
+
+    for (;; insn++) {
+        uint32_t k = insn->k;
+
+        switch (insn->op) {
+        case SKF_LD_W_ABS: if (sk_filter_load(&d, k, 4, &A) < 0) goto drop; break;
+        case SKF_LD_H_ABS: if (sk_filter_load(&d, k, 2, &A) < 0) goto drop; break;
+        case SKF_LD_B_ABS: if (sk_filter_load(&d, k, 1, &A) < 0) goto drop; break;
+        case SKF_LD_W_IND: if (k + X < k || sk_filter_load(&d, k + X, 4, &A) < 0) goto drop; break;
+        case SKF_LD_H_IND: if (k + X < k || sk_filter_load(&d, k + X, 2, &A) < 0) goto drop; break;
+        case SKF_LD_B_IND: if (k + X < k || sk_filter_load(&d, k + X, 1, &A) < 0) goto drop; break;
+        case SKF_LD_W_LEN: A = d.len; break;
+        case SKF_LD_IMM: A = k; break;
+        case SKF_LD_MEM: A = mem[k]; break;
+        case SKF_LDX_IMM: X = k; break;
+        case SKF_LDX_MEM: X = mem[k]; break;
+        case SKF_LDX_W_LEN: X = d.len; break;
+        case SKF_LDX_B_MSH:
+            if (sk_filter_load(&d, k, 1, &tmp) < 0) goto drop;
+            X = (tmp & 0x0F) << 2;
+            break;
+        case SKF_ST: mem[k] = A; break;
+        case SKF_STX: mem[k] = X; break;
+        case SKF_ALU_ADD_K: A += k; break;
+        case SKF_ALU_SUB_K: A -= k; break;
+        case SKF_ALU_MUL_K: A *= k; break;
+        case SKF_ALU_DIV_K: A /= k; break;
+        case SKF_ALU_MOD_K: A %= k; break;
+        case SKF_ALU_AND_K: A &= k; break;
+        case SKF_ALU_OR_K: A |= k; break;
+        case SKF_ALU_XOR_K: A ^= k; break;
+        case SKF_ALU_LSH_K: A <<= k; break;
+        case SKF_ALU_RSH_K: A >>= k; break;
+        case SKF_ALU_ADD_X: A += X; break;
+        case SKF_ALU_SUB_X: A -= X; break;
+        case SKF_ALU_MUL_X: A *= X; break;
+        case SKF_ALU_DIV_X: if (X == 0) goto drop; A /= X; break;
+        case SKF_ALU_MOD_X: if (X == 0) goto drop; A %= X; break;
+        case SKF_ALU_AND_X: A &= X; break;
+        case SKF_ALU_OR_X: A |= X; break;
+        case SKF_ALU_XOR_X: A ^= X; break;
+        case SKF_ALU_LSH_X: A = X < 32 ? A << X : 0; break;
+        case SKF_ALU_RSH_X: A = X < 32 ? A >> X : 0; break;
+        case SKF_ALU_NEG: A = (uint32_t)-A; break;
+        case SKF_JMP_JA: insn += k; break;
+        case SKF_JMP_JEQ_K: insn += (A == k) ? insn->jt : insn->jf; break;
+        case SKF_JMP_JGT_K: insn += (A > k) ? insn->jt : insn->jf; break;
+        case SKF_JMP_JGE_K: insn += (A >= k) ? insn->jt : insn->jf; break;
+        case SKF_JMP_JSET_K: insn += (A & k) ? insn->jt : insn->jf; break;
+        case SKF_JMP_JEQ_X: insn += (A == X) ? insn->jt : insn->jf; break;
+        case SKF_JMP_JGT_X: insn += (A > X) ? insn->jt : insn->jf; break;
+        case SKF_JMP_JGE_X: insn += (A >= X) ? insn->jt : insn->jf; break;
+        case SKF_JMP_JSET_X: insn += (A & X) ? insn->jt : insn->jf; break;
+        case SKF_RET_K: result = k; goto out;
+        case SKF_RET_A: result = A; goto out;
+        case SKF_MISC_TAX: X = A; break;
+        case SKF_MISC_TXA: A = X; break;
+        default: goto drop;     /* 预解码后不会出现 */
+        }
+    }
+
+drop:
+    result = 0;
+out:
+    if (result == 0) {
+        f->drops++;
+    }
+    return result;
+}
+
+/**
+ * 对投递给UDP Socket的数据报运行过滤器：头部在栈上构造，负载不复制
+ * @param target 接收方（已挂过滤器）
+ * @param src 发送方地址
+ * @param dst 目标地址
+ * @param len 负载长度
+ * @return 要复制的负载字节数，0表示丢弃
+ */
+size_t sk_filter_udp(struct mysocket *target, const struct mysocket_addr_in *src,
+                     const struct mysocket_addr_in *dst, const void *data, size_t len) {
+    uint8_t hdr[IP_WIRE_HDR_LEN + UDP_WIRE_HDR_LEN];
+    packet_udp_wire_headers(hdr, src, dst, len);
+
+    uint32_t keep = sk_filter_run(target->filter, hdr, sizeof(hdr), data, len);
+    if (keep <= sizeof(hdr)) {
+        return 0;
+    }
+    keep -= sizeof(hdr);
+    return keep < len ? keep : len;
+}
+
+/**
+ * 挂载过滤器（类似setsockopt(SO_ATTACH_FILTER)），替换已有的过滤器
+ * @param sockfd Socket文件描述符
+ * @param fprog 程序
+ * @return 0成功，-1失败
+ */
+int mysocket_attach_filter(int sockfd, const struct mysocket_sock_fprog *fprog) {
+    struct mysocket *sock = socket_find_by_fd(sockfd);
+    if (!sock || !fprog) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    if (sock->host_fd >= 0) {
+        if (host_sock_attach_filter(sock->host_fd, fprog->filter, fprog->len) < 0) {
+            socket_set_error(MYSOCKET_EINVAL);
+            return -1;
+        }
+        return 0;
+    }
+
+    struct sk_filter *f = sk_filter_create(fprog->filter, fprog->len);
+    if (!f) {
+        return -1;
+    }
+
+    sk_filter_destroy(sock->filter);
+    sock->filter = f;
+
+    DEBUG_PRINT("挂载BPF过滤器: fd=%d, len=%u", sockfd, fprog->len);
+    return 0;
+}
+
+/**
+ * 卸载过滤器（类似setsockopt(SO_DETACH_FILTER)）
+ * @param sockfd Socket文件描述符
+ * @return 0成功，-1失败（没有挂载过滤器为MYSOCKET_EINVAL）
+ */
+int mysocket_detach_filter(int sockfd) {
+    struct mysocket *sock = socket_find_by_fd(sockfd);
+    if (!sock) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    if (sock->host_fd >= 0) {
+        if (host_sock_detach_filter(sock->host_fd) < 0) {
+            socket_set_error(MYSOCKET_EINVAL);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!sock->filter) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    sk_filter_destroy(sock->filter);
+    sock->filter = NULL;
+    return 0;
+}
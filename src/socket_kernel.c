@@ -0,0 +1,366 @@
+/**
+ * @file socket_kernel.c
+ * @brief 内核直通后端：mysocket_*调用直接映射到Linux的真实套接字
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 同一份应用代码既可以跑在本项目的协议栈上，也可以跑在内核上，用于对比两条路径。
+ * g_socket_backend为SOCKET_BACKEND_KERNEL时（mysocket_init读取环境变量MYSOCKET_BACKEND=kernel，
+ * 也可以直接修改），新建的Socket在内核中创建一个真实套接字，记录在host_fd中；
+ * 各mysocket_*函数查到Socket后发现host_fd有效，就转到这里处理，已有的Socket不受切换影响。
+ *
+ * 直通的Socket仍然在管理器中占一个本项目的文件描述符，但不分配缓冲区和连接控制块，
+ * 本地和对端地址也不记录在Socket中，不参与本项目协议栈的地址查找。
+ * 支持AF_INET和AF_UNIX的流式和数据报套接字；地址在struct mysocket_addr_in/mysocket_addr_un
+ * 与系统地址之间转换，errno转换为MYSOCKET_E*错误码。
+ *
+ * 与本项目协议栈的差别：内核套接字默认阻塞（mysocket_set_nonblocking才设置O_NONBLOCK），
+ * 对端关闭后mysocket_recv返回0。
+ */
+
+#include "socket_internal.h"
+#include <stddef.h>
+
+/* 新建Socket使用的后端 */
+int g_socket_backend = SOCKET_BACKEND_USER;
+
+/**
+ * 根据环境变量MYSOCKET_BACKEND选择后端（"kernel"或"user"），未设置时保持不变
+ */
+void socket_kernel_init(void) {
+    const char *backend = getenv("MYSOCKET_BACKEND");
+    if (!backend) return;
+
+    if (strcmp(backend, "kernel") == 0) {
+        g_socket_backend = SOCKET_BACKEND_KERNEL;
+    } else if (strcmp(backend, "user") == 0) {
+        g_socket_backend = SOCKET_BACKEND_USER;
+    }
+    DEBUG_PRINT("Socket后端: %s", g_socket_backend == SOCKET_BACKEND_KERNEL ? "内核" : "用户态");
+}
+
+/**
+ * 把errno转换为本项目的错误码
+ */
+static int socket_kernel_errno(int err) {
+    switch (err) {
+        case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+        case EWOULDBLOCK:
+#endif
+        case EINPROGRESS:
+        case EALREADY:
+            return MYSOCKET_EAGAIN;
+        case EADDRINUSE:
+        case EADDRNOTAVAIL:
+            return MYSOCKET_EADDRINUSE;
+        case ECONNREFUSED:
+        case ECONNRESET:
+        case EPIPE:
+        case ENOENT:
+            return MYSOCKET_ECONNREFUSED;
+        case ETIMEDOUT:
+            return MYSOCKET_ETIMEDOUT;
+        case ENOMEM:
+        case ENOBUFS:
+            return MYSOCKET_ENOMEM;
+        case EINVAL:
+        case EBADF:
+        case ENOTCONN:
+        case EISCONN:
+        case EAFNOSUPPORT:
+        case EOPNOTSUPP:
+        case EDESTADDRREQ:
+        case EMSGSIZE:
+        case ENAMETOOLONG:
+            return MYSOCKET_EINVAL;
+        default:
+            return MYSOCKET_ERROR;
+    }
+}
+
+/**
+ * 按errno设置错误码
+ * @return -1
+ */
+static int socket_kernel_fail(void) {
+    int err = errno;
+    DEBUG_PRINT("内核套接字调用失败: %s", strerror(err));
+    socket_set_error(socket_kernel_errno(err));
+    return -1;
+}
+
+/**
+ * 本项目的地址转换为主机地址
+ * @return 0成功，-1地址与Socket的协议族不符或长度不够
+ */
+static int socket_kernel_addr_from(struct host_sockaddr *sa, const struct mysocket *sock,
+                                   const struct mysocket_addr *addr, socklen_t addrlen) {
+    memset(sa, 0, sizeof(*sa));
+    if (!addr || addr->sa_family != sock->family) return -1;
+
+    if (sock->family == AF_INET) {
+        const struct mysocket_addr_in *in = (const struct mysocket_addr_in *)addr;
+        if (addrlen < sizeof(struct mysocket_addr_in)) return -1;
+        sa->family = HOST_AF_INET;
+        sa->addr = in->sin_addr;
+        sa->port = in->sin_port;
+        return 0;
+    }
+
+    /* Unix域：和Linux一样由addrlen决定名字长度，抽象命名空间的名字可以含0字节 */
+    const struct mysocket_addr_un *un = (const struct mysocket_addr_un *)addr;
+    size_t offset = offsetof(struct mysocket_addr_un, sun_path);
+    if (addrlen <= offset || addrlen > sizeof(struct mysocket_addr_un)) return -1;
+    sa->family = HOST_AF_UNIX;
+    sa->path_len = addrlen - offset;
+    memcpy(sa->path, un->sun_path, sa->path_len);
+    return 0;
+}
+
+/**
+ * 主机地址转换为本项目的地址
+ * @param addr 输出地址，可以为NULL
+ * @param addrlen 输入缓冲区长度，输出地址的实际长度（缓冲区不够时截断）
+ */
+static void socket_kernel_addr_to(struct mysocket_addr *addr, socklen_t *addrlen,
+                                  const struct host_sockaddr *sa) {
+    if (!addr || !addrlen) return;
+
+    if (sa->family == HOST_AF_INET) {
+        if (*addrlen >= sizeof(struct mysocket_addr_in)) {
+            struct mysocket_addr_in in;
+            memset(&in, 0, sizeof(in));
+            in.sin_family = AF_INET;
+            in.sin_addr = sa->addr;
+            in.sin_port = sa->port;
+            memcpy(addr, &in, sizeof(in));
+            *addrlen = sizeof(in);
+        }
+        return;
+    }
+
+    if (sa->family != HOST_AF_UNIX) {
+        *addrlen = 0;
+        return;
+    }
+
+    struct mysocket_addr_un un;
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    memcpy(un.sun_path, sa->path, sa->path_len);
+
+    socklen_t len = (socklen_t)(offsetof(struct mysocket_addr_un, sun_path) + sa->path_len);
+    memcpy(addr, &un, *addrlen < len ? *addrlen : len);
+    *addrlen = len;
+}
+
+/**
+ * 为主机套接字建立Socket结构；内存不足时关闭host_fd
+ * @return Socket指针，失败返回NULL并设置错误码
+ */
+static struct mysocket* socket_kernel_wrap(int host_fd, int domain, int type, int protocol) {
+    struct mysocket *sock = calloc(1, sizeof(struct mysocket));
+    if (!sock) {
+        host_sock_close(host_fd);
+        socket_set_error(MYSOCKET_ENOMEM);
+        return NULL;
+    }
+
+    sock->host_fd = host_fd;
+    sock->fd = socket_alloc_fd();
+    sock->family = domain;
+    sock->type = type;
+    sock->protocol = protocol;
+    sock->state = SS_UNCONNECTED;
+    sock->tcp_state = TCP_CLOSED;
+    sock->local_addr.sin_family = domain;
+    sock->peer_addr.sin_family = domain;
+    return sock;
+}
+
+/**
+ * 创建直通内核的Socket结构（由调用者加入管理器）
+ * @param domain AF_INET或AF_UNIX
+ * @param type SOCK_STREAM或SOCK_DGRAM
+ * @param protocol 协议（已推导）
+ * @return Socket指针，失败返回NULL并设置错误码
+ */
+struct mysocket* socket_kernel_create(int domain, int type, int protocol) {
+    if ((domain != AF_INET && domain != AF_UNIX) || (type != SOCK_STREAM && type != SOCK_DGRAM)) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return NULL;
+    }
+
+    int host_fd = host_sock_socket(domain == AF_INET ? HOST_AF_INET : HOST_AF_UNIX,
+                                   type == SOCK_STREAM ? HOST_SOCK_STREAM : HOST_SOCK_DGRAM);
+    if (host_fd < 0) {
+        socket_kernel_fail();
+        return NULL;
+    }
+
+    struct mysocket *sock = socket_kernel_wrap(host_fd, domain, type, protocol);
+    if (sock) {
+        DEBUG_PRINT("内核直通Socket创建成功: fd=%d, host_fd=%d", sock->fd, sock->host_fd);
+    }
+    return sock;
+}
+
+/**
+ * 创建一对已连接的Unix域内核套接字（由调用者加入管理器）
+ * @param pair 返回两个Socket
+ * @return 0成功，-1失败
+ */
+int socket_kernel_socketpair(int type, int protocol, struct mysocket *pair[2]) {
+    int host_fds[2];
+    if (host_sock_socketpair(type == SOCK_STREAM ? HOST_SOCK_STREAM : HOST_SOCK_DGRAM, host_fds) < 0) {
+        return socket_kernel_fail();
+    }
+
+    pair[0] = socket_kernel_wrap(host_fds[0], AF_UNIX, type, protocol);
+    pair[1] = socket_kernel_wrap(host_fds[1], AF_UNIX, type, protocol);
+    if (!pair[0] || !pair[1]) {
+        socket_destroy(pair[0]);
+        socket_destroy(pair[1]);
+        return -1;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        pair[i]->state = SS_CONNECTED;
+        pair[i]->tcp_state = type == SOCK_STREAM ? TCP_ESTABLISHED : TCP_CLOSED;
+    }
+    return 0;
+}
+
+int socket_kernel_bind(struct mysocket *sock, const struct mysocket_addr *addr, socklen_t addrlen) {
+    struct host_sockaddr sa;
+    if (socket_kernel_addr_from(&sa, sock, addr, addrlen) < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    if (host_sock_bind(sock->host_fd, &sa) < 0) {
+        return socket_kernel_fail();
+    }
+    return MYSOCKET_OK;
+}
+
+int socket_kernel_listen(struct mysocket *sock, int backlog) {
+    if (backlog <= 0) {
+        backlog = DEFAULT_LISTEN_BACKLOG;
+    }
+
+    if (host_sock_listen(sock->host_fd, backlog) < 0) {
+        return socket_kernel_fail();
+    }
+
+    sock->state = SS_LISTENING;
+    sock->tcp_state = TCP_LISTEN;
+    return MYSOCKET_OK;
+}
+
+/**
+ * 接受连接：新连接同样是直通内核的Socket
+ * @return 新连接的文件描述符，失败返回-1
+ */
+int socket_kernel_accept(struct mysocket *sock, struct mysocket_addr *addr, socklen_t *addrlen) {
+    struct host_sockaddr sa;
+    int host_fd = host_sock_accept(sock->host_fd, &sa);
+    if (host_fd < 0) {
+        return socket_kernel_fail();
+    }
+
+    struct mysocket *new_sock = socket_kernel_wrap(host_fd, sock->family, sock->type, sock->protocol);
+    if (!new_sock) {
+        return -1;
+    }
+
+    new_sock->state = SS_CONNECTED;
+    new_sock->tcp_state = TCP_ESTABLISHED;
+    socket_add_to_manager(new_sock);
+
+    socket_kernel_addr_to(addr, addrlen, &sa);
+    return new_sock->fd;
+}
+
+/**
+ * 连接：阻塞的Socket等内核完成握手；非阻塞的Socket握手进行中时返回MYSOCKET_EAGAIN
+ */
+int socket_kernel_connect(struct mysocket *sock, const struct mysocket_addr *addr, socklen_t addrlen) {
+    struct host_sockaddr sa;
+    if (socket_kernel_addr_from(&sa, sock, addr, addrlen) < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    if (host_sock_connect(sock->host_fd, &sa) < 0) {
+        if (errno == EINPROGRESS) {
+            sock->state = SS_CONNECTING;
+            sock->tcp_state = TCP_SYN_SENT;
+        }
+        return socket_kernel_fail();
+    }
+
+    sock->state = SS_CONNECTED;
+    if (sock->type == SOCK_STREAM) {
+        sock->tcp_state = TCP_ESTABLISHED;
+    }
+    return MYSOCKET_OK;
+}
+
+ssize_t socket_kernel_send(struct mysocket *sock, const void *buf, size_t len) {
+    ssize_t n = host_sock_send(sock->host_fd, buf, len);
+    return n < 0 ? socket_kernel_fail() : n;
+}
+
+/**
+ * 接收数据
+ * @return 接收的字节数，对端关闭返回0，失败返回-1
+ */
+ssize_t socket_kernel_recv(struct mysocket *sock, void *buf, size_t len) {
+    ssize_t n = host_sock_recv(sock->host_fd, buf, len);
+    return n < 0 ? socket_kernel_fail() : n;
+}
+
+ssize_t socket_kernel_sendto(struct mysocket *sock, const void *buf, size_t len,
+                             const struct mysocket_addr *dest_addr, socklen_t addrlen) {
+    struct host_sockaddr sa;
+    if (socket_kernel_addr_from(&sa, sock, dest_addr, addrlen) < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    ssize_t n = host_sock_sendto(sock->host_fd, buf, len, &sa);
+    return n < 0 ? socket_kernel_fail() : n;
+}
+
+ssize_t socket_kernel_recvfrom(struct mysocket *sock, void *buf, size_t len,
+                               struct mysocket_addr *src_addr, socklen_t *addrlen) {
+    struct host_sockaddr sa;
+    ssize_t n = host_sock_recvfrom(sock->host_fd, buf, len, &sa);
+    if (n < 0) {
+        return socket_kernel_fail();
+    }
+
+    socket_kernel_addr_to(src_addr, addrlen, &sa);
+    return n;
+}
+
+/**
+ * 从文件发送：交给内核的sendfile
+ * @param offset 文件偏移，返回时前移已发送的字节数
+ */
+ssize_t socket_kernel_sendfile(struct mysocket *sock, int in_fd, off_t *offset, size_t count) {
+    ssize_t n = host_sock_sendfile(sock->host_fd, in_fd, offset, count);
+    if (n < 0) {
+        return socket_kernel_fail();
+    }
+    return n;
+}
+
+int socket_kernel_set_nonblocking(struct mysocket *sock) {
+    if (host_sock_set_nonblocking(sock->host_fd) < 0) {
+        return socket_kernel_fail();
+    }
+    return MYSOCKET_OK;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file socket_mem.c
+ * @brief Socket全局内存记账
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 仿照Linux的tcp_mem/udp_mem，按协议统计所有Socket缓冲区和包队列占用的内存，
+ * 并分为三个水位：
+ *   - 超过压力阈值进入内存压力状态：禁止缓冲区增长、收缩通告窗口、回收空闲缓冲区，
+ *     降到低水位以下才退出
+ *   - 达到上限：拒绝新的分配（新连接、乱序段、UDP数据报）
+ */
+
+#include "socket_internal.h"
+
+/* 各协议的水位：低水位、压力阈值、上限（字节） */
+size_t g_tcp_mem[3] = { 48 * 1024 * 1024, 64 * 1024 * 1024, 96 * 1024 * 1024 };
+size_t g_udp_mem[3] = { 16 * 1024 * 1024, 24 * 1024 * 1024, 32 * 1024 * 1024 };
+
+/* 各协议的记账状态 */
+static struct socket_mem_stats mem_stats[SOCKET_MEM_CLASSES];
+static int mem_under_pressure[SOCKET_MEM_CLASSES];
+static int mem_reclaim_pending;     /* 进入压力状态后还没执行的空闲缓冲区回收 */
+static pthread_mutex_t mem_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * 获取协议对应的水位配置
+ */
+static size_t* socket_mem_limits(int mem_class) {
+    return (mem_class == SOCKET_MEM_UDP) ? g_udp_mem : g_tcp_mem;
+}
+
+/**
+ * 根据当前占用更新压力状态（调用者持有mem_mutex）
+ * @return 1表示刚进入压力状态
+ */
+static int socket_mem_update_pressure(int mem_class) {
+    size_t *limits = socket_mem_limits(mem_class);
+    size_t allocated = mem_stats[mem_class].allocated;
+
+    if (!mem_under_pressure[mem_class] && allocated > limits[1]) {
+        mem_under_pressure[mem_class] = 1;
+        mem_stats[mem_class].pressure_events++;
+        return 1;
+    }
+
+    if (mem_under_pressure[mem_class] && allocated < limits[0]) {
+        mem_under_pressure[mem_class] = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * 确定Socket的记账类别
+ * @param sock Socket指针
+ * @return SOCKET_MEM_TCP或SOCKET_MEM_UDP
+ */
+int socket_mem_class(const struct mysocket *sock) {
+    return (sock && sock->type == SOCK_STREAM) ? SOCKET_MEM_TCP : SOCKET_MEM_UDP;
+}
+
+/**
+ * 记账一次内存分配
+ * @param mem_class 记账类别
+ * @param bytes 字节数
+ * @param kind SOCKET_MEM_FORCE总是成功（如已发出待确认的数据），
+ *             SOCKET_MEM_NEW超过上限时失败，
+ *             SOCKET_MEM_GROW在压力状态下或会超过压力阈值时失败
+ * @return 0成功，-1失败
+ */
+int socket_mem_charge(int mem_class, size_t bytes, int kind) {
+    if (mem_class < 0 || mem_class >= SOCKET_MEM_CLASSES) return -1;
+    if (bytes == 0) return 0;
+
+    size_t *limits = socket_mem_limits(mem_class);
+    struct socket_mem_stats *stats = &mem_stats[mem_class];
+    int entered = 0;
+    int result = 0;
+
+    pthread_mutex_lock(&mem_mutex);
+
+    if (kind == SOCKET_MEM_GROW &&
+        (mem_under_pressure[mem_class] || stats->allocated + bytes > limits[1])) {
+        stats->grow_denied++;
+        result = -1;
+    } else if (kind == SOCKET_MEM_NEW && stats->allocated + bytes > limits[2]) {
+        stats->alloc_failures++;
+        result = -1;
+    } else {
+        stats->allocated += bytes;
+        if (stats->allocated > stats->peak) {
+            stats->peak = stats->allocated;
+        }
+        entered = socket_mem_update_pressure(mem_class);
+    }
+
+    pthread_mutex_unlock(&mem_mutex);
+
+    /* 刚进入压力状态：只记下需要回收，由socket_mem_reclaim在协议处理之外执行 */
+    if (entered) {
+        DEBUG_PRINT("进入内存压力状态: class=%d, allocated=%zu", mem_class, stats->allocated);
+        __atomic_store_n(&mem_reclaim_pending, 1, __ATOMIC_RELEASE);
+    }
+
+    return result;
+}
+
+/**
+ * 执行进入压力状态时推迟的回收：请求所有连接收缩空闲缓冲区
+ * 记账可能发生在发送或收包处理的中途（重传队列、乱序队列），还可能持有其他锁，
+ * 所以由socket_rx_process在处理任何包之前调用；这里只设置各连接的标记，
+ * 每个连接由自己的线程收缩
+ */
+void socket_mem_reclaim(void) {
+    if (__atomic_load_n(&mem_reclaim_pending, __ATOMIC_ACQUIRE) &&
+        __atomic_exchange_n(&mem_reclaim_pending, 0, __ATOMIC_ACQ_REL)) {
+        socket_buffer_request_reclaim(NULL);
+    }
+}
+
+/**
+ * 归还记账的内存
+ * @param mem_class 记账类别
+ * @param bytes 字节数
+ */
+void socket_mem_uncharge(int mem_class, size_t bytes) {
+    if (mem_class < 0 || mem_class >= SOCKET_MEM_CLASSES || bytes == 0) return;
+
+    pthread_mutex_lock(&mem_mutex);
+
+    struct socket_mem_stats *stats = &mem_stats[mem_class];
+    stats->allocated = (stats->allocated > bytes) ? stats->allocated - bytes : 0;
+    socket_mem_update_pressure(mem_class);
+
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+/**
+ * 获取当前内存状态
+ * @param mem_class 记账类别
+ * @return SOCKET_MEM_NORMAL、SOCKET_MEM_PRESSURE或SOCKET_MEM_HIGH
+ */
+socket_mem_state_t socket_mem_state(int mem_class) {
+    if (mem_class < 0 || mem_class >= SOCKET_MEM_CLASSES) return SOCKET_MEM_NORMAL;
+
+    size_t *limits = socket_mem_limits(mem_class);
+    socket_mem_state_t state = SOCKET_MEM_NORMAL;
+
+    pthread_mutex_lock(&mem_mutex);
+
+    if (mem_stats[mem_class].allocated >= limits[2]) {
+        state = SOCKET_MEM_HIGH;
+    } else if (mem_under_pressure[mem_class]) {
+        state = SOCKET_MEM_PRESSURE;
+    }
+
+    pthread_mutex_unlock(&mem_mutex);
+
+    return state;
+}
+
+/**
+ * 记录因内存不足丢弃的包
+ * @param mem_class 记账类别
+ */
+void socket_mem_count_drop(int mem_class) {
+    if (mem_class < 0 || mem_class >= SOCKET_MEM_CLASSES) return;
+
+    pthread_mutex_lock(&mem_mutex);
+    mem_stats[mem_class].packets_dropped++;
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+/**
+ * 记录因内存不足拒绝的连接
+ * @param mem_class 记账类别
+ */
+void socket_mem_count_refused(int mem_class) {
+    if (mem_class < 0 || mem_class >= SOCKET_MEM_CLASSES) return;
+
+    pthread_mutex_lock(&mem_mutex);
+    mem_stats[mem_class].conns_refused++;
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+/**
+ * 获取内存统计
+ * @param mem_class 记账类别
+ * @param stats 返回统计信息
+ */
+void socket_mem_get_stats(int mem_class, struct socket_mem_stats *stats) {
+    if (mem_class < 0 || mem_class >= SOCKET_MEM_CLASSES || !stats) return;
+
+    pthread_mutex_lock(&mem_mutex);
+    *stats = mem_stats[mem_class];
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+/**
+ * 清零计数器（当前占用和压力状态保持不变）
+ */
+void socket_mem_reset_stats(void) {
+    pthread_mutex_lock(&mem_mutex);
+
+    for (int i = 0; i < SOCKET_MEM_CLASSES; i++) {
+        size_t allocated = mem_stats[i].allocated;
+        memset(&mem_stats[i], 0, sizeof(mem_stats[i]));
+        mem_stats[i].allocated = allocated;
+        mem_stats[i].peak = allocated;
+    }
+
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+/**
+ * 打印内存统计
+ */
+void mysocket_print_mem_stats(void) {
+    static const char *names[SOCKET_MEM_CLASSES] = { "TCP", "UDP" };
+    static const char *states[] = { "正常", "压力", "上限" };
+
+    printf("=== Socket内存统计 ===\n");
+    for (int i = 0; i < SOCKET_MEM_CLASSES; i++) {
+        struct socket_mem_stats stats;
+        size_t *limits = socket_mem_limits(i);
+
+        socket_mem_get_stats(i, &stats);
+        printf("%s: 占用=%zu 峰值=%zu 水位=%zu/%zu/%zu 状态=%s\n",
+               names[i], stats.allocated, stats.peak,
+               limits[0], limits[1], limits[2], states[socket_mem_state(i)]);
+        printf("     进入压力=%llu 拒绝增长=%llu 分配失败=%llu 丢包=%llu 拒绝连接=%llu\n",
+               (unsigned long long)stats.pressure_events,
+               (unsigned long long)stats.grow_denied,
+               (unsigned long long)stats.alloc_failures,
+               (unsigned long long)stats.packets_dropped,
+               (unsigned long long)stats.conns_refused);
+    }
+}
@@ -0,0 +1,178 @@
+/**
+ * @file socket_ratelimit.c
+ * @brief 按源地址的令牌桶限速：监听Socket限制建连速率，UDP Socket限制数据报速率
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 每个源地址一个令牌桶，每秒补充rate个令牌，最多积攒burst个，每个SYN或数据报消耗一个，
+ * 没有令牌时丢弃（SYN在socket_can_accept_connection里、创建子Socket之前丢弃；
+ * 数据报在socket_send_udp_packet里、BPF过滤器和复制之前丢弃），并计数。
+ * 只按源地址区分：同一主机换端口不能绕过限速，绑定在通配地址上的UDP发送方源地址是127.0.0.1。
+ *
+ * 令牌桶放在固定大小的组相联表里（RATE_LIMIT_SETS组，每组RATE_LIMIT_WAYS路），
+ * 内存有上限，不随源地址数增长。组满时淘汰令牌最多的一路：令牌满的桶与不存在等价，
+ * 淘汰它不损失任何信息；只有所有桶都在欠账时才会丢掉某个来源的记录（计入evictions），
+ * 这个来源下次出现时得到一个满桶。正在被限速的来源令牌少，不会被偶尔出现的来源挤出表，
+ * 与lossy counting保留高频元素的思路相同。
+ *
+ * 令牌以千分之一为单位保存，时间用tcp_clock_ms（测试可替换），每毫秒补充rate个单位。
+ *
+ * 限速表第一次设置时用CAS挂到Socket上，之后直到socket_destroy都不释放：
+ * 收包路径在别的线程里不加Socket锁地读取sock->rate_limit，取消限速只在表锁内把rate置0。
+ */
+
+#include "socket_internal.h"
+
+#define RATE_TOKEN_UNIT         1000        /* 一个令牌的单位数 */
+#define RATE_LIMIT_MAX_BURST    1000000     /* burst*单位不超过uint32_t */
+
+/**
+ * 源地址对应的组
+ */
+static uint32_t rate_limit_set(uint32_t addr) {
+    /* 同一网段的地址只有低位不同，先把每一位都混合到低位 */
+    addr ^= addr >> 16;
+    addr *= 0x45d9f3bu;
+    addr ^= addr >> 16;
+    return addr & (RATE_LIMIT_SETS - 1);
+}
+
+/**
+ * 按经过的时间补充令牌
+ */
+static void rate_bucket_refill(const struct rate_limit *rl, struct rate_bucket *b, uint32_t now) {
+    uint64_t tokens = b->tokens + (uint64_t)(uint32_t)(now - b->last_ms) * rl->rate;
+    uint64_t cap = (uint64_t)rl->burst * RATE_TOKEN_UNIT;
+    b->tokens = (uint32_t)(tokens > cap ? cap : tokens);
+    b->last_ms = now;
+}
+
+/**
+ * 来自addr的一个事件（SYN或数据报）能否通过
+ * @param addr 源地址（网络字节序）
+ * @return 1通过，0被限速
+ */
+int socket_rate_limit_allow(struct rate_limit *rl, uint32_t addr) {
+    uint32_t now = (uint32_t)tcp_clock_ms();
+    struct rate_bucket *set = rl->buckets + rate_limit_set(addr) * RATE_LIMIT_WAYS;
+    struct rate_bucket *b = NULL, *victim = NULL;
+
+    pthread_mutex_lock(&rl->lock);
+
+    if (rl->rate == 0) {        /* 已取消限速 */
+        pthread_mutex_unlock(&rl->lock);
+        return 1;
+    }
+
+    for (int i = 0; i < RATE_LIMIT_WAYS; i++) {
+        if (!set[i].in_use) {
+            if (!victim || victim->in_use) victim = &set[i];
+            continue;
+        }
+        if (set[i].addr == addr) {
+            b = &set[i];
+            break;
+        }
+        rate_bucket_refill(rl, &set[i], now);
+        if (!victim || (victim->in_use && set[i].tokens > victim->tokens)) {
+            victim = &set[i];
+        }
+    }
+
+    if (b) {
+        rate_bucket_refill(rl, b, now);
+    } else {
+        /* 新来源（或被淘汰过的来源）从满桶开始 */
+        if (victim->in_use && victim->tokens < rl->burst * RATE_TOKEN_UNIT) {
+            rl->evictions++;
+        }
+        b = victim;
+        b->addr = addr;
+        b->in_use = 1;
+        b->tokens = rl->burst * RATE_TOKEN_UNIT;
+        b->last_ms = now;
+    }
+
+    int ok = b->tokens >= RATE_TOKEN_UNIT;
+    if (ok) {
+        b->tokens -= RATE_TOKEN_UNIT;
+        rl->passed++;
+    } else {
+        rl->throttled++;
+    }
+
+    pthread_mutex_unlock(&rl->lock);
+    return ok;
+}
+
+/**
+ * 释放限速表（socket_destroy调用，此时已没有其他线程使用这个Socket）
+ */
+void socket_rate_limit_destroy(struct rate_limit *rl) {
+    if (!rl) return;
+    pthread_mutex_destroy(&rl->lock);
+    free(rl);
+}
+
+/**
+ * 设置按源地址的限速
+ * @param sockfd 监听（或将要监听）的TCP Socket，或UDP Socket
+ * @param rate 每个源地址每秒允许的SYN/数据报数，0表示取消限速（计数保留）
+ * @param burst 允许的突发数（桶容量），0表示与rate相同
+ * @return 0成功，-1失败
+ */
+int mysocket_rate_limit(int sockfd, unsigned int rate, unsigned int burst) {
+    struct mysocket *sock = socket_find_by_fd(sockfd);
+    if (!sock || sock->host_fd >= 0 || sock->family != AF_INET ||
+        (sock->type != SOCK_STREAM && sock->type != SOCK_DGRAM)) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    if (burst == 0) burst = rate;
+    if (rate > RATE_LIMIT_MAX_BURST || burst > RATE_LIMIT_MAX_BURST) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    struct rate_limit *rl = __atomic_load_n(&sock->rate_limit, __ATOMIC_ACQUIRE);
+    if (!rl) {
+        if (rate == 0) return 0;
+
+        struct rate_limit *fresh = calloc(1, sizeof(struct rate_limit));
+        if (!fresh) {
+            socket_set_error(MYSOCKET_ENOMEM);
+            return -1;
+        }
+        pthread_mutex_init(&fresh->lock, NULL);
+
+        /* 与另一个同时设置的线程竞争：输的一方释放自己的表，改用对方的 */
+        rl = NULL;
+        if (__atomic_compare_exchange_n(&sock->rate_limit, &rl, fresh, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            rl = fresh;
+        } else {
+            socket_rate_limit_destroy(fresh);
+        }
+    }
+
+    pthread_mutex_lock(&rl->lock);
+    if (rate == 0) {
+        /* 取消限速：表保留（收包路径可能正在使用），清空所有桶，重新启用时从满桶开始 */
+        rl->rate = 0;
+        memset(rl->buckets, 0, sizeof(rl->buckets));
+    } else {
+        /* 已有的桶保留，按新的容量截断 */
+        rl->rate = rate;
+        rl->burst = burst;
+        for (int i = 0; i < RATE_LIMIT_SETS * RATE_LIMIT_WAYS; i++) {
+            if (rl->buckets[i].tokens > burst * RATE_TOKEN_UNIT) {
+                rl->buckets[i].tokens = burst * RATE_TOKEN_UNIT;
+            }
+        }
+    }
+    pthread_mutex_unlock(&rl->lock);
+
+    DEBUG_PRINT("源地址限速: fd=%d, rate=%u/s, burst=%u", sockfd, rate, burst);
+    return 0;
+}
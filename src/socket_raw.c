@@ -0,0 +1,225 @@
+/**
+ * @file socket_raw.c
+ * @brief 原始套接字：旁听经packet_send发出的包，注入构造好的IP帧
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * mysocket_socket(AF_INET, SOCK_RAW, protocol)创建，protocol为IP协议号，0表示所有协议。
+ *
+ * 旁听：packet_send先检查g_raw_sock_count，没有原始套接字时只多这一次读；
+ * 有则把包的克隆挂到协议号匹配的每个原始套接字的接收队列。克隆与原包共享缓冲区，
+ * 只增加引用计数，不复制负载，协议栈的数据路径不因旁听变慢。
+ * 接收时才把包序列化为线格式的IP帧（IP头、TCP头、负载）复制给调用者，缓冲区不足时截断；
+ * 同一进程里的工具可以用raw_dequeue直接取走包本身。
+ * 队列按包的truesize（被引用的整个缓冲区）计入rcvbuf，超出时丢弃并计数。
+ *
+ * 注入：send/sendto的数据是完整的IP帧（相当于IP_HDRINCL，sendto的目标地址被忽略），
+ * 经packet_parse检查格式、packet_from_wire转为包后交给packet_send，与协议栈发出的包走同一路径，
+ * 因此也会被原始套接字（包括发送者自己）旁听到。
+ *
+ * 原始套接字链表由raw_lock保护，旁听在持有raw_lock时入队，关闭时摘除后就不会再有包到达。
+ */
+
+#include "socket_internal.h"
+
+#define RAW_RCVBUF_SIZE     (256 * 1024)    /* 接收队列上限（按truesize计） */
+
+int g_raw_sock_count = 0;
+
+static struct raw_sock *raw_list = NULL;
+static pthread_mutex_t raw_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * 分配原始套接字的私有数据并加入旁听链表（socket_create调用）
+ * @return 0成功，-1失败
+ */
+int raw_sock_init(struct mysocket *sock) {
+    struct raw_sock *rsk = calloc(1, sizeof(struct raw_sock));
+    if (!rsk) return -1;
+
+    rsk->sock = sock;
+    rsk->protocol = sock->protocol;
+    rsk->rcvbuf = RAW_RCVBUF_SIZE;
+    pthread_mutex_init(&rsk->lock, NULL);
+    sock->raw_sk = rsk;
+
+    pthread_mutex_lock(&raw_lock);
+    rsk->next = raw_list;
+    raw_list = rsk;
+    __atomic_add_fetch(&g_raw_sock_count, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&raw_lock);
+    return 0;
+}
+
+/**
+ * 释放私有数据（socket_destroy调用）：退出旁听链表，释放队列中的包
+ */
+void raw_sock_release(struct mysocket *sock) {
+    struct raw_sock *rsk = sock->raw_sk;
+    if (!rsk) return;
+
+    pthread_mutex_lock(&raw_lock);
+    struct raw_sock **link = &raw_list;
+    while (*link && *link != rsk) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = rsk->next;
+        __atomic_sub_fetch(&g_raw_sock_count, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&raw_lock);
+
+    while (rsk->queue) {
+        struct packet *pkt = rsk->queue;
+        rsk->queue = pkt->next;
+        packet_destroy(pkt);
+    }
+
+    pthread_mutex_destroy(&rsk->lock);
+    free(rsk);
+    sock->raw_sk = NULL;
+}
+
+/**
+ * 旁听一个发出的包：协议号匹配的原始套接字各得到一个克隆（packet_send调用）
+ * @param pkt 数据包（不转移所有权）
+ */
+void raw_tap(const struct packet *pkt) {
+    pthread_mutex_lock(&raw_lock);
+
+    for (struct raw_sock *rsk = raw_list; rsk; rsk = rsk->next) {
+        if (rsk->protocol != 0 && rsk->protocol != pkt->ip_hdr.protocol) {
+            continue;
+        }
+
+        pthread_mutex_lock(&rsk->lock);
+        if (rsk->queued + packet_truesize(pkt) > rsk->rcvbuf) {
+            rsk->drops++;
+            pthread_mutex_unlock(&rsk->lock);
+            continue;
+        }
+
+        struct packet *clone = packet_clone(pkt);
+        if (!clone) {
+            rsk->drops++;
+            pthread_mutex_unlock(&rsk->lock);
+            continue;
+        }
+
+        if (rsk->queue_tail) {
+            rsk->queue_tail->next = clone;
+        } else {
+            rsk->queue = clone;
+        }
+        rsk->queue_tail = clone;
+        rsk->queued += packet_truesize(clone);
+        rsk->packets++;
+        pthread_mutex_unlock(&rsk->lock);
+    }
+
+    pthread_mutex_unlock(&raw_lock);
+}
+
+/**
+ * 从接收队列取出一个包（与发出的包共享缓冲区，只读）
+ * @param sock 原始套接字
+ * @return 数据包（调用者用packet_destroy释放），队列为空返回NULL
+ */
+struct packet* raw_dequeue(struct mysocket *sock) {
+    struct raw_sock *rsk = sock->raw_sk;
+
+    pthread_mutex_lock(&rsk->lock);
+    struct packet *pkt = rsk->queue;
+    if (pkt) {
+        rsk->queue = pkt->next;
+        if (!rsk->queue) rsk->queue_tail = NULL;
+        rsk->queued -= packet_truesize(pkt);
+        pkt->next = NULL;
+    }
+    pthread_mutex_unlock(&rsk->lock);
+
+    return pkt;
+}
+
+/**
+ * 注入一个IP帧
+ * @param sock 原始套接字
+ * @param buf 完整的IP帧
+ * @param len 帧长度
+ * @return 帧长度，失败返回-1
+ */
+ssize_t raw_send(struct mysocket *sock, const void *buf, size_t len) {
+    struct packet_wire_info info;
+
+    if (!buf || len == 0 || packet_parse(buf, len, &info) < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+    if (sock->raw_sk->protocol != 0 && info.protocol != sock->raw_sk->protocol) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    struct packet *pkt = packet_from_wire(&info);
+    if (!pkt) {
+        return -1;
+    }
+
+    DEBUG_PRINT("原始套接字注入: fd=%d, protocol=%d, len=%zu", sock->fd, info.protocol, info.ip_len);
+
+    if (packet_send(pkt) < 0) {
+        socket_set_error(MYSOCKET_ERROR);
+        return -1;
+    }
+    return (ssize_t)len;
+}
+
+/**
+ * 接收一个包：序列化为线格式的IP帧，buf放不下时截断（多余部分丢弃）
+ * @param src_addr 返回源地址（端口为0），可为NULL
+ * @return 复制的字节数，失败返回-1
+ */
+ssize_t raw_recvfrom(struct mysocket *sock, void *buf, size_t len,
+                     struct mysocket_addr *src_addr, socklen_t *addrlen) {
+    if (!buf || len == 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    struct packet *pkt = raw_dequeue(sock);
+    if (!pkt) {
+        socket_set_error(MYSOCKET_EAGAIN);
+        return -1;
+    }
+
+    size_t wire_len = packet_wire_len(pkt);
+    ssize_t copied;
+    if (wire_len <= len) {
+        copied = packet_serialize(pkt, buf, len);
+    } else {
+        char *frame = malloc(wire_len);
+        if (!frame) {
+            packet_destroy(pkt);
+            socket_set_error(MYSOCKET_ENOMEM);
+            return -1;
+        }
+        copied = packet_serialize(pkt, frame, wire_len);
+        if (copied > 0) {
+            memcpy(buf, frame, len);
+            copied = (ssize_t)len;
+        }
+        free(frame);
+    }
+
+    if (copied > 0 && src_addr && addrlen && *addrlen >= sizeof(struct mysocket_addr_in)) {
+        struct mysocket_addr_in from;
+        memset(&from, 0, sizeof(from));
+        from.sin_family = AF_INET;
+        from.sin_addr = pkt->ip_hdr.src_addr;
+        memcpy(src_addr, &from, sizeof(from));
+        *addrlen = sizeof(from);
+    }
+
+    packet_destroy(pkt);
+    return copied;
+}
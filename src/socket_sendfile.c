@@ -0,0 +1,354 @@
+/**
+ * @file socket_sendfile.c
+ * @brief mysocket_sendfile：把文件内容直接发到Socket，不经过用户缓冲区
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 常规做法是read到用户内存、mysocket_send复制进发送缓冲区、tcp_send_data再复制进包，
+ * 每个字节复制三次。这里映射文件，每个报文段的负载直接引用映射的页（packet_alloc_ext），
+ * 只计算校验和不复制；映射按引用计数在最后一个引用它的段（包括重传队列中的段）释放后解除。
+ * 每次调用受发送窗口限制往往只发几KB，因此一次映射SENDFILE_MAP_SIZE并预先建立页表，
+ * 每线程缓存最近的映射供后续调用复用，发送到映射末尾（或文件末尾）时放弃缓存。
+ * 文件不能映射时（如g_sendfile_mmap为0）回退为preadv直接读入各段的包缓冲区，仍然只复制一次。
+ *
+ * 映射的页在段被确认前一直被引用，期间修改文件会使重传的内容随之改变（与Linux的sendfile一样），
+ * 截短文件则会使重传时访问映射产生SIGBUS，调用者应保证发送期间文件不被截短。
+ *
+ * Unix域Socket从映射直接写入对端的接收缓冲区；内核直通Socket直接调用内核的sendfile。
+ */
+
+#define _GNU_SOURCE
+
+#include "socket_internal.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define SENDFILE_MAP_SIZE       (1024 * 1024)   /* 每次映射的大小，也是每次调用最多发送的字节数 */
+#define SENDFILE_IOV_BATCH      64              /* pread回退时每次preadv读入的段数 */
+#define SENDFILE_BOUNCE_SIZE    (64 * 1024)     /* Unix域回退路径的中转缓冲区 */
+
+/* sendfile映射文件页并按引用挂到报文段上，0时总是pread（对照和测试用） */
+int g_sendfile_mmap = 1;
+
+/* 文件映射，作为报文段的外部缓冲区 */
+struct sendfile_map {
+    struct packet_extbuf ext;   /* 必须是第一个成员 */
+    void *base;
+    size_t length;
+    int fd;                     /* 映射的文件（fd可能被关闭后复用，同时比较dev/ino） */
+    dev_t dev;
+    ino_t ino;
+    off_t start;                /* base对应的文件偏移（页对齐） */
+};
+
+/* 每线程最近使用的映射（持有一个引用） */
+static __thread struct sendfile_map *sendfile_cache;
+
+static void sendfile_map_release(struct packet_extbuf *ext) {
+    struct sendfile_map *map = (struct sendfile_map *)ext;
+    munmap(map->base, map->length);
+    free(map);
+}
+
+static void sendfile_cache_drop(void) {
+    if (sendfile_cache) {
+        packet_extbuf_put(&sendfile_cache->ext);
+        sendfile_cache = NULL;
+    }
+}
+
+/**
+ * 取得覆盖文件[offset, offset + len)的映射：命中缓存时复用，否则从offset所在的页起
+ * 映射SENDFILE_MAP_SIZE（不超过文件末尾）并放入缓存
+ * @param st in_fd的文件状态（调用者已按文件大小限制len）
+ * @param data 返回offset处的地址
+ * @return 映射（调用者持有一个引用），不能映射时返回NULL
+ */
+static struct sendfile_map* sendfile_map_get(int fd, const struct stat *st, off_t offset, size_t len,
+                                             const char **data) {
+    struct sendfile_map *map = sendfile_cache;
+
+    if (!map || map->fd != fd || map->dev != st->st_dev || map->ino != st->st_ino ||
+        offset < map->start || offset + (off_t)len > map->start + (off_t)map->length) {
+        sendfile_cache_drop();
+
+        off_t page = (off_t)sysconf(_SC_PAGESIZE);
+        off_t start = offset - offset % page;
+        size_t length = (size_t)(offset - start) + SENDFILE_MAP_SIZE;
+        if (start + (off_t)length > st->st_size) {
+            length = (size_t)(st->st_size - start);
+        }
+
+        /* 预先建立页表，避免发送时逐页缺页 */
+        void *base = mmap(NULL, length, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, start);
+        if (base == MAP_FAILED) {
+            DEBUG_PRINT("文件映射失败，回退为pread: fd=%d, errno=%d", fd, errno);
+            return NULL;
+        }
+
+        map = malloc(sizeof(struct sendfile_map));
+        if (!map) {
+            munmap(base, length);
+            return NULL;
+        }
+
+        map->ext.refcnt = 1;
+        map->ext.release = sendfile_map_release;
+        map->base = base;
+        map->length = length;
+        map->fd = fd;
+        map->dev = st->st_dev;
+        map->ino = st->st_ino;
+        map->start = start;
+        sendfile_cache = map;
+    }
+
+    packet_extbuf_get(&map->ext);
+    *data = (const char *)map->base + (offset - map->start);
+    return map;
+}
+
+/**
+ * 释放调用者的引用；已发送到映射末尾时同时放弃缓存，让映射随最后一个段的确认而解除
+ */
+static void sendfile_map_done(struct sendfile_map *map, off_t end) {
+    if (map == sendfile_cache && end >= map->start + (off_t)map->length) {
+        sendfile_cache_drop();
+    }
+    packet_extbuf_put(&map->ext);
+}
+
+/**
+ * pread回退：分配一批段，一次preadv读入各段的包缓冲区
+ * @param pkts 返回读入数据的段（短读时末尾的段已截短或释放）
+ * @return 读入数据的段数，失败返回-1
+ */
+static int sendfile_read_segments(int fd, off_t offset, size_t len, size_t mss,
+                                  struct packet **pkts) {
+    struct iovec iov[SENDFILE_IOV_BATCH];
+    int count = 0;
+
+    while (len > 0 && count < SENDFILE_IOV_BATCH) {
+        size_t seg_len = (len > mss) ? mss : len;
+        struct packet *pkt = packet_alloc(seg_len);
+        if (!pkt) break;
+        iov[count].iov_base = packet_put(pkt, seg_len);
+        iov[count].iov_len = seg_len;
+        pkts[count++] = pkt;
+        len -= seg_len;
+    }
+
+    ssize_t n = count > 0 ? preadv(fd, iov, count, offset) : -1;
+
+    int used = 0;
+    for (int i = 0; i < count; i++) {
+        if (n > 0) {
+            size_t seg_len = ((size_t)n < iov[i].iov_len) ? (size_t)n : iov[i].iov_len;
+            packet_trim(pkts[i], seg_len);
+            n -= (ssize_t)seg_len;
+            used++;
+        } else {
+            packet_destroy(pkts[i]);
+        }
+    }
+
+    return (count > 0 && used == 0 && n < 0) ? -1 : used;
+}
+
+/**
+ * 发往本项目的TCP：按窗口生成报文段，负载引用映射的页或由preadv读入
+ * @return 发送的字节数，失败返回-1
+ */
+static ssize_t tcp_sendfile(struct mysocket *sock, int in_fd, const struct stat *st,
+                            off_t offset, size_t count) {
+    struct connection_cb *cb = sock->conn;
+
+    socket_rx_process(sock);
+    tcp_retransmit_timer(sock);
+
+    /* 发送缓冲区中已有的数据必须先发出 */
+    socket_flush_send_buffer(sock);
+    if (sock->send_buf_used > 0 || cb->in_output ||
+        socket_mem_state(SOCKET_MEM_TCP) == SOCKET_MEM_HIGH) {
+        socket_set_error(MYSOCKET_EAGAIN);
+        return -1;
+    }
+
+    size_t len = tcp_send_window_avail(sock);
+    size_t space = tcp_send_buffer_space(sock);
+    if (len > space) {
+        /* 受发送缓冲区而非对端窗口限制，让发送缓冲区随ACK自动增长 */
+        if (count > space) cb->snd_buf_limited = 1;
+        len = space;
+    }
+    if (len > count) len = count;
+    if (len == 0) {
+        socket_set_error(MYSOCKET_EAGAIN);
+        return -1;
+    }
+
+    const char *data = NULL;
+    struct sendfile_map *map = NULL;
+    if (g_sendfile_mmap && S_ISREG(st->st_mode)) {
+        map = sendfile_map_get(in_fd, st, offset, len, &data);
+    }
+
+    size_t mss = tcp_current_mss(sock);
+    size_t sent = 0;
+    int error = MYSOCKET_OK;
+
+    cb->in_output = 1;
+    packet_tx_begin();
+
+    while (sent < len && error == MYSOCKET_OK) {
+        struct packet *pkts[SENDFILE_IOV_BATCH];
+        int count_segs;
+
+        if (map) {
+            count_segs = 0;
+            for (size_t pos = sent; pos < len && count_segs < SENDFILE_IOV_BATCH; ) {
+                size_t seg_len = (len - pos > mss) ? mss : len - pos;
+                pkts[count_segs] = packet_alloc_ext(&map->ext, data + pos, seg_len);
+                if (!pkts[count_segs]) break;
+                count_segs++;
+                pos += seg_len;
+            }
+        } else {
+            count_segs = sendfile_read_segments(in_fd, offset + (off_t)sent, len - sent, mss, pkts);
+            if (count_segs < 0) {
+                error = MYSOCKET_EINVAL;
+                break;
+            }
+        }
+        if (count_segs == 0) {
+            error = map ? MYSOCKET_ENOMEM : MYSOCKET_EAGAIN;
+            break;
+        }
+
+        for (int i = 0; i < count_segs; i++) {
+            size_t seg_len = pkts[i]->data_len;
+            if (error != MYSOCKET_OK) {
+                packet_destroy(pkts[i]);
+            } else if (tcp_send_segment(sock, pkts[i]) < 0) {
+                error = MYSOCKET_ERROR;
+            } else {
+                sent += seg_len;
+            }
+        }
+    }
+
+    /* 已生成的段都在重传队列中，刷新失败由重传恢复 */
+    packet_tx_end();
+    cb->in_output = 0;
+
+    if (map) {
+        sendfile_map_done(map, offset + (off_t)sent);
+    }
+
+    if (sent == 0) {
+        socket_set_error(error != MYSOCKET_OK ? error : MYSOCKET_EAGAIN);
+        return -1;
+    }
+    return (ssize_t)sent;
+}
+
+/**
+ * 发往Unix域流式Socket：从映射直接写入对端的接收缓冲区，不能映射时经中转缓冲区
+ * @return 发送的字节数，失败返回-1
+ */
+static ssize_t unix_sendfile(struct mysocket *sock, int in_fd, const struct stat *st,
+                             off_t offset, size_t count) {
+    const char *data = NULL;
+    struct sendfile_map *map = NULL;
+    if (g_sendfile_mmap && S_ISREG(st->st_mode)) {
+        map = sendfile_map_get(in_fd, st, offset, count, &data);
+    }
+
+    if (map) {
+        ssize_t n = unix_send(sock, data, count);
+        sendfile_map_done(map, offset + (n > 0 ? n : 0));
+        return n;
+    }
+
+    char bounce[SENDFILE_BOUNCE_SIZE];
+    ssize_t n = pread(in_fd, bounce, count < sizeof(bounce) ? count : sizeof(bounce), offset);
+    if (n < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    return unix_send(sock, bounce, (size_t)n);
+}
+
+/**
+ * 把文件内容发到流式Socket
+ * @param out_fd 已连接的流式Socket
+ * @param in_fd 文件描述符（普通文件可以映射，其他可pread的文件回退为pread）
+ * @param offset 起始偏移，返回时前移已发送的字节数；为NULL时使用并前移in_fd的文件位置
+ * @param count 最多发送的字节数
+ * @return 发送的字节数（受窗口和缓冲区限制可能少于count），文件已到末尾返回0；
+ *         暂时不能发送返回-1（MYSOCKET_EAGAIN）
+ */
+ssize_t mysocket_sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    DEBUG_PRINT("发送文件: out_fd=%d, in_fd=%d, count=%zu", out_fd, in_fd, count);
+
+    struct mysocket *sock = socket_find_by_fd(out_fd);
+    if (!sock || in_fd < 0 || sock->type != SOCK_STREAM || sock->state != SS_CONNECTED) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    off_t pos = offset ? *offset : lseek(in_fd, 0, SEEK_CUR);
+    if (pos < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    /* 不映射文件末尾之后的页（访问会产生SIGBUS） */
+    struct stat st;
+    if (fstat(in_fd, &st) < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+    if (S_ISREG(st.st_mode)) {
+        if (pos >= st.st_size) {
+            return 0;
+        }
+        if (count > (size_t)(st.st_size - pos)) {
+            count = (size_t)(st.st_size - pos);
+        }
+    }
+    if (count > SENDFILE_MAP_SIZE) {
+        count = SENDFILE_MAP_SIZE;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    ssize_t n;
+    if (sock->host_fd >= 0) {
+        off_t kernel_pos = pos;
+        n = socket_kernel_sendfile(sock, in_fd, &kernel_pos, count);
+    } else if (sock->unix_sk) {
+        n = unix_sendfile(sock, in_fd, &st, pos, count);
+    } else if (sock->conn) {
+        n = tcp_sendfile(sock, in_fd, &st, pos, count);
+    } else {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    if (n > 0) {
+        if (offset) {
+            *offset = pos + n;
+        } else {
+            lseek(in_fd, pos + n, SEEK_SET);
+        }
+    }
+
+    DEBUG_PRINT("文件发送: out_fd=%d, sent=%zd", out_fd, n);
+    return n;
+}
@@ -9,6 +9,18 @@
 
 #include "socket_internal.h"
 
+static int tcp_flush_send_buffer(struct mysocket *sock);
+
+/**
+ * 应用层写不进更多数据时，记录发送是否受发送缓冲区（而非对端窗口）限制
+ * @param sock Socket指针
+ */
+static void tcp_check_sndbuf_limited(struct mysocket *sock) {
+    if (sock->conn && tcp_send_window_avail(sock) > sock->send_buf_used) {
+        sock->conn->snd_buf_limited = 1;
+    }
+}
+
 /**
  * 发送数据
  * @param sockfd Socket文件描述符
@@ -27,6 +39,16 @@ ssize_t mysocket_send(int sockfd, const void *buf, size_t len, int flags) {
         return -1;
     }
     
+    if (sock->host_fd >= 0) {
+        return socket_kernel_send(sock, buf, len);
+    }
+    if (sock->unix_sk) {
+        return unix_send(sock, buf, len);
+    }
+    if (sock->raw_sk) {
+        return raw_send(sock, buf, len);
+    }
+    
     /* 参数验证 */
     if (!buf || len == 0) {
         socket_set_error(MYSOCKET_EINVAL);
@@ -39,9 +61,15 @@ ssize_t mysocket_send(int sockfd, const void *buf, size_t len, int flags) {
         return -1;
     }
     
-    /* 检查发送缓冲区空间 */
-    size_t available = sock->send_buf_size - sock->send_buf_used;
+    /* 处理接收环中的ACK，再检查重传定时器 */
+    socket_rx_process(sock);
+    tcp_retransmit_timer(sock);
+    
+    /* 检查发送缓冲区空间（TCP已发送未确认的数据也占用发送缓冲区） */
+    size_t available = sock->conn ? tcp_send_buffer_space(sock)
+                                   : sock->send_buf_size - sock->send_buf_used;
     if (available == 0) {
+        tcp_check_sndbuf_limited(sock);
         socket_set_error(MYSOCKET_EAGAIN);
         return -1;
     }
@@ -63,6 +91,10 @@ ssize_t mysocket_send(int sockfd, const void *buf, size_t len, int flags) {
         return -1;
     }
     
+    if (send_len < len) {
+        tcp_check_sndbuf_limited(sock);
+    }
+    
     DEBUG_PRINT("数据发送成功: fd=%d, sent=%d", sockfd, written);
     
     return written;
@@ -86,6 +118,16 @@ ssize_t mysocket_recv(int sockfd, void *buf, size_t len, int flags) {
         return -1;
     }
     
+    if (sock->host_fd >= 0) {
+        return socket_kernel_recv(sock, buf, len);
+    }
+    if (sock->unix_sk) {
+        return unix_recv(sock, buf, len);
+    }
+    if (sock->raw_sk) {
+        return raw_recvfrom(sock, buf, len, NULL, NULL);
+    }
+    
     /* 参数验证 */
     if (!buf || len == 0) {
         socket_set_error(MYSOCKET_EINVAL);
@@ -98,6 +140,10 @@ ssize_t mysocket_recv(int sockfd, void *buf, size_t len, int flags) {
         return -1;
     }
     
+    /* 处理接收环中的包，再检查重传定时器 */
+    socket_rx_process(sock);
+    tcp_retransmit_timer(sock);
+    
     /* 尝试从网络接收数据到缓冲区 */
     socket_fill_recv_buffer(sock);
     
@@ -114,6 +160,11 @@ ssize_t mysocket_recv(int sockfd, void *buf, size_t len, int flags) {
         return -1;
     }
     
+    /* 接收缓冲区自动调整和窗口更新 */
+    if (sock->protocol == IPPROTO_TCP) {
+        tcp_cleanup_rbuf(sock, (size_t)read_len);
+    }
+    
     DEBUG_PRINT("数据接收成功: fd=%d, recv=%d", sockfd, read_len);
     
     return read_len;
@@ -140,6 +191,16 @@ ssize_t mysocket_sendto(int sockfd, const void *buf, size_t len, int flags,
         return -1;
     }
     
+    if (sock->host_fd >= 0) {
+        return socket_kernel_sendto(sock, buf, len, dest_addr, addrlen);
+    }
+    if (sock->unix_sk) {
+        return unix_sendto(sock, buf, len, dest_addr, addrlen);
+    }
+    if (sock->raw_sk) {
+        return raw_send(sock, buf, len);    /* 帧自带IP头，忽略目标地址 */
+    }
+    
     /* 参数验证 */
     if (!buf || len == 0 || !dest_addr || addrlen < sizeof(struct mysocket_addr_in)) {
         socket_set_error(MYSOCKET_EINVAL);
@@ -198,6 +259,16 @@ ssize_t mysocket_recvfrom(int sockfd, void *buf, size_t len, int flags,
         return -1;
     }
     
+    if (sock->host_fd >= 0) {
+        return socket_kernel_recvfrom(sock, buf, len, src_addr, addrlen);
+    }
+    if (sock->unix_sk) {
+        return unix_recvfrom(sock, buf, len, src_addr, addrlen);
+    }
+    if (sock->raw_sk) {
+        return raw_recvfrom(sock, buf, len, src_addr, addrlen);
+    }
+    
     /* 参数验证 */
     if (!buf || len == 0) {
         socket_set_error(MYSOCKET_EINVAL);
@@ -230,6 +301,152 @@ ssize_t mysocket_recvfrom(int sockfd, void *buf, size_t len, int flags,
     return result;
 }
 
+/**
+ * 把源Socket接收缓冲区中的数据交给TCP Socket发送：发送缓冲区为空时按窗口直接从源数据构造包
+ * （复制进包的同时计算校验和），窗口之外的部分才写入发送缓冲区
+ * 已生成的段（投递失败的留在重传队列）和已写入发送缓冲区的数据都算作已接收，
+ * 调用者必须从源数据中移除恰好这么多
+ * @return 接收的字节数，一个字节都没有接收时返回-1
+ */
+static ssize_t tcp_splice_write(struct mysocket *sock, const char *data, size_t len) {
+    struct connection_cb *cb = sock->conn;
+    size_t available = tcp_send_buffer_space(sock);
+    if (available == 0) {
+        tcp_check_sndbuf_limited(sock);
+        socket_set_error(MYSOCKET_EAGAIN);
+        return -1;
+    }
+    if (len > available) {
+        len = available;
+    }
+    
+    /* 发送缓冲区中还有数据时必须排在它们后面 */
+    size_t direct = 0;
+    if (sock->send_buf_used == 0 && !cb->in_output &&
+        socket_mem_state(SOCKET_MEM_TCP) != SOCKET_MEM_HIGH) {
+        direct = tcp_send_window_avail(sock);
+        if (direct > len) {
+            direct = len;
+        }
+        if (direct > 0) {
+            uint32_t start = cb->snd_nxt;
+            cb->in_output = 1;
+            int ret = tcp_send_data(sock, data, direct);
+            cb->in_output = 0;
+            if (ret < 0) {
+                /* 中途失败时只有已生成的段占用了序列号 */
+                size_t sent = cb->snd_nxt - start;
+                if (sent == 0) {
+                    socket_set_error(MYSOCKET_ERROR);
+                    return -1;
+                }
+                return (ssize_t)sent;
+            }
+        }
+    }
+    
+    if (direct < len) {
+        socket_buffer_write(sock->send_buffer, &sock->send_buf_used, sock->send_buf_size,
+                            data + direct, len - direct);
+        /* 数据已在发送缓冲区中，刷新失败时留待下次发送 */
+        if (socket_flush_send_buffer(sock) < 0) {
+            DEBUG_PRINT("刷新发送缓冲区失败: fd=%d, pending=%zu", sock->fd, sock->send_buf_used);
+        }
+        tcp_check_sndbuf_limited(sock);
+    }
+    
+    return (ssize_t)len;
+}
+
+/**
+ * 在两个流式Socket之间直接搬运数据（代理用）：数据从fd_in的接收缓冲区直接交给fd_out，
+ * 不经过用户缓冲区。发往TCP时窗口内的数据直接复制进包，发往Unix域时直接写入对端的接收缓冲区，
+ * 发往内核直通Socket时直接从接收缓冲区调用send
+ * @param fd_in 源Socket（本项目协议栈的TCP或Unix域流式Socket）
+ * @param fd_out 目标Socket（任意已连接的流式Socket）
+ * @param len 最多搬运的字节数
+ * @param flags 保留，必须为0
+ * @return 搬运的字节数；源Socket没有数据返回-1（MYSOCKET_EAGAIN），源Socket的对端已关闭返回0；
+ *         目标Socket放不下时返回-1（MYSOCKET_EAGAIN），数据留在源Socket中
+ */
+ssize_t mysocket_splice(int fd_in, int fd_out, size_t len, int flags) {
+    DEBUG_PRINT("搬运数据: fd_in=%d, fd_out=%d, len=%zu", fd_in, fd_out, len);
+    
+    struct mysocket *in = socket_find_by_fd(fd_in);
+    struct mysocket *out = socket_find_by_fd(fd_out);
+    if (!in || !out || in == out || len == 0 || flags != 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+    
+    /* 内核直通Socket的数据在内核中，无法按引用取出 */
+    if (in->host_fd >= 0 || in->type != SOCK_STREAM || out->type != SOCK_STREAM ||
+        in->state != SS_CONNECTED || out->state != SS_CONNECTED) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+    
+    /* 先处理两端的接收环：收包可能调整接收缓冲区，之后才能引用源数据 */
+    if (in->conn) {
+        socket_rx_process(in);
+        tcp_retransmit_timer(in);
+    }
+    if (out->conn && out->host_fd < 0) {
+        socket_rx_process(out);
+        tcp_retransmit_timer(out);
+    }
+    
+    /* Unix域的接收缓冲区只有本线程读取，对端只在末尾追加，锁内取得长度后即可在锁外引用 */
+    size_t available;
+    if (in->unix_sk) {
+        pthread_mutex_lock(&in->unix_sk->lock);
+        available = in->recv_buf_used;
+        pthread_mutex_unlock(&in->unix_sk->lock);
+    } else {
+        available = in->recv_buf_used;
+    }
+    
+    if (available == 0) {
+        if (in->unix_sk && in->unix_sk->peer_closed) {
+            return 0;
+        }
+        socket_set_error(MYSOCKET_EAGAIN);
+        return -1;
+    }
+    if (len > available) {
+        len = available;
+    }
+    
+    ssize_t moved;
+    if (out->host_fd >= 0) {
+        moved = socket_kernel_send(out, in->recv_buffer, len);
+    } else if (out->unix_sk) {
+        moved = unix_send(out, in->recv_buffer, len);
+    } else if (out->conn) {
+        moved = tcp_splice_write(out, in->recv_buffer, len);
+    } else {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+    if (moved <= 0) {
+        return -1;
+    }
+    
+    /* 从源Socket移除恰好已被目标接收的数据 */
+    if (in->unix_sk) {
+        pthread_mutex_lock(&in->unix_sk->lock);
+        socket_buffer_consume(in->recv_buffer, &in->recv_buf_used, (size_t)moved);
+        pthread_mutex_unlock(&in->unix_sk->lock);
+    } else {
+        socket_buffer_consume(in->recv_buffer, &in->recv_buf_used, (size_t)moved);
+        tcp_cleanup_rbuf(in, (size_t)moved);
+    }
+    
+    DEBUG_PRINT("数据搬运成功: fd_in=%d, fd_out=%d, moved=%zd", fd_in, fd_out, moved);
+    
+    return moved;
+}
+
 /**
  * 刷新发送缓冲区（实际发送数据）
  * @param sock Socket指针
@@ -243,11 +460,8 @@ int socket_flush_send_buffer(struct mysocket *sock) {
     DEBUG_PRINT("刷新发送缓冲区: fd=%d, data=%zu", sock->fd, sock->send_buf_used);
     
     /* 根据协议类型处理 */
-    if (sock->protocol == IPPROTO_TCP) {
-        /* TCP数据发送 */
-        if (tcp_send_data(sock, sock->send_buffer, sock->send_buf_used) < 0) {
-            return -1;
-        }
+    if (sock->protocol == IPPROTO_TCP && sock->conn) {
+        return tcp_flush_send_buffer(sock);
     } else if (sock->protocol == IPPROTO_UDP) {
         /* UDP数据发送 */
         if (socket_send_udp_packet(sock, sock->send_buffer, sock->send_buf_used) < 0) {
@@ -261,6 +475,56 @@ int socket_flush_send_buffer(struct mysocket *sock) {
     return 0;
 }
 
+/**
+ * 按对端接收窗口发送TCP发送缓冲区中的数据，剩余部分留待窗口打开
+ * @param sock Socket指针
+ * @return 0成功，-1失败
+ */
+static int tcp_flush_send_buffer(struct mysocket *sock) {
+    struct connection_cb *cb = sock->conn;
+    int result = 0;
+    
+    /* 本地投递时ACK会同步到达并再次触发刷新，由外层循环继续发送 */
+    if (cb->in_output) {
+        return 0;
+    }
+    cb->in_output = 1;
+    
+    while (sock->send_buf_used > 0) {
+        /* 内存达到上限时不再产生新的待确认段，等ACK释放重传队列 */
+        if (socket_mem_state(SOCKET_MEM_TCP) == SOCKET_MEM_HIGH) {
+            break;
+        }
+        
+        size_t len = tcp_send_window_avail(sock);
+        if (len == 0) {
+            break;
+        }
+        if (len > sock->send_buf_used) {
+            len = sock->send_buf_used;
+        }
+        
+        uint32_t start = cb->snd_nxt;
+        if (tcp_send_data(sock, sock->send_buffer, len) < 0) {
+            /* 已生成的段（含投递失败而留在重传队列中的）不能再从缓冲区发一次 */
+            len = cb->snd_nxt - start;
+            result = -1;
+        }
+        
+        /* 移除已发送的数据 */
+        sock->send_buf_used -= len;
+        if (sock->send_buf_used > 0) {
+            memmove(sock->send_buffer, sock->send_buffer + len, sock->send_buf_used);
+        }
+        if (result < 0) {
+            break;
+        }
+    }
+    
+    cb->in_output = 0;
+    return result;
+}
+
 /**
  * 填充接收缓冲区（从网络接收数据）
  * @param sock Socket指针
@@ -281,11 +545,8 @@ int socket_fill_recv_buffer(struct mysocket *sock) {
     char temp_data[1024];
     size_t recv_len = 0;
     
-    /* 根据协议类型接收数据 */
-    if (sock->protocol == IPPROTO_TCP) {
-        /* 模拟TCP数据接收 */
-        recv_len = socket_simulate_tcp_receive(sock, temp_data, sizeof(temp_data));
-    } else if (sock->protocol == IPPROTO_UDP) {
+    /* TCP数据由协议栈直接写入接收缓冲区，这里只处理UDP */
+    if (sock->protocol == IPPROTO_UDP) {
         /* 模拟UDP数据接收 */
         struct mysocket_addr_in peer_addr;
         recv_len = socket_recv_udp_packet(sock, temp_data, sizeof(temp_data), &peer_addr);
@@ -321,12 +582,46 @@ ssize_t socket_send_udp_packet(struct mysocket *sock, const void *data, size_t l
     /* 模拟UDP数据发送 */
     /* 在实际实现中，这里会构造UDP包并通过网络发送 */
     
+    /* 未绑定的Socket第一次发送时自动分配端口（与内核相同），接收方据此区分来源 */
+    if (sock->local_addr.sin_port == 0 && socket_auto_bind(sock) < 0) {
+        return -1;
+    }
+    
+    /* 实际的源地址：绑定在通配地址上时，回环发出的包源地址是127.0.0.1 */
+    struct mysocket_addr_in src = sock->local_addr;
+    if (src.sin_addr == 0) {
+        src.sin_addr = mysocket_htonl(0x7F000001);
+    }
+    
     /* 简单模拟：如果目标地址有对应的接收Socket，将数据放入其接收缓冲区 */
+    /* 内存达到上限时丢弃新的数据报 */
+    if (socket_mem_state(SOCKET_MEM_UDP) == SOCKET_MEM_HIGH) {
+        socket_mem_count_drop(SOCKET_MEM_UDP);
+        return len;
+    }
+    
     struct mysocket *target = socket_find_udp_receiver(&sock->peer_addr);
     if (target && target != sock) {
+        /* 按实际的源地址限速 */
+        struct rate_limit *rl = __atomic_load_n(&target->rate_limit, __ATOMIC_ACQUIRE);
+        if (rl && !socket_rate_limit_allow(rl, src.sin_addr)) {
+            DEBUG_PRINT("UDP数据报被限速: target_fd=%d, len=%zu", target->fd, len);
+            return len;
+        }
+        
+        /* 过滤器在复制之前运行，被丢弃的数据报不进入接收缓冲区 */
+        size_t keep = len;
+        if (target->filter) {
+            keep = sk_filter_udp(target, &src, &sock->peer_addr, data, len);
+            if (keep == 0) {
+                DEBUG_PRINT("UDP数据报被过滤器丢弃: target_fd=%d, len=%zu", target->fd, len);
+                return len;
+            }
+        }
+        
         size_t available = target->recv_buf_size - target->recv_buf_used;
         if (available > 0) {
-            size_t copy_len = (len > available) ? available : len;
+            size_t copy_len = (keep > available) ? available : keep;
             memcpy(target->recv_buffer + target->recv_buf_used, data, copy_len);
             target->recv_buf_used += copy_len;
             
@@ -407,29 +702,3 @@ struct mysocket* socket_find_udp_receiver(const struct mysocket_addr_in *addr) {
     
     return NULL;
 }
-
-/**
- * 模拟TCP数据接收
- * @param sock Socket指针
- * @param buf 接收缓冲区
- * @param len 缓冲区大小
- * @return 接收的字节数
- */
-size_t socket_simulate_tcp_receive(struct mysocket *sock, void *buf, size_t len) {
-    if (!sock || !buf) return 0;
-    
-    /* 简单模拟：生成一些测试数据 */
-    static int counter = 0;
-    counter++;
-    
-    if (counter % 10 == 0) {  /* 每10次调用生成一次数据 */
-        char test_data[] = "Hello from TCP simulation!";
-        size_t test_len = strlen(test_data);
-        size_t copy_len = (len > test_len) ? test_len : len;
-        
-        memcpy(buf, test_data, copy_len);
-        return copy_len;
-    }
-    
-    return 0;  /* 没有数据 */
-}
\ No newline at end of file
@@ -0,0 +1,534 @@
+/**
+ * @file socket_unix.c
+ * @brief Unix域Socket：按路径寻址的本机IPC，数据在两个Socket的缓冲区之间直接复制
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 模仿Linux的af_unix.c。地址是struct mysocket_addr_un：sun_path以非0字节开头时是路径名
+ * （只在本进程的路径表中登记，不在文件系统中创建文件），以0字节开头时是抽象命名空间的名字，
+ * 长度由addrlen决定。绑定的Socket登记在按名字散列的路径表中，connect/sendto查表找到对端。
+ *
+ * 数据路径不构造包、不计算校验和：
+ *   流式：connect时创建服务端的子Socket并与客户端互相指向，send直接把数据写入对端的接收缓冲区；
+ *   数据报：sendto把一条记录（记录头、发送方名字、数据）整体写入目标的接收缓冲区，
+ *   recvfrom每次取出一条，保留消息边界，缓冲区放不下整条记录时返回MYSOCKET_EAGAIN。
+ *
+ * 路径表、流式Socket的对端指针和监听队列由unix_lock保护，接收缓冲区由各自的lock保护；
+ * 和TCP一样，关闭Socket时不能有其他线程正在使用它或它的对端。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+#include <stddef.h>
+
+#define UNIX_HASH_SIZE          256         /* 路径表的桶数，必须是2的幂 */
+#define UNIX_RCVBUF_SIZE        (64 * 1024) /* 接收缓冲区（默认的8KB对本机IPC太小） */
+
+/* 数据报在接收缓冲区中的记录头，后跟发送方名字和数据 */
+struct unix_dgram_hdr {
+    uint32_t data_len;
+    uint32_t addr_len;
+};
+
+static struct unix_sock *unix_table[UNIX_HASH_SIZE];
+static pthread_mutex_t unix_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * 名字的散列值（FNV-1a）
+ */
+static uint32_t unix_hash(const char *name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return h & (UNIX_HASH_SIZE - 1);
+}
+
+/**
+ * 在路径表中查找（调用者持有unix_lock）
+ */
+static struct unix_sock* unix_lookup_locked(const char *name, size_t len) {
+    struct unix_sock *usk = unix_table[unix_hash(name, len)];
+    while (usk && (usk->path_len != len || memcmp(usk->path, name, len) != 0)) {
+        usk = usk->hash_next;
+    }
+    return usk;
+}
+
+/**
+ * 解析地址中的名字
+ * @param name 返回名字（路径名不含结尾的0字节，抽象名字含开头的0字节）
+ * @param name_len 返回名字长度
+ * @return 0成功，-1地址无效
+ */
+static int unix_addr_parse(const struct mysocket_addr *addr, socklen_t addrlen,
+                           char *name, size_t *name_len) {
+    size_t offset = offsetof(struct mysocket_addr_un, sun_path);
+    if (!addr || addrlen <= offset || addrlen > sizeof(struct mysocket_addr_un) ||
+        addr->sa_family != AF_UNIX) {
+        return -1;
+    }
+
+    const struct mysocket_addr_un *un = (const struct mysocket_addr_un *)addr;
+    size_t max = addrlen - offset;
+    size_t len = un->sun_path[0] != '\0' ? strnlen(un->sun_path, max) : max;
+
+    memcpy(name, un->sun_path, len);
+    *name_len = len;
+    return 0;
+}
+
+/**
+ * 填写返回给应用的地址：路径名带结尾的0字节，未绑定的Socket只有地址族
+ * @param addr 输出地址，可以为NULL
+ * @param addrlen 输入缓冲区长度，输出地址的实际长度（缓冲区不够时截断）
+ */
+static void unix_addr_fill(struct mysocket_addr *addr, socklen_t *addrlen,
+                           const char *name, size_t name_len) {
+    if (!addr || !addrlen) return;
+
+    struct mysocket_addr_un un;
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    memcpy(un.sun_path, name, name_len);
+
+    size_t len = offsetof(struct mysocket_addr_un, sun_path) + name_len;
+    if (name_len > 0 && name[0] != '\0' && name_len < sizeof(un.sun_path)) {
+        len++;
+    }
+
+    memcpy(addr, &un, *addrlen < len ? *addrlen : len);
+    *addrlen = (socklen_t)len;
+}
+
+/**
+ * 初始化Unix域Socket的私有数据（socket_create调用）
+ * @return 0成功，-1失败
+ */
+int unix_sock_init(struct mysocket *sock) {
+    struct unix_sock *usk = calloc(1, sizeof(struct unix_sock));
+    if (!usk) return -1;
+
+    usk->sock = sock;
+    pthread_mutex_init(&usk->lock, NULL);
+    sock->unix_sk = usk;
+
+    /* 内存紧张时保留默认大小 */
+    socket_buffer_resize(sock, 0, UNIX_RCVBUF_SIZE);
+    return 0;
+}
+
+/**
+ * 释放私有数据（socket_destroy调用）：从路径表摘除，通知流式对端连接已关闭
+ */
+void unix_sock_release(struct mysocket *sock) {
+    struct unix_sock *usk = sock->unix_sk;
+    if (!usk) return;
+
+    pthread_mutex_lock(&unix_lock);
+
+    /* 服务端的子Socket沿用监听Socket的名字但不在表中，按指针摘除 */
+    if (usk->path_len > 0) {
+        struct unix_sock **link = &unix_table[unix_hash(usk->path, usk->path_len)];
+        while (*link && *link != usk) {
+            link = &(*link)->hash_next;
+        }
+        if (*link) {
+            *link = usk->hash_next;
+        }
+    }
+
+    if (usk->peer) {
+        struct unix_sock *peer = usk->peer->unix_sk;
+        peer->peer = NULL;
+        peer->peer_closed = 1;
+    }
+
+    pthread_mutex_unlock(&unix_lock);
+
+    pthread_mutex_destroy(&usk->lock);
+    free(usk);
+    sock->unix_sk = NULL;
+}
+
+/**
+ * 关闭前的处理（mysocket_close调用）：关闭监听队列中还没有被accept的连接，客户端随后读到结束
+ */
+void unix_close(struct mysocket *sock) {
+    if (sock->state != SS_LISTENING) return;
+
+    for (;;) {
+        pthread_mutex_lock(&unix_lock);
+        struct mysocket *child = socket_listen_queue_remove(sock);
+        pthread_mutex_unlock(&unix_lock);
+        if (!child) break;
+
+        socket_remove_from_manager(child);
+        socket_destroy(child);
+    }
+}
+
+/**
+ * 把两个新建的Unix域Socket互连（mysocket_socketpair调用）：与connect建立的连接一样
+ * 直接写对方的接收缓冲区，只是双方都没有名字，也不经过路径表和监听队列
+ * @return 0成功
+ */
+int unix_socketpair(struct mysocket *a, struct mysocket *b) {
+    pthread_mutex_lock(&unix_lock);
+    a->unix_sk->peer = b;
+    b->unix_sk->peer = a;
+    a->state = SS_CONNECTED;
+    b->state = SS_CONNECTED;
+    pthread_mutex_unlock(&unix_lock);
+
+    DEBUG_PRINT("Unix域Socket对创建成功: fd=%d <-> fd=%d", a->fd, b->fd);
+    return MYSOCKET_OK;
+}
+
+int unix_bind(struct mysocket *sock, const struct mysocket_addr *addr, socklen_t addrlen) {
+    struct unix_sock *usk = sock->unix_sk;
+    char name[MYSOCKET_UNIX_PATH_MAX];
+    size_t len;
+
+    if (unix_addr_parse(addr, addrlen, name, &len) < 0 || len == 0 || usk->path_len > 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    pthread_mutex_lock(&unix_lock);
+    if (unix_lookup_locked(name, len)) {
+        pthread_mutex_unlock(&unix_lock);
+        socket_set_error(MYSOCKET_EADDRINUSE);
+        return -1;
+    }
+
+    memcpy(usk->path, name, len);
+    usk->path_len = len;
+    uint32_t bucket = unix_hash(name, len);
+    usk->hash_next = unix_table[bucket];
+    unix_table[bucket] = usk;
+    pthread_mutex_unlock(&unix_lock);
+
+    DEBUG_PRINT("Unix域Socket绑定成功: fd=%d, len=%zu", sock->fd, len);
+    return MYSOCKET_OK;
+}
+
+int unix_listen(struct mysocket *sock, int backlog) {
+    if (sock->type != SOCK_STREAM || sock->unix_sk->path_len == 0 || sock->state != SS_UNCONNECTED) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    if (backlog <= 0 || backlog > DEFAULT_LISTEN_BACKLOG) {
+        backlog = DEFAULT_LISTEN_BACKLOG;
+    }
+
+    sock->listen_queue = calloc(backlog, sizeof(struct mysocket*));
+    if (!sock->listen_queue) {
+        socket_set_error(MYSOCKET_ENOMEM);
+        return -1;
+    }
+
+    sock->listen_backlog = backlog;
+    sock->listen_count = 0;
+    sock->state = SS_LISTENING;
+    return MYSOCKET_OK;
+}
+
+/**
+ * 取出一个已连接的子Socket
+ * @return 文件描述符，队列为空返回-1（MYSOCKET_EAGAIN）
+ */
+int unix_accept(struct mysocket *sock, struct mysocket_addr *addr, socklen_t *addrlen) {
+    if (sock->state != SS_LISTENING) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    pthread_mutex_lock(&unix_lock);
+    struct mysocket *child = socket_listen_queue_remove(sock);
+    if (child) {
+        struct mysocket *peer = child->unix_sk->peer;
+        if (peer) {
+            unix_addr_fill(addr, addrlen, peer->unix_sk->path, peer->unix_sk->path_len);
+        } else {
+            unix_addr_fill(addr, addrlen, "", 0);
+        }
+    }
+    pthread_mutex_unlock(&unix_lock);
+
+    if (!child) {
+        socket_set_error(MYSOCKET_EAGAIN);
+        return -1;
+    }
+
+    DEBUG_PRINT("Unix域连接接受成功: listen_fd=%d, new_fd=%d", sock->fd, child->fd);
+    return child->fd;
+}
+
+/**
+ * 连接：流式Socket立即与服务端新建的子Socket互连，数据报Socket只记录默认目标
+ */
+int unix_connect(struct mysocket *sock, const struct mysocket_addr *addr, socklen_t addrlen) {
+    struct unix_sock *usk = sock->unix_sk;
+    char name[MYSOCKET_UNIX_PATH_MAX];
+    size_t len;
+
+    if (unix_addr_parse(addr, addrlen, name, &len) < 0 || len == 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    if (sock->type == SOCK_DGRAM) {
+        /* socketpair创建的一对不能改连其他目标 */
+        if (usk->peer || usk->peer_closed) {
+            socket_set_error(MYSOCKET_EINVAL);
+            return -1;
+        }
+
+        pthread_mutex_lock(&unix_lock);
+        struct unix_sock *target = unix_lookup_locked(name, len);
+        int ok = target && target->sock->type == SOCK_DGRAM;
+        pthread_mutex_unlock(&unix_lock);
+        if (!ok) {
+            socket_set_error(MYSOCKET_ECONNREFUSED);
+            return -1;
+        }
+
+        memcpy(usk->peer_path, name, len);
+        usk->peer_path_len = len;
+        sock->state = SS_CONNECTED;
+        return MYSOCKET_OK;
+    }
+
+    if (sock->state != SS_UNCONNECTED) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    /* 先在锁外创建子Socket（管理器的锁在unix_lock之外） */
+    struct mysocket *child = socket_create(AF_UNIX, SOCK_STREAM, 0);
+    if (!child) {
+        socket_set_error(MYSOCKET_ENOMEM);
+        return -1;
+    }
+    socket_add_to_manager(child);
+
+    pthread_mutex_lock(&unix_lock);
+    struct unix_sock *listener = unix_lookup_locked(name, len);
+    int error = MYSOCKET_OK;
+    if (!listener || listener->sock->type != SOCK_STREAM || listener->sock->state != SS_LISTENING) {
+        error = MYSOCKET_ECONNREFUSED;
+    } else if (socket_listen_queue_add(listener->sock, child) < 0) {
+        error = MYSOCKET_EAGAIN;
+    } else {
+        memcpy(child->unix_sk->path, name, len);
+        child->unix_sk->path_len = len;
+        child->unix_sk->peer = sock;
+        usk->peer = child;
+        child->state = SS_CONNECTED;
+        sock->state = SS_CONNECTED;
+    }
+    pthread_mutex_unlock(&unix_lock);
+
+    if (error != MYSOCKET_OK) {
+        socket_remove_from_manager(child);
+        socket_destroy(child);
+        socket_set_error(error);
+        return -1;
+    }
+
+    DEBUG_PRINT("Unix域连接成功: fd=%d, peer_fd=%d", sock->fd, child->fd);
+    return MYSOCKET_OK;
+}
+
+/**
+ * 把一条数据报写入目标的接收缓冲区（调用者持有unix_lock，使目标在复制期间不会被关闭）
+ * @return MYSOCKET_OK或错误码
+ */
+static int unix_dgram_deliver_locked(struct mysocket *sock, struct unix_sock *target,
+                                     const void *buf, size_t len) {
+    struct unix_sock *usk = sock->unix_sk;
+    struct unix_dgram_hdr hdr = { (uint32_t)len, (uint32_t)usk->path_len };
+    size_t record = sizeof(hdr) + usk->path_len + len;
+    int error = MYSOCKET_OK;
+
+    if (!target || target->sock->type != SOCK_DGRAM) {
+        return MYSOCKET_ECONNREFUSED;
+    }
+
+    /* 过滤器只看到负载，丢弃时发送方照常成功（与Linux相同） */
+    struct mysocket *dst = target->sock;
+    if (dst->filter) {
+        uint32_t keep = sk_filter_run(dst->filter, NULL, 0, buf, len);
+        if (keep == 0) {
+            return MYSOCKET_OK;
+        }
+        if (keep < len) {
+            len = keep;
+            hdr.data_len = (uint32_t)len;
+            record = sizeof(hdr) + usk->path_len + len;
+        }
+    }
+
+    pthread_mutex_lock(&target->lock);
+    if (record > dst->recv_buf_size) {
+        error = MYSOCKET_EINVAL;
+    } else if (record > dst->recv_buf_size - dst->recv_buf_used) {
+        error = MYSOCKET_EAGAIN;
+    } else {
+        char *p = dst->recv_buffer + dst->recv_buf_used;
+        memcpy(p, &hdr, sizeof(hdr));
+        memcpy(p + sizeof(hdr), usk->path, usk->path_len);
+        memcpy(p + sizeof(hdr) + usk->path_len, buf, len);
+        dst->recv_buf_used += record;
+    }
+    pthread_mutex_unlock(&target->lock);
+    return error;
+}
+
+/**
+ * 发送一条数据报：name为NULL时发往socketpair的对端，否则按名字查找目标
+ */
+static ssize_t unix_dgram_send(struct mysocket *sock, const char *name, size_t name_len,
+                               const void *buf, size_t len) {
+    pthread_mutex_lock(&unix_lock);
+    struct unix_sock *target;
+    if (name) {
+        target = unix_lookup_locked(name, name_len);
+    } else {
+        target = sock->unix_sk->peer ? sock->unix_sk->peer->unix_sk : NULL;
+    }
+    int error = unix_dgram_deliver_locked(sock, target, buf, len);
+    pthread_mutex_unlock(&unix_lock);
+
+    if (error != MYSOCKET_OK) {
+        socket_set_error(error);
+        return -1;
+    }
+    return (ssize_t)len;
+}
+
+/**
+ * 发送：流式写入对端的接收缓冲区（放不下时只写入一部分），数据报发往connect设置的目标
+ * @return 发送的字节数，失败返回-1（对端已关闭为MYSOCKET_ECONNREFUSED）
+ */
+ssize_t unix_send(struct mysocket *sock, const void *buf, size_t len) {
+    struct unix_sock *usk = sock->unix_sk;
+
+    if (!buf || len == 0 || sock->state != SS_CONNECTED) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    if (sock->type == SOCK_DGRAM) {
+        /* socketpair创建的一对没有名字，对端关闭后发送失败 */
+        const char *name = usk->peer_path_len > 0 ? usk->peer_path : NULL;
+        return unix_dgram_send(sock, name, usk->peer_path_len, buf, len);
+    }
+
+    struct mysocket *peer = usk->peer;
+    if (!peer) {
+        socket_set_error(MYSOCKET_ECONNREFUSED);
+        return -1;
+    }
+
+    pthread_mutex_lock(&peer->unix_sk->lock);
+    int written = socket_buffer_write(peer->recv_buffer, &peer->recv_buf_used,
+                                      peer->recv_buf_size, buf, len);
+    pthread_mutex_unlock(&peer->unix_sk->lock);
+
+    if (written <= 0) {
+        socket_set_error(MYSOCKET_EAGAIN);
+        return -1;
+    }
+    return written;
+}
+
+/**
+ * 接收：流式读取自己的接收缓冲区，对端关闭且缓冲区已空时返回0
+ */
+ssize_t unix_recv(struct mysocket *sock, void *buf, size_t len) {
+    if (sock->type == SOCK_DGRAM) {
+        return unix_recvfrom(sock, buf, len, NULL, NULL);
+    }
+
+    if (!buf || len == 0 || sock->state != SS_CONNECTED) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    pthread_mutex_lock(&sock->unix_sk->lock);
+    int read_len = socket_buffer_read(sock->recv_buffer, &sock->recv_buf_used, buf, len);
+    pthread_mutex_unlock(&sock->unix_sk->lock);
+
+    if (read_len > 0) {
+        return read_len;
+    }
+    if (sock->unix_sk->peer_closed) {
+        return 0;
+    }
+    socket_set_error(MYSOCKET_EAGAIN);
+    return -1;
+}
+
+ssize_t unix_sendto(struct mysocket *sock, const void *buf, size_t len,
+                    const struct mysocket_addr *dest_addr, socklen_t addrlen) {
+    /* 流式Socket忽略目标地址 */
+    if (sock->type == SOCK_STREAM) {
+        return unix_send(sock, buf, len);
+    }
+
+    char name[MYSOCKET_UNIX_PATH_MAX];
+    size_t name_len;
+    if (!buf || len == 0 || unix_addr_parse(dest_addr, addrlen, name, &name_len) < 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    return unix_dgram_send(sock, name, name_len, buf, len);
+}
+
+/**
+ * 接收一条数据报，缓冲区不够时截断，剩余部分丢弃
+ * @param src_addr 返回发送方地址（发送方未绑定时只有地址族），可以为NULL
+ */
+ssize_t unix_recvfrom(struct mysocket *sock, void *buf, size_t len,
+                      struct mysocket_addr *src_addr, socklen_t *addrlen) {
+    if (sock->type == SOCK_STREAM) {
+        if (addrlen) *addrlen = 0;
+        return unix_recv(sock, buf, len);
+    }
+
+    if (!buf || len == 0) {
+        socket_set_error(MYSOCKET_EINVAL);
+        return -1;
+    }
+
+    struct unix_sock *usk = sock->unix_sk;
+    pthread_mutex_lock(&usk->lock);
+
+    if (sock->recv_buf_used == 0) {
+        pthread_mutex_unlock(&usk->lock);
+        socket_set_error(MYSOCKET_EAGAIN);
+        return -1;
+    }
+
+    struct unix_dgram_hdr hdr;
+    memcpy(&hdr, sock->recv_buffer, sizeof(hdr));
+    const char *name = sock->recv_buffer + sizeof(hdr);
+    size_t record = sizeof(hdr) + hdr.addr_len + hdr.data_len;
+    size_t copy_len = hdr.data_len < len ? hdr.data_len : len;
+
+    memcpy(buf, name + hdr.addr_len, copy_len);
+    unix_addr_fill(src_addr, addrlen, name, hdr.addr_len);
+
+    sock->recv_buf_used -= record;
+    if (sock->recv_buf_used > 0) {
+        memmove(sock->recv_buffer, sock->recv_buffer + record, sock->recv_buf_used);
+    }
+
+    pthread_mutex_unlock(&usk->lock);
+    return (ssize_t)copy_len;
+}
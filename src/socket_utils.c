@@ -19,62 +19,178 @@
 #define TCP_EVENT_CLOSE         7
 #define TCP_EVENT_TIMEOUT       8
 
+/* 数据包输出钩子（NULL表示直接投递） */
+static packet_output_hook_t packet_output_hook = NULL;
+
+/**
+ * 设置数据包输出钩子
+ * @param hook 钩子函数，NULL恢复直接投递
+ */
+void packet_set_output_hook(packet_output_hook_t hook) {
+    packet_output_hook = hook;
+}
+
 /**
- * 创建数据包
- * @return 数据包指针，失败返回NULL
+ * 发送数据包：批量发送区间内先进入发送队列，否则立即交给链路
+ * @param pkt 数据包（所有权转移，发送后释放）
+ * @return 0成功（已排队的包在刷新时才知道结果），-1失败
  */
-struct packet* packet_create(void) {
-    struct packet *pkt = calloc(1, sizeof(struct packet));
-    if (!pkt) return NULL;
+int packet_send(struct packet *pkt) {
+    if (!pkt) return -1;
+    
+    DEBUG_PRINT("发送数据包: src=%08x:%d -> dst=%08x:%d", 
+                pkt->ip_hdr.src_addr, mysocket_ntohs(pkt->tcp_hdr.src_port),
+                pkt->ip_hdr.dst_addr, mysocket_ntohs(pkt->tcp_hdr.dst_port));
     
-    /* 初始化包头 */
-    memset(&pkt->ip_hdr, 0, sizeof(pkt->ip_hdr));
-    memset(&pkt->tcp_hdr, 0, sizeof(pkt->tcp_hdr));
+    /* 有原始套接字时，每个匹配的原始套接字得到一个共享缓冲区的克隆 */
+    if (__atomic_load_n(&g_raw_sock_count, __ATOMIC_RELAXED) > 0) {
+        raw_tap(pkt);
+    }
     
-    pkt->data = NULL;
-    pkt->data_len = 0;
-    pkt->next = NULL;
+    if (packet_tx_enqueue(pkt)) {
+        return 0;
+    }
     
-    return pkt;
+    int result = packet_xmit(pkt);
+    packet_destroy(pkt);
+    return result;
 }
 
 /**
- * 销毁数据包
- * @param pkt 数据包指针
+ * 把一个包交给链路：有输出钩子时交给钩子，否则交给当前网卡
+ * @param pkt 数据包（调用者保留所有权）
+ * @return 0成功，-1失败
  */
-void packet_destroy(struct packet *pkt) {
-    if (!pkt) return;
-    
-    if (pkt->data) {
-        free(pkt->data);
+int packet_xmit(struct packet *pkt) {
+    return packet_xmit_burst(&pkt, 1) == 1 ? 0 : -1;
+}
+
+/**
+ * 包的出口设备：TCP连接的包已带上缓存的路由，其余的包按目标地址查路由表
+ */
+static struct netdev* packet_output_dev(struct packet *pkt) {
+    if (!pkt->dev) {
+        pkt->dev = route_output(pkt->ip_hdr.dst_addr);
+    }
+    return pkt->dev;
+}
+
+/**
+ * 把一批包交给链路，连续发往同一设备的包作为一批交给该设备
+ * @param pkts 数据包数组（调用者保留所有权）
+ * @param n 包数
+ * @return 发出的包数
+ */
+int packet_xmit_burst(struct packet **pkts, int n) {
+    /* 链路仿真等场景：逐个交给钩子处理 */
+    if (packet_output_hook) {
+        int sent = 0;
+        for (int i = 0; i < n; i++) {
+            if (packet_output_hook(pkts[i]) == 0) {
+                sent++;
+            }
+        }
+        return sent;
     }
     
-    free(pkt);
+    int sent = 0;
+    int i = 0;
+    while (i < n) {
+        struct netdev *dev = packet_output_dev(pkts[i]);
+        int j = i + 1;
+        while (j < n && packet_output_dev(pkts[j]) == dev) {
+            j++;
+        }
+        sent += netdev_tx_burst(dev, pkts + i, j - i);
+        i = j;
+    }
+    return sent;
+}
+
+/**
+ * 投递数据包到目标Socket
+ * @param pkt 数据包（调用者保留所有权）
+ * @return 0成功，-1失败
+ */
+int packet_deliver(struct packet *pkt) {
+    return packet_deliver_cached(pkt, NULL);
 }
 
 /**
- * 发送数据包
+ * 查找数据包的目标Socket
  * @param pkt 数据包
+ * @return Socket指针，未找到返回NULL
+ */
+static struct mysocket* packet_lookup_target(const struct packet *pkt) {
+    struct mysocket_addr_in target_addr;
+    target_addr.sin_family = AF_INET;
+    target_addr.sin_addr = pkt->ip_hdr.dst_addr;
+    target_addr.sin_port = pkt->tcp_hdr.dst_port;
+    
+    struct mysocket *target = NULL;
+    if (pkt->ip_hdr.protocol == IPPROTO_TCP) {
+        /* TCP按四元组查找已连接Socket，找不到再交给监听Socket */
+        struct mysocket_addr_in source_addr;
+        source_addr.sin_family = AF_INET;
+        source_addr.sin_addr = pkt->ip_hdr.src_addr;
+        source_addr.sin_port = pkt->tcp_hdr.src_port;
+        target = socket_lookup_tcp(&target_addr, &source_addr);
+    } else {
+        target = socket_find_by_address(&target_addr);
+    }
+    
+    return target;
+}
+
+/**
+ * 投递数据包到目标Socket，连续发往同一四元组的包复用上次的查找结果
+ * Socket链表变化（新建、关闭）后缓存失效。查找在Socket链表的锁内进行；
+ * 异步投递时还在锁内取得目标的生产者引用，关闭目标的线程摘链后等引用归零才释放接收环
+ * @param pkt 数据包（调用者保留所有权）
+ * @param cache 查找缓存，NULL表示每次查找
  * @return 0成功，-1失败
  */
-int packet_send(struct packet *pkt) {
+int packet_deliver_cached(struct packet *pkt, struct packet_dst_cache *cache) {
     if (!pkt) return -1;
     
-    DEBUG_PRINT("发送数据包: src=%08x:%d -> dst=%08x:%d", 
-                pkt->ip_hdr.src_addr, mysocket_ntohs(pkt->tcp_hdr.src_port),
-                pkt->ip_hdr.dst_addr, mysocket_ntohs(pkt->tcp_hdr.dst_port));
+    struct mysocket *target = NULL;
+    socket_manager_lock();
+    uint32_t generation = __atomic_load_n(&g_socket_manager.generation, __ATOMIC_ACQUIRE);
     
-    /* 模拟数据包发送 */
-    /* 在实际实现中，这里会通过网络接口发送数据包 */
+    if (cache && cache->valid && cache->generation == generation &&
+        cache->protocol == pkt->ip_hdr.protocol &&
+        cache->src_addr == pkt->ip_hdr.src_addr && cache->dst_addr == pkt->ip_hdr.dst_addr &&
+        cache->src_port == pkt->tcp_hdr.src_port && cache->dst_port == pkt->tcp_hdr.dst_port) {
+        target = cache->target;
+        cache->hits++;
+    } else {
+        target = packet_lookup_target(pkt);
+        if (cache) {
+            cache->valid = 1;
+            cache->generation = generation;
+            cache->protocol = pkt->ip_hdr.protocol;
+            cache->src_addr = pkt->ip_hdr.src_addr;
+            cache->dst_addr = pkt->ip_hdr.dst_addr;
+            cache->src_port = pkt->tcp_hdr.src_port;
+            cache->dst_port = pkt->tcp_hdr.dst_port;
+            cache->target = target;
+        }
+    }
     
-    /* 简单模拟：查找目标Socket并投递数据包 */
-    struct mysocket_addr_in target_addr;
-    target_addr.sin_family = AF_INET;
-    target_addr.sin_addr = pkt->ip_hdr.dst_addr;
-    target_addr.sin_port = pkt->tcp_hdr.dst_port;
+    int async = g_packet_rx_queue;
+    if (target && async) {
+        __atomic_add_fetch(&target->rx_producers, 1, __ATOMIC_ACQUIRE);
+    }
+    socket_manager_unlock();
     
-    struct mysocket *target = socket_find_by_address(&target_addr);
     if (target) {
+        /* 异步投递：放入目标的接收环，由接收方线程处理 */
+        if (async) {
+            int ret = socket_rx_enqueue(target, pkt);
+            __atomic_sub_fetch(&target->rx_producers, 1, __ATOMIC_RELEASE);
+            return ret;
+        }
+        
         /* 处理数据包 */
         if (pkt->ip_hdr.protocol == IPPROTO_TCP) {
             tcp_process_packet(target, pkt);
@@ -87,20 +203,6 @@ int packet_send(struct packet *pkt) {
     return -1;
 }
 
-/**
- * 接收数据包
- * @param sock Socket指针
- * @return 数据包指针，无数据返回NULL
- */
-struct packet* packet_receive(struct mysocket *sock) {
-    if (!sock) return NULL;
-    
-    /* 简化实现：模拟从网络接收数据包 */
-    /* 在实际实现中，这里会从网络接口读取数据包 */
-    
-    return NULL;  /* 暂不实现 */
-}
-
 /**
  * 根据地址查找Socket
  * @param addr 地址
@@ -126,6 +228,38 @@ struct mysocket* socket_find_by_address(const struct mysocket_addr_in *addr) {
     return NULL;
 }
 
+/**
+ * 按四元组查找TCP Socket
+ * 优先匹配已连接的Socket，其次是监听Socket
+ * @param local 本地地址（数据包目标地址）
+ * @param remote 远端地址（数据包源地址）
+ * @return Socket指针，未找到返回NULL
+ */
+struct mysocket* socket_lookup_tcp(const struct mysocket_addr_in *local,
+                                   const struct mysocket_addr_in *remote) {
+    if (!local || !remote) return NULL;
+    
+    struct mysocket *current = g_socket_manager.socket_list;
+    
+    while (current != NULL) {
+        if (current->type == SOCK_STREAM &&
+            current->state != SS_LISTENING &&
+            current->local_addr.sin_port == local->sin_port &&
+            current->peer_addr.sin_port == remote->sin_port &&
+            current->peer_addr.sin_addr == remote->sin_addr) {
+            return current;
+        }
+        current = current->next;
+    }
+    
+    struct mysocket *listener = socket_find_listening_socket(local);
+    if (listener) {
+        return listener;
+    }
+    
+    return socket_find_by_address(local);
+}
+
 /**
  * 网络字节序转换：主机到网络（16位）
  */
@@ -178,6 +312,28 @@ uint32_t mysocket_inet_addr(const char *cp) {
     return mysocket_htonl((a << 24) | (b << 16) | (c << 8) | d);
 }
 
+/**
+ * 解析CIDR前缀"a.b.c.d/len"，省略"/len"表示/32
+ * @param prefix 返回前缀（主机字节序，长度以外的位清零）
+ * @param len 返回前缀长度
+ * @return 0成功，-1格式错误
+ */
+int socket_parse_cidr(const char *cidr, uint32_t *prefix, int *len) {
+    if (!cidr) return -1;
+    
+    unsigned int a, b, c, d;
+    int bits = 32;
+    int fields = sscanf(cidr, "%u.%u.%u.%u/%d", &a, &b, &c, &d, &bits);
+    if (fields < 4 || a > 255 || b > 255 || c > 255 || d > 255 || bits < 0 || bits > 32) {
+        return -1;
+    }
+    
+    uint32_t addr = (a << 24) | (b << 16) | (c << 8) | d;
+    *prefix = bits == 0 ? 0 : addr & (0xFFFFFFFFu << (32 - bits));
+    *len = bits;
+    return 0;
+}
+
 /**
  * 网络地址转换为字符串IP地址
  */
@@ -204,6 +360,10 @@ int mysocket_set_nonblocking(int sockfd) {
         return -1;
     }
     
+    if (sock->host_fd >= 0) {
+        return socket_kernel_set_nonblocking(sock);
+    }
+    
     /* 简单实现：设置标志位 */
     /* 在实际实现中需要修改Socket的阻塞属性 */
     
@@ -127,41 +127,178 @@ const char* tcp_state_name(tcp_state_t state) {
 }
 
 /**
- * 发送SYN包
+ * 创建TCP连接控制块
+ * @param sock 关联的Socket
+ * @return 控制块指针，失败返回NULL
+ */
+struct connection_cb* tcp_conn_create(struct mysocket *sock) {
+    struct connection_cb *cb = calloc(1, sizeof(struct connection_cb));
+    if (!cb) return NULL;
+    
+    cb->sock = sock;
+    cb->snd_wnd = DEFAULT_RECV_BUFFER_SIZE;
+    cb->rcv_wnd = DEFAULT_RECV_BUFFER_SIZE;
+    cb->rto_ms = TCP_RTO_INIT_MS;
+    cb->last_active = tcp_clock_ms();
+    tcp_scoreboard_clear(&cb->scoreboard);
+    
+    return cb;
+}
+
+/**
+ * 销毁TCP连接控制块
+ * @param cb 控制块指针
+ */
+void tcp_conn_destroy(struct connection_cb *cb) {
+    if (!cb) return;
+    
+    tcp_retrans_queue_purge(cb);
+    tcp_ooo_queue_purge(cb);
+    free(cb);
+}
+
+/**
+ * 根据连接的四元组生成包头模板
+ * @param sock Socket指针
+ */
+static void tcp_build_hdr_template(struct mysocket *sock) {
+    struct tcp_hdr_template *tmpl = &sock->conn->hdr_tmpl;
+    
+    memset(tmpl, 0, sizeof(*tmpl));
+    tmpl->ip_hdr.version_ihl = 0x45;
+    tmpl->ip_hdr.ttl = 64;
+    tmpl->ip_hdr.protocol = IPPROTO_TCP;
+    tmpl->ip_hdr.src_addr = sock->local_addr.sin_addr;
+    tmpl->ip_hdr.dst_addr = sock->peer_addr.sin_addr;
+    tmpl->tcp_hdr.src_port = sock->local_addr.sin_port;
+    tmpl->tcp_hdr.dst_port = sock->peer_addr.sin_port;
+    tmpl->pseudo_sum = tcp_pseudo_sum(tmpl->ip_hdr.src_addr, tmpl->ip_hdr.dst_addr, IPPROTO_TCP);
+    
+    sock->conn->hdr_tmpl_valid = 1;
+}
+
+/**
+ * 连接的出口设备：使用缓存的路由，路由表或当前设备变化后重新查找
+ * @param sock Socket指针（有连接控制块）
+ * @return 设备指针（不会为NULL）
+ */
+struct netdev* tcp_route(struct mysocket *sock) {
+    struct connection_cb *cb = sock->conn;
+    uint32_t gen = __atomic_load_n(&g_route_gen, __ATOMIC_ACQUIRE);
+    
+    if (cb->route_gen != gen) {
+        cb->route_dev = route_output(sock->peer_addr.sin_addr);
+        cb->route_gen = gen;
+    }
+    return cb->route_dev;
+}
+
+/**
+ * 从包头模板复制IP/TCP头，再补上随报文段变化的字段
+ * @param sock Socket指针
+ * @param pkt 数据包（数据已写入）
+ * @param seq 序列号
+ * @param flags TCP标志，带ACK时填入rcv_nxt
+ */
+static void tcp_init_segment(struct mysocket *sock, struct packet *pkt, uint32_t seq, uint16_t flags) {
+    struct connection_cb *cb = sock->conn;
+    
+    if (!cb->hdr_tmpl_valid) {
+        tcp_build_hdr_template(sock);
+    }
+    
+    pkt->ip_hdr = cb->hdr_tmpl.ip_hdr;
+    pkt->tcp_hdr = cb->hdr_tmpl.tcp_hdr;
+    pkt->ip_hdr.total_len = mysocket_htons((uint16_t)(sizeof(struct ip_header) +
+                                                      sizeof(struct tcp_header) + pkt->data_len));
+    pkt->tcp_hdr.seq_num = mysocket_htonl(seq);
+    pkt->tcp_hdr.ack_num = (flags & TCP_FLAG_ACK) ? mysocket_htonl(cb->rcv_nxt) : 0;
+    pkt->tcp_hdr.flags = flags;
+    pkt->tcp_hdr.window = mysocket_htons(tcp_select_window(sock, (flags & TCP_FLAG_SYN) != 0));
+    pkt->dev = tcp_route(sock);
+}
+
+/**
+ * 是否把校验和留给设备计算（开启卸载且连接的出口设备支持）
+ */
+static int tcp_csum_offload(struct mysocket *sock) {
+    return g_tcp_checksum_offload && (tcp_route(sock)->features & NETDEV_F_HW_CSUM);
+}
+
+/**
+ * 出口设备MTU下数据段的最大长度（线格式头和最长的选项都要放得下）
+ * @param sock Socket指针（有连接控制块）
+ */
+size_t tcp_current_mss(struct mysocket *sock) {
+    size_t limit = tcp_route(sock)->mtu - PACKET_WIRE_MAX_HDR;
+    return limit < TCP_DEFAULT_MSS ? limit : TCP_DEFAULT_MSS;
+}
+
+/**
+ * 用模板中的伪首部部分和计算报文段校验和（包头其余字段填完之后调用）
+ * 开启校验和卸载且设备支持时不计算，标记为PACKET_CSUM_PARTIAL
+ * @param sock Socket指针
+ * @param pkt 数据包
+ * @param data_sum 数据的部分和（复制数据时已算好）
+ */
+static void tcp_finish_segment(struct mysocket *sock, struct packet *pkt, uint32_t data_sum) {
+    pkt->tcp_hdr.checksum = 0;
+    
+    if (tcp_csum_offload(sock)) {
+        pkt->ip_summed = PACKET_CSUM_PARTIAL;
+        return;
+    }
+    
+    pkt->ip_summed = PACKET_CSUM_NONE;
+    pkt->tcp_hdr.checksum = tcp_checksum_data_sum(sock->conn->hdr_tmpl.pseudo_sum, &pkt->tcp_hdr,
+                                                  data_sum, pkt->data_len);
+}
+
+/**
+ * 发送SYN包（SYN_RECV状态下发送SYN-ACK）
  * @param sock Socket指针
  * @return 0成功，-1失败
  */
 int tcp_send_syn(struct mysocket *sock) {
-    if (!sock) return -1;
+    if (!sock || !sock->conn) return -1;
+    
+    struct connection_cb *cb = sock->conn;
+    int is_synack = (sock->tcp_state == TCP_SYN_RECV);
     
-    DEBUG_PRINT("发送SYN包: fd=%d", sock->fd);
+    DEBUG_PRINT("发送%s包: fd=%d", is_synack ? "SYN-ACK" : "SYN", sock->fd);
     
     /* 创建TCP包 */
     struct packet *pkt = packet_create();
     if (!pkt) return -1;
     
-    /* 填充IP头 */
-    pkt->ip_hdr.src_addr = sock->local_addr.sin_addr;
-    pkt->ip_hdr.dst_addr = sock->peer_addr.sin_addr;
-    pkt->ip_hdr.protocol = IPPROTO_TCP;
+    /* 主动打开时按接收缓冲区上限确定本端扩大因子（被动打开在收到SYN时已确定） */
+    if (!is_synack) {
+        cb->rcv_wscale = g_tcp_window_scaling ?
+                         tcp_compute_wscale(TCP_MAX_RECV_BUFFER_SIZE) : 0;
+    }
     
-    /* 填充TCP头 */
-    pkt->tcp_hdr.src_port = sock->local_addr.sin_port;
-    pkt->tcp_hdr.dst_port = sock->peer_addr.sin_port;
-    pkt->tcp_hdr.seq_num = mysocket_htonl(rand());  /* 随机初始序列号 */
-    pkt->tcp_hdr.ack_num = 0;
-    pkt->tcp_hdr.flags = TCP_FLAG_SYN;
-    pkt->tcp_hdr.window = mysocket_htons(8192);
+    /* 随机初始序列号，SYN占用一个序列号 */
+    cb->iss = (uint32_t)rand();
+    cb->snd_una = cb->iss;
+    cb->snd_nxt = cb->iss + 1;
+    
+    /* 四元组在此确定，生成包头模板后填充包头 */
+    tcp_build_hdr_template(sock);
+    tcp_init_segment(sock, pkt, cb->iss, is_synack ? (TCP_FLAG_SYN | TCP_FLAG_ACK) : TCP_FLAG_SYN);
+    
+    /* SYN通告本端支持SACK，SYN-ACK只在双方都支持时回应 */
+    pkt->tcp_opt.sack_permitted = is_synack ? (uint8_t)cb->sack_ok : (uint8_t)g_tcp_sack_enabled;
+    
+    /* 窗口扩大选项同理 */
+    pkt->tcp_opt.wscale_ok = is_synack ? (uint8_t)cb->wscale_ok : (uint8_t)g_tcp_window_scaling;
+    pkt->tcp_opt.wscale = pkt->tcp_opt.wscale_ok ? cb->rcv_wscale : 0;
     
     /* 计算校验和 */
-    pkt->tcp_hdr.checksum = tcp_checksum(&pkt->ip_hdr, &pkt->tcp_hdr, NULL, 0);
+    tcp_finish_segment(sock, pkt, 0);
     
-    /* 发送包 */
+    /* 发送包（所有权转移） */
     int result = packet_send(pkt);
     
-    /* 清理 */
-    packet_destroy(pkt);
-    
     if (result < 0) {
         return -1;
     }
@@ -176,36 +313,32 @@ int tcp_send_syn(struct mysocket *sock) {
  * @return 0成功，-1失败
  */
 int tcp_send_ack(struct mysocket *sock) {
-    if (!sock) return -1;
+    if (!sock || !sock->conn) return -1;
+    
+    struct connection_cb *cb = sock->conn;
     
-    DEBUG_PRINT("发送ACK包: fd=%d", sock->fd);
+    DEBUG_PRINT("发送ACK包: fd=%d, ack=%u, sacks=%d", sock->fd, cb->rcv_nxt, cb->num_sacks);
     
     /* 创建TCP包 */
     struct packet *pkt = packet_create();
     if (!pkt) return -1;
     
-    /* 填充IP头 */
-    pkt->ip_hdr.src_addr = sock->local_addr.sin_addr;
-    pkt->ip_hdr.dst_addr = sock->peer_addr.sin_addr;
-    pkt->ip_hdr.protocol = IPPROTO_TCP;
+    /* 填充包头 */
+    tcp_init_segment(sock, pkt, cb->snd_nxt, TCP_FLAG_ACK);
     
-    /* 填充TCP头 */
-    pkt->tcp_hdr.src_port = sock->local_addr.sin_port;
-    pkt->tcp_hdr.dst_port = sock->peer_addr.sin_port;
-    pkt->tcp_hdr.seq_num = mysocket_htonl(1000);  /* 简化的序列号 */
-    pkt->tcp_hdr.ack_num = mysocket_htonl(1001);  /* 简化的确认号 */
-    pkt->tcp_hdr.flags = TCP_FLAG_ACK;
-    pkt->tcp_hdr.window = mysocket_htons(8192);
+    /* 携带SACK块，告知对端已收到的乱序数据 */
+    if (cb->sack_ok && cb->num_sacks > 0) {
+        pkt->tcp_opt.num_sacks = (uint8_t)cb->num_sacks;
+        memcpy(pkt->tcp_opt.sacks, cb->sack_blocks,
+               cb->num_sacks * sizeof(struct tcp_sack_block));
+    }
     
     /* 计算校验和 */
-    pkt->tcp_hdr.checksum = tcp_checksum(&pkt->ip_hdr, &pkt->tcp_hdr, NULL, 0);
+    tcp_finish_segment(sock, pkt, 0);
     
-    /* 发送包 */
+    /* 发送包（所有权转移） */
     int result = packet_send(pkt);
     
-    /* 清理 */
-    packet_destroy(pkt);
-    
     if (result < 0) {
         return -1;
     }
@@ -220,7 +353,9 @@ int tcp_send_ack(struct mysocket *sock) {
  * @return 0成功，-1失败
  */
 int tcp_send_fin(struct mysocket *sock) {
-    if (!sock) return -1;
+    if (!sock || !sock->conn) return -1;
+    
+    struct connection_cb *cb = sock->conn;
     
     DEBUG_PRINT("发送FIN包: fd=%d", sock->fd);
     
@@ -228,28 +363,16 @@ int tcp_send_fin(struct mysocket *sock) {
     struct packet *pkt = packet_create();
     if (!pkt) return -1;
     
-    /* 填充IP头 */
-    pkt->ip_hdr.src_addr = sock->local_addr.sin_addr;
-    pkt->ip_hdr.dst_addr = sock->peer_addr.sin_addr;
-    pkt->ip_hdr.protocol = IPPROTO_TCP;
-    
-    /* 填充TCP头 */
-    pkt->tcp_hdr.src_port = sock->local_addr.sin_port;
-    pkt->tcp_hdr.dst_port = sock->peer_addr.sin_port;
-    pkt->tcp_hdr.seq_num = mysocket_htonl(2000);  /* 简化的序列号 */
-    pkt->tcp_hdr.ack_num = mysocket_htonl(2001);  /* 简化的确认号 */
-    pkt->tcp_hdr.flags = TCP_FLAG_FIN;
-    pkt->tcp_hdr.window = mysocket_htons(8192);
+    /* 填充包头，FIN占用一个序列号 */
+    tcp_init_segment(sock, pkt, cb->snd_nxt, TCP_FLAG_FIN | TCP_FLAG_ACK);
+    cb->snd_nxt++;
     
     /* 计算校验和 */
-    pkt->tcp_hdr.checksum = tcp_checksum(&pkt->ip_hdr, &pkt->tcp_hdr, NULL, 0);
+    tcp_finish_segment(sock, pkt, 0);
     
-    /* 发送包 */
+    /* 发送包（所有权转移） */
     int result = packet_send(pkt);
     
-    /* 清理 */
-    packet_destroy(pkt);
-    
     if (result < 0) {
         return -1;
     }
@@ -259,161 +382,483 @@ int tcp_send_fin(struct mysocket *sock) {
 }
 
 /**
- * 发送TCP数据包
+ * 为已填好负载的包填充包头并发出，发送克隆、原包进入重传队列
+ * @param sock Socket指针
+ * @param pkt 负载已就绪的包（所有权转移，失败时释放）
+ * @param data_sum 负载的校验和累加值（校验和卸载时为0）
+ * @return 0成功，-1失败
+ */
+static int tcp_transmit_new_segment(struct mysocket *sock, struct packet *pkt, uint32_t data_sum) {
+    struct connection_cb *cb = sock->conn;
+    
+    /* 从包头模板填充包头 */
+    pkt->seq = cb->snd_nxt;
+    pkt->end_seq = cb->snd_nxt + (uint32_t)pkt->data_len;
+    tcp_init_segment(sock, pkt, pkt->seq, TCP_FLAG_PSH | TCP_FLAG_ACK);
+    tcp_finish_segment(sock, pkt, data_sum);
+    
+    /* 发送共享负载的克隆，原包留给重传队列（接收路径可能pull克隆的数据指针） */
+    struct packet *skb = packet_clone(pkt);
+    if (!skb) {
+        packet_destroy(pkt);
+        return -1;
+    }
+    
+    pkt->sent_time = tcp_clock_ms();
+    cb->snd_nxt = pkt->end_seq;
+    
+    if (packet_send(skb) < 0) {
+        cb->snd_nxt = pkt->seq;
+        packet_destroy(pkt);
+        return -1;
+    }
+    
+    /* 本地投递时对端的ACK可能已同步到达，只有仍未确认的段才进入重传队列 */
+    if (tcp_seq_after(pkt->end_seq, cb->snd_una)) {
+        tcp_retrans_queue_add(cb, pkt);
+    } else {
+        packet_destroy(pkt);
+    }
+    return 0;
+}
+
+/**
+ * 发送TCP数据包（按MSS和设备MTU分段，未确认的段进入重传队列）
+ * 各段先进入发送队列，全部生成后整批交给链路
  * @param sock Socket指针
  * @param data 数据
  * @param len 数据长度
- * @return 0成功，-1失败
+ * @return 0成功，-1失败（整批刷新时有段投递失败也返回-1，已发出的段留在重传队列）
  */
 int tcp_send_data(struct mysocket *sock, const void *data, size_t len) {
-    if (!sock || !data || len == 0) return -1;
+    if (!sock || !sock->conn || !data || len == 0) return -1;
+    
+    struct connection_cb *cb = sock->conn;
+    const char *ptr = (const char *)data;
+    size_t remaining = len;
+    size_t mss = tcp_current_mss(sock);
+    int offload = tcp_csum_offload(sock);
+    int result = 0;
     
     DEBUG_PRINT("发送TCP数据: fd=%d, len=%zu", sock->fd, len);
     
-    /* 创建TCP包 */
-    struct packet *pkt = packet_create();
-    if (!pkt) return -1;
+    cb->last_active = tcp_clock_ms();
+    packet_tx_begin();
+    
+    while (remaining > 0) {
+        size_t seg_len = (remaining > mss) ? mss : remaining;
+        
+        /* 创建TCP包，数据直接写入包缓冲区，需要校验和时复制的同时累加 */
+        struct packet *pkt = packet_alloc(seg_len);
+        if (!pkt) {
+            result = -1;
+            break;
+        }
+        
+        char *payload = packet_put(pkt, seg_len);
+        uint32_t data_sum = 0;
+        if (offload) {
+            memcpy(payload, ptr, seg_len);
+        } else {
+            data_sum = checksum_copy(payload, ptr, seg_len, 0);
+        }
+        
+        if (tcp_transmit_new_segment(sock, pkt, data_sum) < 0) {
+            result = -1;
+            break;
+        }
+        
+        ptr += seg_len;
+        remaining -= seg_len;
+    }
+    
+    if (packet_tx_end() < 0) {
+        result = -1;
+    }
     
-    /* 分配数据空间 */
-    pkt->data = malloc(len);
-    if (!pkt->data) {
+    DEBUG_PRINT("TCP数据发送%s: fd=%d, len=%zu", result == 0 ? "成功" : "失败", sock->fd, len);
+    return result;
+}
+
+/**
+ * 发送负载已就绪的数据段（sendfile用：负载引用映射的文件页，或已由pread读入包缓冲区）
+ * 只计算校验和而不复制负载；调用者负责分段（不超过tcp_current_mss(sock)）和packet_tx_begin/end
+ * @param sock Socket指针
+ * @param pkt 负载已就绪的包（所有权转移，失败时释放）
+ * @return 0成功，-1失败
+ */
+int tcp_send_segment(struct mysocket *sock, struct packet *pkt) {
+    if (!sock || !sock->conn || !pkt || pkt->data_len == 0) {
         packet_destroy(pkt);
         return -1;
     }
     
-    memcpy(pkt->data, data, len);
-    pkt->data_len = len;
+    uint32_t data_sum = 0;
+    if (!tcp_csum_offload(sock)) {
+        data_sum = checksum_partial(pkt->data, pkt->data_len, 0);
+    }
     
-    /* 填充IP头 */
-    pkt->ip_hdr.src_addr = sock->local_addr.sin_addr;
-    pkt->ip_hdr.dst_addr = sock->peer_addr.sin_addr;
-    pkt->ip_hdr.protocol = IPPROTO_TCP;
-    pkt->ip_hdr.total_len = mysocket_htons(sizeof(struct ip_header) + 
-                                          sizeof(struct tcp_header) + len);
+    sock->conn->last_active = tcp_clock_ms();
+    return tcp_transmit_new_segment(sock, pkt, data_sum);
+}
+
+/**
+ * 将按序到达的数据写入接收缓冲区
+ * @param sock Socket指针
+ * @param data 数据
+ * @param len 数据长度
+ * @return 实际写入的字节数
+ */
+size_t tcp_data_to_recv_buffer(struct mysocket *sock, const char *data, size_t len) {
+    if (!sock || !data || len == 0) return 0;
+    
+    size_t available = sock->recv_buf_size - sock->recv_buf_used;
+    size_t copy_len = (len > available) ? available : len;
+    
+    if (copy_len > 0) {
+        /* 校验时已暂存到同一位置的数据不必再复制 */
+        struct connection_cb *cb = sock->conn;
+        char *dst = sock->recv_buffer + sock->recv_buf_used;
+        if (!cb || cb->csum_staged_src != data || cb->csum_staged_dst != dst ||
+            cb->csum_staged_len != copy_len) {
+            memcpy(dst, data, copy_len);
+        }
+        if (cb) {
+            cb->csum_staged_src = NULL;
+        }
+        sock->recv_buf_used += copy_len;
+        
+        DEBUG_PRINT("TCP数据写入缓冲区: fd=%d, len=%zu", sock->fd, copy_len);
+    }
     
-    /* 填充TCP头 */
-    pkt->tcp_hdr.src_port = sock->local_addr.sin_port;
-    pkt->tcp_hdr.dst_port = sock->peer_addr.sin_port;
-    pkt->tcp_hdr.seq_num = mysocket_htonl(3000);  /* 简化的序列号 */
-    pkt->tcp_hdr.ack_num = mysocket_htonl(3001);  /* 简化的确认号 */
-    pkt->tcp_hdr.flags = TCP_FLAG_PSH | TCP_FLAG_ACK;
-    pkt->tcp_hdr.window = mysocket_htons(8192);
+    return copy_len;
+}
+
+/**
+ * 监听Socket收到SYN：创建半连接子Socket并回复SYN-ACK
+ * @param listen_sock 监听Socket
+ * @param pkt SYN包
+ * @return 0成功，-1失败
+ */
+static int tcp_handle_syn(struct mysocket *listen_sock, struct packet *pkt) {
+    struct mysocket_addr_in peer_addr;
+    memset(&peer_addr, 0, sizeof(peer_addr));
+    peer_addr.sin_family = AF_INET;
+    peer_addr.sin_addr = pkt->ip_hdr.src_addr;
+    peer_addr.sin_port = pkt->tcp_hdr.src_port;
+    
+    if (!socket_can_accept_connection(listen_sock, &peer_addr)) {
+        DEBUG_PRINT("拒绝SYN: listen_fd=%d", listen_sock->fd);
+        return -1;
+    }
     
-    /* 计算校验和 */
-    pkt->tcp_hdr.checksum = tcp_checksum(&pkt->ip_hdr, &pkt->tcp_hdr, 
-                                        pkt->data, pkt->data_len);
+    /* 内存达到上限时拒绝新连接 */
+    if (socket_mem_state(SOCKET_MEM_TCP) == SOCKET_MEM_HIGH) {
+        DEBUG_PRINT("内存达到上限，拒绝SYN: listen_fd=%d", listen_sock->fd);
+        socket_mem_count_refused(SOCKET_MEM_TCP);
+        return -1;
+    }
     
-    /* 发送包 */
-    int result = packet_send(pkt);
+    struct mysocket *child = socket_create(listen_sock->family, 
+                                          listen_sock->type, 
+                                          listen_sock->protocol);
+    if (!child) {
+        socket_mem_count_refused(SOCKET_MEM_TCP);
+        return -1;
+    }
     
-    /* 清理 */
-    packet_destroy(pkt);
+    /* 子Socket继承监听地址，通配地址替换为实际目标地址 */
+    child->local_addr = listen_sock->local_addr;
+    if (child->local_addr.sin_addr == 0) {
+        child->local_addr.sin_addr = pkt->ip_hdr.dst_addr;
+    }
+    child->peer_addr = peer_addr;
     
-    if (result < 0) {
+    /* 计入源地址的连接数，子Socket销毁时减去 */
+    if (socket_acl_charge(listen_sock, child) < 0) {
+        socket_destroy(child);
         return -1;
     }
     
-    DEBUG_PRINT("TCP数据发送成功: fd=%d, len=%zu", sock->fd, len);
-    return 0;
+    struct connection_cb *cb = child->conn;
+    cb->irs = mysocket_ntohl(pkt->tcp_hdr.seq_num);
+    cb->rcv_nxt = cb->irs + 1;
+    cb->sack_ok = g_tcp_sack_enabled && pkt->tcp_opt.sack_permitted;
+    cb->snd_wnd = mysocket_ntohs(pkt->tcp_hdr.window);
+    
+    /* 只有双方都在SYN中携带窗口扩大选项时才启用 */
+    cb->wscale_ok = g_tcp_window_scaling && pkt->tcp_opt.wscale_ok;
+    if (cb->wscale_ok) {
+        cb->snd_wscale = pkt->tcp_opt.wscale;
+        cb->rcv_wscale = tcp_compute_wscale(TCP_MAX_RECV_BUFFER_SIZE);
+    }
+    
+    child->state = SS_CONNECTING;
+    child->tcp_state = TCP_LISTEN;
+    tcp_state_transition(child, TCP_EVENT_SYN_RECV);
+    
+    if (socket_add_to_manager(child) < 0) {
+        socket_destroy(child);
+        return -1;
+    }
+    
+    /* 先入队再回复：本地投递时第三次握手的ACK会同步到达 */
+    if (socket_listen_queue_add(listen_sock, child) < 0) {
+        socket_remove_from_manager(child);
+        socket_destroy(child);
+        return -1;
+    }
+    
+    return tcp_send_syn(child);
 }
 
 /**
- * 处理TCP数据包
+ * 处理ACK：推进snd_una、更新记分板、检测重复ACK
  * @param sock Socket指针
  * @param pkt 数据包
- * @return 0成功，-1失败
  */
-int tcp_process_packet(struct mysocket *sock, struct packet *pkt) {
-    if (!sock || !pkt) return -1;
+static void tcp_ack(struct mysocket *sock, struct packet *pkt) {
+    struct connection_cb *cb = sock->conn;
+    uint32_t ack = mysocket_ntohl(pkt->tcp_hdr.ack_num);
     
-    DEBUG_PRINT("处理TCP包: fd=%d, flags=0x%x", sock->fd, pkt->tcp_hdr.flags);
+    /* 确认了尚未发送的数据，忽略 */
+    if (tcp_seq_after(ack, cb->snd_nxt)) {
+        return;
+    }
     
-    /* 检查端口匹配 */
-    if (pkt->tcp_hdr.dst_port != sock->local_addr.sin_port) {
+    cb->last_ack_time = tcp_clock_ms();
+    cb->snd_wnd = (uint32_t)mysocket_ntohs(pkt->tcp_hdr.window) << cb->snd_wscale;
+    
+    if (cb->sack_ok && pkt->tcp_opt.num_sacks > 0) {
+        tcp_sack_process(cb, pkt);
+    }
+    
+    if (tcp_seq_after(ack, cb->snd_una)) {
+        /* 新数据被确认 */
+        cb->snd_una = ack;
+        cb->dupacks = 0;
+        cb->retrans_count = 0;
+        tcp_retrans_queue_clean(cb);
+        tcp_snd_space_adjust(sock);
+        
+        if (cb->in_recovery) {
+            if (!tcp_seq_before(ack, cb->recovery_point)) {
+                cb->in_recovery = 0;
+            } else if (cb->sack_ok) {
+                /* 部分确认：继续修补剩余空洞 */
+                tcp_fast_retransmit(sock);
+            }
+        }
+    } else if (ack == cb->snd_una && pkt->data_len == 0 &&
+               !(pkt->tcp_hdr.flags & (TCP_FLAG_SYN | TCP_FLAG_FIN)) &&
+               cb->retrans_queue != NULL) {
+        /* 重复ACK */
+        cb->dupacks++;
+        if (cb->dupacks == TCP_DUPACK_THRESHOLD ||
+            (cb->in_recovery && cb->sack_ok)) {
+            tcp_fast_retransmit(sock);
+        }
+    }
+    
+    /* 本端FIN被确认 */
+    if (ack == cb->snd_nxt &&
+        (sock->tcp_state == TCP_FIN_WAIT1 || sock->tcp_state == TCP_CLOSING ||
+         sock->tcp_state == TCP_LAST_ACK)) {
+        tcp_state_transition(sock, TCP_EVENT_ACK_RECV);
+    }
+    
+    /* 窗口打开后继续发送发送缓冲区中积压的数据 */
+    if (sock->send_buf_used > 0 && !cb->in_output && tcp_send_window_avail(sock) > 0) {
+        socket_flush_send_buffer(sock);
+    }
+}
+
+/**
+ * 处理数据段：按序数据写入接收缓冲区，乱序数据进入乱序队列
+ * @param sock Socket指针
+ * @param pkt 数据包
+ */
+static void tcp_data_queue(struct mysocket *sock, struct packet *pkt) {
+    struct connection_cb *cb = sock->conn;
+    uint32_t seq = mysocket_ntohl(pkt->tcp_hdr.seq_num);
+    uint32_t end_seq = seq + (uint32_t)pkt->data_len;
+    
+    if (!tcp_seq_after(end_seq, cb->rcv_nxt)) {
+        /* 完全重复的段，只需重新确认 */
+        DEBUG_PRINT("重复数据段: fd=%d, seq=%u", sock->fd, seq);
+    } else if (!tcp_seq_after(seq, cb->rcv_nxt)) {
+        /* 按序到达，去掉与已收数据重叠的部分 */
+        packet_pull(pkt, cb->rcv_nxt - seq);
+        size_t want = pkt->data_len;
+        size_t copied = tcp_data_to_recv_buffer(sock, pkt->data, want);
+        cb->rcv_nxt += (uint32_t)copied;
+        tcp_rcv_rtt_measure(cb);
+        
+        /* 填补空洞后，乱序队列中的后续数据也变为按序 */
+        if (copied == want) {
+            tcp_ooo_queue_drain(sock);
+        }
+        tcp_sack_build_blocks(cb, 0, 0);
+    } else {
+        /* 乱序到达 */
+        DEBUG_PRINT("乱序数据段: fd=%d, seq=%u, rcv_nxt=%u", sock->fd, seq, cb->rcv_nxt);
+        tcp_ooo_queue_insert(cb, pkt);
+        tcp_sack_build_blocks(cb, seq, end_seq);
+    }
+    
+    tcp_send_ack(sock);
+}
+
+/**
+ * 校验接收到的段（仅在开启接收校验且段带有软件校验和时）
+ * 能完整按序放入接收缓冲区的数据段在复制到缓冲区空闲处的同时校验，
+ * 之后写入接收缓冲区时不必再复制；其余的段单独遍历一遍数据
+ * @param sock Socket指针
+ * @param pkt 数据包
+ * @return 0通过或无需校验，-1校验失败
+ */
+static int tcp_rcv_checksum(struct mysocket *sock, struct packet *pkt) {
+    if (!g_tcp_checksum_verify || pkt->ip_summed != PACKET_CSUM_NONE) {
+        return 0;
+    }
+    
+    struct connection_cb *cb = sock->conn;
+    uint32_t pseudo = tcp_pseudo_sum(pkt->ip_hdr.src_addr, pkt->ip_hdr.dst_addr, IPPROTO_TCP);
+    uint32_t data_sum;
+    
+    cb->csum_staged_src = NULL;
+    
+    if (pkt->data_len > 0 && sock->tcp_state == TCP_ESTABLISHED &&
+        mysocket_ntohl(pkt->tcp_hdr.seq_num) == cb->rcv_nxt &&
+        pkt->data_len <= sock->recv_buf_size - sock->recv_buf_used) {
+        char *dst = sock->recv_buffer + sock->recv_buf_used;
+        data_sum = checksum_copy(dst, pkt->data, pkt->data_len, 0);
+        cb->csum_staged_src = pkt->data;
+        cb->csum_staged_dst = dst;
+        cb->csum_staged_len = pkt->data_len;
+    } else {
+        data_sum = checksum_partial(pkt->data, pkt->data_len, 0);
+    }
+    
+    if (tcp_checksum_data_sum(pseudo, &pkt->tcp_hdr, data_sum, pkt->data_len) != 0) {
+        cb->csum_staged_src = NULL;
+        cb->csum_errors++;
+        DEBUG_PRINT("校验和错误，丢弃: fd=%d, seq=%u", sock->fd, mysocket_ntohl(pkt->tcp_hdr.seq_num));
         return -1;
     }
     
-    /* 根据标志位处理 */
-    if (pkt->tcp_hdr.flags & TCP_FLAG_SYN) {
-        /* 处理SYN */
-        if (sock->tcp_state == TCP_LISTEN) {
-            tcp_state_transition(sock, TCP_EVENT_SYN_RECV);
-            tcp_send_ack(sock);
+    pkt->ip_summed = PACKET_CSUM_UNNECESSARY;
+    return 0;
+}
+
+/**
+ * 按连接状态处理已通过校验的段
+ * @param sock Socket指针
+ * @param pkt 数据包
+ * @return 0成功，-1失败
+ */
+static int tcp_rcv_state_process(struct mysocket *sock, struct packet *pkt) {
+    struct connection_cb *cb = sock->conn;
+    uint16_t flags = pkt->tcp_hdr.flags;
+    uint32_t fin_seq = mysocket_ntohl(pkt->tcp_hdr.seq_num) + (uint32_t)pkt->data_len;
+    cb->last_active = tcp_clock_ms();
+    
+    /* 监听Socket只处理SYN */
+    if (sock->tcp_state == TCP_LISTEN) {
+        if ((flags & TCP_FLAG_SYN) && !(flags & TCP_FLAG_ACK)) {
+            return tcp_handle_syn(sock, pkt);
         }
+        return -1;
     }
     
-    if (pkt->tcp_hdr.flags & TCP_FLAG_ACK) {
-        /* 处理ACK */
-        if (sock->tcp_state == TCP_SYN_SENT) {
+    /* 主动打开：等待SYN-ACK */
+    if (sock->tcp_state == TCP_SYN_SENT) {
+        if ((flags & TCP_FLAG_SYN) && (flags & TCP_FLAG_ACK) &&
+            mysocket_ntohl(pkt->tcp_hdr.ack_num) == cb->snd_nxt) {
+            cb->irs = mysocket_ntohl(pkt->tcp_hdr.seq_num);
+            cb->rcv_nxt = cb->irs + 1;
+            cb->rcv_wup = cb->rcv_nxt;      /* SYN中的窗口从对端的第一个数据字节算起 */
+            cb->snd_una = cb->snd_nxt;
+            cb->snd_wnd = mysocket_ntohs(pkt->tcp_hdr.window);
+            cb->sack_ok = g_tcp_sack_enabled && pkt->tcp_opt.sack_permitted;
+            cb->wscale_ok = g_tcp_window_scaling && pkt->tcp_opt.wscale_ok;
+            if (cb->wscale_ok) {
+                cb->snd_wscale = pkt->tcp_opt.wscale;
+            } else {
+                cb->snd_wscale = 0;
+                cb->rcv_wscale = 0;
+            }
             tcp_state_transition(sock, TCP_EVENT_SYN_ACK_RECV);
-        } else if (sock->tcp_state == TCP_SYN_RECV) {
-            tcp_state_transition(sock, TCP_EVENT_ACK_RECV);
+            tcp_send_ack(sock);
         }
+        return 0;
     }
     
-    if (pkt->tcp_hdr.flags & TCP_FLAG_FIN) {
-        /* 处理FIN */
-        tcp_state_transition(sock, TCP_EVENT_FIN_RECV);
+    /* 已同步状态下的SYN（如重复的SYN-ACK），重新确认即可 */
+    if (flags & TCP_FLAG_SYN) {
         tcp_send_ack(sock);
+        return 0;
     }
     
-    /* 如果有数据，写入接收缓冲区 */
+    if (flags & TCP_FLAG_ACK) {
+        /* 被动打开：第三次握手 */
+        if (sock->tcp_state == TCP_SYN_RECV) {
+            if (mysocket_ntohl(pkt->tcp_hdr.ack_num) != cb->snd_nxt) {
+                return -1;
+            }
+            tcp_state_transition(sock, TCP_EVENT_ACK_RECV);
+            sock->state = SS_CONNECTED;
+        }
+        
+        tcp_ack(sock, pkt);
+    }
+    
+    /* 如果有数据，按序写入接收缓冲区 */
     if (pkt->data_len > 0 && pkt->data) {
-        size_t available = sock->recv_buf_size - sock->recv_buf_used;
-        if (available > 0) {
-            size_t copy_len = (pkt->data_len > available) ? available : pkt->data_len;
-            memcpy(sock->recv_buffer + sock->recv_buf_used, pkt->data, copy_len);
-            sock->recv_buf_used += copy_len;
-            
-            DEBUG_PRINT("TCP数据写入缓冲区: fd=%d, len=%zu", sock->fd, copy_len);
+        tcp_data_queue(sock, pkt);
+    }
+    
+    if (flags & TCP_FLAG_FIN) {
+        /* FIN位于数据之后（数据可能已被pull），只有按序到达时才处理 */
+        if (fin_seq == cb->rcv_nxt) {
+            cb->rcv_nxt++;
+            tcp_state_transition(sock, TCP_EVENT_FIN_RECV);
         }
+        tcp_send_ack(sock);
     }
     
     return 0;
 }
 
 /**
- * 计算校验和
- * @param data 数据
- * @param len 数据长度
- * @return 校验和
+ * 处理TCP数据包
+ * @param sock Socket指针
+ * @param pkt 数据包
+ * @return 0成功，-1失败
  */
-uint16_t checksum(void *data, size_t len) {
-    uint16_t *ptr = (uint16_t *)data;
-    uint32_t sum = 0;
+int tcp_process_packet(struct mysocket *sock, struct packet *pkt) {
+    if (!sock || !pkt) return -1;
     
-    /* 16位求和 */
-    while (len > 1) {
-        sum += *ptr++;
-        len -= 2;
+    DEBUG_PRINT("处理TCP包: fd=%d, flags=0x%x", sock->fd, pkt->tcp_hdr.flags);
+    
+    /* 检查端口匹配 */
+    if (pkt->tcp_hdr.dst_port != sock->local_addr.sin_port) {
+        return -1;
     }
     
-    /* 处理奇数字节 */
-    if (len == 1) {
-        sum += *(uint8_t*)ptr;
+    struct connection_cb *cb = sock->conn;
+    if (!cb) {
+        return -1;
     }
     
-    /* 处理进位 */
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
+    if (tcp_rcv_checksum(sock, pkt) < 0) {
+        return -1;
     }
     
-    return ~sum;
+    int result = tcp_rcv_state_process(sock, pkt);
+    
+    /* 暂存只对本段有效 */
+    cb->csum_staged_src = NULL;
+    
+    return result;
 }
-
-/**
- * 计算TCP校验和
- * @param ip_hdr IP头
- * @param tcp_hdr TCP头
- * @param data 数据
- * @param data_len 数据长度
- * @return TCP校验和
- */
-uint16_t tcp_checksum(struct ip_header *ip_hdr, struct tcp_header *tcp_hdr, 
-                     void *data, size_t data_len) {
-    if (!ip_hdr || !tcp_hdr) return 0;
-    
-    /* 简化实现：返回固定值 */
-    /* 在实际实现中需要构造伪头部并计算校验和 */
-    return 0x1234;
-}
\ No newline at end of file
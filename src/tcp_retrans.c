@@ -0,0 +1,286 @@
+/**
+ * @file tcp_retrans.c
+ * @brief TCP重传机制实现
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 重传队列、RTT估计（RFC 6298）、超时重传和快速重传。
+ * 协商了SACK的连接只补发记分板中的空洞，否则退化为回退N。
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "socket_internal.h"
+
+/**
+ * 默认时钟：单调时间（毫秒）
+ */
+static uint64_t tcp_default_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* 当前使用的时钟（可被链路仿真替换为虚拟时钟） */
+static uint64_t (*tcp_clock_fn)(void) = tcp_default_clock;
+
+/**
+ * 获取TCP时钟（毫秒）
+ */
+uint64_t tcp_clock_ms(void) {
+    return tcp_clock_fn();
+}
+
+/**
+ * 替换TCP时钟
+ * @param clock_fn 时钟函数，NULL恢复默认时钟
+ */
+void tcp_set_clock(uint64_t (*clock_fn)(void)) {
+    tcp_clock_fn = clock_fn ? clock_fn : tcp_default_clock;
+}
+
+/**
+ * 根据RTT样本更新RTO（RFC 6298）
+ * @param cb 连接控制块
+ * @param rtt_ms RTT样本
+ */
+static void tcp_rtt_update(struct connection_cb *cb, uint32_t rtt_ms) {
+    if (cb->srtt_ms == 0 && cb->rttvar_ms == 0) {
+        cb->srtt_ms = rtt_ms;
+        cb->rttvar_ms = rtt_ms / 2;
+    } else {
+        uint32_t delta = (cb->srtt_ms > rtt_ms) ? cb->srtt_ms - rtt_ms : rtt_ms - cb->srtt_ms;
+        cb->rttvar_ms = (3 * cb->rttvar_ms + delta) / 4;
+        cb->srtt_ms = (7 * cb->srtt_ms + rtt_ms) / 8;
+    }
+
+    uint32_t rto = cb->srtt_ms + ((4 * cb->rttvar_ms > 1) ? 4 * cb->rttvar_ms : 1);
+    if (rto < TCP_RTO_MIN_MS) rto = TCP_RTO_MIN_MS;
+    if (rto > TCP_RTO_MAX_MS) rto = TCP_RTO_MAX_MS;
+    cb->rto_ms = rto;
+}
+
+/**
+ * 已发送的段加入重传队列尾部
+ * @param cb 连接控制块
+ * @param seg 数据段（所有权转移给队列）
+ */
+void tcp_retrans_queue_add(struct connection_cb *cb, struct packet *seg) {
+    if (!cb || !seg) return;
+
+    seg->next = NULL;
+    socket_mem_charge(SOCKET_MEM_TCP, packet_truesize(seg), SOCKET_MEM_FORCE);
+
+    if (cb->retrans_tail) {
+        cb->retrans_tail->next = seg;
+    } else {
+        cb->retrans_queue = seg;
+    }
+    cb->retrans_tail = seg;
+}
+
+/**
+ * 释放已被累计确认的段，并用未重传过的段采样RTT（Karn算法）
+ * @param cb 连接控制块
+ */
+void tcp_retrans_queue_clean(struct connection_cb *cb) {
+    if (!cb) return;
+
+    uint64_t now = tcp_clock_ms();
+    int have_sample = 0;
+    uint32_t sample = 0;
+
+    while (cb->retrans_queue && !tcp_seq_after(cb->retrans_queue->end_seq, cb->snd_una)) {
+        struct packet *seg = cb->retrans_queue;
+        cb->retrans_queue = seg->next;
+
+        if (!(seg->seg_flags & TCP_SEG_RETRANS)) {
+            sample = (uint32_t)(now - seg->sent_time);
+            have_sample = 1;
+        }
+
+        socket_mem_uncharge(SOCKET_MEM_TCP, packet_truesize(seg));
+        packet_destroy(seg);
+    }
+
+    if (!cb->retrans_queue) {
+        cb->retrans_tail = NULL;
+    } else if (tcp_seq_after(cb->snd_una, cb->retrans_queue->seq)) {
+        /* 部分确认：去掉已确认的前缀，重传时只发送未确认的部分 */
+        struct packet *seg = cb->retrans_queue;
+        packet_pull(seg, cb->snd_una - seg->seq);
+        seg->seq = cb->snd_una;
+        seg->tcp_hdr.seq_num = mysocket_htonl(seg->seq);
+        seg->ip_hdr.total_len = mysocket_htons((uint16_t)(sizeof(struct ip_header) +
+                                                          sizeof(struct tcp_header) + seg->data_len));
+        if (seg->ip_summed == PACKET_CSUM_NONE) {
+            seg->tcp_hdr.checksum = 0;
+            seg->tcp_hdr.checksum = tcp_checksum_pseudo(cb->hdr_tmpl.pseudo_sum, &seg->tcp_hdr,
+                                                        seg->data, seg->data_len);
+        }
+    }
+
+    if (have_sample) {
+        tcp_rtt_update(cb, sample);
+    }
+
+    tcp_scoreboard_trim(&cb->scoreboard, cb->snd_una);
+}
+
+/**
+ * 释放整个重传队列
+ * @param cb 连接控制块
+ */
+void tcp_retrans_queue_purge(struct connection_cb *cb) {
+    if (!cb) return;
+
+    while (cb->retrans_queue) {
+        struct packet *seg = cb->retrans_queue;
+        cb->retrans_queue = seg->next;
+        socket_mem_uncharge(SOCKET_MEM_TCP, packet_truesize(seg));
+        packet_destroy(seg);
+    }
+    cb->retrans_tail = NULL;
+
+    tcp_scoreboard_clear(&cb->scoreboard);
+}
+
+/**
+ * 查找第一个起始序列号不小于seq的段
+ * 重传过程中对端的ACK可能同步到达并释放队列中的段，因此每次都从头查找
+ */
+static struct packet* tcp_retrans_queue_find(struct connection_cb *cb, uint32_t seq) {
+    struct packet *seg = cb->retrans_queue;
+    while (seg && tcp_seq_before(seg->seq, seq)) {
+        seg = seg->next;
+    }
+    return seg;
+}
+
+/**
+ * 重传单个段
+ * @param sock Socket指针
+ * @param seg 重传队列中的段
+ * @return 0成功，-1失败
+ */
+int tcp_retransmit_segment(struct mysocket *sock, struct packet *seg) {
+    if (!sock || !sock->conn || !seg) return -1;
+
+    struct connection_cb *cb = sock->conn;
+
+    /* 发送副本：原段留在队列中，发送期间可能被ACK释放 */
+    struct packet *copy = packet_clone(seg);
+    if (!copy) return -1;
+
+    /* 只有确认号变化，增量更新校验和（卸载时不计算） */
+    uint32_t ack_num = mysocket_htonl(cb->rcv_nxt);
+    if (copy->ip_summed == PACKET_CSUM_NONE) {
+        copy->tcp_hdr.checksum = checksum_update32(copy->tcp_hdr.checksum,
+                                                   copy->tcp_hdr.ack_num, ack_num);
+    }
+    copy->tcp_hdr.ack_num = ack_num;
+    copy->dev = tcp_route(sock);    /* 路由可能在首次发送后变化 */
+
+    seg->sent_time = tcp_clock_ms();
+    seg->seg_flags |= TCP_SEG_RETRANS;
+    cb->retrans_segs++;
+    cb->retrans_bytes += seg->data_len;
+
+    DEBUG_PRINT("重传数据段: fd=%d, seq=%u, len=%zu", sock->fd, seg->seq, seg->data_len);
+
+    return packet_send(copy);
+}
+
+/**
+ * 快速重传（收到重复ACK或SACK部分确认时调用）
+ * SACK连接重传最高SACK序号以下、未被SACK且本轮未重传的段；
+ * 否则只重传第一个未确认段
+ * @param sock Socket指针
+ * @return 重传的段数
+ */
+int tcp_fast_retransmit(struct mysocket *sock) {
+    if (!sock || !sock->conn) return 0;
+
+    struct connection_cb *cb = sock->conn;
+    if (!cb->retrans_queue) return 0;
+
+    if (!cb->in_recovery) {
+        cb->in_recovery = 1;
+        cb->recovery_point = cb->snd_nxt;
+    }
+
+    if (!cb->sack_ok || cb->scoreboard.count == 0) {
+        struct packet *head = cb->retrans_queue;
+        if (head->seg_flags & TCP_SEG_RETRANS) {
+            return 0;
+        }
+        return (tcp_retransmit_segment(sock, head) == 0) ? 1 : 0;
+    }
+
+    int count = 0;
+    struct packet *seg = cb->retrans_queue;
+    packet_tx_begin();
+    while (seg && cb->scoreboard.count > 0 &&
+           tcp_seq_before(seg->seq, cb->scoreboard.high_sacked)) {
+        uint32_t next_seq = seg->end_seq;
+
+        if (!(seg->seg_flags & TCP_SEG_RETRANS) &&
+            !tcp_scoreboard_is_sacked(&cb->scoreboard, seg->seq, seg->end_seq)) {
+            tcp_retransmit_segment(sock, seg);
+            count++;
+        }
+
+        seg = tcp_retrans_queue_find(cb, next_seq);
+    }
+    packet_tx_end();
+
+    return count;
+}
+
+/**
+ * 超时重传检查，由收发路径周期性调用
+ * 超时后RTO加倍并回退N重传全部未确认段；按RFC 2018，接收端可能已丢弃
+ * 被SACK的数据，超时后记分板作废，SACK过的段同样重传
+ * @param sock Socket指针
+ * @return 重传的段数
+ */
+int tcp_retransmit_timer(struct mysocket *sock) {
+    if (!sock || !sock->conn) return 0;
+
+    struct connection_cb *cb = sock->conn;
+    struct packet *head = cb->retrans_queue;
+    if (!head) return 0;
+
+    uint64_t now = tcp_clock_ms();
+    if (now - head->sent_time < cb->rto_ms) {
+        return 0;
+    }
+
+    DEBUG_PRINT("重传超时: fd=%d, snd_una=%u, rto=%u", sock->fd, cb->snd_una, cb->rto_ms);
+
+    cb->retrans_count++;
+    cb->rto_ms = (cb->rto_ms * 2 > TCP_RTO_MAX_MS) ? TCP_RTO_MAX_MS : cb->rto_ms * 2;
+    cb->in_recovery = 0;
+    cb->dupacks = 0;
+
+    tcp_scoreboard_clear(&cb->scoreboard);
+
+    for (struct packet *seg = cb->retrans_queue; seg; seg = seg->next) {
+        seg->seg_flags &= (uint8_t)~TCP_SEG_RETRANS;
+    }
+
+    int count = 0;
+    struct packet *seg = cb->retrans_queue;
+    packet_tx_begin();
+    while (seg) {
+        uint32_t next_seq = seg->end_seq;
+
+        tcp_retransmit_segment(sock, seg);
+        count++;
+
+        seg = tcp_retrans_queue_find(cb, next_seq);
+    }
+    packet_tx_end();
+
+    return count;
+}
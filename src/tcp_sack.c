@@ -0,0 +1,321 @@
+/**
+ * @file tcp_sack.c
+ * @brief TCP选择性确认（SACK）实现
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 接收端：维护乱序队列并生成SACK块（RFC 2018）
+ * 发送端：维护按序列号区间组织的记分板，重传时只补发空洞
+ */
+
+#include "socket_internal.h"
+
+/* 是否在SYN中协商SACK，默认开启 */
+int g_tcp_sack_enabled = 1;
+
+/**
+ * 清空记分板
+ * @param sb 记分板
+ */
+void tcp_scoreboard_clear(struct tcp_scoreboard *sb) {
+    if (!sb) return;
+
+    sb->count = 0;
+    sb->high_sacked = 0;
+}
+
+/**
+ * 向记分板加入一个已SACK区间，与重叠或相邻的区间合并
+ * @param sb 记分板
+ * @param start_seq 区间起始序列号
+ * @param end_seq 区间结束序列号（不含）
+ */
+void tcp_scoreboard_add(struct tcp_scoreboard *sb, uint32_t start_seq, uint32_t end_seq) {
+    if (!sb || !tcp_seq_before(start_seq, end_seq)) return;
+
+    struct tcp_sack_block merged = { start_seq, end_seq };
+    struct tcp_sack_block out[TCP_SCOREBOARD_SIZE + 1];
+    int n = 0;
+    int inserted = 0;
+
+    for (int i = 0; i < sb->count; i++) {
+        struct tcp_sack_block r = sb->ranges[i];
+
+        if (tcp_seq_before(r.end_seq, merged.start_seq)) {
+            /* 完全位于新区间之前 */
+            out[n++] = r;
+        } else if (tcp_seq_after(r.start_seq, merged.end_seq)) {
+            /* 完全位于新区间之后 */
+            if (!inserted) {
+                out[n++] = merged;
+                inserted = 1;
+            }
+            out[n++] = r;
+        } else {
+            /* 重叠或相邻，合并 */
+            if (tcp_seq_before(r.start_seq, merged.start_seq)) merged.start_seq = r.start_seq;
+            if (tcp_seq_after(r.end_seq, merged.end_seq)) merged.end_seq = r.end_seq;
+        }
+    }
+
+    if (!inserted) {
+        out[n++] = merged;
+    }
+
+    /* 区间过多时丢弃最高的区间，最坏情况只是多重传 */
+    if (n > TCP_SCOREBOARD_SIZE) {
+        n = TCP_SCOREBOARD_SIZE;
+    }
+
+    memcpy(sb->ranges, out, n * sizeof(struct tcp_sack_block));
+    sb->count = n;
+
+    if (sb->count > 0) {
+        uint32_t top = sb->ranges[sb->count - 1].end_seq;
+        if (sb->count == 1 || tcp_seq_after(top, sb->high_sacked)) {
+            sb->high_sacked = top;
+        }
+    }
+}
+
+/**
+ * 丢弃snd_una之前的记分板信息
+ * @param sb 记分板
+ * @param snd_una 最早未确认序列号
+ */
+void tcp_scoreboard_trim(struct tcp_scoreboard *sb, uint32_t snd_una) {
+    if (!sb) return;
+
+    int n = 0;
+    for (int i = 0; i < sb->count; i++) {
+        struct tcp_sack_block r = sb->ranges[i];
+
+        if (!tcp_seq_after(r.end_seq, snd_una)) {
+            continue;  /* 已被累计确认 */
+        }
+        if (tcp_seq_before(r.start_seq, snd_una)) {
+            r.start_seq = snd_una;
+        }
+        sb->ranges[n++] = r;
+    }
+
+    sb->count = n;
+}
+
+/**
+ * 检查区间是否已被SACK完全覆盖
+ * @param sb 记分板
+ * @param start_seq 区间起始序列号
+ * @param end_seq 区间结束序列号（不含）
+ * @return 1已覆盖，0未覆盖
+ */
+int tcp_scoreboard_is_sacked(const struct tcp_scoreboard *sb, uint32_t start_seq, uint32_t end_seq) {
+    if (!sb) return 0;
+
+    for (int i = 0; i < sb->count; i++) {
+        const struct tcp_sack_block *r = &sb->ranges[i];
+
+        if (tcp_seq_after(r->start_seq, start_seq)) {
+            break;  /* 区间有序，后面不可能覆盖 */
+        }
+        if (!tcp_seq_after(end_seq, r->end_seq)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * 处理ACK携带的SACK块，更新记分板
+ * @param cb 连接控制块
+ * @param pkt 收到的ACK包
+ */
+void tcp_sack_process(struct connection_cb *cb, const struct packet *pkt) {
+    if (!cb || !pkt) return;
+
+    for (int i = 0; i < pkt->tcp_opt.num_sacks && i < TCP_MAX_SACK_BLOCKS; i++) {
+        uint32_t start_seq = pkt->tcp_opt.sacks[i].start_seq;
+        uint32_t end_seq = pkt->tcp_opt.sacks[i].end_seq;
+
+        /* 忽略非法块以及已被累计确认的块（D-SACK） */
+        if (!tcp_seq_before(start_seq, end_seq) ||
+            tcp_seq_before(start_seq, cb->snd_una) ||
+            tcp_seq_after(end_seq, cb->snd_nxt)) {
+            continue;
+        }
+
+        tcp_scoreboard_add(&cb->scoreboard, start_seq, end_seq);
+    }
+
+    DEBUG_PRINT("SACK记分板更新: fd=%d, ranges=%d, high=%u",
+                cb->sock ? cb->sock->fd : -1, cb->scoreboard.count,
+                cb->scoreboard.high_sacked);
+}
+
+/**
+ * 乱序段加入乱序队列（按序列号排序，完全重复的段丢弃）
+ * 超出通告窗口右边界的段丢弃；队列中的数据不超过接收缓冲区大小
+ * @param cb 连接控制块
+ * @param pkt 乱序到达的数据段
+ * @return 1已加入，0重复丢弃，-1失败
+ */
+int tcp_ooo_queue_insert(struct connection_cb *cb, const struct packet *pkt) {
+    if (!cb || !pkt || !pkt->data || pkt->data_len == 0) return -1;
+
+    uint32_t seq = mysocket_ntohl(pkt->tcp_hdr.seq_num);
+    uint32_t end_seq = seq + (uint32_t)pkt->data_len;
+
+    if (tcp_seq_after(end_seq, cb->rcv_wup + cb->rcv_wnd)) {
+        DEBUG_PRINT("乱序段超出接收窗口: seq=%u, end=%u, 右边界=%u",
+                    seq, end_seq, cb->rcv_wup + cb->rcv_wnd);
+        return -1;
+    }
+    if (cb->sock && cb->ooo_bytes + pkt->data_len > cb->sock->recv_buf_size) {
+        DEBUG_PRINT("乱序队列已满: ooo_bytes=%zu, recv_buf_size=%zu",
+                    cb->ooo_bytes, cb->sock->recv_buf_size);
+        return -1;
+    }
+
+    /* 查找插入位置 */
+    struct packet **link = &cb->ooo_queue;
+    while (*link && tcp_seq_before((*link)->seq, seq)) {
+        if (!tcp_seq_before((*link)->end_seq, end_seq)) {
+            return 0;  /* 被前面的段完全覆盖 */
+        }
+        link = &(*link)->next;
+    }
+
+    if (*link && (*link)->seq == seq && !tcp_seq_before((*link)->end_seq, end_seq)) {
+        return 0;
+    }
+
+    /* 内存达到上限时丢弃乱序段，等待对端重传 */
+    if (socket_mem_charge(SOCKET_MEM_TCP, packet_truesize(pkt), SOCKET_MEM_NEW) < 0) {
+        socket_mem_count_drop(SOCKET_MEM_TCP);
+        return -1;
+    }
+
+    struct packet *copy = packet_clone(pkt);
+    if (!copy) {
+        socket_mem_uncharge(SOCKET_MEM_TCP, packet_truesize(pkt));
+        return -1;
+    }
+
+    copy->seq = seq;
+    copy->end_seq = end_seq;
+    copy->next = *link;
+    *link = copy;
+    cb->ooo_bytes += copy->data_len;
+
+    return 1;
+}
+
+/**
+ * 把乱序队列中已变为按序的数据移入接收缓冲区
+ * @param sock Socket指针
+ * @return 移入的字节数
+ */
+size_t tcp_ooo_queue_drain(struct mysocket *sock) {
+    if (!sock || !sock->conn) return 0;
+
+    struct connection_cb *cb = sock->conn;
+    size_t total = 0;
+
+    while (cb->ooo_queue && !tcp_seq_after(cb->ooo_queue->seq, cb->rcv_nxt)) {
+        struct packet *seg = cb->ooo_queue;
+        cb->ooo_queue = seg->next;
+        cb->ooo_bytes -= seg->data_len;
+
+        if (tcp_seq_after(seg->end_seq, cb->rcv_nxt)) {
+            packet_pull(seg, cb->rcv_nxt - seg->seq);
+            size_t want = seg->data_len;
+            size_t copied = tcp_data_to_recv_buffer(sock, seg->data, want);
+
+            cb->rcv_nxt += (uint32_t)copied;
+            total += copied;
+
+            if (copied < want) {
+                /* 接收缓冲区已满：这部分已被SACK，对端不会再重传，
+                 * 剩余数据放回队首，待应用读取后继续移入 */
+                packet_pull(seg, copied);
+                seg->seq = cb->rcv_nxt;
+                seg->next = cb->ooo_queue;
+                cb->ooo_queue = seg;
+                cb->ooo_bytes += seg->data_len;
+                break;
+            }
+        }
+
+        socket_mem_uncharge(SOCKET_MEM_TCP, packet_truesize(seg));
+        packet_destroy(seg);
+    }
+
+    return total;
+}
+
+/**
+ * 释放乱序队列
+ * @param cb 连接控制块
+ */
+void tcp_ooo_queue_purge(struct connection_cb *cb) {
+    if (!cb) return;
+
+    while (cb->ooo_queue) {
+        struct packet *seg = cb->ooo_queue;
+        cb->ooo_queue = seg->next;
+        socket_mem_uncharge(SOCKET_MEM_TCP, packet_truesize(seg));
+        packet_destroy(seg);
+    }
+
+    cb->ooo_bytes = 0;
+    cb->num_sacks = 0;
+}
+
+/**
+ * 根据乱序队列重新生成待通告的SACK块
+ * 按RFC 2018，包含最近到达段的块放在第一位
+ * @param cb 连接控制块
+ * @param recent_start 最近到达段的起始序列号
+ * @param recent_end 最近到达段的结束序列号（与起始相同表示无）
+ */
+void tcp_sack_build_blocks(struct connection_cb *cb, uint32_t recent_start, uint32_t recent_end) {
+    if (!cb) return;
+
+    struct tcp_sack_block recent_run = { 0, 0 };
+    struct tcp_sack_block others[TCP_MAX_SACK_BLOCKS];
+    int have_recent = 0;
+    int num_others = 0;
+
+    struct packet *seg = cb->ooo_queue;
+    while (seg) {
+        /* 合并连续的段为一个区间 */
+        struct tcp_sack_block run = { seg->seq, seg->end_seq };
+        seg = seg->next;
+        while (seg && !tcp_seq_after(seg->seq, run.end_seq)) {
+            if (tcp_seq_after(seg->end_seq, run.end_seq)) {
+                run.end_seq = seg->end_seq;
+            }
+            seg = seg->next;
+        }
+
+        if (recent_start != recent_end && !have_recent &&
+            !tcp_seq_before(recent_start, run.start_seq) &&
+            !tcp_seq_after(recent_end, run.end_seq)) {
+            recent_run = run;
+            have_recent = 1;
+        } else if (num_others < TCP_MAX_SACK_BLOCKS) {
+            others[num_others++] = run;
+        }
+    }
+
+    int n = 0;
+    if (have_recent) {
+        cb->sack_blocks[n++] = recent_run;
+    }
+    for (int i = 0; i < num_others && n < TCP_MAX_SACK_BLOCKS; i++) {
+        cb->sack_blocks[n++] = others[i];
+    }
+
+    cb->num_sacks = n;
+}
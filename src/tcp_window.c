@@ -0,0 +1,340 @@
+/**
+ * @file tcp_window.c
+ * @brief TCP窗口管理实现
+ * @author Socket学习者
+ * @date 2025-09-19
+ *
+ * 窗口扩大选项（RFC 7323）、通告窗口的选择、发送端流量控制，
+ * 以及缓冲区自动调整：接收缓冲区按应用层实际读取速率增长（类似Linux的DRS），
+ * 发送缓冲区按每RTT确认量（吞吐×RTT）增长，空闲连接的缓冲区可被收缩。
+ */
+
+#include "socket_internal.h"
+
+/* 是否在SYN中协商窗口扩大，默认开启 */
+int g_tcp_window_scaling = 1;
+
+/* 是否自动调整接收缓冲区，默认开启 */
+int g_tcp_moderate_rcvbuf = 1;
+
+/* 是否自动调整发送缓冲区，默认开启 */
+int g_tcp_moderate_sndbuf = 1;
+
+/**
+ * 计算能表示max_space的最小窗口扩大因子
+ * @param max_space 接收缓冲区可能达到的最大值
+ * @return 扩大因子（0~TCP_MAX_WSCALE）
+ */
+uint8_t tcp_compute_wscale(size_t max_space) {
+    uint8_t wscale = 0;
+
+    while (wscale < TCP_MAX_WSCALE && (max_space >> wscale) > 0xFFFF) {
+        wscale++;
+    }
+
+    return wscale;
+}
+
+/**
+ * 选择要通告的接收窗口（接收缓冲区剩余空间）
+ * SYN中的窗口不做缩放（RFC 7323），其余按rcv_wscale右移；
+ * 已通告的右边沿不再左移（RFC 1122 4.2.2.16）：对端可能已经按它发出了数据，
+ * 收回的部分到达时会落在窗口外。内存压力下窗口停止扩大，
+ * 新空间最多通告到TCP_PRESSURE_WINDOW，减缓对端的发送
+ * @param sock Socket指针
+ * @param is_syn 是否为SYN/SYN-ACK
+ * @return 主机字节序的窗口字段值
+ */
+uint16_t tcp_select_window(struct mysocket *sock, int is_syn) {
+    if (!sock || !sock->conn) return 0;
+
+    struct connection_cb *cb = sock->conn;
+    size_t free_space = sock->recv_buf_size - sock->recv_buf_used;
+    size_t space = free_space;
+    uint8_t shift = is_syn ? 0 : cb->rcv_wscale;
+
+    /* 上次通告的右边沿之前还剩下的窗口 */
+    uint32_t cur_win = 0;
+    if (!is_syn && tcp_seq_after(cb->rcv_wup + cb->rcv_wnd, cb->rcv_nxt)) {
+        cur_win = cb->rcv_wup + cb->rcv_wnd - cb->rcv_nxt;
+    }
+
+    if (socket_mem_state(SOCKET_MEM_TCP) != SOCKET_MEM_NORMAL) {
+        size_t limit = cur_win > TCP_PRESSURE_WINDOW ? cur_win : TCP_PRESSURE_WINDOW;
+        if (space > limit) {
+            space = limit;
+        }
+    }
+    if (cb->rcv_clamp && space > cb->rcv_clamp) {
+        space = cb->rcv_clamp;
+    }
+
+    if (space < cur_win) {
+        space = cur_win;
+    }
+
+    /* 按扩大因子取整：向下取整会收回不到一个单位，缓冲区放得下时向上取整，
+     * 但仍记录原来的右边沿，多出的不到一个单位不会随每个ACK累积 */
+    size_t window = space >> shift;
+    uint32_t wnd = (uint32_t)(window << shift);
+    if (wnd < cur_win && ((window + 1) << shift) <= free_space) {
+        window++;
+        wnd = cur_win;
+    }
+    if (window > 0xFFFF) {
+        window = 0xFFFF;
+        wnd = (uint32_t)(window << shift);
+    }
+
+    cb->rcv_wnd = wnd;
+    cb->rcv_wup = cb->rcv_nxt;
+    return (uint16_t)window;
+}
+
+/**
+ * 对端接收窗口中还能发送的字节数
+ * @param sock Socket指针
+ * @return 可发送字节数
+ */
+uint32_t tcp_send_window_avail(struct mysocket *sock) {
+    if (!sock || !sock->conn) return 0;
+
+    struct connection_cb *cb = sock->conn;
+    uint32_t in_flight = cb->snd_nxt - cb->snd_una;
+
+    return (cb->snd_wnd > in_flight) ? cb->snd_wnd - in_flight : 0;
+}
+
+/**
+ * 接收端RTT估计：记录收满一个通告窗口所需的时间
+ * 发送端受窗口限制时这近似一个RTT，取较小的样本避免应用层限速造成的偏大
+ * @param cb 连接控制块
+ */
+void tcp_rcv_rtt_measure(struct connection_cb *cb) {
+    if (!cb) return;
+
+    uint64_t now = tcp_clock_ms();
+
+    if (cb->rcv_rtt_time == 0) {
+        cb->rcv_rtt_seq = cb->rcv_nxt + cb->rcv_wnd;
+        cb->rcv_rtt_time = now;
+        return;
+    }
+
+    if (tcp_seq_before(cb->rcv_nxt, cb->rcv_rtt_seq)) {
+        return;
+    }
+
+    uint32_t sample = (uint32_t)(now - cb->rcv_rtt_time);
+    if (sample == 0) {
+        sample = 1;
+    }
+
+    if (cb->rcv_rtt_ms == 0 || sample < cb->rcv_rtt_ms) {
+        cb->rcv_rtt_ms = sample;
+    } else {
+        cb->rcv_rtt_ms = (7 * cb->rcv_rtt_ms + sample) / 8;
+    }
+
+    cb->rcv_rtt_seq = cb->rcv_nxt + cb->rcv_wnd;
+    cb->rcv_rtt_time = now;
+}
+
+/**
+ * 接收缓冲区自动调整：每个RTT统计一次应用层读取量，
+ * 读取量超过上一轮时把缓冲区增长到读取量的两倍（上限TCP_MAX_RECV_BUFFER_SIZE）
+ * @param sock Socket指针
+ */
+void tcp_rcv_space_adjust(struct mysocket *sock) {
+    if (!sock || !sock->conn || !g_tcp_moderate_rcvbuf) return;
+
+    struct connection_cb *cb = sock->conn;
+    uint64_t now = tcp_clock_ms();
+
+    if (cb->rcvq_time == 0) {
+        cb->rcvq_time = now;
+        cb->rcvq_seq = cb->copied_seq;
+        cb->rcvq_space = (uint32_t)(sock->recv_buf_size / 2);
+        return;
+    }
+
+    if (cb->rcv_rtt_ms == 0 || now - cb->rcvq_time < cb->rcv_rtt_ms) {
+        return;
+    }
+
+    uint32_t copied = cb->copied_seq - cb->rcvq_seq;
+
+    /* 等待收缩时应用层在一个RTT内读满了限制后窗口的一半：连接不再空闲，取消收缩 */
+    if (cb->rcv_clamp && copied >= cb->rcv_clamp / 2) {
+        cb->rcv_clamp = 0;
+    }
+
+    if (copied > cb->rcvq_space) {
+        size_t rcvbuf = 2 * (size_t)copied;
+        if (rcvbuf > TCP_MAX_RECV_BUFFER_SIZE) {
+            rcvbuf = TCP_MAX_RECV_BUFFER_SIZE;
+        }
+
+        int grown = 1;
+        if (rcvbuf > sock->recv_buf_size) {
+            grown = socket_buffer_grow(sock, 0, rcvbuf) == 0;
+            if (grown) {
+                DEBUG_PRINT("接收缓冲区自动增长: fd=%d, copied=%u, rtt=%u, rcvbuf=%zu",
+                            sock->fd, copied, cb->rcv_rtt_ms, rcvbuf);
+            }
+        }
+        /* 受内存限制没能增长时保留原来的基准，其他连接回收后下一轮再试 */
+        if (grown) {
+            cb->rcvq_space = copied;
+        }
+    }
+
+    cb->rcvq_seq = cb->copied_seq;
+    cb->rcvq_time = now;
+}
+
+/**
+ * 应用层读取数据后的处理：调整接收缓冲区，窗口明显增大时发送窗口更新
+ * @param sock Socket指针
+ * @param copied 本次读取的字节数
+ */
+void tcp_cleanup_rbuf(struct mysocket *sock, size_t copied) {
+    if (!sock || !sock->conn || copied == 0) return;
+
+    struct connection_cb *cb = sock->conn;
+    cb->copied_seq += (uint32_t)copied;
+
+    tcp_rcv_space_adjust(sock);
+
+    if (sock->tcp_state != TCP_ESTABLISHED && sock->tcp_state != TCP_FIN_WAIT1 &&
+        sock->tcp_state != TCP_FIN_WAIT2) {
+        return;
+    }
+
+    /* 接收缓冲区满时停在乱序队列里的数据（已被SACK），腾出空间后继续移入 */
+    if (cb->ooo_queue && !tcp_seq_after(cb->ooo_queue->seq, cb->rcv_nxt) &&
+        tcp_ooo_queue_drain(sock) > 0) {
+        tcp_sack_build_blocks(cb, 0, 0);
+        tcp_send_ack(sock);
+        return;
+    }
+
+    /* 窗口至少翻倍且超过一个MSS才通告，避免糊涂窗口综合症 */
+    uint32_t advertised = cb->rcv_wnd;
+    size_t space = sock->recv_buf_size - sock->recv_buf_used;
+    if (space >= TCP_DEFAULT_MSS && space >= 2 * (size_t)advertised) {
+        tcp_send_ack(sock);
+    }
+}
+
+/**
+ * 发送缓冲区剩余空间：已发送未确认的数据也计入发送缓冲区
+ * @param sock Socket指针
+ * @return 应用层还能写入的字节数
+ */
+size_t tcp_send_buffer_space(struct mysocket *sock) {
+    if (!sock || !sock->conn) return 0;
+
+    struct connection_cb *cb = sock->conn;
+    size_t in_flight = cb->snd_nxt - cb->snd_una;
+    size_t used = sock->send_buf_used + in_flight;
+
+    return (sock->send_buf_size > used) ? sock->send_buf_size - used : 0;
+}
+
+/**
+ * 发送缓冲区自动调整：每个RTT统计一次被确认的字节数（即吞吐×RTT），
+ * 本轮发送受发送缓冲区限制且确认量超过缓冲区一半时，增长到确认量的两倍
+ * @param sock Socket指针
+ */
+void tcp_snd_space_adjust(struct mysocket *sock) {
+    if (!sock || !sock->conn || !g_tcp_moderate_sndbuf) return;
+
+    struct connection_cb *cb = sock->conn;
+    uint64_t now = tcp_clock_ms();
+
+    if (cb->sndq_time == 0) {
+        cb->sndq_time = now;
+        cb->sndq_seq = cb->snd_una;
+        return;
+    }
+
+    uint32_t rtt = cb->srtt_ms ? cb->srtt_ms : 1;
+    if (now - cb->sndq_time < rtt) {
+        return;
+    }
+
+    /* 本地投递时ACK在发送途中同步到达，tcp_send_data还在引用发送缓冲区，留到下一个ACK再调整 */
+    if (cb->in_output) {
+        return;
+    }
+
+    uint32_t acked = cb->snd_una - cb->sndq_seq;
+    if (cb->snd_buf_limited && 2 * (size_t)acked > sock->send_buf_size) {
+        size_t sndbuf = 2 * (size_t)acked;
+        if (sndbuf > TCP_MAX_SEND_BUFFER_SIZE) {
+            sndbuf = TCP_MAX_SEND_BUFFER_SIZE;
+        }
+
+        if (sndbuf > sock->send_buf_size && socket_buffer_grow(sock, sndbuf, 0) == 0) {
+            DEBUG_PRINT("发送缓冲区自动增长: fd=%d, acked=%u, rtt=%u, sndbuf=%zu",
+                        sock->fd, acked, rtt, sndbuf);
+        }
+    }
+
+    cb->sndq_seq = cb->snd_una;
+    cb->sndq_time = now;
+    cb->snd_buf_limited = 0;
+}
+
+/**
+ * 收缩空闲连接的缓冲区到默认大小
+ * 只收缩为空的缓冲区；接收缓冲区收缩后立即通告新的窗口。
+ * 本端空闲不代表对端不会按以前通告的（可能扩大到几百KB的）窗口发送：
+ * 通告过的右边沿超出默认大小时先不收缩，只让新通告的窗口不再超过默认大小，
+ * 等对端用掉旧窗口后的下一次回收再收缩
+ * @param sock Socket指针
+ * @return 释放的字节数
+ */
+size_t tcp_shrink_idle_buffers(struct mysocket *sock) {
+    if (!sock || !sock->conn) return 0;
+
+    struct connection_cb *cb = sock->conn;
+    if (tcp_clock_ms() - cb->last_active < TCP_BUFFER_IDLE_MS) {
+        return 0;
+    }
+
+    size_t freed = 0;
+
+    if (sock->send_buf_size > DEFAULT_SEND_BUFFER_SIZE &&
+        sock->send_buf_used == 0 && cb->snd_nxt == cb->snd_una) {
+        freed += sock->send_buf_size - DEFAULT_SEND_BUFFER_SIZE;
+        socket_buffer_resize(sock, DEFAULT_SEND_BUFFER_SIZE, 0);
+        cb->sndq_time = 0;
+    }
+
+    if (sock->recv_buf_size > DEFAULT_RECV_BUFFER_SIZE &&
+        sock->recv_buf_used == 0 && cb->ooo_queue == NULL) {
+        uint32_t edge = cb->rcv_wup + cb->rcv_wnd;
+        if (tcp_seq_after(edge, cb->rcv_nxt + DEFAULT_RECV_BUFFER_SIZE)) {
+            cb->rcv_clamp = DEFAULT_RECV_BUFFER_SIZE;
+            cb->rcvq_time = 0;      /* 从下一次读取开始重新统计读取速率 */
+            DEBUG_PRINT("推迟收缩接收缓冲区: fd=%d, 已通告窗口%u", sock->fd, edge - cb->rcv_nxt);
+        } else {
+            freed += sock->recv_buf_size - DEFAULT_RECV_BUFFER_SIZE;
+            socket_buffer_resize(sock, 0, DEFAULT_RECV_BUFFER_SIZE);
+            cb->rcvq_time = 0;
+            cb->rcv_clamp = 0;
+
+            if (sock->tcp_state == TCP_ESTABLISHED) {
+                tcp_send_ack(sock);
+            }
+        }
+    }
+
+    if (freed > 0) {
+        DEBUG_PRINT("收缩空闲连接缓冲区: fd=%d, freed=%zu", sock->fd, freed);
+    }
+
+    return freed;
+}
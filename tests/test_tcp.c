@@ -0,0 +1,2694 @@
+/**
+ * @file test_tcp.c
+ * @brief TCP协议栈测试（握手、序列号、SACK、重传与窗口）
+ * @author Socket学习者
+ * @date 2025-09-19
+ */
+
+#include "socket_internal.h"
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#define TEST_SEGMENTS 5
+
+/* 仿真链路：发出的包先排队，按数据段序号丢包或报告投递失败，link_flush时再投递 */
+static int drop_mask = 0;
+static int fail_mask = 0;
+static int data_seg_index = 0;
+static struct packet *link_head = NULL;
+static struct packet *link_tail = NULL;
+
+static int link_hook(struct packet *pkt) {
+    if (pkt->data_len > 0) {
+        int index = data_seg_index++;
+        if (index < 32 && (drop_mask & (1u << index))) {
+            return 0;  /* 模拟链路丢包 */
+        }
+        if (index < 32 && (fail_mask & (1u << index))) {
+            return -1; /* 模拟网卡发送失败 */
+        }
+    }
+
+    struct packet *copy = packet_clone(pkt);
+    assert(copy != NULL);
+    if (link_tail) {
+        link_tail->next = copy;
+    } else {
+        link_head = copy;
+    }
+    link_tail = copy;
+    return 0;
+}
+
+static void link_flush(void) {
+    while (link_head) {
+        struct packet *pkt = link_head;
+        link_head = pkt->next;
+        if (!link_head) link_tail = NULL;
+        pkt->next = NULL;
+        packet_deliver(pkt);
+        packet_destroy(pkt);
+    }
+}
+
+/* 虚拟时钟 */
+static uint64_t fake_now = 0;
+
+static uint64_t fake_clock(void) {
+    return fake_now;
+}
+
+/**
+ * 建立一对已连接的TCP Socket
+ */
+static void make_connection(uint16_t port, int *client_fd, int *server_fd) {
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int cfd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(listen_fd >= 0 && cfd >= 0);
+
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", port);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 4) == 0);
+    assert(mysocket_connect(cfd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+
+    struct mysocket_addr_in peer;
+    socklen_t peer_len = sizeof(peer);
+    int sfd = mysocket_accept(listen_fd, (struct mysocket_addr*)&peer, &peer_len);
+    assert(sfd >= 0);
+
+    /* accept返回的是真实的对端，而不是模拟连接 */
+    struct mysocket *client = socket_find_by_fd(cfd);
+    assert(peer.sin_port == client->local_addr.sin_port);
+
+    *client_fd = cfd;
+    *server_fd = sfd;
+}
+
+void test_handshake_and_data() {
+    printf("测试三次握手和数据传输...\n");
+
+    assert(mysocket_init() == 0);
+
+    int cfd, sfd;
+    make_connection(9100, &cfd, &sfd);
+
+    struct mysocket *client = socket_find_by_fd(cfd);
+    struct mysocket *server = socket_find_by_fd(sfd);
+    assert(client->tcp_state == TCP_ESTABLISHED);
+    assert(server->tcp_state == TCP_ESTABLISHED);
+    assert(client->conn->sack_ok && server->conn->sack_ok);
+    printf("  握手完成，SACK已协商\n");
+
+    /* 数据到达服务端子Socket，且全部被确认 */
+    const char *msg = "Hello, TCP!";
+    assert(mysocket_send(cfd, msg, strlen(msg), 0) == (ssize_t)strlen(msg));
+    assert(server->recv_buf_used == strlen(msg));
+    assert(memcmp(server->recv_buffer, msg, strlen(msg)) == 0);
+    assert(client->conn->snd_una == client->conn->snd_nxt);
+    assert(client->conn->retrans_queue == NULL);
+    printf("  数据送达对端并被确认\n");
+
+    mysocket_cleanup();
+
+    printf("✓ 三次握手和数据传输测试通过\n\n");
+}
+
+void test_scoreboard() {
+    printf("测试SACK记分板...\n");
+
+    struct tcp_scoreboard sb;
+    tcp_scoreboard_clear(&sb);
+
+    tcp_scoreboard_add(&sb, 3000, 4000);
+    tcp_scoreboard_add(&sb, 1000, 2000);
+    tcp_scoreboard_add(&sb, 2000, 2500);  /* 与[1000,2000)相邻，合并 */
+    assert(sb.count == 2);
+    assert(sb.ranges[0].start_seq == 1000 && sb.ranges[0].end_seq == 2500);
+    assert(sb.high_sacked == 4000);
+
+    assert(tcp_scoreboard_is_sacked(&sb, 1200, 2400));
+    assert(!tcp_scoreboard_is_sacked(&sb, 2400, 3100));
+
+    tcp_scoreboard_trim(&sb, 3500);
+    assert(sb.count == 1 && sb.ranges[0].start_seq == 3500);
+
+    /* 序列号回绕 */
+    tcp_scoreboard_clear(&sb);
+    tcp_scoreboard_add(&sb, 0xFFFFFF00u, 0x100);
+    assert(tcp_scoreboard_is_sacked(&sb, 0xFFFFFFF0u, 0x10));
+
+    printf("✓ SACK记分板测试通过\n\n");
+}
+
+/**
+ * 丢弃第2、4个数据段（不足3个重复ACK），进入恢复或超时后检查重传的段数
+ */
+static uint64_t run_loss_case(int sack, int timeout, uint16_t port) {
+    assert(mysocket_init() == 0);
+    g_tcp_sack_enabled = sack;
+    fake_now = 1000;
+    tcp_set_clock(fake_clock);
+
+    int cfd, sfd;
+    make_connection(port, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+    struct mysocket *server = socket_find_by_fd(sfd);
+
+    char data[TEST_SEGMENTS * TCP_DEFAULT_MSS];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)('a' + i % 26);
+    }
+
+    drop_mask = (1 << 1) | (1 << 3);
+    data_seg_index = 0;
+    packet_set_output_hook(link_hook);
+
+    assert(tcp_send_data(client, data, sizeof(data)) == 0);
+    link_flush();
+    assert(server->recv_buf_used == TCP_DEFAULT_MSS);
+    if (sack) {
+        assert(server->conn->num_sacks == 2);
+    }
+
+    drop_mask = 0;
+    if (timeout) {
+        fake_now += TCP_RTO_INIT_MS;
+        assert(tcp_retransmit_timer(client) > 0);
+        assert(client->conn->scoreboard.count == 0);
+    } else {
+        /* SACK恢复只重传空洞 */
+        assert(tcp_fast_retransmit(client) == 2);
+    }
+    link_flush();
+
+    assert(server->recv_buf_used == sizeof(data));
+    assert(memcmp(server->recv_buffer, data, sizeof(data)) == 0);
+    assert(client->conn->retrans_queue == NULL);
+
+    uint64_t retrans = client->conn->retrans_segs;
+
+    packet_set_output_hook(NULL);
+    tcp_set_clock(NULL);
+    g_tcp_sack_enabled = 1;
+    mysocket_cleanup();
+
+    return retrans;
+}
+
+void test_selective_retransmit() {
+    printf("测试选择性重传...\n");
+
+    uint64_t with_sack = run_loss_case(1, 0, 9101);
+    uint64_t without_sack = run_loss_case(0, 1, 9102);
+
+    printf("  SACK重传段数: %llu, 回退N重传段数: %llu\n",
+           (unsigned long long)with_sack, (unsigned long long)without_sack);
+    assert(with_sack == 2);
+    assert(without_sack == 4);
+
+    /* 超时说明接收端可能已丢弃SACK过的数据（RFC 2018），记分板作废，全部重传 */
+    assert(run_loss_case(1, 1, 9118) == 4);
+
+    printf("✓ 选择性重传测试通过\n\n");
+}
+
+void test_fast_retransmit() {
+    printf("测试快速重传...\n");
+
+    assert(mysocket_init() == 0);
+
+    int cfd, sfd;
+    make_connection(9103, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+    struct mysocket *server = socket_find_by_fd(sfd);
+
+    char data[TEST_SEGMENTS * TCP_DEFAULT_MSS];
+    memset(data, 'x', sizeof(data));
+
+    /* 只丢第2段：后续3个段产生3个重复ACK，触发快速重传 */
+    drop_mask = (1 << 1);
+    data_seg_index = 0;
+    packet_set_output_hook(link_hook);
+
+    assert(tcp_send_data(client, data, sizeof(data)) == 0);
+    link_flush();
+    assert(server->recv_buf_used == sizeof(data));
+    assert(client->conn->retrans_segs == 1);
+    assert(client->conn->retrans_queue == NULL);
+
+    packet_set_output_hook(NULL);
+    mysocket_cleanup();
+
+    printf("✓ 快速重传测试通过\n\n");
+}
+
+/**
+ * 空洞填上时接收缓冲区装不下乱序队列中的段：剩余部分已被SACK，
+ * 对端不会重传，必须留在乱序队列里，应用读取后继续交付
+ */
+void test_ooo_drain_full() {
+    printf("测试乱序数据在接收缓冲区满时的交付...\n");
+
+    assert(mysocket_init() == 0);
+
+    int cfd, sfd;
+    make_connection(9119, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+    struct mysocket *server = socket_find_by_fd(sfd);
+
+    char data[3 * TCP_DEFAULT_MSS];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)('a' + i % 26);
+    }
+
+    /* 丢第2段，第3段进入乱序队列并被SACK */
+    drop_mask = (1 << 1);
+    data_seg_index = 0;
+    packet_set_output_hook(link_hook);
+
+    assert(tcp_send_data(client, data, sizeof(data)) == 0);
+    link_flush();
+    assert(server->recv_buf_used == TCP_DEFAULT_MSS);
+    assert(server->conn->ooo_queue != NULL);
+    assert(client->conn->scoreboard.count == 1);
+
+    /* 超出通告窗口右边界的乱序段丢弃 */
+    struct connection_cb *scb = server->conn;
+    uint32_t edge = scb->rcv_wup + scb->rcv_wnd;
+    static char payload[2000];
+    struct packet *pkt = packet_alloc(sizeof(payload));
+    memcpy(packet_put(pkt, 100), payload, 100);
+    pkt->tcp_hdr.seq_num = mysocket_htonl(edge - 50);
+    assert(tcp_ooo_queue_insert(scb, pkt) < 0);
+    packet_destroy(pkt);
+
+    /* 接收缓冲区只够再放第2段和第3段的一部分 */
+    size_t partial = 500;
+    assert(socket_buffer_resize(server, 0, 2 * TCP_DEFAULT_MSS + partial) == 0);
+
+    /* 乱序队列不超过接收缓冲区大小 */
+    pkt = packet_alloc(sizeof(payload));
+    memcpy(packet_put(pkt, sizeof(payload)), payload, sizeof(payload));
+    pkt->tcp_hdr.seq_num = mysocket_htonl(scb->rcv_nxt + 2 * TCP_DEFAULT_MSS);
+    assert(!tcp_seq_after(scb->rcv_nxt + 2 * TCP_DEFAULT_MSS + sizeof(payload), edge));
+    assert(tcp_ooo_queue_insert(scb, pkt) < 0);
+    packet_destroy(pkt);
+    assert(scb->ooo_bytes == TCP_DEFAULT_MSS);
+
+    assert(tcp_fast_retransmit(client) == 1);
+    link_flush();
+    assert(server->recv_buf_used == server->recv_buf_size);
+    assert(server->conn->ooo_queue != NULL);
+    assert(server->conn->ooo_queue->data_len == TCP_DEFAULT_MSS - partial);
+
+    /* 应用读取后剩余部分移入接收缓冲区，不需要对端重传 */
+    char buf[sizeof(data)];
+    size_t received = 0;
+    ssize_t n;
+    while ((n = mysocket_recv(sfd, buf + received, sizeof(buf) - received, 0)) > 0) {
+        received += (size_t)n;
+        link_flush();
+    }
+    assert(received == sizeof(data));
+    assert(memcmp(buf, data, sizeof(data)) == 0);
+    assert(server->conn->ooo_queue == NULL && server->conn->ooo_bytes == 0);
+    assert(client->conn->retrans_queue == NULL);
+    assert(client->conn->retrans_segs == 1);
+    printf("  已SACK的剩余 %zu 字节在读取后交付\n", (size_t)TCP_DEFAULT_MSS - partial);
+
+    packet_set_output_hook(NULL);
+    mysocket_cleanup();
+
+    printf("✓ 乱序数据交付测试通过\n\n");
+}
+
+void test_window_scaling() {
+    printf("测试窗口扩大和流量控制...\n");
+
+    assert(mysocket_init() == 0);
+    fake_now = 1000;
+    tcp_set_clock(fake_clock);
+
+    int cfd, sfd;
+    make_connection(9104, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+    struct mysocket *server = socket_find_by_fd(sfd);
+
+    uint8_t wscale = tcp_compute_wscale(TCP_MAX_RECV_BUFFER_SIZE);
+    assert(wscale > 0);
+    assert(client->conn->wscale_ok && server->conn->wscale_ok);
+    assert(client->conn->snd_wscale == wscale && server->conn->snd_wscale == wscale);
+    printf("  窗口扩大已协商: wscale=%u\n", wscale);
+
+    /* 对端不读取时，发送量受通告窗口限制，剩余数据留在发送缓冲区 */
+    static char data[4 * DEFAULT_RECV_BUFFER_SIZE];
+    memset(data, 'w', sizeof(data));
+    assert(mysocket_send(cfd, data, sizeof(data), 0) == DEFAULT_SEND_BUFFER_SIZE);
+    assert(server->recv_buf_used == DEFAULT_RECV_BUFFER_SIZE);
+    assert(mysocket_send(cfd, data, sizeof(data), 0) == DEFAULT_SEND_BUFFER_SIZE);
+    assert(client->send_buf_used == DEFAULT_SEND_BUFFER_SIZE);
+    assert(tcp_send_window_avail(client) == 0);
+    assert(mysocket_send(cfd, data, sizeof(data), 0) == -1);
+
+    /* 读取后发送窗口更新，积压数据继续发送 */
+    static char sink[DEFAULT_RECV_BUFFER_SIZE];
+    assert(mysocket_recv(sfd, sink, sizeof(sink), 0) == (ssize_t)sizeof(sink));
+    assert(client->send_buf_used == 0);
+    assert(server->recv_buf_used == DEFAULT_RECV_BUFFER_SIZE);
+    printf("  零窗口时数据留在发送缓冲区，窗口更新后继续发送\n");
+
+    /* 持续读取时接收缓冲区按读取速率增长 */
+    size_t received = 0;
+    for (int tick = 0; tick < 20; tick++) {
+        fake_now += 10;
+        while (mysocket_send(cfd, data, sizeof(data), 0) > 0) {
+        }
+        ssize_t n;
+        while ((n = mysocket_recv(sfd, sink, sizeof(sink), 0)) > 0) {
+            received += (size_t)n;
+        }
+    }
+    printf("  接收缓冲区: %zu -> %zu 字节, 接收 %zu 字节\n",
+           (size_t)DEFAULT_RECV_BUFFER_SIZE, server->recv_buf_size, received);
+    assert(server->recv_buf_size > 64 * 1024);
+    assert(server->recv_buf_size <= TCP_MAX_RECV_BUFFER_SIZE);
+    assert(client->conn->snd_wnd > 0xFFFF);
+
+    /* 空闲后不收回已通告的大窗口：先只限制新通告的窗口，对端用掉旧窗口后再收缩 */
+    while (client->send_buf_used > 0 || mysocket_recv(sfd, sink, sizeof(sink), 0) > 0) {
+        mysocket_recv(sfd, sink, sizeof(sink), 0);
+    }
+    struct connection_cb *scb = server->conn;
+    uint32_t edge = scb->rcv_wup + scb->rcv_wnd;
+    uint32_t idle_wnd = edge - scb->rcv_nxt;
+    assert(idle_wnd > DEFAULT_RECV_BUFFER_SIZE);
+    fake_now += TCP_BUFFER_IDLE_MS;
+    size_t rcvbuf = server->recv_buf_size;
+    tcp_shrink_idle_buffers(server);
+    assert(server->recv_buf_size == rcvbuf && scb->rcv_clamp == DEFAULT_RECV_BUFFER_SIZE);
+
+    while (tcp_seq_after(edge, scb->rcv_nxt + DEFAULT_RECV_BUFFER_SIZE)) {
+        assert(mysocket_send(cfd, data, DEFAULT_RECV_BUFFER_SIZE / 2, 0) > 0);
+        while (mysocket_recv(sfd, sink, sizeof(sink), 0) > 0) {
+        }
+        assert(!tcp_seq_after(scb->rcv_wup + scb->rcv_wnd, edge));
+    }
+    fake_now += TCP_BUFFER_IDLE_MS;
+    assert(tcp_shrink_idle_buffers(server) == rcvbuf - DEFAULT_RECV_BUFFER_SIZE);
+    assert(server->recv_buf_size == DEFAULT_RECV_BUFFER_SIZE && scb->rcv_clamp == 0);
+    printf("  空闲时已通告窗口 %u 字节，对端用完后收缩接收缓冲区 %zu -> %d\n",
+           idle_wnd, rcvbuf, DEFAULT_RECV_BUFFER_SIZE);
+
+    tcp_set_clock(NULL);
+    mysocket_cleanup();
+
+    printf("✓ 窗口扩大和流量控制测试通过\n\n");
+}
+
+/**
+ * 批量传输若干个10ms的时间片：发送端写满发送缓冲区，经仿真链路投递后接收端读空
+ */
+static void run_bulk(int cfd, int sfd, int ticks) {
+    static char data[64 * 1024];
+    static char sink[64 * 1024];
+
+    for (int tick = 0; tick < ticks; tick++) {
+        fake_now += 10;
+        while (mysocket_send(cfd, data, sizeof(data), 0) > 0) {
+        }
+        link_flush();
+        while (mysocket_recv(sfd, sink, sizeof(sink), 0) > 0) {
+        }
+    }
+
+    /* 停止写入后把积压的数据传完 */
+    struct mysocket *client = socket_find_by_fd(cfd);
+    while (client->send_buf_used > 0 || client->conn->snd_nxt != client->conn->snd_una) {
+        link_flush();
+        while (mysocket_recv(sfd, sink, sizeof(sink), 0) > 0) {
+        }
+    }
+    link_flush();  /* 最后的窗口更新 */
+}
+
+static size_t tcp_mem_allocated(void) {
+    struct socket_mem_stats stats;
+    socket_mem_get_stats(SOCKET_MEM_TCP, &stats);
+    return stats.allocated;
+}
+
+void test_buffer_autotune() {
+    printf("测试缓冲区自动调整和全局内存限制...\n");
+
+    assert(mysocket_init() == 0);
+    fake_now = 1000;
+    tcp_set_clock(fake_clock);
+
+    size_t saved_mem[3];
+    memcpy(saved_mem, g_tcp_mem, sizeof(saved_mem));
+    g_tcp_mem[0] = 1536 * 1024;
+    g_tcp_mem[1] = 2 * 1024 * 1024;
+    g_tcp_mem[2] = 4 * 1024 * 1024;
+
+    int a_cfd, a_sfd, b_cfd, b_sfd;
+    make_connection(9105, &a_cfd, &a_sfd);
+    make_connection(9106, &b_cfd, &b_sfd);
+    drop_mask = 0;
+    packet_set_output_hook(link_hook);
+    struct mysocket *a_client = socket_find_by_fd(a_cfd);
+    struct mysocket *a_server = socket_find_by_fd(a_sfd);
+    struct mysocket *b_client = socket_find_by_fd(b_cfd);
+    struct mysocket *b_server = socket_find_by_fd(b_sfd);
+
+    /* 批量传输的连接两端缓冲区都增长，但总量不超过压力阈值 */
+    run_bulk(b_cfd, b_sfd, 40);
+    printf("  连接B: 发送缓冲区 %zu, 接收缓冲区 %zu, 总占用 %zu\n",
+           b_client->send_buf_size, b_server->recv_buf_size, tcp_mem_allocated());
+    assert(b_client->send_buf_size > DEFAULT_SEND_BUFFER_SIZE);
+    assert(b_server->recv_buf_size > DEFAULT_RECV_BUFFER_SIZE);
+    assert(tcp_mem_allocated() <= g_tcp_mem[1]);
+
+    /* B空闲后，A增长受限时请求回收：B不被A的线程改动，在自己下一次进入API时收缩 */
+    fake_now += TCP_BUFFER_IDLE_MS;
+    size_t b_sndbuf = b_client->send_buf_size;
+    run_bulk(a_cfd, a_sfd, 20);
+    assert(b_client->send_buf_size == b_sndbuf);
+    assert(b_client->conn->shrink_pending && b_server->conn->shrink_pending);
+    char buf[32];
+    assert(mysocket_recv(b_cfd, buf, sizeof(buf), 0) <= 0);
+    assert(mysocket_recv(b_sfd, buf, sizeof(buf), 0) <= 0);
+    link_flush();
+    assert(b_client->send_buf_size == DEFAULT_SEND_BUFFER_SIZE);
+    assert(b_server->recv_buf_size == DEFAULT_RECV_BUFFER_SIZE);
+
+    /* 回收的内存让A继续增长 */
+    run_bulk(a_cfd, a_sfd, 20);
+    printf("  连接A: 发送缓冲区 %zu, 接收缓冲区 %zu, 总占用 %zu\n",
+           a_client->send_buf_size, a_server->recv_buf_size, tcp_mem_allocated());
+    assert(a_client->send_buf_size > DEFAULT_SEND_BUFFER_SIZE);
+    assert(a_server->recv_buf_size > DEFAULT_RECV_BUFFER_SIZE);
+    assert(tcp_mem_allocated() <= g_tcp_mem[1]);
+
+    /* 收缩后的连接仍然可用 */
+    const char *msg = "still alive";
+    assert(mysocket_send(b_cfd, msg, strlen(msg), 0) == (ssize_t)strlen(msg));
+    link_flush();
+    assert(mysocket_recv(b_sfd, buf, sizeof(buf), 0) == (ssize_t)strlen(msg));
+    assert(memcmp(buf, msg, strlen(msg)) == 0);
+
+    packet_set_output_hook(NULL);
+    memcpy(g_tcp_mem, saved_mem, sizeof(saved_mem));
+    tcp_set_clock(NULL);
+    mysocket_cleanup();
+    assert(tcp_mem_allocated() == 0);
+
+    printf("✓ 缓冲区自动调整和全局内存限制测试通过\n\n");
+}
+
+void test_memory_pressure() {
+    printf("测试全局内存压力状态...\n");
+
+    assert(mysocket_init() == 0);
+
+    /* 每个Socket的默认缓冲区占用16KB */
+    const size_t sock_mem = DEFAULT_SEND_BUFFER_SIZE + DEFAULT_RECV_BUFFER_SIZE;
+    size_t saved_mem[3];
+    memcpy(saved_mem, g_tcp_mem, sizeof(saved_mem));
+    g_tcp_mem[0] = 4 * sock_mem;
+    g_tcp_mem[1] = 6 * sock_mem;
+    g_tcp_mem[2] = 8 * sock_mem;
+    socket_mem_reset_stats();
+
+    int cfd, sfd;
+    make_connection(9107, &cfd, &sfd);
+    struct mysocket *server = socket_find_by_fd(sfd);
+    int late_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(late_fd >= 0);
+    assert(socket_mem_state(SOCKET_MEM_TCP) == SOCKET_MEM_NORMAL);
+
+    /* 超过压力阈值：禁止增长，通告窗口收缩 */
+    int extra[4];
+    for (int i = 0; i < 3; i++) {
+        extra[i] = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        assert(extra[i] >= 0);
+    }
+    assert(socket_mem_state(SOCKET_MEM_TCP) == SOCKET_MEM_PRESSURE);
+    assert(socket_buffer_grow(server, 0, 1024 * 1024) < 0);
+
+    /* 已通告的右边沿不收回，对端按它发出的数据仍在窗口内 */
+    struct connection_cb *scb = server->conn;
+    uint32_t edge = scb->rcv_wup + scb->rcv_wnd;
+    assert(edge - scb->rcv_nxt > TCP_PRESSURE_WINDOW);
+    uint32_t window = (uint32_t)tcp_select_window(server, 0) << scb->rcv_wscale;
+    assert(scb->rcv_nxt + window == edge);
+
+    /* 对端用掉一部分窗口后，新空间只通告到TCP_PRESSURE_WINDOW */
+    static char chunk[4000];
+    char *sink = malloc(sizeof(chunk));
+    assert(mysocket_send(cfd, chunk, sizeof(chunk), 0) == (ssize_t)sizeof(chunk));
+    assert(mysocket_recv(sfd, sink, sizeof(chunk), 0) == (ssize_t)sizeof(chunk));
+    free(sink);
+    window = (uint32_t)tcp_select_window(server, 0) << scb->rcv_wscale;
+    assert(window <= TCP_PRESSURE_WINDOW && !tcp_seq_before(scb->rcv_nxt + window, edge));
+    printf("  压力状态: 拒绝增长，通告窗口 %u 字节\n", window);
+
+    /* 达到上限：拒绝新Socket、新连接和乱序段 */
+    extra[3] = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(extra[3] >= 0);
+    assert(socket_mem_state(SOCKET_MEM_TCP) == SOCKET_MEM_HIGH);
+    assert(mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP) == -1);
+    assert(socket_get_error() == MYSOCKET_ENOMEM);
+
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", 9107);
+    assert(mysocket_connect(late_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == -1);
+
+    char payload[100] = {0};
+    struct packet *pkt = packet_alloc(sizeof(payload));
+    memcpy(packet_put(pkt, sizeof(payload)), payload, sizeof(payload));
+    pkt->tcp_hdr.seq_num = mysocket_htonl(server->conn->rcv_nxt + 1000);
+    assert(tcp_ooo_queue_insert(server->conn, pkt) < 0);
+    packet_destroy(pkt);
+
+    struct socket_mem_stats stats;
+    socket_mem_get_stats(SOCKET_MEM_TCP, &stats);
+    assert(stats.pressure_events == 1);
+    assert(stats.grow_denied >= 1);
+    assert(stats.alloc_failures >= 1);
+    assert(stats.conns_refused == 1);
+    assert(stats.packets_dropped == 1);
+    printf("  上限状态: 分配失败=%llu, 拒绝连接=%llu, 丢包=%llu\n",
+           (unsigned long long)stats.alloc_failures,
+           (unsigned long long)stats.conns_refused,
+           (unsigned long long)stats.packets_dropped);
+
+    /* 降到低水位以下才退出压力状态 */
+    for (int i = 0; i < 4; i++) {
+        mysocket_close(extra[i]);
+    }
+    assert(socket_mem_state(SOCKET_MEM_TCP) == SOCKET_MEM_PRESSURE);
+    mysocket_close(late_fd);
+    assert(socket_mem_state(SOCKET_MEM_TCP) == SOCKET_MEM_NORMAL);
+    assert(socket_buffer_grow(server, 0, 2 * DEFAULT_RECV_BUFFER_SIZE) == 0);
+
+    /* 进入压力状态的记账可能发生在收包或发送途中，只记下回收；下一次API入口请求各连接回收，
+     * 每个连接在自己进入API时收缩自己的缓冲区 */
+    fake_now = server->conn->last_active + TCP_BUFFER_IDLE_MS;
+    tcp_set_clock(fake_clock);
+    for (int i = 0; i < 4 && socket_mem_state(SOCKET_MEM_TCP) == SOCKET_MEM_NORMAL; i++) {
+        extra[i] = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        assert(extra[i] >= 0);
+    }
+    assert(socket_mem_state(SOCKET_MEM_TCP) == SOCKET_MEM_PRESSURE);
+    assert(server->recv_buf_size == 2 * DEFAULT_RECV_BUFFER_SIZE);
+    char buf[16];
+    assert(mysocket_recv(sfd, buf, sizeof(buf), 0) <= 0);
+    assert(server->recv_buf_size == DEFAULT_RECV_BUFFER_SIZE && !server->conn->shrink_pending);
+    assert(socket_find_by_fd(cfd)->conn->shrink_pending);
+    tcp_set_clock(NULL);
+
+    memcpy(g_tcp_mem, saved_mem, sizeof(saved_mem));
+    mysocket_cleanup();
+
+    printf("✓ 全局内存压力状态测试通过\n\n");
+}
+
+void test_packet_pool() {
+    printf("测试数据包缓冲区和对象池...\n");
+
+    assert(mysocket_init() == 0);
+    fake_now = 1000;
+    tcp_set_clock(fake_clock);
+    g_tcp_moderate_rcvbuf = 0;
+    g_tcp_moderate_sndbuf = 0;
+
+    /* 缓冲区预留包头空间，put/push/pull/trim只移动数据边界 */
+    struct packet *pkt = packet_alloc(TCP_DEFAULT_MSS);
+    assert(pkt->data_len == 0 && packet_headroom(pkt) == PACKET_HEADROOM);
+    memset(packet_put(pkt, 1000), 0x5A, 1000);
+    assert(packet_push(pkt, sizeof(struct tcp_header)) == pkt->head + PACKET_HEADROOM - sizeof(struct tcp_header));
+    assert(pkt->data_len == 1000 + sizeof(struct tcp_header));
+    assert(packet_pull(pkt, sizeof(struct tcp_header)) == pkt->head + PACKET_HEADROOM);
+    packet_trim(pkt, 600);
+    assert(pkt->data_len == 600 && packet_tailroom(pkt) == PACKET_INLINE_SIZE - 600);
+    assert(packet_put(pkt, PACKET_INLINE_SIZE) == NULL);
+    assert(packet_pull(pkt, 601) == NULL);
+
+    /* 克隆共享缓冲区：只读，pull不影响原包，最后一个引用释放时才归还 */
+    struct packet *clone = packet_clone(pkt);
+    assert(clone->data == pkt->data && clone->owner == pkt);
+    assert(packet_shared(pkt) && packet_shared(clone) && pkt->dataref == 2);
+    assert(packet_truesize(clone) == packet_truesize(pkt));
+    assert(packet_push(pkt, 20) == NULL && packet_put(clone, 1) == NULL);
+    packet_pull(clone, 100);
+    assert(clone->data_len == 500 && pkt->data_len == 600);
+    packet_destroy(pkt);
+    assert(clone->owner->dataref == 1 && (unsigned char)clone->data[499] == 0x5A);
+
+    /* 复制得到私有缓冲区 */
+    struct packet *copy = packet_copy(clone);
+    assert(!packet_shared(copy) && copy->data != clone->data && copy->data_len == 500);
+    assert(memcmp(copy->data, clone->data, 500) == 0);
+    assert(packet_push(copy, 20) != NULL);
+    packet_destroy(clone);
+    packet_destroy(copy);
+
+    /* 超过对象池数据区的包一次分配，不进入对象池 */
+    pkt = packet_alloc(4 * PACKET_INLINE_SIZE);
+    assert(pkt->pool_class == PACKET_POOL_NONE);
+    assert(packet_put(pkt, 4 * PACKET_INLINE_SIZE) != NULL);
+    packet_destroy(pkt);
+
+    /* 复用的包不带上一次的包头 */
+    pkt = packet_create();
+    assert(pkt->data_len == 0 && pkt->tcp_hdr.seq_num == 0 && pkt->seg_flags == 0);
+    packet_destroy(pkt);
+
+    int cfd, sfd;
+    drop_mask = 0;
+    make_connection(9108, &cfd, &sfd);
+    packet_set_output_hook(link_hook);
+
+    /* 预热后，稳态收发不再分配堆内存 */
+    run_bulk(cfd, sfd, 5);
+    struct packet_pool_stats before, after;
+    packet_pool_get_stats(&before);
+    run_bulk(cfd, sfd, 20);
+    packet_pool_get_stats(&after);
+
+    printf("  稳态: 创建=%llu, 克隆=%llu, 复用=%llu, 堆分配=%llu, 缓存=%zu\n",
+           (unsigned long long)(after.allocs - before.allocs),
+           (unsigned long long)(after.clones - before.clones),
+           (unsigned long long)(after.pool_hits - before.pool_hits),
+           (unsigned long long)(after.heap_allocs - before.heap_allocs),
+           after.cached);
+    assert(after.allocs > before.allocs);
+    assert(after.pool_hits - before.pool_hits == after.allocs - before.allocs);
+    assert(after.heap_allocs == before.heap_allocs);
+    assert(after.clones > before.clones);
+
+    packet_set_output_hook(NULL);
+    tcp_set_clock(NULL);
+    g_tcp_moderate_rcvbuf = 1;
+    g_tcp_moderate_sndbuf = 1;
+    mysocket_cleanup();
+
+    packet_pool_get_stats(&after);
+    assert(after.cached == 0);
+
+    printf("✓ 数据包缓冲区和对象池测试通过\n\n");
+}
+
+void test_header_template() {
+    printf("测试包头模板和校验和...\n");
+
+    /* RFC 1071中的示例：00 01 f2 03 f4 f5 f6 f7，部分和0xddf2，校验和0x220d */
+    uint8_t sample[8] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7 };
+    uint16_t sum = checksum(sample, sizeof(sample));
+    assert(((uint8_t *)&sum)[0] == 0x22 && ((uint8_t *)&sum)[1] == 0x0d);
+
+    assert(mysocket_init() == 0);
+
+    int cfd, sfd;
+    drop_mask = 0;
+    make_connection(9109, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+    struct connection_cb *cb = client->conn;
+
+    assert(cb->hdr_tmpl_valid);
+    assert(cb->hdr_tmpl.tcp_hdr.src_port == client->local_addr.sin_port);
+    assert(cb->hdr_tmpl.tcp_hdr.dst_port == client->peer_addr.sin_port);
+    assert(cb->hdr_tmpl.pseudo_sum == tcp_pseudo_sum(client->local_addr.sin_addr,
+                                                     client->peer_addr.sin_addr, IPPROTO_TCP));
+
+    /* 模板生成的每个段（含对端的ACK）都带有正确的校验和 */
+    static char data[3 * TCP_DEFAULT_MSS + 7];
+    memset(data, 0xA5, sizeof(data));
+    packet_set_output_hook(link_hook);
+    assert(mysocket_send(cfd, data, sizeof(data), 0) == (ssize_t)sizeof(data));
+
+    /* 逐个投递，对端回的ACK也经过检查 */
+    int segments = 0;
+    while (link_head) {
+        struct packet *pkt = link_head;
+        link_head = pkt->next;
+        if (!link_head) link_tail = NULL;
+        pkt->next = NULL;
+
+        assert(pkt->ip_hdr.version_ihl == 0x45 && pkt->ip_hdr.protocol == IPPROTO_TCP);
+        assert(mysocket_ntohs(pkt->ip_hdr.total_len) ==
+               sizeof(struct ip_header) + sizeof(struct tcp_header) + pkt->data_len);
+        assert(tcp_checksum(&pkt->ip_hdr, &pkt->tcp_hdr, pkt->data, pkt->data_len) == 0);
+        segments++;
+
+        packet_deliver(pkt);
+        packet_destroy(pkt);
+    }
+    assert(segments >= 5);
+    assert(cb->snd_una == cb->snd_nxt);
+    printf("  %d个报文段校验和正确\n", segments);
+
+    packet_set_output_hook(NULL);
+    mysocket_cleanup();
+
+    printf("✓ 包头模板和校验和测试通过\n\n");
+}
+
+/**
+ * 参照实现：逐个16位大端字累加
+ */
+static uint16_t ref_checksum(const uint8_t *data, size_t len) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)(data[i] << 8 | data[i + 1]);
+    }
+    if (len & 1) {
+        sum += (uint32_t)data[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return mysocket_htons((uint16_t)~sum);
+}
+
+void test_checksum_impls() {
+    printf("测试校验和实现和增量更新...\n");
+
+    static uint8_t buf[9000 + 8];
+    const char *impls[] = { "scalar", "sse2", "avx2" };
+    uint32_t seed = 1;
+
+    for (int k = 0; k < 3; k++) {
+        if (checksum_select_impl(impls[k]) < 0) {
+            printf("  %s: CPU不支持，跳过\n", impls[k]);
+            continue;
+        }
+
+        for (int round = 0; round < 2; round++) {
+            for (size_t i = 0; i < sizeof(buf); i++) {
+                seed = seed * 1103515245u + 12345u;
+                buf[i] = round ? 0xFF : (uint8_t)(seed >> 16);  /* 第二轮全1，检查进位 */
+            }
+
+            size_t lens[] = { 0, 1, 2, 3, 15, 16, 17, 31, 33, 63, 64, 127, 129, 255,
+                              TCP_DEFAULT_MSS, 4095, 9000 };
+            for (size_t j = 0; j < sizeof(lens) / sizeof(lens[0]); j++) {
+                for (size_t offset = 0; offset < 4; offset++) {
+                    assert(checksum(buf + offset, lens[j]) == ref_checksum(buf + offset, lens[j]));
+
+                    /* 融合复制：结果与单独计算相同，数据原样复制 */
+                    static uint8_t copy[sizeof(buf)];
+                    memset(copy, 0, sizeof(copy));
+                    uint32_t sum = checksum_copy(copy + 3 - offset, buf + offset, lens[j], 0);
+                    assert(checksum_fold(sum) == ref_checksum(buf + offset, lens[j]));
+                    assert(memcmp(copy + 3 - offset, buf + offset, lens[j]) == 0);
+                }
+            }
+        }
+        printf("  %s: 与参照实现一致\n", checksum_impl_name());
+    }
+    checksum_select_impl(NULL);
+
+    /* 修改确认号和窗口后增量更新，与重新计算的结果相同 */
+    struct ip_header ip_hdr;
+    struct tcp_header tcp_hdr;
+    memset(&ip_hdr, 0, sizeof(ip_hdr));
+    memset(&tcp_hdr, 0, sizeof(tcp_hdr));
+    ip_hdr.src_addr = mysocket_inet_addr("10.0.0.1");
+    ip_hdr.dst_addr = mysocket_inet_addr("10.0.0.2");
+    ip_hdr.protocol = IPPROTO_TCP;
+    tcp_hdr.src_port = mysocket_htons(1234);
+    tcp_hdr.dst_port = mysocket_htons(80);
+    tcp_hdr.seq_num = mysocket_htonl(0x12345678);
+    tcp_hdr.ack_num = mysocket_htonl(0xFFFF0000);
+    tcp_hdr.flags = TCP_FLAG_ACK;
+    tcp_hdr.window = mysocket_htons(0xFFFF);
+    tcp_hdr.checksum = tcp_checksum(&ip_hdr, &tcp_hdr, buf, 100);
+
+    for (int i = 0; i < 1000; i++) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t ack = mysocket_htonl(seed);
+        uint16_t window = mysocket_htons((uint16_t)(seed >> 7));
+
+        uint16_t check = checksum_update32(tcp_hdr.checksum, tcp_hdr.ack_num, ack);
+        check = checksum_update16(check, tcp_hdr.window, window);
+        tcp_hdr.ack_num = ack;
+        tcp_hdr.window = window;
+        tcp_hdr.checksum = 0;
+        assert(check == tcp_checksum(&ip_hdr, &tcp_hdr, buf, 100));
+        tcp_hdr.checksum = check;
+        assert(tcp_checksum(&ip_hdr, &tcp_hdr, buf, 100) == 0);
+    }
+    printf("  增量更新与完整计算一致\n");
+
+    printf("✓ 校验和实现和增量更新测试通过\n\n");
+}
+
+void test_checksum_offload() {
+    printf("测试接收校验和校验和卸载...\n");
+
+    assert(mysocket_init() == 0);
+    fake_now = 1000;
+    tcp_set_clock(fake_clock);
+    g_tcp_checksum_verify = 1;
+
+    int cfd, sfd;
+    drop_mask = 0;
+    make_connection(9110, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+    struct mysocket *server = socket_find_by_fd(sfd);
+    packet_set_output_hook(link_hook);
+
+    /* 链路上损坏一个数据段（换成私有副本再改，不影响重传队列中的原段） */
+    static char data[2 * TCP_DEFAULT_MSS];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)(i * 7);
+    }
+    assert(mysocket_send(cfd, data, sizeof(data), 0) == (ssize_t)sizeof(data));
+    assert(link_head && link_head->data_len == TCP_DEFAULT_MSS);
+    struct packet *bad = packet_copy(link_head);
+    bad->next = link_head->next;
+    packet_destroy(link_head);
+    link_head = bad;
+    if (!bad->next) link_tail = bad;
+    bad->data[100] ^= 0x01;
+
+    link_flush();
+    assert(server->conn->csum_errors == 1);
+    assert(server->recv_buf_used == 0);
+
+    /* 超时重传后数据完整到达 */
+    fake_now += client->conn->rto_ms + 1;
+    tcp_retransmit_timer(client);
+    link_flush();
+    assert(server->recv_buf_used == sizeof(data));
+    assert(memcmp(server->recv_buffer, data, sizeof(data)) == 0);
+    assert(client->conn->snd_una == client->conn->snd_nxt);
+    printf("  损坏的段被丢弃，重传后数据完整\n");
+
+    /* 卸载：发送端不计算校验和，接收端信任本地回环 */
+    g_tcp_checksum_offload = 1;
+    char sink[sizeof(data)];
+    assert(mysocket_recv(sfd, sink, sizeof(sink), 0) == (ssize_t)sizeof(data));
+    link_flush();
+    assert(mysocket_send(cfd, data, sizeof(data), 0) == (ssize_t)sizeof(data));
+    for (struct packet *pkt = link_head; pkt; pkt = pkt->next) {
+        assert(pkt->ip_summed == PACKET_CSUM_PARTIAL && pkt->tcp_hdr.checksum == 0);
+    }
+    link_flush();
+    assert(server->conn->csum_errors == 1);
+    assert(mysocket_recv(sfd, sink, sizeof(sink), 0) == (ssize_t)sizeof(data));
+    assert(memcmp(sink, data, sizeof(data)) == 0);
+    printf("  卸载模式下跳过校验和计算和校验\n");
+
+    packet_set_output_hook(NULL);
+    tcp_set_clock(NULL);
+    g_tcp_checksum_offload = 0;
+    g_tcp_checksum_verify = 0;
+    mysocket_cleanup();
+
+    printf("✓ 接收校验和校验和卸载测试通过\n\n");
+}
+
+/* 经过线格式往返的帧统计 */
+static int wire_frames = 0;
+static int wire_syn_opts = 0;
+static int wire_sack_opts = 0;
+
+/**
+ * 序列化后再解析成新包，检查线上的TCP校验和按标准算法正确、
+ * 转换回来的内存形式校验和与原包一致
+ */
+static struct packet* wire_roundtrip(const struct packet *pkt) {
+    static uint8_t frame[PACKET_WIRE_MAX_HDR + 65536];
+    ssize_t len = packet_serialize(pkt, frame, sizeof(frame));
+    assert(len > 0 && (size_t)len == packet_wire_len(pkt));
+
+    struct packet_wire_info info;
+    assert(packet_parse(frame, (size_t)len, &info) == 0);
+    assert(info.protocol == IPPROTO_TCP && info.payload_len == pkt->data_len);
+    assert(info.payload == frame + IP_WIRE_HDR_LEN + info.l4_hlen);
+    assert(info.src_port == pkt->tcp_hdr.src_port && info.dst_port == pkt->tcp_hdr.dst_port);
+
+    size_t tcp_len = (size_t)len - IP_WIRE_HDR_LEN;
+    uint32_t pseudo = tcp_pseudo_sum(info.src_addr, info.dst_addr, IPPROTO_TCP);
+    assert(checksum_fold(checksum_partial(info.l4, tcp_len, pseudo + mysocket_htons((uint16_t)tcp_len))) == 0);
+
+    struct packet *copy = packet_from_wire(&info);
+    assert(copy != NULL);
+    assert(memcmp(copy->data, pkt->data, pkt->data_len) == 0);
+    assert(copy->tcp_hdr.flags == pkt->tcp_hdr.flags);
+    assert(copy->tcp_opt.num_sacks == pkt->tcp_opt.num_sacks);
+    if (pkt->ip_summed != PACKET_CSUM_PARTIAL) {
+        assert(copy->tcp_hdr.checksum == pkt->tcp_hdr.checksum);
+    }
+
+    wire_frames++;
+    if (info.tcp_opt.sack_permitted && info.tcp_opt.wscale_ok) wire_syn_opts++;
+    if (info.tcp_opt.num_sacks > 0) wire_sack_opts++;
+    return copy;
+}
+
+static int wire_direct_hook(struct packet *pkt) {
+    struct packet *copy = wire_roundtrip(pkt);
+    int result = packet_deliver(copy);
+    packet_destroy(copy);
+    return result;
+}
+
+static int wire_link_hook(struct packet *pkt) {
+    struct packet *copy = wire_roundtrip(pkt);
+    int result = link_hook(copy);
+    packet_destroy(copy);
+    return result;
+}
+
+void test_packet_wire() {
+    printf("测试线格式序列化和解析...\n");
+
+    assert(mysocket_init() == 0);
+    fake_now = 1000;
+    tcp_set_clock(fake_clock);
+    g_tcp_checksum_verify = 1;
+    wire_frames = wire_syn_opts = wire_sack_opts = 0;
+
+    /* 握手和有丢包的传输全部经过线格式 */
+    int cfd, sfd;
+    packet_set_output_hook(wire_direct_hook);
+    make_connection(9111, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+    struct mysocket *server = socket_find_by_fd(sfd);
+    assert(client->conn->sack_ok && client->conn->wscale_ok);
+    assert(wire_syn_opts == 2);
+
+    char data[TEST_SEGMENTS * TCP_DEFAULT_MSS];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)(i * 13 + 1);
+    }
+    drop_mask = (1 << 1) | (1 << 3);
+    data_seg_index = 0;
+    packet_set_output_hook(wire_link_hook);
+    assert(tcp_send_data(client, data, sizeof(data)) == 0);
+    link_flush();
+    assert(wire_sack_opts > 0);
+
+    drop_mask = 0;
+    fake_now += TCP_RTO_INIT_MS;
+    assert(tcp_retransmit_timer(client) > 0);
+    link_flush();
+    assert(server->recv_buf_used == sizeof(data));
+    assert(memcmp(server->recv_buffer, data, sizeof(data)) == 0);
+    assert(server->conn->csum_errors == 0);
+
+    /* 卸载的包在序列化时填写校验和 */
+    g_tcp_checksum_offload = 1;
+    assert(tcp_send_data(client, data, 100) == 0);
+    link_flush();
+    assert(server->recv_buf_used == sizeof(data) + 100);
+    assert(server->conn->csum_errors == 0);
+    g_tcp_checksum_offload = 0;
+    printf("  %d个帧经过线格式往返，SYN选项和SACK块保持不变\n", wire_frames);
+
+    packet_set_output_hook(NULL);
+    tcp_set_clock(NULL);
+    g_tcp_checksum_verify = 0;
+
+    /* 构造一个带SACK的报文段，检查各种不合法的帧被拒绝 */
+    struct packet *pkt = packet_alloc(64);
+    memset(packet_put(pkt, 64), 'x', 64);
+    pkt->ip_hdr.protocol = IPPROTO_TCP;
+    pkt->ip_hdr.src_addr = mysocket_htonl(0x0A000001);
+    pkt->ip_hdr.dst_addr = mysocket_htonl(0x0A000002);
+    pkt->tcp_hdr.src_port = mysocket_htons(1234);
+    pkt->tcp_hdr.dst_port = mysocket_htons(80);
+    pkt->tcp_hdr.flags = TCP_FLAG_ACK | TCP_FLAG_PSH;
+    pkt->tcp_opt.num_sacks = 1;
+    pkt->tcp_opt.sacks[0].start_seq = 1000;
+    pkt->tcp_opt.sacks[0].end_seq = 2000;
+
+    uint8_t good[256], bad[256];
+    ssize_t len = packet_serialize(pkt, good, sizeof(good));
+    assert(len == IP_WIRE_HDR_LEN + TCP_WIRE_HDR_LEN + 12 + 64);
+    assert(packet_serialize(pkt, good, (size_t)len - 1) == -1);
+
+    struct packet_wire_info info;
+    assert(packet_parse(good, (size_t)len, &info) == 0);
+    assert(info.tcp_opt.sacks[0].start_seq == 1000 && info.tcp_opt.sacks[0].end_seq == 2000);
+    assert(packet_parse(good, (size_t)len + 10, &info) == 0 && info.payload_len == 64);
+    assert(packet_parse(good, (size_t)len - 1, &info) == -1);          /* 截断 */
+    assert(packet_parse(good, IP_WIRE_HDR_LEN - 1, &info) == -1);
+
+    uint8_t *th = bad + IP_WIRE_HDR_LEN;
+#define CORRUPT(stmt) do { memcpy(bad, good, (size_t)len); stmt; \
+                           assert(packet_parse(bad, (size_t)len, &info) == -1); } while (0)
+    CORRUPT(bad[0] = 0x65);                                 /* 版本 */
+    CORRUPT(bad[0] = 0x44);                                 /* IP头长度 */
+    CORRUPT(bad[8]--);                                      /* IP头校验和 */
+    CORRUPT(th[12] = 0xF0);                                 /* 数据偏移超出报文 */
+    CORRUPT(th[12] = 0x40);                                 /* 数据偏移小于20 */
+    CORRUPT(th[TCP_WIRE_HDR_LEN + 3] = 40);                 /* 选项长度越界 */
+    CORRUPT(th[TCP_WIRE_HDR_LEN + 3] = 9);                  /* SACK长度不是8的倍数 */
+    CORRUPT(th[13] = TCP_FLAG_SYN | TCP_FLAG_FIN);
+    CORRUPT(th[13] = TCP_FLAG_FIN);
+    CORRUPT(th[13] = 0);
+#undef CORRUPT
+    packet_destroy(pkt);
+
+    /* UDP数据报 */
+    struct mysocket_addr_in src = mysocket_make_addr("10.0.0.1", 5000);
+    struct mysocket_addr_in dst = mysocket_make_addr("10.0.0.2", 53);
+    const char *msg = "udp payload";
+    len = packet_serialize_udp(good, sizeof(good), &src, &dst, msg, strlen(msg));
+    assert(len == (ssize_t)(IP_WIRE_HDR_LEN + UDP_WIRE_HDR_LEN + strlen(msg)));
+    assert(packet_parse(good, (size_t)len, &info) == 0);
+    assert(info.protocol == IPPROTO_UDP && info.src_port == src.sin_port && info.dst_port == dst.sin_port);
+    assert(info.payload_len == strlen(msg) && memcmp(info.payload, msg, strlen(msg)) == 0);
+    size_t udp_len = (size_t)len - IP_WIRE_HDR_LEN;
+    uint32_t pseudo = tcp_pseudo_sum(src.sin_addr, dst.sin_addr, IPPROTO_UDP);
+    assert(checksum_fold(checksum_partial(info.l4, udp_len, pseudo + mysocket_htons((uint16_t)udp_len))) == 0);
+    assert(packet_from_wire(&info) == NULL);
+    printf("  不合法的帧被拒绝，UDP数据报往返正确\n");
+
+    mysocket_cleanup();
+
+    printf("✓ 线格式序列化和解析测试通过\n\n");
+}
+
+/* 接收环并发测试：每个生产者按顺序放入带编号的包 */
+#define RING_PRODUCERS      4
+#define RING_PER_PRODUCER   50000
+
+struct ring_producer {
+    struct packet_ring *ring;
+    uint32_t id;
+};
+
+static void* ring_producer_main(void *arg) {
+    struct ring_producer *p = arg;
+
+    for (uint32_t i = 0; i < RING_PER_PRODUCER; i++) {
+        struct packet *pkt = packet_alloc(0);
+        assert(pkt != NULL);
+        pkt->seq = i;
+        pkt->end_seq = p->id;
+        while (packet_ring_enqueue(p->ring, pkt) < 0) {
+            sched_yield();  /* 环满，等消费者取走 */
+        }
+    }
+
+    return NULL;
+}
+
+/* 异步投递的服务端线程：accept后收满数据 */
+struct rx_server {
+    int listen_fd;
+    const char *expect;
+    size_t len;
+    int ok;
+    int done;
+};
+
+/* 异步投递的发送方线程：不停地向一个反复关闭、重建的Socket投递 */
+struct rx_blaster {
+    struct mysocket_addr_in dst;
+    int stop;
+    uint64_t sent;
+};
+
+static void* rx_blaster_main(void *arg) {
+    struct rx_blaster *b = arg;
+    struct packet *pkt = packet_alloc(0);
+    assert(pkt != NULL);
+    pkt->ip_hdr.protocol = IPPROTO_TCP;
+    pkt->ip_hdr.src_addr = mysocket_inet_addr("127.0.0.1");
+    pkt->ip_hdr.dst_addr = b->dst.sin_addr;
+    pkt->tcp_hdr.src_port = mysocket_htons(40000);
+    pkt->tcp_hdr.dst_port = b->dst.sin_port;
+
+    while (!__atomic_load_n(&b->stop, __ATOMIC_ACQUIRE)) {
+        if (packet_deliver(pkt) == 0) {
+            b->sent++;
+        }
+    }
+
+    packet_destroy(pkt);
+    return NULL;
+}
+
+static void* rx_server_main(void *arg) {
+    struct rx_server *srv = arg;
+    int fd;
+
+    while ((fd = mysocket_accept(srv->listen_fd, NULL, NULL)) < 0) {
+        sched_yield();  /* 等待握手完成 */
+    }
+
+    static char buf[256 * 1024];
+    size_t got = 0;
+    while (got < srv->len) {
+        ssize_t n = mysocket_recv(fd, buf + got, srv->len - got, 0);
+        if (n > 0) {
+            got += (size_t)n;
+        } else {
+            sched_yield();
+        }
+    }
+
+    srv->ok = (memcmp(buf, srv->expect, srv->len) == 0);
+    __atomic_store_n(&srv->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void test_rx_queue() {
+    printf("测试接收环和异步投递...\n");
+
+    /* 多生产者并发放入，单消费者按每个生产者的顺序取出 */
+    struct packet_ring *ring = packet_ring_create();
+    assert(ring != NULL);
+    assert(packet_ring_dequeue(ring) == NULL);
+
+    pthread_t threads[RING_PRODUCERS];
+    struct ring_producer producers[RING_PRODUCERS];
+    for (uint32_t i = 0; i < RING_PRODUCERS; i++) {
+        producers[i].ring = ring;
+        producers[i].id = i;
+        assert(pthread_create(&threads[i], NULL, ring_producer_main, &producers[i]) == 0);
+    }
+
+    uint32_t next[RING_PRODUCERS] = { 0 };
+    size_t received = 0;
+    while (received < (size_t)RING_PRODUCERS * RING_PER_PRODUCER) {
+        struct packet *pkt = packet_ring_dequeue(ring);
+        if (!pkt) {
+            sched_yield();
+            continue;
+        }
+        assert(pkt->end_seq < RING_PRODUCERS);
+        assert(pkt->seq == next[pkt->end_seq]);
+        next[pkt->end_seq]++;
+        packet_destroy(pkt);
+        received++;
+    }
+    for (int i = 0; i < RING_PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(packet_ring_dequeue(ring) == NULL);
+    packet_ring_destroy(ring);
+    printf("  %d个生产者的%zu个包按各自顺序取出\n", RING_PRODUCERS, received);
+
+    /* 环满时丢包并计数 */
+    assert(mysocket_init() == 0);
+    int fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket *sock = socket_find_by_fd(fd);
+    struct packet *pkt = packet_alloc(0);
+    for (int i = 0; i < PACKET_RX_RING_SIZE; i++) {
+        assert(socket_rx_enqueue(sock, pkt) == 0);
+    }
+    assert(socket_rx_enqueue(sock, pkt) == -1);
+    assert(sock->rx_ring->drops == 1);
+    packet_destroy(pkt);
+    mysocket_cleanup();  /* 销毁时释放环中未处理的包 */
+
+    /* 客户端和服务端在各自线程中处理自己的包 */
+    assert(mysocket_init() == 0);
+    g_packet_rx_queue = 1;
+
+    static char data[256 * 1024];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)(i * 31 + 5);
+    }
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", 9112);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 4) == 0);
+
+    /* 没有握手包时accept不再模拟连接 */
+    assert(mysocket_accept(listen_fd, NULL, NULL) == -1);
+
+    struct rx_server srv = { listen_fd, data, sizeof(data), 0, 0 };
+    pthread_t server_thread;
+    assert(pthread_create(&server_thread, NULL, rx_server_main, &srv) == 0);
+
+    int cfd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(mysocket_connect(cfd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+
+    size_t sent = 0;
+    while (sent < sizeof(data)) {
+        ssize_t n = mysocket_send(cfd, data + sent, sizeof(data) - sent, 0);
+        if (n > 0) {
+            sent += (size_t)n;
+        } else {
+            sched_yield();
+        }
+    }
+
+    /* 异步模式的约定：所有者线程持续轮询自己的Socket。发送缓冲区中可能还有等窗口的数据，
+     * 打开窗口的ACK只由本线程处理，服务端收完之前本线程的事件循环继续推进客户端 */
+    struct mysocket *client = socket_find_by_fd(cfd);
+    while (!__atomic_load_n(&srv.done, __ATOMIC_ACQUIRE)) {
+        socket_rx_process(client);
+        tcp_retransmit_timer(client);
+        sched_yield();
+    }
+    pthread_join(server_thread, NULL);
+    assert(srv.ok);
+
+    while (client->conn->snd_una != client->conn->snd_nxt) {
+        socket_rx_process(client);
+        sched_yield();
+    }
+    printf("  异步投递传输%zu字节，接收端线程处理协议\n", sizeof(data));
+
+    /* 关闭与投递并发：关闭方先摘链，等正在投递的线程退出后才释放接收环 */
+    struct rx_blaster blaster = { mysocket_make_addr("127.0.0.1", 9113), 0, 0 };
+    pthread_t blaster_thread;
+    assert(pthread_create(&blaster_thread, NULL, rx_blaster_main, &blaster) == 0);
+    for (int i = 0; i < 2000; i++) {
+        int victim = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        assert(mysocket_bind(victim, (struct mysocket_addr*)&blaster.dst, sizeof(blaster.dst)) == 0);
+        sched_yield();
+        assert(mysocket_close(victim) == 0);
+    }
+    __atomic_store_n(&blaster.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(blaster_thread, NULL);
+    printf("  关闭期间投递%llu个包\n", (unsigned long long)blaster.sent);
+
+    g_packet_rx_queue = 0;
+    mysocket_cleanup();
+
+    printf("✓ 接收环和异步投递测试通过\n\n");
+}
+
+void test_tx_batch() {
+    printf("测试批量发送队列...\n");
+
+    assert(mysocket_init() == 0);
+
+    int cfd, sfd;
+    make_connection(9113, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+    struct mysocket *server = socket_find_by_fd(sfd);
+
+    static char data[40 * TCP_DEFAULT_MSS];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)(i * 17 + 3);
+    }
+
+    /* 40个段分两批交给链路：攒满32个时刷新一次，发送结束时再刷新一次 */
+    struct packet_tx_stats before, after;
+    packet_set_output_hook(link_hook);
+    packet_tx_get_stats(&before);
+    assert(tcp_send_data(client, data, sizeof(data)) == 0);
+    packet_tx_get_stats(&after);
+    assert(after.batches - before.batches == 2);
+    assert(after.packets - before.packets == 40);
+
+    int queued = 0;
+    while (link_head) {
+        struct packet *pkt = link_head;
+        link_head = pkt->next;
+        packet_destroy(pkt);
+        queued++;
+    }
+    link_tail = NULL;
+    assert(queued == 40);
+
+    /* 区间之外的包立即发送，不经过发送队列 */
+    packet_tx_get_stats(&before);
+    assert(tcp_send_ack(client) == 0);
+    packet_tx_get_stats(&after);
+    assert(after.packets == before.packets);
+    assert(link_head != NULL && link_head->next == NULL);
+    packet_destroy(link_head);
+    link_head = link_tail = NULL;
+    packet_set_output_hook(NULL);
+    mysocket_cleanup();
+
+    /* 直接投递：同一批中发往同一连接的包只查找一次目标 */
+    assert(mysocket_init() == 0);
+    make_connection(9114, &cfd, &sfd);
+    client = socket_find_by_fd(cfd);
+    server = socket_find_by_fd(sfd);
+    assert(socket_buffer_resize(server, 0, sizeof(data)) == 0);
+
+    struct netdev_stats dev_before, dev_after;
+    packet_tx_get_stats(&before);
+    netdev_get_stats(NULL, &dev_before);
+    assert(tcp_send_data(client, data, sizeof(data)) == 0);
+    packet_tx_get_stats(&after);
+    netdev_get_stats(NULL, &dev_after);
+    assert(server->recv_buf_used == sizeof(data));
+    assert(memcmp(server->recv_buffer, data, sizeof(data)) == 0);
+    assert(client->conn->snd_una == client->conn->snd_nxt);
+
+    uint64_t packets = after.packets - before.packets;
+    uint64_t hits = dev_after.lookup_hits - dev_before.lookup_hits;
+    printf("  %llu个包（含对端ACK）分%llu批发送，复用查找%llu次\n",
+           (unsigned long long)packets, (unsigned long long)(after.batches - before.batches),
+           (unsigned long long)hits);
+    assert(hits + (after.batches - before.batches) >= packets);
+    assert(dev_after.tx_packets - dev_before.tx_packets == packets);
+
+    mysocket_cleanup();
+
+    printf("✓ 批量发送队列测试通过\n\n");
+}
+
+void test_netdev() {
+    printf("测试虚拟网卡和pcap驱动...\n");
+
+    assert(mysocket_init() == 0);
+
+    /* 默认使用内置回环设备 */
+    struct netdev *lo = netdev_get_default();
+    assert(lo->ops == &netdev_loopback_ops);
+    assert(lo->features & NETDEV_F_HW_CSUM);
+    assert(netdev_open("nosuchdev", NULL) == NULL);
+    assert(netdev_open("pcap", "bogus") == NULL);
+    assert(netdev_open("pcap", "rx=/nonexistent/in.pcap") == NULL);
+
+    int cfd, sfd;
+    make_connection(9115, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+    struct mysocket *server = socket_find_by_fd(sfd);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/mysocket_netdev_%d.pcap", (int)getpid());
+    char arg[80];
+
+    /* 抓包：客户端发出的段写入文件，不到达服务端；卸载的校验和在序列化时填好 */
+    snprintf(arg, sizeof(arg), "tx=%s", path);
+    struct netdev *cap = netdev_open("pcap", arg);
+    assert(cap != NULL);
+    assert(cap->mtu == 1500 && !(cap->features & NETDEV_F_RXCSUM));
+    assert(netdev_set_mtu(cap, 100) == -1);
+    assert(netdev_set_mtu(cap, 576) == 0);
+    netdev_set_default(cap);
+
+    static char data[8000];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)(i * 7 + 1);
+    }
+
+    g_tcp_checksum_offload = 1;
+    assert(tcp_send_data(client, data, sizeof(data)) == 0);
+    g_tcp_checksum_offload = 0;
+
+    /* MTU 576时每段最多576 - 80字节 */
+    size_t mss = 576 - PACKET_WIRE_MAX_HDR;
+    uint64_t segs = (sizeof(data) + mss - 1) / mss;
+    struct netdev_stats stats;
+    netdev_get_stats(cap, &stats);
+    assert(stats.tx_packets == segs && stats.tx_dropped == 0);
+    assert(server->recv_buf_used == 0);
+    printf("  %llu个段写入抓包文件\n", (unsigned long long)segs);
+
+    netdev_close(cap);
+    assert(netdev_get_default() == lo);
+
+    /* 追加一条畸形记录 */
+    FILE *fp = fopen(path, "ab");
+    assert(fp != NULL);
+    uint32_t rec[4] = { 0, 0, 10, 10 };
+    char junk[10] = { 0x45 };
+    assert(fwrite(rec, sizeof(rec), 1, fp) == 1 && fwrite(junk, sizeof(junk), 1, fp) == 1);
+    fclose(fp);
+
+    /* 重放：服务端在recv中轮询设备，收到完整数据并校验线上的校验和 */
+    snprintf(arg, sizeof(arg), "rx=%s", path);
+    struct netdev *replay = netdev_open("pcap", arg);
+    assert(replay != NULL);
+    netdev_set_default(replay);
+    g_tcp_checksum_verify = 1;
+
+    static char buf[8000];
+    assert(mysocket_recv(sfd, buf, sizeof(buf), 0) == (ssize_t)sizeof(buf));
+    assert(memcmp(buf, data, sizeof(data)) == 0);
+    assert(server->conn->csum_errors == 0);
+
+    netdev_get_stats(replay, &stats);
+    assert(stats.rx_packets == segs && stats.rx_dropped == 1);
+    assert(stats.tx_packets >= segs);   /* 服务端的ACK经同一设备发出（没有tx文件时丢弃） */
+    assert(netdev_poll(replay, 64) == 0);
+
+    g_tcp_checksum_verify = 0;
+    netdev_set_default(NULL);
+    netdev_close(replay);
+    remove(path);
+
+    mysocket_cleanup();
+
+    printf("✓ 虚拟网卡和pcap驱动测试通过\n\n");
+}
+
+void test_netdev_udp() {
+    printf("测试UDP封装设备...\n");
+
+    assert(mysocket_init() == 0);
+
+    /* 本地和对端是同一个主机UDP端口：所有包经内核绕一圈再回到本进程 */
+    uint16_t port = (uint16_t)(40000 + getpid() % 20000);
+    char arg[96];
+    snprintf(arg, sizeof(arg), "local=127.0.0.1:%u,remote=127.0.0.1:%u", port, port);
+
+    assert(netdev_open("udp", "local=127.0.0.1:1") == NULL);
+    assert(netdev_open("udp", "local=127.0.0.1,remote=127.0.0.1:1") == NULL);
+
+    struct netdev *dev = netdev_open("udp", arg);
+    assert(dev != NULL);
+    assert(dev->ops->rx_burst != NULL);
+    netdev_set_default(dev);
+    assert(packet_rx_deferred());
+    g_tcp_checksum_offload = 1;
+    g_tcp_checksum_verify = 1;
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", 9116);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 4) == 0);
+
+    /* connect等待经主机UDP往返的SYN-ACK，accept等待最后的ACK */
+    int cfd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(mysocket_connect(cfd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+
+    int sfd = -1;
+    for (int i = 0; i < 10000 && sfd < 0; i++) {
+        sfd = mysocket_accept(listen_fd, NULL, NULL);
+        if (sfd < 0) sched_yield();
+    }
+    assert(sfd >= 0);
+
+    static char data[256 * 1024];
+    static char buf[256 * 1024];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)(i * 29 + 5);
+    }
+
+    size_t sent = 0, received = 0;
+    for (int spins = 0; received < sizeof(data) && spins < 1000000; spins++) {
+        if (sent < sizeof(data)) {
+            ssize_t n = mysocket_send(cfd, data + sent, sizeof(data) - sent, 0);
+            if (n > 0) sent += (size_t)n;
+        }
+        ssize_t n = mysocket_recv(sfd, buf + received, sizeof(buf) - received, 0);
+        if (n > 0) {
+            received += (size_t)n;
+        } else {
+            sched_yield();
+        }
+    }
+    assert(received == sizeof(data));
+    assert(memcmp(buf, data, sizeof(data)) == 0);
+
+    struct mysocket *server = socket_find_by_fd(sfd);
+    assert(server->conn->csum_errors == 0);
+
+    struct netdev_stats stats;
+    netdev_get_stats(dev, &stats);
+    assert(stats.rx_packets > 0 && stats.rx_dropped == 0);
+    printf("  经主机UDP传输%zu字节：发出%llu个包（%llu批），收到%llu个\n", sizeof(data),
+           (unsigned long long)stats.tx_packets, (unsigned long long)stats.tx_bursts,
+           (unsigned long long)stats.rx_packets);
+
+    g_tcp_checksum_offload = 0;
+    g_tcp_checksum_verify = 0;
+    netdev_close(dev);
+    assert(netdev_get_default()->ops == &netdev_loopback_ops);
+    mysocket_cleanup();
+
+    printf("✓ UDP封装设备测试通过\n\n");
+}
+
+#define SHM_TEST_BYTES  (1024 * 1024)
+
+static char shm_pattern(size_t i) {
+    return (char)(i * 13 + 7);
+}
+
+/**
+ * 共享内存测试的服务端进程：映射父进程创建的区域，接收并校验全部数据
+ * @return 0成功，1失败
+ */
+static int shm_server_main(int shm_fd, int ready_fd) {
+    char path[64];
+    snprintf(path, sizeof(path), "attach=/proc/self/fd/%d", shm_fd);
+
+    assert(mysocket_init() == 0);
+    struct netdev *dev = netdev_open("shm", path);
+    if (!dev) return 1;
+    netdev_set_default(dev);
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", 9117);
+    if (mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) < 0 ||
+        mysocket_listen(listen_fd, 1) < 0 || write(ready_fd, "r", 1) != 1) {
+        return 1;
+    }
+
+    int fd;
+    while ((fd = mysocket_accept(listen_fd, NULL, NULL)) < 0) {
+        netdev_wait(NULL, 10);
+    }
+
+    static char buf[64 * 1024];
+    size_t received = 0;
+    while (received < SHM_TEST_BYTES) {
+        ssize_t n = mysocket_recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            netdev_wait(NULL, 10);
+            continue;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] != shm_pattern(received + (size_t)i)) return 1;
+        }
+        received += (size_t)n;
+    }
+
+    /* 继续处理一会儿，让客户端收到最后的ACK */
+    struct mysocket *sock = socket_find_by_fd(fd);
+    for (int i = 0; i < 20; i++) {
+        socket_rx_process(sock);
+        netdev_wait(NULL, 5);
+    }
+
+    netdev_close(dev);
+    mysocket_cleanup();
+    return 0;
+}
+
+void test_netdev_shm() {
+    printf("测试共享内存设备...\n");
+
+    assert(netdev_open("shm", NULL) == NULL);
+    assert(netdev_open("shm", "attach=/nonexistent/shm") == NULL);
+
+    struct netdev *dev = netdev_open("shm", "create");
+    assert(dev != NULL);
+    assert(netdev_shm_fd(dev) >= 0);
+    assert(netdev_shm_fd(netdev_get_default()) == -1);
+
+    int ready[2];
+    assert(pipe(ready) == 0);
+
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(ready[0]);
+        _exit(shm_server_main(netdev_shm_fd(dev), ready[1]));
+    }
+
+    close(ready[1]);
+    char c;
+    assert(read(ready[0], &c, 1) == 1);
+    close(ready[0]);
+
+    assert(mysocket_init() == 0);
+    netdev_set_default(dev);
+
+    int cfd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", 9117);
+    assert(mysocket_connect(cfd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+
+    static char data[SHM_TEST_BYTES];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = shm_pattern(i);
+    }
+
+    size_t sent = 0;
+    while (sent < sizeof(data)) {
+        ssize_t n = mysocket_send(cfd, data + sent, sizeof(data) - sent, 0);
+        if (n > 0) {
+            sent += (size_t)n;
+        } else {
+            netdev_wait(NULL, 1);
+        }
+    }
+
+    struct mysocket *client = socket_find_by_fd(cfd);
+    while (client->send_buf_used > 0 || client->conn->snd_una != client->conn->snd_nxt) {
+        socket_rx_process(client);
+        tcp_retransmit_timer(client);
+        socket_flush_send_buffer(client);
+        netdev_wait(NULL, 1);
+    }
+
+    int status = 0;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    struct netdev_stats stats;
+    netdev_get_stats(dev, &stats);
+    assert(stats.rx_packets > 0 && stats.rx_dropped == 0);
+    printf("  两个进程经共享内存传输%d字节：发出%llu个包，敲门铃%llu次\n", SHM_TEST_BYTES,
+           (unsigned long long)stats.tx_packets, (unsigned long long)stats.doorbells);
+
+    netdev_close(dev);
+    mysocket_cleanup();
+
+    printf("✓ 共享内存设备测试通过\n\n");
+}
+
+void test_kernel_backend() {
+    printf("测试内核直通后端...\n");
+
+    assert(mysocket_init() == 0);
+    g_socket_backend = SOCKET_BACKEND_KERNEL;
+
+    /* TCP：监听、连接、收发，错误码转换 */
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, 0);
+    assert(listen_fd >= 0);
+    assert(socket_find_by_fd(listen_fd)->host_fd >= 0);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", 39510);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 4) == 0);
+    assert(mysocket_get_socket_state(listen_fd) == SS_LISTENING);
+
+    int dup_fd = mysocket_socket(AF_INET, SOCK_STREAM, 0);
+    assert(mysocket_bind(dup_fd, (struct mysocket_addr*)&addr, sizeof(addr)) < 0);
+    assert(socket_get_error() == MYSOCKET_EADDRINUSE);
+    struct mysocket_addr_in closed = mysocket_make_addr("127.0.0.1", 39511);
+    assert(mysocket_connect(dup_fd, (struct mysocket_addr*)&closed, sizeof(closed)) < 0);
+    assert(socket_get_error() == MYSOCKET_ECONNREFUSED);
+    assert(mysocket_close(dup_fd) == 0);
+
+    int cfd = mysocket_socket(AF_INET, SOCK_STREAM, 0);
+    assert(mysocket_connect(cfd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    struct mysocket_addr_in peer;
+    socklen_t peer_len = sizeof(peer);
+    int sfd = mysocket_accept(listen_fd, (struct mysocket_addr*)&peer, &peer_len);
+    assert(sfd >= 0 && peer_len == sizeof(peer));
+    assert(peer.sin_family == AF_INET && peer.sin_addr == mysocket_inet_addr("127.0.0.1"));
+
+    char out[4096], in[4096];
+    for (size_t i = 0; i < sizeof(out); i++) {
+        out[i] = (char)(i * 7);
+    }
+    assert(mysocket_send(cfd, out, sizeof(out), 0) == (ssize_t)sizeof(out));
+    size_t got = 0;
+    while (got < sizeof(in)) {
+        ssize_t n = mysocket_recv(sfd, in + got, sizeof(in) - got, 0);
+        assert(n > 0);
+        got += (size_t)n;
+    }
+    assert(memcmp(in, out, sizeof(out)) == 0);
+
+    assert(mysocket_set_nonblocking(sfd) == 0);
+    assert(mysocket_recv(sfd, in, sizeof(in), 0) < 0);
+    assert(socket_get_error() == MYSOCKET_EAGAIN);
+    assert(mysocket_close(cfd) == 0);
+    assert(mysocket_recv(sfd, in, sizeof(in), 0) == 0);
+
+    /* UDP：返回源地址 */
+    int u1 = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    int u2 = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    struct mysocket_addr_in a1 = mysocket_make_addr("127.0.0.1", 39512);
+    struct mysocket_addr_in a2 = mysocket_make_addr("127.0.0.1", 39513);
+    assert(mysocket_bind(u1, (struct mysocket_addr*)&a1, sizeof(a1)) == 0);
+    assert(mysocket_bind(u2, (struct mysocket_addr*)&a2, sizeof(a2)) == 0);
+    assert(mysocket_sendto(u1, "ping", 4, 0, (struct mysocket_addr*)&a2, sizeof(a2)) == 4);
+    struct mysocket_addr_in from;
+    socklen_t from_len = sizeof(from);
+    assert(mysocket_recvfrom(u2, in, sizeof(in), 0, (struct mysocket_addr*)&from, &from_len) == 4);
+    assert(memcmp(in, "ping", 4) == 0 && from.sin_port == a1.sin_port);
+
+    /* AF_UNIX：抽象命名空间的流式套接字 */
+    struct mysocket_addr_un un;
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    int name_len = snprintf(un.sun_path + 1, sizeof(un.sun_path) - 1, "mysocket-test-%d", (int)getpid());
+    socklen_t un_len = (socklen_t)(offsetof(struct mysocket_addr_un, sun_path) + 1 + (size_t)name_len);
+
+    int ul = mysocket_socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(mysocket_bind(ul, (struct mysocket_addr*)&un, un_len) == 0);
+    assert(mysocket_listen(ul, 1) == 0);
+    int uc = mysocket_socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(mysocket_connect(uc, (struct mysocket_addr*)&un, un_len) == 0);
+    int us = mysocket_accept(ul, NULL, NULL);
+    assert(us >= 0);
+    assert(mysocket_send(us, "unix", 4, 0) == 4);
+    assert(mysocket_recv(uc, in, sizeof(in), 0) == 4 && memcmp(in, "unix", 4) == 0);
+
+    /* 切回用户态后新建的Socket使用本项目的协议栈，已有的不受影响 */
+    g_socket_backend = SOCKET_BACKEND_USER;
+    int user_fd = mysocket_socket(AF_INET, SOCK_STREAM, 0);
+    assert(socket_find_by_fd(user_fd)->host_fd == -1);
+    assert(mysocket_send(uc, "more", 4, 0) == 4);
+    assert(mysocket_recv(us, in, sizeof(in), 0) == 4);
+
+    mysocket_cleanup();
+
+    printf("✓ 内核直通后端测试通过\n\n");
+}
+
+/* 填写Unix域地址：name以'@'开头表示抽象命名空间 */
+static socklen_t unix_test_addr(struct mysocket_addr_un *un, const char *name) {
+    memset(un, 0, sizeof(*un));
+    un->sun_family = AF_UNIX;
+    size_t len = strlen(name);
+    memcpy(un->sun_path, name, len);
+    if (name[0] == '@') {
+        un->sun_path[0] = '\0';
+        return (socklen_t)(offsetof(struct mysocket_addr_un, sun_path) + len);
+    }
+    return (socklen_t)sizeof(*un);
+}
+
+void test_unix_sockets() {
+    printf("测试Unix域Socket...\n");
+
+    assert(mysocket_init() == 0);
+    struct mysocket_addr_un un, from;
+    socklen_t from_len;
+    char buf[256];
+
+    assert(mysocket_socket(AF_UNIX, SOCK_RAW, 0) < 0);
+
+    /* 流式：路径名地址，连接后立即可以收发，数据不经过包和校验和 */
+    uint64_t tx_before = netdev_get_default()->stats.tx_packets;
+    socklen_t len = unix_test_addr(&un, "/tmp/mysocket-test.sock");
+    int listen_fd = mysocket_socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(socket_find_by_fd(listen_fd)->conn == NULL);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&un, len) == 0);
+    int dup_fd = mysocket_socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(mysocket_bind(dup_fd, (struct mysocket_addr*)&un, len) < 0);
+    assert(socket_get_error() == MYSOCKET_EADDRINUSE);
+    assert(mysocket_connect(dup_fd, (struct mysocket_addr*)&un, len) < 0);
+    assert(socket_get_error() == MYSOCKET_ECONNREFUSED);
+    assert(mysocket_listen(listen_fd, 2) == 0);
+    assert(mysocket_accept(listen_fd, NULL, NULL) < 0 && socket_get_error() == MYSOCKET_EAGAIN);
+
+    struct mysocket_addr_un client_addr;
+    socklen_t client_len = unix_test_addr(&client_addr, "@client");
+    int cfd = mysocket_socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(mysocket_bind(cfd, (struct mysocket_addr*)&client_addr, client_len) == 0);
+    assert(mysocket_connect(cfd, (struct mysocket_addr*)&un, len) == 0);
+    assert(mysocket_send(cfd, "hello", 5, 0) == 5);
+
+    from_len = sizeof(from);
+    int sfd = mysocket_accept(listen_fd, (struct mysocket_addr*)&from, &from_len);
+    assert(sfd >= 0 && from_len == client_len && memcmp(&from, &client_addr, client_len) == 0);
+    assert(mysocket_recv(sfd, buf, sizeof(buf), 0) == 5 && memcmp(buf, "hello", 5) == 0);
+    assert(mysocket_recv(sfd, buf, sizeof(buf), 0) < 0 && socket_get_error() == MYSOCKET_EAGAIN);
+
+    /* 接收缓冲区满时部分写入，读走后继续 */
+    static char big[256 * 1024];
+    ssize_t first = mysocket_send(sfd, big, sizeof(big), 0);
+    assert(first > 0 && (size_t)first < sizeof(big));
+    assert(mysocket_send(sfd, big, sizeof(big), 0) < 0 && socket_get_error() == MYSOCKET_EAGAIN);
+    size_t drained = 0;
+    ssize_t n;
+    while ((n = mysocket_recv(cfd, big, sizeof(big), 0)) > 0) {
+        drained += (size_t)n;
+    }
+    assert(drained == (size_t)first);
+
+    /* 关闭一端后另一端读到结束，发送失败 */
+    assert(mysocket_close(sfd) == 0);
+    assert(mysocket_recv(cfd, buf, sizeof(buf), 0) == 0);
+    assert(mysocket_send(cfd, "x", 1, 0) < 0 && socket_get_error() == MYSOCKET_ECONNREFUSED);
+
+    /* 关闭监听Socket时未被accept的连接也被关闭，名字可以重新绑定 */
+    int pending = mysocket_socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(mysocket_connect(pending, (struct mysocket_addr*)&un, len) == 0);
+    assert(mysocket_close(listen_fd) == 0);
+    assert(mysocket_recv(pending, buf, sizeof(buf), 0) == 0);
+    assert(mysocket_bind(dup_fd, (struct mysocket_addr*)&un, len) == 0);
+
+    /* 数据报：保留消息边界，返回发送方地址 */
+    struct mysocket_addr_un a1, a2;
+    socklen_t l1 = unix_test_addr(&a1, "@dgram-1");
+    socklen_t l2 = unix_test_addr(&a2, "@dgram-2");
+    int d1 = mysocket_socket(AF_UNIX, SOCK_DGRAM, 0);
+    int d2 = mysocket_socket(AF_UNIX, SOCK_DGRAM, 0);
+    assert(mysocket_bind(d1, (struct mysocket_addr*)&a1, l1) == 0);
+    assert(mysocket_bind(d2, (struct mysocket_addr*)&a2, l2) == 0);
+    assert(mysocket_sendto(d1, "one", 3, 0, (struct mysocket_addr*)&a2, l2) == 3);
+    assert(mysocket_sendto(d1, "second", 6, 0, (struct mysocket_addr*)&a2, l2) == 6);
+
+    from_len = sizeof(from);
+    assert(mysocket_recvfrom(d2, buf, sizeof(buf), 0, (struct mysocket_addr*)&from, &from_len) == 3);
+    assert(memcmp(buf, "one", 3) == 0);
+    assert(from_len == l1 && memcmp(&from, &a1, l1) == 0);
+    assert(mysocket_recvfrom(d2, buf, 3, 0, NULL, NULL) == 3);    /* 截断 */
+    assert(mysocket_recv(d2, buf, sizeof(buf), 0) < 0 && socket_get_error() == MYSOCKET_EAGAIN);
+
+    assert(mysocket_connect(d2, (struct mysocket_addr*)&a1, l1) == 0);
+    assert(mysocket_send(d2, "reply", 5, 0) == 5);
+    assert(mysocket_recv(d1, buf, sizeof(buf), 0) == 5 && memcmp(buf, "reply", 5) == 0);
+
+    struct mysocket_addr_un none;
+    socklen_t none_len = unix_test_addr(&none, "@nobody");
+    assert(mysocket_sendto(d1, "x", 1, 0, (struct mysocket_addr*)&none, none_len) < 0);
+    assert(socket_get_error() == MYSOCKET_ECONNREFUSED);
+
+    assert(netdev_get_default()->stats.tx_packets == tx_before);
+
+    mysocket_cleanup();
+
+    printf("✓ Unix域Socket测试通过\n\n");
+}
+
+void test_socketpair() {
+    printf("测试Socket对...\n");
+
+    assert(mysocket_init() == 0);
+    int sv[2];
+    char buf[64];
+
+    assert(mysocket_socketpair(AF_INET, SOCK_STREAM, 0, sv) < 0 && socket_get_error() == MYSOCKET_EINVAL);
+    assert(mysocket_socketpair(AF_UNIX, SOCK_RAW, 0, sv) < 0);
+
+    /* 流式：创建后立即双向收发，不产生包 */
+    uint64_t tx_before = netdev_get_default()->stats.tx_packets;
+    assert(mysocket_socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    assert(sv[0] != sv[1]);
+    assert(mysocket_send(sv[0], "ping", 4, 0) == 4);
+    assert(mysocket_recv(sv[1], buf, sizeof(buf), 0) == 4 && memcmp(buf, "ping", 4) == 0);
+    assert(mysocket_send(sv[1], "pong", 4, 0) == 4);
+    assert(mysocket_recv(sv[0], buf, sizeof(buf), 0) == 4 && memcmp(buf, "pong", 4) == 0);
+    assert(mysocket_recv(sv[0], buf, sizeof(buf), 0) < 0 && socket_get_error() == MYSOCKET_EAGAIN);
+    assert(mysocket_close(sv[1]) == 0);
+    assert(mysocket_recv(sv[0], buf, sizeof(buf), 0) == 0);
+    assert(mysocket_send(sv[0], "x", 1, 0) < 0 && socket_get_error() == MYSOCKET_ECONNREFUSED);
+    assert(mysocket_close(sv[0]) == 0);
+
+    /* 数据报：没有名字也能收发，保留消息边界，不能改连其他目标 */
+    assert(mysocket_socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == 0);
+    assert(mysocket_send(sv[0], "one", 3, 0) == 3);
+    assert(mysocket_send(sv[0], "two!", 4, 0) == 4);
+    assert(mysocket_recv(sv[1], buf, sizeof(buf), 0) == 3);
+    assert(mysocket_recv(sv[1], buf, sizeof(buf), 0) == 4 && memcmp(buf, "two!", 4) == 0);
+    assert(mysocket_send(sv[1], "back", 4, 0) == 4);
+    assert(mysocket_recv(sv[0], buf, sizeof(buf), 0) == 4);
+    struct mysocket_addr_un other;
+    socklen_t other_len = unix_test_addr(&other, "@elsewhere");
+    assert(mysocket_connect(sv[0], (struct mysocket_addr*)&other, other_len) < 0);
+    assert(mysocket_close(sv[1]) == 0);
+    assert(mysocket_send(sv[0], "x", 1, 0) < 0 && socket_get_error() == MYSOCKET_ECONNREFUSED);
+    assert(netdev_get_default()->stats.tx_packets == tx_before);
+
+    /* 内核直通后端：真实的socketpair */
+    g_socket_backend = SOCKET_BACKEND_KERNEL;
+    assert(mysocket_socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    assert(socket_find_by_fd(sv[0])->host_fd >= 0);
+    assert(mysocket_send(sv[0], "kern", 4, 0) == 4);
+    assert(mysocket_recv(sv[1], buf, sizeof(buf), 0) == 4 && memcmp(buf, "kern", 4) == 0);
+    assert(mysocket_close(sv[0]) == 0);
+    assert(mysocket_recv(sv[1], buf, sizeof(buf), 0) == 0);
+    g_socket_backend = SOCKET_BACKEND_USER;
+
+    mysocket_cleanup();
+
+    printf("✓ Socket对测试通过\n\n");
+}
+
+#define SPLICE_TEST_BYTES   (256 * 1024)
+
+void test_splice() {
+    printf("测试Socket间直接搬运数据...\n");
+
+    assert(mysocket_init() == 0);
+    static char out[SPLICE_TEST_BYTES], in[SPLICE_TEST_BYTES];
+    for (size_t i = 0; i < sizeof(out); i++) {
+        out[i] = (char)(i * 7 + (i >> 9));
+    }
+
+    /* TCP代理：client -> front | 代理 | back -> server */
+    int client, front, back, server;
+    make_connection(9600, &client, &front);
+    make_connection(9601, &back, &server);
+    assert(mysocket_splice(front, back, 1024, 0) < 0 && socket_get_error() == MYSOCKET_EAGAIN);
+    assert(mysocket_splice(front, front, 1024, 0) < 0 && socket_get_error() == MYSOCKET_EINVAL);
+
+    size_t sent = 0, received = 0;
+    int direct_seen = 0;
+    while (received < sizeof(out)) {
+        if (sent < sizeof(out)) {
+            ssize_t n = mysocket_send(client, out + sent, sizeof(out) - sent, 0);
+            if (n > 0) sent += (size_t)n;
+        }
+        ssize_t moved = mysocket_splice(front, back, SPLICE_TEST_BYTES, 0);
+        if (moved > 0 && socket_find_by_fd(back)->send_buf_used == 0) {
+            direct_seen = 1;    /* 窗口内的数据没有经过发送缓冲区 */
+        }
+        ssize_t n = mysocket_recv(server, in + received, sizeof(in) - received, 0);
+        if (n > 0) received += (size_t)n;
+    }
+    assert(memcmp(in, out, sizeof(out)) == 0);
+    assert(direct_seen);
+    printf("  TCP到TCP搬运%d字节，内容一致\n", SPLICE_TEST_BYTES);
+
+    /* Unix域Socket对与TCP之间双向搬运 */
+    int sv[2];
+    assert(mysocket_socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    assert(mysocket_send(sv[0], "to-tcp", 6, 0) == 6);
+    assert(mysocket_splice(sv[1], back, 64, 0) == 6);
+    assert(mysocket_recv(server, in, sizeof(in), 0) == 6 && memcmp(in, "to-tcp", 6) == 0);
+    assert(mysocket_send(client, "to-unix", 7, 0) == 7);
+    assert(mysocket_splice(front, sv[1], 64, 0) == 7);
+    assert(mysocket_recv(sv[0], in, sizeof(in), 0) == 7 && memcmp(in, "to-unix", 7) == 0);
+
+    /* 目标放不下时数据留在源Socket中 */
+    static char big[128 * 1024];
+    size_t prefilled = 0;
+    ssize_t n;
+    while ((n = mysocket_send(sv[1], big, sizeof(big), 0)) > 0) {
+        prefilled += (size_t)n;
+    }
+    ssize_t queued = mysocket_send(client, big, sizeof(big), 0);
+    assert(queued > 0);
+    size_t drained = 0;
+    int sink_full = 0;
+    while (drained < prefilled + (size_t)queued) {
+        ssize_t moved = mysocket_splice(front, sv[1], sizeof(big), 0);
+        if (moved < 0) {
+            assert(socket_get_error() == MYSOCKET_EAGAIN);
+            if (socket_find_by_fd(front)->recv_buf_used > 0) {
+                sink_full = 1;
+            }
+            while ((n = mysocket_recv(sv[0], big, sizeof(big), 0)) > 0) {
+                drained += (size_t)n;
+            }
+        }
+    }
+    assert(sink_full && drained == prefilled + (size_t)queued);
+
+    /* 源Socket的对端关闭后返回0；数据报和内核直通Socket不能作为源 */
+    assert(mysocket_close(sv[0]) == 0);
+    assert(mysocket_splice(sv[1], back, 64, 0) == 0);
+    int dv[2];
+    assert(mysocket_socketpair(AF_UNIX, SOCK_DGRAM, 0, dv) == 0);
+    assert(mysocket_splice(dv[0], back, 64, 0) < 0 && socket_get_error() == MYSOCKET_EINVAL);
+    g_socket_backend = SOCKET_BACKEND_KERNEL;
+    int kv[2];
+    assert(mysocket_socketpair(AF_UNIX, SOCK_STREAM, 0, kv) == 0);
+    g_socket_backend = SOCKET_BACKEND_USER;
+    assert(mysocket_splice(kv[0], back, 64, 0) < 0 && socket_get_error() == MYSOCKET_EINVAL);
+
+    /* 内核直通Socket可以作为目标 */
+    assert(mysocket_send(client, "to-kernel", 9, 0) == 9);
+    assert(mysocket_splice(front, kv[0], 64, 0) == 9);
+    assert(mysocket_recv(kv[1], in, sizeof(in), 0) == 9 && memcmp(in, "to-kernel", 9) == 0);
+
+    /* 发送中途失败：已生成的段留在重传队列里，源Socket移除恰好这么多，不会重复发送 */
+    struct mysocket *back_sock = socket_find_by_fd(back);
+    assert(back_sock->send_buf_used == 0);
+    size_t burst = 3 * TCP_DEFAULT_MSS;
+    assert(mysocket_send(client, out, burst, 0) == (ssize_t)burst);
+    fail_mask = (1 << 1);
+    data_seg_index = 0;
+    packet_set_output_hook(link_hook);
+    assert(mysocket_splice(front, back, burst, 0) == (ssize_t)burst);
+    assert(socket_find_by_fd(front)->recv_buf_used == 0);
+    link_flush();
+    fail_mask = 0;
+    assert(tcp_fast_retransmit(back_sock) == 1);
+    link_flush();
+    packet_set_output_hook(NULL);
+    received = 0;
+    while ((n = mysocket_recv(server, in + received, sizeof(in) - received, 0)) > 0) {
+        received += (size_t)n;
+    }
+    assert(received == burst && memcmp(in, out, burst) == 0);
+    assert(back_sock->conn->retrans_queue == NULL);
+    printf("  发送中途失败时只移除已交给TCP的%zu字节\n", burst);
+
+    mysocket_cleanup();
+
+    printf("✓ Socket间直接搬运数据测试通过\n\n");
+}
+
+#define SENDFILE_TEST_BYTES (300 * 1024 + 123)
+#define SENDFILE_TEST_PATH  "/tmp/mysocket-sendfile-test.dat"
+
+/* 文件是否仍被映射在本进程中 */
+static int file_mapped(const char *path) {
+    FILE *f = fopen("/proc/self/maps", "r");
+    assert(f != NULL);
+    char line[512];
+    int found = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (strstr(line, path)) found = 1;
+    }
+    fclose(f);
+    return found;
+}
+
+void test_sendfile() {
+    printf("测试从文件直接发送...\n");
+
+    assert(mysocket_init() == 0);
+    g_tcp_checksum_verify = 1;
+
+    static char content[SENDFILE_TEST_BYTES], in[SENDFILE_TEST_BYTES];
+    for (size_t i = 0; i < sizeof(content); i++) {
+        content[i] = (char)(i * 13 + (i >> 11));
+    }
+    int fd = open(SENDFILE_TEST_PATH, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    assert(fd >= 0);
+    assert(write(fd, content, sizeof(content)) == (ssize_t)sizeof(content));
+
+    /* 映射和pread两种方式：从非页对齐的偏移发送到文件末尾，内容一致且校验和正确 */
+    for (int use_mmap = 1; use_mmap >= 0; use_mmap--) {
+        g_sendfile_mmap = use_mmap;
+        int cfd, sfd;
+        make_connection((uint16_t)(9610 + use_mmap), &cfd, &sfd);
+        struct mysocket *client = socket_find_by_fd(cfd);
+
+        drop_mask = 0;
+        data_seg_index = 0;
+        packet_set_output_hook(link_hook);
+
+        off_t off = 100;
+        size_t expect = sizeof(content) - 100, received = 0;
+        int ext_segs = 0, copied_segs = 0;
+        while (received < expect) {
+            ssize_t n = mysocket_sendfile(cfd, fd, &off, sizeof(content));
+            if (n > 0 && client->conn->retrans_queue) {
+                /* 链路还没有投递，刚发出的段都在重传队列中 */
+                if (client->conn->retrans_queue->extbuf) {
+                    ext_segs++;
+                } else {
+                    copied_segs++;
+                }
+            }
+            link_flush();
+            ssize_t got;
+            while ((got = mysocket_recv(sfd, in + received, expect - received, 0)) > 0) {
+                received += (size_t)got;
+            }
+            link_flush();
+        }
+        packet_set_output_hook(NULL);
+
+        assert(memcmp(in, content + 100, expect) == 0);
+        assert(off == (off_t)sizeof(content));
+        assert(mysocket_sendfile(cfd, fd, &off, 10) == 0);
+        assert(use_mmap ? (ext_segs > 0 && copied_segs == 0) : (copied_segs > 0 && ext_segs == 0));
+        assert(client->conn->retrans_queue == NULL && !file_mapped(SENDFILE_TEST_PATH));
+        printf("  %s：发送%zu字节，内容一致\n", use_mmap ? "映射文件页" : "pread回退", expect);
+
+        /* offset为NULL时使用并前移文件位置 */
+        assert(lseek(fd, (off_t)sizeof(content) - 10, SEEK_SET) >= 0);
+        assert(mysocket_sendfile(cfd, fd, NULL, 100) == 10);
+        assert(lseek(fd, 0, SEEK_CUR) == (off_t)sizeof(content));
+        assert(mysocket_recv(sfd, in, sizeof(in), 0) == 10);
+        assert(memcmp(in, content + sizeof(content) - 10, 10) == 0);
+    }
+    g_sendfile_mmap = 1;
+
+    /* Unix域Socket对和内核直通Socket */
+    int sv[2];
+    off_t off = 4000;
+    assert(mysocket_socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    assert(mysocket_sendfile(sv[0], fd, &off, 1000) == 1000 && off == 5000);
+    assert(mysocket_recv(sv[1], in, sizeof(in), 0) == 1000 && memcmp(in, content + 4000, 1000) == 0);
+
+    g_socket_backend = SOCKET_BACKEND_KERNEL;
+    assert(mysocket_socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    g_socket_backend = SOCKET_BACKEND_USER;
+    assert(mysocket_sendfile(sv[0], fd, &off, 1000) == 1000 && off == 6000);
+    assert(mysocket_recv(sv[1], in, sizeof(in), 0) == 1000 && memcmp(in, content + 5000, 1000) == 0);
+
+    assert(mysocket_socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == 0);
+    assert(mysocket_sendfile(sv[0], fd, &off, 1000) < 0 && socket_get_error() == MYSOCKET_EINVAL);
+
+    close(fd);
+    unlink(SENDFILE_TEST_PATH);
+    g_tcp_checksum_verify = 0;
+    mysocket_cleanup();
+
+    printf("✓ 从文件直接发送测试通过\n\n");
+}
+
+/**
+ * 原始套接字：旁听发出的包（共享缓冲区的克隆），读到线格式的帧，注入帧
+ */
+void test_raw_socket() {
+    printf("测试原始套接字...\n");
+
+    assert(mysocket_init() == 0);
+    g_tcp_checksum_verify = 1;
+
+    int cfd, sfd;
+    make_connection(9620, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+
+    int raw_tcp = mysocket_socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+    int raw_udp = mysocket_socket(AF_INET, SOCK_RAW, IPPROTO_UDP);
+    int raw_all = mysocket_socket(AF_INET, SOCK_RAW, 0);
+    assert(raw_tcp >= 0 && raw_udp >= 0 && raw_all >= 0 && g_raw_sock_count == 3);
+    assert(mysocket_socket(AF_UNIX, SOCK_RAW, 0) < 0);
+    assert(mysocket_socket(AF_INET, SOCK_RAW, 256) < 0);
+    struct raw_sock *all_sk = socket_find_by_fd(raw_all)->raw_sk;
+
+    /* 链路丢掉数据段，原始套接字在packet_send中已经拿到了它 */
+    drop_mask = 1;
+    data_seg_index = 0;
+    packet_set_output_hook(link_hook);
+    assert(mysocket_send(cfd, "hello", 5, 0) == 5);
+    packet_set_output_hook(NULL);
+    drop_mask = 0;
+
+    char buf[256];
+    assert(mysocket_recv(sfd, buf, sizeof(buf), 0) < 0);
+
+    /* 直接取包：与重传队列中的段共享缓冲区，没有复制 */
+    struct packet *seg = raw_dequeue(socket_find_by_fd(raw_all));
+    struct packet *queued = client->conn->retrans_queue;
+    assert(seg && queued && seg->owner == queued && seg->data == queued->data && seg->data_len == 5);
+    packet_destroy(seg);
+    assert(raw_dequeue(socket_find_by_fd(raw_all)) == NULL && all_sk->queued == 0);
+
+    /* 读到线格式的帧 */
+    uint8_t frame[256];
+    struct mysocket_addr_in from;
+    socklen_t from_len = sizeof(from);
+    ssize_t n = mysocket_recvfrom(raw_tcp, frame, sizeof(frame), 0, (struct mysocket_addr*)&from, &from_len);
+    struct packet_wire_info info;
+    assert(n > 0 && packet_parse(frame, (size_t)n, &info) == 0);
+    assert(info.protocol == IPPROTO_TCP && info.payload_len == 5 && memcmp(info.payload, "hello", 5) == 0);
+    assert(from_len == sizeof(from) && from.sin_addr == client->local_addr.sin_addr && from.sin_port == 0);
+    assert(mysocket_recv(raw_udp, buf, sizeof(buf), 0) < 0 && socket_get_error() == MYSOCKET_EAGAIN);
+
+    /* 注入抓到的帧：服务端收到被链路丢掉的数据 */
+    assert(mysocket_send(raw_tcp, frame, (size_t)n, 0) == n);
+    assert(mysocket_recv(sfd, buf, sizeof(buf), 0) == 5 && memcmp(buf, "hello", 5) == 0);
+
+    /* 注入的帧本身也经过packet_send；缓冲区不够时截断 */
+    assert(mysocket_recv(raw_tcp, buf, 10, 0) == 10 && memcmp(buf, frame, 10) == 0);
+    printf("  旁听%llu个包，注入的帧被服务端接收\n", (unsigned long long)all_sk->packets);
+
+    /* 格式不合法或协议不匹配的帧 */
+    assert(mysocket_send(raw_tcp, "garbage", 7, 0) < 0 && socket_get_error() == MYSOCKET_EINVAL);
+    assert(mysocket_send(raw_udp, frame, (size_t)n, 0) < 0 && socket_get_error() == MYSOCKET_EINVAL);
+
+    /* 队列满时丢弃并计数，不影响连接 */
+    while ((seg = raw_dequeue(socket_find_by_fd(raw_all))) != NULL) {
+        packet_destroy(seg);
+    }
+    all_sk->rcvbuf = 0;
+    uint64_t drops = all_sk->drops;
+    assert(mysocket_send(cfd, "world", 5, 0) == 5);
+    assert(mysocket_recv(sfd, buf, sizeof(buf), 0) == 5 && memcmp(buf, "world", 5) == 0);
+    assert(all_sk->drops > drops && all_sk->queued == 0);
+
+    /* 关闭时释放队列中的包，之后packet_send不再旁听 */
+    assert(mysocket_close(raw_tcp) == 0);
+    assert(mysocket_close(raw_udp) == 0);
+    assert(mysocket_close(raw_all) == 0);
+    assert(g_raw_sock_count == 0);
+    assert(mysocket_send(cfd, "again", 5, 0) == 5);
+    assert(mysocket_recv(sfd, buf, sizeof(buf), 0) == 5);
+
+    g_tcp_checksum_verify = 0;
+    mysocket_cleanup();
+
+    printf("✓ 原始套接字测试通过\n\n");
+}
+
+/**
+ * BPF套接字过滤器：校验、解释执行，UDP与Unix域数据报在复制前被丢弃或截断
+ */
+void test_socket_filter() {
+    printf("测试BPF套接字过滤器...\n");
+
+    assert(mysocket_init() == 0);
+
+    /* 只接收目标端口为9631、负载首字节不是'x'的UDP数据报，负载最多保留4字节 */
+    struct mysocket_sock_filter port_prog[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),                      /* IP协议号 */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 7),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),                     /* X = IP头长度 */
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),                      /* UDP目标端口 */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 9631, 0, 4),
+        BPF_STMT(BPF_LD | BPF_B | BPF_IND, 8),                      /* 负载首字节 */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 'x', 2, 0),
+        BPF_STMT(BPF_LD | BPF_IMM, 28 + 4),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct mysocket_sock_fprog port_fprog = { sizeof(port_prog) / sizeof(port_prog[0]), port_prog };
+
+    /* 解释器：直接在构造的数据上运行 */
+    struct sk_filter *f = sk_filter_create(port_prog, port_fprog.len);
+    assert(f != NULL);
+    struct mysocket_addr_in src = mysocket_make_addr("127.0.0.1", 5000);
+    struct mysocket_addr_in dst = mysocket_make_addr("127.0.0.1", 9631);
+    uint8_t hdr[IP_WIRE_HDR_LEN + UDP_WIRE_HDR_LEN];
+    packet_udp_wire_headers(hdr, &src, &dst, 6);
+    assert(sk_filter_run(f, hdr, sizeof(hdr), "hello!", 6) == 32);
+    assert(sk_filter_run(f, hdr, sizeof(hdr), "xhello", 6) == 0);
+    /* 读取跨越头部和负载、越界读取按丢弃处理 */
+    struct mysocket_sock_filter span_prog[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 26),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sk_filter *span = sk_filter_create(span_prog, 2);
+    assert(span && sk_filter_run(span, hdr, sizeof(hdr), "ab", 2) == (uint32_t)(('a' << 8) | 'b'));
+    assert(sk_filter_run(span, hdr, sizeof(hdr), "a", 1) == 0 && span->drops == 1);
+    sk_filter_destroy(span);
+    sk_filter_destroy(f);
+
+    /* 校验：非法操作码、越界跳转、除以0、暂存下标越界、不以RET结束 */
+    struct mysocket_sock_filter bad_code[] = { { 0xFFFF, 0, 0, 0 }, BPF_STMT(BPF_RET | BPF_K, 0) };
+    struct mysocket_sock_filter bad_jump[] = { BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0), BPF_STMT(BPF_RET | BPF_K, 0) };
+    struct mysocket_sock_filter bad_ja[] = { BPF_STMT(BPF_JMP | BPF_JA, 1), BPF_STMT(BPF_RET | BPF_K, 0) };
+    struct mysocket_sock_filter bad_div[] = { BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, 0), BPF_STMT(BPF_RET | BPF_A, 0) };
+    struct mysocket_sock_filter bad_mem[] = { BPF_STMT(BPF_ST, BPF_MEMWORDS), BPF_STMT(BPF_RET | BPF_A, 0) };
+    struct mysocket_sock_filter no_ret[] = { BPF_STMT(BPF_LD | BPF_IMM, 1) };
+    assert(sk_filter_create(bad_code, 2) == NULL && socket_get_error() == MYSOCKET_EINVAL);
+    assert(sk_filter_create(bad_jump, 2) == NULL);
+    assert(sk_filter_create(bad_ja, 2) == NULL);
+    assert(sk_filter_create(bad_div, 2) == NULL);
+    assert(sk_filter_create(bad_mem, 2) == NULL);
+    assert(sk_filter_create(no_ret, 1) == NULL);
+    assert(sk_filter_create(port_prog, 0) == NULL);
+
+    /* UDP：被丢弃的数据报不进入接收缓冲区，保留的被截断 */
+    int rx = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    assert(mysocket_bind(rx, (struct mysocket_addr*)&dst, sizeof(dst)) == 0);
+    assert(mysocket_attach_filter(rx, &port_fprog) == 0);
+    struct mysocket *rx_sock = socket_find_by_fd(rx);
+
+    assert(mysocket_sendto(tx, "xdrop", 5, 0, (struct mysocket_addr*)&dst, sizeof(dst)) == 5);
+    assert(rx_sock->recv_buf_used == 0 && rx_sock->filter->drops == 1);
+    assert(mysocket_sendto(tx, "keep-me", 7, 0, (struct mysocket_addr*)&dst, sizeof(dst)) == 7);
+    char buf[64];
+    assert(mysocket_recvfrom(rx, buf, sizeof(buf), 0, NULL, NULL) == 4 && memcmp(buf, "keep", 4) == 0);
+
+    /* 卸载后照常接收；没有过滤器时卸载失败 */
+    assert(mysocket_detach_filter(rx) == 0);
+    assert(mysocket_detach_filter(rx) < 0 && socket_get_error() == MYSOCKET_EINVAL);
+    assert(mysocket_sendto(tx, "xdrop", 5, 0, (struct mysocket_addr*)&dst, sizeof(dst)) == 5);
+    assert(mysocket_recvfrom(rx, buf, sizeof(buf), 0, NULL, NULL) == 5);
+    assert(mysocket_attach_filter(rx, &(struct mysocket_sock_fprog){ 2, bad_div }) < 0);
+
+    /* Unix域数据报：过滤器只看到负载，按长度丢弃超过8字节的数据报 */
+    struct mysocket_sock_filter len_prog[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+        BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 8, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct mysocket_sock_fprog len_fprog = { 4, len_prog };
+    int sv[2];
+    assert(mysocket_socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == 0);
+    assert(mysocket_attach_filter(sv[1], &len_fprog) == 0);
+    assert(mysocket_send(sv[0], "too long message", 16, 0) == 16);
+    assert(mysocket_send(sv[0], "short", 5, 0) == 5);
+    assert(mysocket_recv(sv[1], buf, sizeof(buf), 0) == 5 && memcmp(buf, "short", 5) == 0);
+    assert(mysocket_recv(sv[1], buf, sizeof(buf), 0) < 0 && socket_get_error() == MYSOCKET_EAGAIN);
+
+    /* 内核直通的套接字：程序交给内核 */
+    g_socket_backend = SOCKET_BACKEND_KERNEL;
+    assert(mysocket_socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == 0);
+    g_socket_backend = SOCKET_BACKEND_USER;
+    assert(mysocket_attach_filter(sv[1], &len_fprog) == 0);
+    assert(mysocket_send(sv[0], "too long message", 16, 0) == 16);
+    assert(mysocket_send(sv[0], "short", 5, 0) == 5);
+    assert(mysocket_recv(sv[1], buf, sizeof(buf), 0) == 5 && memcmp(buf, "short", 5) == 0);
+    assert(mysocket_detach_filter(sv[1]) == 0);
+
+    mysocket_cleanup();
+
+    printf("✓ BPF套接字过滤器测试通过\n\n");
+}
+
+/**
+ * 从指定源地址连接，返回客户端fd（连接失败时关闭并返回-1）
+ */
+static int acl_connect_from(const char *src, const struct mysocket_addr_in *dst) {
+    static uint16_t port = 9640;   /* 端口为0时自动绑定会把地址换成通配地址 */
+    int fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in local = mysocket_make_addr(src, port++);
+    assert(fd >= 0 && mysocket_bind(fd, (struct mysocket_addr*)&local, sizeof(local)) == 0);
+    if (mysocket_connect(fd, (const struct mysocket_addr*)dst, sizeof(*dst)) < 0) {
+        mysocket_close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * 监听Socket的访问控制：最长前缀匹配、每源连接数上限，被拒绝的SYN不创建子Socket
+ */
+void test_listen_acl() {
+    printf("测试监听Socket的访问控制...\n");
+
+    /* 前缀树本身 */
+    struct lpm_trie t;
+    assert(lpm_trie_init(&t) == 0);
+    assert(lpm_trie_lookup(&t, 0x0A000001) == LPM_NONE);
+    assert(lpm_trie_insert(&t, 0x0A000000, 8, 1) == 0);
+    assert(lpm_trie_insert(&t, 0x0A010000, 16, 2) == 0);
+    assert(lpm_trie_insert(&t, 0x0A010203, 32, 3) == 0);
+    assert(lpm_trie_insert(&t, 0x0A0100FF, 16, 4) == 0);   /* 同一前缀，替换 */
+    assert(lpm_trie_insert(&t, 0, 33, 1) < 0);
+    assert(t.prefixes == 3);
+    assert(lpm_trie_lookup(&t, 0x0A090909) == 1);
+    assert(lpm_trie_lookup(&t, 0x0A010909) == 4);
+    assert(lpm_trie_lookup(&t, 0x0A010203) == 3);
+    assert(lpm_trie_lookup(&t, 0x0B000000) == LPM_NONE);
+    assert(lpm_trie_insert(&t, 0, 0, 5) == 0);
+    assert(lpm_trie_lookup(&t, 0x0B000000) == 5);
+    lpm_trie_free(&t);
+
+    assert(mysocket_init() == 0);
+
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", 9630);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 16) == 0);
+
+    /* 参数检查 */
+    int udp_fd = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    assert(mysocket_acl_add(udp_fd, "10.0.0.0/8", MYSOCKET_ACL_DENY) < 0);
+    assert(mysocket_acl_add(listen_fd, "10.0.0.0/33", MYSOCKET_ACL_DENY) < 0);
+    assert(mysocket_acl_add(listen_fd, "10.0.0/8", MYSOCKET_ACL_DENY) < 0);
+    assert(mysocket_acl_add(listen_fd, "10.0.0.0/8", 2) < 0);
+    mysocket_close(udp_fd);
+
+    /* 拒绝10.0.0.0/8，但允许其中的10.1.0.0/16 */
+    assert(mysocket_acl_add(listen_fd, "10.0.0.0/8", MYSOCKET_ACL_DENY) == 0);
+    assert(mysocket_acl_add(listen_fd, "10.1.0.0/16", MYSOCKET_ACL_ALLOW) == 0);
+    struct listen_acl *acl = socket_find_by_fd(listen_fd)->acl;
+    int sockets = g_socket_manager.total_sockets;
+
+    assert(acl_connect_from("10.2.3.4", &addr) < 0 && socket_get_error() == MYSOCKET_ECONNREFUSED);
+    assert(acl->denied == 1);
+    assert(g_socket_manager.total_sockets == sockets);   /* 没有创建子Socket */
+
+    int allowed = acl_connect_from("10.1.2.3", &addr);
+    assert(allowed >= 0);
+    int server = mysocket_accept(listen_fd, NULL, NULL);
+    assert(server >= 0 && mysocket_send(allowed, "ok", 2, 0) == 2);
+    char buf[16];
+    assert(mysocket_recv(server, buf, sizeof(buf), 0) == 2);
+
+    /* 子Socket引用监听Socket的访问控制，通过它修改规则被拒绝，监听Socket的规则不变 */
+    assert(socket_find_by_fd(server)->acl == acl);
+    assert(mysocket_acl_add(server, "10.2.0.0/16", MYSOCKET_ACL_ALLOW) < 0);
+    assert(socket_get_error() == MYSOCKET_EINVAL);
+    assert(mysocket_acl_default(server, MYSOCKET_ACL_DENY) < 0);
+    assert(mysocket_acl_limit(server, 1) < 0);
+    assert(mysocket_acl_clear(server) < 0);
+    assert(mysocket_acl_add(allowed, "10.2.0.0/16", MYSOCKET_ACL_ALLOW) < 0);
+    assert(socket_find_by_fd(allowed)->acl == NULL);
+    assert(acl->rules.prefixes == 2 && acl->default_action == MYSOCKET_ACL_ALLOW);
+    assert(acl->max_per_source == 0);
+    assert(lpm_trie_lookup(&acl->rules, 0x0A020304) == MYSOCKET_ACL_DENY);
+
+    assert(acl_connect_from("192.168.0.1", &addr) >= 0);    /* 默认允许 */
+
+    /* 白名单：默认拒绝 */
+    assert(mysocket_acl_default(listen_fd, MYSOCKET_ACL_DENY) == 0);
+    assert(acl_connect_from("192.168.0.2", &addr) < 0 && acl->denied == 2);
+    assert(mysocket_acl_clear(listen_fd) == 0);
+    assert(acl_connect_from("10.2.3.4", &addr) >= 0);
+
+    /* 每个源地址最多2个连接：半连接和等待accept的连接也计数，关闭后释放名额 */
+    assert(mysocket_acl_limit(listen_fd, 2) == 0);
+    int first = acl_connect_from("172.16.0.9", &addr);
+    int second = acl_connect_from("172.16.0.9", &addr);
+    assert(first >= 0 && second >= 0);
+    sockets = g_socket_manager.total_sockets;
+    assert(acl_connect_from("172.16.0.9", &addr) < 0 && acl->limited == 1);
+    assert(g_socket_manager.total_sockets == sockets);
+    assert(acl_connect_from("172.16.0.10", &addr) >= 0);
+
+    /* 接受第二个连接并在服务端关闭后，同一来源可以再连 */
+    int accepted[8];
+    int n_accepted = socket_find_by_fd(listen_fd)->listen_count;
+    assert(n_accepted == 5);
+    for (int i = 0; i < n_accepted; i++) {
+        accepted[i] = mysocket_accept(listen_fd, NULL, NULL);
+    }
+    for (int i = 0; i < n_accepted; i++) {
+        struct mysocket *child = socket_find_by_fd(accepted[i]);
+        assert(child->acl == acl);
+        if (child->peer_addr.sin_addr == mysocket_inet_addr("172.16.0.9")) {
+            mysocket_close(accepted[i]);
+            break;
+        }
+    }
+    int third = acl_connect_from("172.16.0.9", &addr);
+    assert(third >= 0 && acl->limited == 1);
+
+    /* 监听Socket先关闭，剩下的子Socket仍持有访问控制，mysocket_cleanup释放它们 */
+    assert(acl->source_used == 5);
+    mysocket_close(listen_fd);
+    assert(acl->listener == NULL && acl->refcnt > 0);
+
+    mysocket_cleanup();
+
+    printf("✓ 监听Socket访问控制测试通过\n\n");
+}
+
+/**
+ * 按源地址的令牌桶：UDP数据报和SYN被限速，表的大小固定
+ */
+void test_rate_limit() {
+    printf("测试按源地址限速...\n");
+
+    assert(mysocket_init() == 0);
+    tcp_set_clock(fake_clock);
+    fake_now = 1000;
+
+    /* UDP：每秒10个，突发5个 */
+    int rx = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    int tx_a = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    int tx_b = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    struct mysocket_addr_in rx_addr = mysocket_make_addr("127.0.0.1", 9650);
+    struct mysocket_addr_in a_addr = mysocket_make_addr("10.0.0.1", 9651);
+    struct mysocket_addr_in b_addr = mysocket_make_addr("10.0.0.2", 9652);
+    assert(mysocket_bind(rx, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr)) == 0);
+    assert(mysocket_bind(tx_a, (struct mysocket_addr*)&a_addr, sizeof(a_addr)) == 0);
+    assert(mysocket_bind(tx_b, (struct mysocket_addr*)&b_addr, sizeof(b_addr)) == 0);
+    assert(mysocket_rate_limit(rx, 10, 5) == 0);
+    struct mysocket *rx_sock = socket_find_by_fd(rx);
+    struct rate_limit *rl = rx_sock->rate_limit;
+
+    for (int i = 0; i < 8; i++) {
+        assert(mysocket_sendto(tx_a, "abcd", 4, 0, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr)) == 4);
+    }
+    assert(rx_sock->recv_buf_used == 5 * 4 && rl->passed == 5 && rl->throttled == 3);
+
+    /* 另一个来源有自己的桶 */
+    assert(mysocket_sendto(tx_b, "abcd", 4, 0, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr)) == 4);
+    assert(rx_sock->recv_buf_used == 6 * 4 && rl->throttled == 3);
+
+    /* 200ms补充2个令牌 */
+    fake_now += 200;
+    for (int i = 0; i < 3; i++) {
+        mysocket_sendto(tx_a, "abcd", 4, 0, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr));
+    }
+    assert(rx_sock->recv_buf_used == 8 * 4 && rl->throttled == 4);
+
+    /* 取消限速：表保留（收包路径可能正在用它），只是不再限速 */
+    assert(mysocket_rate_limit(rx, 0, 0) == 0 && rx_sock->rate_limit == rl && rl->rate == 0);
+    for (int i = 0; i < 3; i++) {
+        mysocket_sendto(tx_a, "abcd", 4, 0, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr));
+    }
+    assert(rx_sock->recv_buf_used == 11 * 4 && rl->throttled == 4);
+
+    /* 重新启用时复用同一张表，来源从满桶开始 */
+    assert(mysocket_rate_limit(rx, 10, 1) == 0 && rx_sock->rate_limit == rl);
+    for (int i = 0; i < 2; i++) {
+        mysocket_sendto(tx_a, "abcd", 4, 0, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr));
+    }
+    assert(rx_sock->recv_buf_used == 12 * 4 && rl->throttled == 5);
+
+    /* 未绑定的发送方源地址是127.0.0.1：换一个端口（自动分配或显式绑定）仍是同一个桶 */
+    assert(mysocket_rate_limit(rx, 10, 2) == 0);
+    int tx_c = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    int tx_d = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    int tx_e = mysocket_socket(AF_INET, SOCK_DGRAM, 0);
+    struct mysocket_addr_in e_addr = mysocket_make_addr("127.0.0.1", 9654);
+    assert(mysocket_bind(tx_e, (struct mysocket_addr*)&e_addr, sizeof(e_addr)) == 0);
+    for (int i = 0; i < 4; i++) {
+        mysocket_sendto(tx_c, "abcd", 4, 0, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr));
+    }
+    assert(rx_sock->recv_buf_used == 14 * 4 && rl->throttled == 7);
+    assert(mysocket_sendto(tx_d, "abcd", 4, 0, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr)) == 4);
+    assert(mysocket_sendto(tx_e, "abcd", 4, 0, (struct mysocket_addr*)&rx_addr, sizeof(rx_addr)) == 4);
+    assert(rx_sock->recv_buf_used == 14 * 4 && rl->throttled == 9);
+    assert(socket_find_by_fd(tx_c)->local_addr.sin_port != socket_find_by_fd(tx_d)->local_addr.sin_port);
+    assert(mysocket_rate_limit(rx, 0, 0) == 0);
+
+    /* 监听Socket：每秒1个，突发2个，被限速的SYN不创建子Socket */
+    int listen_fd = mysocket_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct mysocket_addr_in addr = mysocket_make_addr("127.0.0.1", 9653);
+    assert(mysocket_bind(listen_fd, (struct mysocket_addr*)&addr, sizeof(addr)) == 0);
+    assert(mysocket_listen(listen_fd, 16) == 0);
+    assert(mysocket_rate_limit(listen_fd, 1, 2) == 0);
+    rl = socket_find_by_fd(listen_fd)->rate_limit;
+
+    assert(acl_connect_from("10.0.0.7", &addr) >= 0);
+    assert(acl_connect_from("10.0.0.7", &addr) >= 0);
+    int sockets = g_socket_manager.total_sockets;
+    assert(acl_connect_from("10.0.0.7", &addr) < 0 && rl->throttled == 1);
+    assert(g_socket_manager.total_sockets == sockets);
+    assert(acl_connect_from("10.0.0.8", &addr) >= 0);
+    fake_now += 1000;
+    assert(acl_connect_from("10.0.0.7", &addr) >= 0);
+
+    /* 访问控制拒绝的SYN不消耗令牌 */
+    assert(mysocket_acl_add(listen_fd, "10.0.0.9/32", MYSOCKET_ACL_DENY) == 0);
+    uint64_t passed = rl->passed;
+    assert(acl_connect_from("10.0.0.9", &addr) < 0 && rl->passed == passed && rl->throttled == 1);
+
+    /* 参数检查 */
+    int unix_fd = mysocket_socket(AF_UNIX, SOCK_DGRAM, 0);
+    assert(mysocket_rate_limit(unix_fd, 10, 0) < 0 && socket_get_error() == MYSOCKET_EINVAL);
+    assert(mysocket_rate_limit(listen_fd, 2000000, 0) < 0);
+
+    /* 来源多于表的容量：内存不变，欠账的桶被淘汰并计数；正在被限速的来源留在表里 */
+    struct rate_limit *table = calloc(1, sizeof(struct rate_limit));
+    pthread_mutex_init(&table->lock, NULL);
+    table->rate = 1;
+    table->burst = 2;
+    uint32_t heavy = mysocket_inet_addr("192.168.0.1");
+    assert(socket_rate_limit_allow(table, heavy) == 1);
+    assert(socket_rate_limit_allow(table, heavy) == 1);
+    assert(socket_rate_limit_allow(table, heavy) == 0);
+    for (uint32_t i = 0; i < 4 * RATE_LIMIT_SETS * RATE_LIMIT_WAYS; i++) {
+        socket_rate_limit_allow(table, mysocket_htonl(0x0B000000 + i));
+    }
+    assert(table->evictions >= 3 * RATE_LIMIT_SETS * RATE_LIMIT_WAYS);
+    assert(socket_rate_limit_allow(table, heavy) == 0);
+    printf("  %d个来源经过%d个桶，淘汰%llu次\n", 4 * RATE_LIMIT_SETS * RATE_LIMIT_WAYS,
+           RATE_LIMIT_SETS * RATE_LIMIT_WAYS, (unsigned long long)table->evictions);
+    socket_rate_limit_destroy(table);
+
+    tcp_set_clock(NULL);
+    mysocket_cleanup();
+
+    printf("✓ 按源地址限速测试通过\n\n");
+}
+
+/**
+ * 路由表：最长前缀和metric选择出口设备，连接缓存路由，路由变化后重新查找
+ */
+void test_routing() {
+    printf("测试路由表...\n");
+
+    /* 前缀树的精确查找和删除 */
+    struct lpm_trie t;
+    assert(lpm_trie_init(&t) == 0);
+    assert(lpm_trie_insert(&t, 0x0A000000, 8, 1) == 0);
+    assert(lpm_trie_insert(&t, 0x0A010000, 16, 2) == 0);
+    assert(lpm_trie_get(&t, 0x0A000000, 8) == 1 && lpm_trie_get(&t, 0x0A000000, 9) == LPM_NONE);
+    assert(lpm_trie_remove(&t, 0x0A010000, 16) == 0 && lpm_trie_remove(&t, 0x0A010000, 16) < 0);
+    assert(lpm_trie_lookup(&t, 0x0A010203) == 1 && t.prefixes == 1);
+    lpm_trie_free(&t);
+
+    assert(mysocket_init() == 0);
+
+    struct netdev *dev_a = netdev_open("loopback", NULL);
+    struct netdev *dev_b = netdev_open("loopback", NULL);
+    assert(dev_a && dev_b);
+    assert(netdev_set_mtu(dev_a, 1000) == 0);
+
+    /* 参数检查 */
+    assert(route_add("127.0.0.0/8", NULL, NULL, 0) < 0);
+    assert(route_add("127.0.0.0/40", NULL, dev_a, 0) < 0);
+    assert(route_add("127.0.0.0/8", NULL, dev_a, -1) < 0);
+    assert(route_del("127.0.0.0/8", NULL) < 0 && socket_get_error() == MYSOCKET_EINVAL);
+
+    /* 最长前缀优先，同一前缀metric小的优先 */
+    assert(route_add("127.0.0.0/8", "127.0.0.254", dev_a, 10) == 0);
+    assert(route_add("127.0.0.1/32", NULL, dev_b, 5) == 0);
+    assert(route_add("127.0.0.1/32", NULL, dev_b, 5) < 0 && socket_get_error() == MYSOCKET_EADDRINUSE);
+    struct route_entry rt;
+    assert(route_lookup(mysocket_inet_addr("127.0.0.1"), &rt) == 0 && rt.dev == dev_b && rt.prefix_len == 32);
+    assert(route_lookup(mysocket_inet_addr("127.9.9.9"), &rt) == 0 && rt.dev == dev_a &&
+           rt.gateway == mysocket_inet_addr("127.0.0.254") && rt.prefix == 0x7F000000);
+    assert(route_lookup(mysocket_inet_addr("10.0.0.1"), &rt) < 0);
+    assert(route_output(mysocket_inet_addr("10.0.0.1")) == netdev_get_default());
+
+    assert(route_add("127.0.0.1/32", NULL, dev_a, 1) == 0);
+    assert(route_output(mysocket_inet_addr("127.0.0.1")) == dev_a);
+    assert(route_del("127.0.0.1/32", dev_a) == 0);
+    assert(route_output(mysocket_inet_addr("127.0.0.1")) == dev_b);
+
+    /* 连接缓存出口设备：握手时查找，之后发数据不再查表 */
+    int cfd, sfd;
+    make_connection(9660, &cfd, &sfd);
+    struct mysocket *client = socket_find_by_fd(cfd);
+    assert(client->conn->route_dev == dev_b && client->conn->route_gen == g_route_gen);
+
+    uint64_t lookups = g_route_lookups;
+    uint64_t tx_b = dev_b->stats.tx_packets;
+    static char data[4000], buf[4000];
+    for (int i = 0; i < 10; i++) {
+        assert(mysocket_send(cfd, data, sizeof(data), 0) == (ssize_t)sizeof(data));
+        assert(mysocket_recv(sfd, buf, sizeof(buf), 0) == (ssize_t)sizeof(buf));
+    }
+    assert(dev_b->stats.tx_packets > tx_b && dev_a->stats.tx_packets == 0);
+    uint64_t data_lookups = g_route_lookups - lookups;
+
+    /* 删除主机路由：连接改走dev_a，报文段按dev_a的MTU分段 */
+    assert(route_del("127.0.0.1/32", NULL) == 0);
+    assert(mysocket_send(cfd, data, sizeof(data), 0) == (ssize_t)sizeof(data));
+    assert(mysocket_recv(sfd, buf, sizeof(buf), 0) == (ssize_t)sizeof(buf));
+    assert(client->conn->route_dev == dev_a && tcp_current_mss(client) == 1000 - PACKET_WIRE_MAX_HDR);
+    assert(dev_a->stats.tx_packets >= sizeof(data) / tcp_current_mss(client));
+    printf("  10次收发查表%llu次，删除路由后改走dev_a发出%llu个包\n",
+           (unsigned long long)data_lookups, (unsigned long long)dev_a->stats.tx_packets);
+    assert(data_lookups == 0);      /* 双方都在握手时缓存了路由 */
+
+    /* 关闭设备时删除经过它的路由，连接回到当前设备 */
+    netdev_close(dev_a);
+    assert(route_lookup(mysocket_inet_addr("127.0.0.1"), &rt) < 0);
+    assert(mysocket_send(cfd, "x", 1, 0) == 1 && mysocket_recv(sfd, buf, sizeof(buf), 0) == 1);
+    assert(client->conn->route_dev == netdev_get_default());
+
+    netdev_close(dev_b);
+    mysocket_cleanup();
+
+    printf("✓ 路由表测试通过\n\n");
+}
+
+int main() {
+    printf("=== MySocket TCP协议测试 ===\n\n");
+
+    test_handshake_and_data();
+    test_scoreboard();
+    test_selective_retransmit();
+    test_fast_retransmit();
+    test_ooo_drain_full();
+    test_window_scaling();
+    test_buffer_autotune();
+    test_memory_pressure();
+    test_packet_pool();
+    test_header_template();
+    test_checksum_impls();
+    test_checksum_offload();
+    test_packet_wire();
+    test_rx_queue();
+    test_tx_batch();
+    test_netdev();
+    test_netdev_udp();
+    test_netdev_shm();
+    test_kernel_backend();
+    test_unix_sockets();
+    test_socketpair();
+    test_splice();
+    test_sendfile();
+    test_raw_socket();
+    test_socket_filter();
+    test_listen_acl();
+    test_rate_limit();
+    test_routing();
+
+    printf("=== 所有测试完成 ===\n");
+
+    return 0;
+}